@@ -0,0 +1,1525 @@
+// src/bench/bench_main.cpp
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unordered_map>
+#include <unistd.h>
+#include <vector>
+
+#include "clanker/builtins.h"
+#include "clanker/expand.h"
+#include "clanker/expr.h"
+#include "clanker/glob.h"
+#include "clanker/lexer.h"
+#include "clanker/parse_cache.h"
+#include "clanker/parser.h"
+#include "clanker/scan.h"
+#include "clanker/script_check.h"
+#include "clanker/vars.h"
+
+// Count heap allocations made by the code under measurement. Every form of
+// new is replaced, so that every form of delete frees what malloc or
+// aligned_alloc returned; none may be inlined, or GCC pairs an inlined
+// malloc with the library's delete and warns.
+static std::atomic<std::size_t> g_allocs{0};
+
+static void* counted_alloc(std::size_t n) noexcept {
+   g_allocs.fetch_add(1, std::memory_order_relaxed);
+   return std::malloc(n ? n : 1);
+}
+
+// std::pmr::new_delete_resource goes through the aligned forms.
+static void* counted_alloc(std::size_t n, std::align_val_t al) noexcept {
+   g_allocs.fetch_add(1, std::memory_order_relaxed);
+   const auto a = static_cast<std::size_t>(al);
+   return std::aligned_alloc(a, n ? (n + a - 1) / a * a : a);
+}
+
+[[gnu::noinline]] void* operator new(std::size_t n) {
+   if (void* p = counted_alloc(n)) return p;
+   throw std::bad_alloc{};
+}
+[[gnu::noinline]] void* operator new[](std::size_t n) {
+   if (void* p = counted_alloc(n)) return p;
+   throw std::bad_alloc{};
+}
+[[gnu::noinline]] void* operator new(std::size_t n,
+                                     const std::nothrow_t&) noexcept {
+   return counted_alloc(n);
+}
+[[gnu::noinline]] void* operator new[](std::size_t n,
+                                       const std::nothrow_t&) noexcept {
+   return counted_alloc(n);
+}
+[[gnu::noinline]] void* operator new(std::size_t n, std::align_val_t al) {
+   if (void* p = counted_alloc(n, al)) return p;
+   throw std::bad_alloc{};
+}
+[[gnu::noinline]] void* operator new[](std::size_t n, std::align_val_t al) {
+   if (void* p = counted_alloc(n, al)) return p;
+   throw std::bad_alloc{};
+}
+[[gnu::noinline]] void* operator new(std::size_t n, std::align_val_t al,
+                                     const std::nothrow_t&) noexcept {
+   return counted_alloc(n, al);
+}
+[[gnu::noinline]] void* operator new[](std::size_t n, std::align_val_t al,
+                                       const std::nothrow_t&) noexcept {
+   return counted_alloc(n, al);
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete[](void* p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void* p, std::size_t) noexcept {
+   std::free(p);
+}
+[[gnu::noinline]] void operator delete[](void* p, std::size_t) noexcept {
+   std::free(p);
+}
+[[gnu::noinline]] void operator delete(void* p,
+                                       const std::nothrow_t&) noexcept {
+   std::free(p);
+}
+[[gnu::noinline]] void operator delete[](void* p,
+                                         const std::nothrow_t&) noexcept {
+   std::free(p);
+}
+[[gnu::noinline]] void operator delete(void* p, std::align_val_t) noexcept {
+   std::free(p);
+}
+[[gnu::noinline]] void operator delete[](void* p, std::align_val_t) noexcept {
+   std::free(p);
+}
+[[gnu::noinline]] void operator delete(void* p, std::size_t,
+                                       std::align_val_t) noexcept {
+   std::free(p);
+}
+[[gnu::noinline]] void operator delete[](void* p, std::size_t,
+                                         std::align_val_t) noexcept {
+   std::free(p);
+}
+[[gnu::noinline]] void operator delete(void* p, std::align_val_t,
+                                       const std::nothrow_t&) noexcept {
+   std::free(p);
+}
+[[gnu::noinline]] void operator delete[](void* p, std::align_val_t,
+                                         const std::nothrow_t&) noexcept {
+   std::free(p);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+using clanker::LexState;
+using clanker::ParseState;
+using clanker::Parser;
+
+// prefix, n, suffix. Appended rather than `"x" + std::to_string(n)`, on
+// which GCC 12 gives a false -Wrestrict warning.
+std::string numbered(std::string_view prefix, int n,
+                     std::string_view suffix = {}) {
+   std::string s(prefix);
+   s += std::to_string(n);
+   s += suffix;
+   return s;
+}
+
+[[noreturn]] void usage() {
+   std::cerr << "usage: clanker_bench /path/to/clanker [--case NAME]\n"
+             << "cases:\n"
+             << "  continuation\n"
+             << "  compound_continuation\n"
+             << "  lexer_allocs\n"
+             << "  statement_allocs\n"
+             << "  lexer_throughput\n"
+             << "  token_stream\n"
+             << "  brace_expansion\n"
+             << "  glob\n"
+             << "  substitution\n"
+             << "  expr\n"
+             << "  vars\n"
+             << "  control_flow\n"
+             << "  function_call\n"
+             << "  arith\n"
+             << "  case\n"
+             << "  read\n"
+             << "  pipeline_builtins\n"
+             << "  builtin_call\n"
+             << "  builtin_output\n"
+             << "  builtin_lookup\n"
+             << "  coreutils_builtins\n"
+             << "  parse_cache\n"
+             << "  script_startup\n"
+             << "  script_memory\n"
+             << "  check_throughput\n";
+
+   std::exit(2);
+}
+
+std::string_view get_case(int argc, char** argv) {
+   // Default: run everything.
+   for (int i = 2; i < argc; ++i) {
+      const std::string_view a = argv[i];
+      if (a == "--case") {
+         if (i + 1 >= argc) usage();
+         return std::string_view(argv[i + 1]);
+      }
+   }
+   return "all";
+}
+
+double ns_since(Clock::time_point t0) {
+   return std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+}
+
+// Keep the optimizer from discarding results.
+volatile int g_sink = 0;
+
+// ---- Benchmarks ----
+
+// Paste an N-line triple-quoted prompt into the REPL one line at a time and
+// measure the cost of the continuation lines near the end of the paste.
+// Full re-parse grows linearly with the buffer (quadratic total); the
+// incremental parser should stay flat.
+void bench_continuation() {
+   const std::string body_line =
+      "   the quick brown fox jumps over the lazy dog 0123456789";
+   constexpr int kTail = 100; // lines measured at the end of each paste
+
+   std::printf("%-8s %18s %18s\n", "lines", "full ns/line",
+               "incremental ns/line");
+
+   for (const int n : {250, 500, 1000, 2000, 4000}) {
+      const Parser parser;
+
+      auto paste = [&](bool incremental) {
+         std::string buffer = "prompt \"\"\"";
+         ParseState cont;
+         double tail_ns = 0;
+         for (int i = 0; i < n; ++i) {
+            buffer.push_back('\n');
+            buffer += (i + 1 == n) ? std::string("\"\"\"") : body_line;
+
+            const auto t0 = Clock::now();
+            const auto pr = incremental ? parser.parse(buffer, cont)
+                                        : parser.parse(buffer);
+            const double dt = ns_since(t0);
+            g_sink = g_sink + static_cast<int>(pr.kind);
+            if (i >= n - kTail) tail_ns += dt;
+         }
+         return tail_ns / kTail;
+      };
+
+      const double full = paste(false);
+      const double incr = paste(true);
+      std::printf("%-8d %18.0f %18.0f\n", n, full, incr);
+   }
+}
+
+// A generated batch script: mostly plain words, some quoting and escapes.
+std::string make_batch_script(int lines) {
+   std::string s;
+   for (int i = 0; i < lines; ++i) {
+      const std::string n = std::to_string(i);
+      s += "tool --input=data/part_" + n + ".json --mode fast out_" + n;
+      s += (i % 4 == 0) ? " 'quoted arg' a\\ b\n" : " > log_" + n + ".txt\n";
+   }
+   return s;
+}
+
+// Heap allocations and time per WORD token when lexing a batch script.
+void bench_lexer_allocs() {
+   const std::string script = make_batch_script(20000);
+   const clanker::Lexer lx;
+
+   const std::size_t a0 = g_allocs.load();
+   const auto t0 = Clock::now();
+   const auto lr = lx.lex(script);
+   const double dt = ns_since(t0);
+   const std::size_t allocs = g_allocs.load() - a0;
+
+   std::size_t words = 0;
+   for (const auto& t : lr.tokens)
+      if (t.kind == clanker::TokenKind::Word) ++words;
+
+   std::printf("bytes=%zu tokens=%zu words=%zu sizeof(Token)=%zu\n",
+               script.size(), lr.tokens.size(), words, sizeof(clanker::Token));
+   std::printf("allocs=%zu allocs/word=%.3f ns/word=%.1f\n", allocs,
+               static_cast<double>(allocs) / static_cast<double>(words),
+               dt / static_cast<double>(words));
+}
+
+// Heap allocations per statement for lex + parse + AST, with the default
+// heap versus a per-unit arena that is released after each statement (the
+// way Shell::run_string drives it).
+void bench_statement_allocs() {
+   const std::vector<std::string> stmts = {
+      "echo hello world",
+      "tool --input=data/part_1.json --mode fast out_1 > log_1.txt",
+      "grep -n 'some pattern' src/file.cpp | sort | uniq -c && echo done",
+      "a; b; c 2> err.txt; d >> out.txt",
+   };
+   constexpr int kRounds = 20000;
+   const Parser parser;
+
+   auto run = [&](std::pmr::memory_resource* mr, auto&& after_unit) {
+      const std::size_t a0 = g_allocs.load();
+      const auto t0 = Clock::now();
+      for (int r = 0; r < kRounds; ++r) {
+         for (const auto& s : stmts) {
+            {
+               ParseState cont{mr};
+               const auto pr = parser.parse(s, cont);
+               g_sink = g_sink + static_cast<int>(pr.kind);
+            }
+            after_unit();
+         }
+      }
+      const double n = static_cast<double>(kRounds * stmts.size());
+      std::printf("  allocs/stmt=%6.2f ns/stmt=%8.1f\n",
+                  static_cast<double>(g_allocs.load() - a0) / n,
+                  ns_since(t0) / n);
+   };
+
+   std::printf("heap:\n");
+   run(std::pmr::get_default_resource(), [] {});
+
+   std::array<std::byte, 16 * 1024> buf;
+   std::pmr::monotonic_buffer_resource arena{buf.data(), buf.size()};
+   std::printf("arena:\n");
+   run(&arena, [&] { arena.release(); });
+}
+
+// Upstream resource that counts the bytes it hands out and the peak held.
+class CountingResource final : public std::pmr::memory_resource {
+ public:
+   [[nodiscard]] std::size_t peak() const noexcept { return peak_; }
+
+ private:
+   void* do_allocate(std::size_t bytes, std::size_t align) override {
+      live_ += bytes;
+      peak_ = std::max(peak_, live_);
+      return std::pmr::new_delete_resource()->allocate(bytes, align);
+   }
+   void do_deallocate(void* p, std::size_t bytes,
+                      std::size_t align) override {
+      live_ -= bytes;
+      std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+   }
+   bool do_is_equal(
+      const std::pmr::memory_resource& o) const noexcept override {
+      return this == &o;
+   }
+
+   std::size_t live_{0};
+   std::size_t peak_{0};
+};
+
+// Feed an N-line function body to the parser one line at a time, the way
+// batch mode and the REPL accumulate a unit, and measure the lines near the
+// end. Re-parsing the buffer on every line costs time proportional to the
+// buffer (quadratic in total, and each attempt builds its own AST); resuming
+// from the ParseState stays flat. Also reports the arena bytes the resumed
+// unit ends up holding.
+void bench_compound_continuation() {
+   const std::string body_line = "   echo line $i | tr a-z A-Z >> out.txt";
+   constexpr int kTail = 100; // lines measured at the end of each body
+
+   std::printf("%-8s %18s %18s %16s\n", "lines", "reparse ns/line",
+               "resumed ns/line", "resumed bytes");
+
+   for (const int n : {500, 1000, 2000, 4000, 8000}) {
+      const Parser parser;
+      std::string buffer = "f() {";
+      for (int i = 0; i < n - kTail; ++i) buffer += "\n" + body_line;
+
+      // Only the tail is parsed: each attempt starts from scratch anyway.
+      double reparse = 0;
+      {
+         std::string tail = buffer;
+         std::array<std::byte, 16 * 1024> buf;
+         std::pmr::monotonic_buffer_resource arena{buf.data(), buf.size()};
+         for (int i = n - kTail; i <= n; ++i) {
+            tail += (i == n) ? std::string("\n}") : "\n" + body_line;
+            const auto t0 = Clock::now();
+            {
+               ParseState cont{&arena};
+               const auto pr = parser.parse(tail, cont);
+               g_sink = g_sink + static_cast<int>(pr.kind);
+            }
+            reparse += ns_since(t0);
+            arena.release();
+         }
+         reparse /= kTail + 1;
+      }
+
+      double resumed = 0;
+      CountingResource counted;
+      {
+         std::pmr::monotonic_buffer_resource arena{&counted};
+         ParseState cont{&arena};
+         std::string text = "f() {";
+         for (int i = 0; i <= n; ++i) {
+            text += (i == n) ? std::string("\n}") : "\n" + body_line;
+            const auto t0 = Clock::now();
+            const auto pr = parser.parse(text, cont);
+            if (i >= n - kTail) resumed += ns_since(t0);
+            g_sink = g_sink + static_cast<int>(pr.kind);
+         }
+         resumed /= kTail + 1;
+      }
+      std::printf("%-8d %18.0f %18.0f %16zu\n", n, reparse, resumed,
+                  counted.peak());
+   }
+}
+
+// Token memory and time-to-first-error: lexing a whole input into a token
+// vector (what the incremental parse does) versus pulling tokens through a
+// TokenStream (what the one-shot Parser::parse does).
+void bench_token_stream() {
+   std::string script;
+   while (script.size() < (16u << 20)) script += make_batch_script(1000);
+
+   {
+      CountingResource counted;
+      LexState st{&counted};
+      const auto t0 = Clock::now();
+      const auto lr = clanker::Lexer{}.lex(script, st);
+      const double ms = ns_since(t0) / 1e6;
+      g_sink = g_sink + static_cast<int>(lr.kind);
+      std::printf("token vector: peak %10zu bytes %8.1f ms\n", counted.peak(),
+                  ms);
+   }
+   {
+      CountingResource counted;
+      clanker::TokenStream ts{script, &counted};
+      const auto t0 = Clock::now();
+      while (ts.next().kind != clanker::TokenKind::End) {
+      }
+      const double ms = ns_since(t0) / 1e6;
+      std::printf("token stream: peak %10zu bytes %8.1f ms\n", counted.peak(),
+                  ms);
+   }
+
+   // A syntax error on the first line of a 16 MiB input; best of 3.
+   const std::string bad = "| oops\n" + script;
+   const Parser parser;
+   auto best_ms = [](auto&& fn) {
+      double best = 1e300;
+      for (int i = 0; i < 3; ++i) {
+         const auto t0 = Clock::now();
+         fn();
+         best = std::min(best, ns_since(t0) / 1e6);
+      }
+      return best;
+   };
+   std::printf("first error, lex all:  %10.3f ms\n", best_ms([&] {
+                  ParseState st;
+                  const auto pr = parser.parse(std::string_view(bad), st);
+                  g_sink = g_sink + static_cast<int>(pr.kind);
+               }));
+   std::printf("first error, streamed: %10.3f ms\n", best_ms([&] {
+                  const auto pr = parser.parse(bad);
+                  g_sink = g_sink + static_cast<int>(pr.kind);
+               }));
+}
+
+// Brace expansion of f{0..9}{0..9}... : materializing every combination
+// group by group (the textbook approach) versus the lazy odometer, which
+// holds one word at a time.
+void bench_brace_expansion() {
+   std::printf("%-7s %9s %12s %12s %12s %12s\n", "groups", "words",
+               "eager MiB", "eager ms", "lazy ms", "lazy allocs");
+   for (const int groups : {4, 5, 6}) {
+      std::string pattern = "f";
+      for (int g = 0; g < groups; ++g) pattern += "{0..9}";
+
+      // Eager: every intermediate product is a vector of strings.
+      double eager_ms = 0;
+      std::size_t eager_bytes = 0;
+      {
+         const auto t0 = Clock::now();
+         std::vector<std::string> words{"f"};
+         for (int g = 0; g < groups; ++g) {
+            std::vector<std::string> next;
+            next.reserve(words.size() * 10);
+            for (const auto& w : words)
+               for (char d = '0'; d <= '9'; ++d) next.push_back(w + d);
+            words = std::move(next);
+         }
+         eager_ms = ns_since(t0) / 1e6;
+         eager_bytes = words.capacity() * sizeof(std::string);
+         for (const auto& w : words)
+            if (w.capacity() > 15) eager_bytes += w.capacity() + 1;
+         g_sink = g_sink + static_cast<int>(words.size());
+      }
+
+      const std::size_t a0 = g_allocs.load();
+      const auto t0 = Clock::now();
+      clanker::BraceExpansion e{pattern};
+      std::size_t words = 0;
+      std::size_t bytes = 0;
+      while (const auto w = e.next()) {
+         ++words;
+         bytes += w->size();
+      }
+      const double lazy_ms = ns_since(t0) / 1e6;
+      const std::size_t allocs = g_allocs.load() - a0;
+      g_sink = g_sink + static_cast<int>(bytes);
+
+      std::printf("%-7d %9zu %12.1f %12.1f %12.1f %12zu\n", groups, words,
+                  static_cast<double>(eager_bytes) / (1 << 20), eager_ms,
+                  lazy_ms, allocs);
+   }
+}
+
+// Lexer throughput in MB/s on multi-megabyte inputs, per scan ISA.
+void bench_lexer_throughput() {
+   constexpr std::size_t kBytes = 8u << 20;
+
+   std::string words;
+   while (words.size() < kBytes)
+      words += "some/long/unquoted/path/segment_0123456789/file-name.ext ";
+
+   std::string triple = "prompt \"\"\"";
+   while (triple.size() < kBytes)
+      triple += "The quick brown fox jumps over the lazy dog, twice.\n";
+   triple += "\"\"\"";
+
+   std::string script;
+   while (script.size() < kBytes) script += make_batch_script(1000);
+
+   const struct {
+      const char* name;
+      const std::string* text;
+   } inputs[] = {
+      {"unquoted words", &words},
+      {"triple-quoted body", &triple},
+      {"batch script", &script},
+   };
+
+   const clanker::ScanIsa saved = clanker::scan_isa();
+   std::printf("%-20s %10s %10s %10s\n", "input", "scalar", "sse2", "avx2");
+   for (const auto& in : inputs) {
+      std::printf("%-20s", in.name);
+      for (const auto isa : {clanker::ScanIsa::Scalar, clanker::ScanIsa::Sse2,
+                             clanker::ScanIsa::Avx2}) {
+         clanker::set_scan_isa(isa);
+         if (clanker::scan_isa() != isa) {
+            std::printf(" %10s", "n/a");
+            continue;
+         }
+         const clanker::Lexer lx;
+         double best = 1e300;
+         for (int rep = 0; rep < 3; ++rep) {
+            const auto t0 = Clock::now();
+            const auto lr = lx.lex(*in.text);
+            best = std::min(best, ns_since(t0));
+            g_sink = g_sink + static_cast<int>(lr.tokens.size());
+         }
+         const double mb = static_cast<double>(in.text->size()) / 1e6;
+         std::printf(" %10.1f", mb / (best / 1e9));
+      }
+      std::printf("  MB/s\n");
+   }
+   clanker::set_scan_isa(saved);
+}
+
+// Re-running the same statements: lex + parse each time versus a
+// ParseCache lookup returning the shared unit.
+void bench_parse_cache() {
+   const std::vector<std::string> stmts = {
+      "echo hello world",
+      "tool --input=data/part_1.json --mode fast out_1 > log_1.txt",
+      "grep -n 'some pattern' src/file.cpp | sort | uniq -c && echo done",
+      "a; b; c 2> err.txt; d >> out.txt",
+   };
+   constexpr int kRounds = 50000;
+   const double n = static_cast<double>(kRounds * stmts.size());
+   const Parser parser;
+
+   std::array<std::byte, 16 * 1024> buf;
+   std::pmr::monotonic_buffer_resource arena{buf.data(), buf.size()};
+   auto t0 = Clock::now();
+   for (int r = 0; r < kRounds; ++r) {
+      for (const auto& s : stmts) {
+         {
+            ParseState cont{&arena};
+            const auto pr = parser.parse(s, cont);
+            g_sink = g_sink + static_cast<int>(pr.kind);
+         }
+         arena.release();
+      }
+   }
+   std::printf("parse:  ns/stmt=%8.1f\n", ns_since(t0) / n);
+
+   clanker::ParseCache cache;
+   for (const auto& s : stmts) cache.insert(s, parser.parse(s));
+   const std::size_t a0 = g_allocs.load();
+   t0 = Clock::now();
+   for (int r = 0; r < kRounds; ++r) {
+      for (const auto& s : stmts) {
+         const auto unit = cache.find(s);
+         g_sink = g_sink + static_cast<int>(unit->result().kind);
+      }
+   }
+   std::printf("cached: ns/stmt=%8.1f allocs/stmt=%.2f\n", ns_since(t0) / n,
+               static_cast<double>(g_allocs.load() - a0) / n);
+}
+
+// Run `clanker SCRIPT` with output discarded; returns the child's peak RSS
+// in KiB.
+long run_script(const char* clanker, const std::string& script) {
+   const pid_t pid = ::fork();
+   if (pid == 0) {
+      const int devnull = ::open("/dev/null", O_WRONLY);
+      ::dup2(devnull, STDOUT_FILENO);
+      ::dup2(devnull, STDERR_FILENO);
+      char* const argv[] = {const_cast<char*>(clanker),
+                            const_cast<char*>(script.c_str()), nullptr};
+      ::execv(clanker, argv);
+      _exit(127);
+   }
+   int status = 0;
+   struct rusage ru{};
+   ::wait4(pid, &status, 0, &ru);
+   return ru.ru_maxrss;
+}
+
+// Scratch directory with a script cache; removed on destruction.
+class ScriptBenchDir {
+ public:
+   ScriptBenchDir() {
+      std::string tmpl =
+         (std::filesystem::temp_directory_path() / "clanker-bench.XXXXXX")
+            .string();
+      if (::mkdtemp(tmpl.data()) == nullptr) {
+         std::perror("mkdtemp");
+         return;
+      }
+      path_ = tmpl;
+      ::setenv("CLANKER_CACHE_DIR", cache().c_str(), 1);
+   }
+   ~ScriptBenchDir() {
+      ::unsetenv("CLANKER_CACHE_DIR");
+      if (!path_.empty()) std::filesystem::remove_all(path_);
+   }
+
+   [[nodiscard]] bool ok() const noexcept { return !path_.empty(); }
+   [[nodiscard]] std::filesystem::path cache() const { return path_ / "cache"; }
+   [[nodiscard]] std::string script() const {
+      return (path_ / "script.clk").string();
+   }
+
+ private:
+   std::filesystem::path path_;
+};
+
+// Startup time of `clanker SCRIPT` for a 30k-line generated script whose
+// first line exits: a cold start (parse everything, write the image) versus
+// a start from the cached image.
+void bench_script_startup(const char* clanker) {
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const std::string script = dir.script();
+   std::ofstream(script) << "exit 0\n" << make_batch_script(30000);
+
+   constexpr int kRuns = 10;
+   double cold = 0;
+   for (int i = 0; i < kRuns; ++i) {
+      std::filesystem::remove_all(dir.cache());
+      const auto t0 = Clock::now();
+      run_script(clanker, script);
+      cold += ns_since(t0);
+   }
+   double cached = 0;
+   for (int i = 0; i < kRuns; ++i) {
+      const auto t0 = Clock::now();
+      run_script(clanker, script);
+      cached += ns_since(t0);
+   }
+
+   std::printf("script bytes=%zu\n",
+               static_cast<std::size_t>(std::filesystem::file_size(script)));
+   std::printf("cold:   %8.2f ms/start\n", cold / kRuns / 1e6);
+   std::printf("cached: %8.2f ms/start\n", cached / kRuns / 1e6);
+}
+
+// Peak RSS of `clanker SCRIPT` as the script grows. The script is read in
+// chunks and the image streamed to disk, so both the cold run and the
+// cached run should stay flat.
+void bench_script_memory(const char* clanker) {
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const std::string script = dir.script();
+
+   std::printf("%-12s %14s %14s\n", "script MiB", "cold KiB", "cached KiB");
+   for (const int lines : {10000, 80000, 320000}) {
+      {
+         std::ofstream out(script, std::ios::trunc);
+         out << "exit 0\n";
+         for (int i = 0; i < lines; i += 10000) out << make_batch_script(10000);
+      }
+      std::filesystem::remove_all(dir.cache());
+      const long cold = run_script(clanker, script);
+      const long cached = run_script(clanker, script);
+      const double mib =
+         static_cast<double>(std::filesystem::file_size(script)) / (1 << 20);
+      std::printf("%-12.1f %14ld %14ld\n", mib, cold, cached);
+   }
+}
+
+// `clanker --check` over many files: files/s by worker count. Parsing is
+// pure, so this should scale with cores until the disk or memory bandwidth
+// runs out.
+void bench_check_throughput() {
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const auto root = std::filesystem::path(dir.script()).parent_path();
+
+   constexpr int kFiles = 256;
+   const std::string body = make_batch_script(2000);
+   std::vector<std::string> paths;
+   for (int i = 0; i < kFiles; ++i) {
+      paths.push_back((root / numbered("s", i, ".clk")).string());
+      std::ofstream(paths.back()) << body;
+   }
+   const double mib =
+      static_cast<double>(body.size()) * kFiles / (1 << 20);
+
+   std::printf("%d files, %.1f MiB\n", kFiles, mib);
+   std::printf("%-8s %12s %12s %10s\n", "jobs", "ms", "MiB/s", "speedup");
+   double base = 0;
+   const unsigned hw = std::max(4u, std::thread::hardware_concurrency());
+   for (unsigned jobs = 1;; jobs = std::min(jobs * 2, hw)) {
+      const auto t0 = Clock::now();
+      const auto reports = clanker::check_scripts(paths, jobs);
+      const double ms = ns_since(t0) / 1e6;
+      for (const auto& r : reports) g_sink = g_sink + static_cast<int>(r.ok());
+      if (jobs == 1) base = ms;
+      std::printf("%-8u %12.1f %12.1f %9.2fx\n", jobs, ms, mib / (ms / 1e3),
+                  base / ms);
+      if (jobs == hw) break;
+   }
+}
+
+// Globbing a generated tree (256 directories of 64 files, all backdated so
+// their listings may be cached) with a fresh GlobCache per glob versus one
+// kept across globs, and "**" by walker thread count.
+void bench_glob() {
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const auto root = std::filesystem::path(dir.script()).parent_path() / "t";
+
+   constexpr int kDirs = 256;
+   constexpr int kFiles = 64;
+   const auto old = std::filesystem::file_time_type::clock::now() -
+                    std::chrono::hours(1);
+   for (int d = 0; d < kDirs; ++d) {
+      const auto sub = root / numbered("d", d / 16) / numbered("e", d % 16);
+      std::filesystem::create_directories(sub);
+      for (int f = 0; f < kFiles; ++f)
+         std::ofstream(sub / numbered("f", f, ".txt"));
+      std::filesystem::last_write_time(sub, old);
+   }
+   for (const auto& e : std::filesystem::directory_iterator(root))
+      std::filesystem::last_write_time(e.path(), old);
+   std::filesystem::last_write_time(root, old);
+
+   auto expand = [](const std::string& pattern, clanker::GlobCache& cache) {
+      clanker::GlobExpansion g{cache.compile(pattern), cache};
+      std::size_t n = 0;
+      while (g.next()) ++n;
+      return n;
+   };
+   auto best_of = [](int runs, auto&& fn) {
+      double best = 1e300;
+      for (int i = 0; i < runs; ++i) {
+         const auto t0 = Clock::now();
+         fn();
+         best = std::min(best, ns_since(t0) / 1e6);
+      }
+      return best;
+   };
+
+   std::printf("%-24s %9s %10s %10s\n", "pattern", "matches", "cold ms",
+               "cached ms");
+   for (const char* p : {"/*/*/f1?.txt", "/*/*/*", "/**/f7.txt"}) {
+      const std::string pattern = root.string() + p;
+      std::size_t matches = 0;
+      const double cold = best_of(5, [&] {
+         clanker::GlobCache cache{1};
+         matches = expand(pattern, cache);
+      });
+      clanker::GlobCache cache{1};
+      expand(pattern, cache);
+      const double cached = best_of(5, [&] { expand(pattern, cache); });
+      std::printf("%-24s %9zu %10.2f %10.2f\n", p, matches, cold, cached);
+   }
+
+   std::printf("%-8s %12s\n", "jobs", "** cold ms");
+   for (const unsigned jobs : {1u, 2u, 4u}) {
+      const std::string pattern = root.string() + "/**/f7.txt";
+      const double ms = best_of(5, [&] {
+         clanker::GlobCache cache{jobs};
+         g_sink = g_sink + static_cast<int>(expand(pattern, cache));
+      });
+      std::printf("%-8u %12.2f\n", jobs, ms);
+   }
+}
+
+// Command substitution in a tight loop: a script of N identical lines
+// `cd $(...)`, timed per line. A pure built-in runs in-process, an external
+// is spawned straight onto a pipe, and a list needs a forked subshell. The
+// same script under bash (which forks for every substitution) is shown for
+// reference when it is installed.
+void bench_substitution(const char* clanker) {
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const std::string script = dir.script();
+
+   constexpr int kLines = 2000;
+   auto per_line_us = [&](const char* shell, std::string_view line) {
+      {
+         std::ofstream out(script, std::ios::trunc);
+         for (int i = 0; i < kLines; ++i) out << line << '\n';
+      }
+      run_script(shell, script); // warm the script cache
+      const auto t0 = Clock::now();
+      run_script(shell, script);
+      return ns_since(t0) / kLines / 1e3;
+   };
+
+   const bool bash = ::access("/bin/bash", X_OK) == 0;
+   std::printf("%-22s %12s %12s\n", "line", "clanker us", "bash us");
+   for (const char* line :
+        {"cd .", "cd $(pwd)", "cd $(/bin/pwd)", "cd $(cd .; pwd)"}) {
+      const double ours = per_line_us(clanker, line);
+      if (bash)
+         std::printf("%-22s %12.2f %12.2f\n", line, ours,
+                     per_line_us("/bin/bash", line));
+      else
+         std::printf("%-22s %12.2f %12s\n", line, ours, "-");
+   }
+}
+
+// @( ) expressions evaluated once per item of a 10k-item list, as a loop
+// body would: time and heap allocations per evaluation, for the compiled
+// program run by one VM and for compiling the source every time.
+void bench_expr() {
+   struct Env final : clanker::ExprEnv {
+      clanker::Value xs;
+      clanker::Value i;
+      const clanker::Value* lookup(std::string_view name) const override {
+         if (name == "xs") return &xs;
+         if (name == "i") return &i;
+         return nullptr;
+      }
+   };
+
+   constexpr int kItems = 10000;
+   Env env;
+   {
+      clanker::Value::List xs;
+      for (int k = 0; k < kItems; ++k)
+         xs.emplace_back(clanker::Value::String("file" + std::to_string(k)));
+      env.xs = clanker::Value{std::move(xs)};
+   }
+
+   std::printf("%-36s %10s %10s %12s\n", "expression", "ns/eval",
+               "allocs", "compile ns");
+   for (const char* src : {"i", "xs[i]", "i % 2 == 0 && i < 5000",
+                           "xs[i] + \".txt\"", "\"dir/\" + str(i) + \".txt\"",
+                           "i % 3 == 0 ? xs[-1 - i] : 'skip'"}) {
+      const auto program = clanker::compile_expr(src).program;
+      clanker::ExprVM vm;
+      std::string err;
+      std::string word;
+      auto eval = [&](const clanker::ExprProgram& p, int k) {
+         env.i = clanker::Value{clanker::Value::Int{k}};
+         const clanker::Value* v = vm.run(p, &env, err);
+         word.clear();
+         if (v && clanker::lower_value(*v, word, err))
+            g_sink = g_sink + static_cast<int>(word.size());
+      };
+      for (int k = 0; k < 100; ++k) eval(*program, k); // warm registers
+
+      const std::size_t a0 = g_allocs.load();
+      auto t0 = Clock::now();
+      for (int k = 0; k < kItems; ++k) eval(*program, k);
+      const double run_ns = ns_since(t0) / kItems;
+      const double allocs =
+         static_cast<double>(g_allocs.load() - a0) / kItems;
+
+      t0 = Clock::now();
+      for (int k = 0; k < kItems; ++k)
+         eval(*clanker::compile_expr(src).program, k);
+      const double compile_ns = ns_since(t0) / kItems - run_ns;
+
+      std::printf("%-36s %10.1f %10.2f %12.1f\n", src, run_ns, allocs,
+                  compile_ns);
+   }
+}
+
+// Variable lookup as expansion does it, by a string_view name, in a store
+// of 50 and 1000 variables: the flat VarStore against std::unordered_map
+// with a transparent hash. Then whole commands of parameter expansions:
+// time and heap allocations per command.
+void bench_vars() {
+   struct Hash {
+      using is_transparent = void;
+      std::size_t operator()(std::string_view s) const noexcept {
+         return std::hash<std::string_view>{}(s);
+      }
+   };
+   constexpr int kLookups = 2'000'000;
+
+   std::printf("%-6s %14s %18s\n", "vars", "VarStore ns", "unordered_map ns");
+   for (const int count : {50, 1000}) {
+      std::vector<std::string> names;
+      clanker::VarStore store;
+      std::unordered_map<std::string, clanker::Value, Hash, std::equal_to<>>
+         map;
+      for (int k = 0; k < count; ++k) {
+         names.push_back(numbered("VAR_", k));
+         store.set(names.back(), clanker::Value{std::to_string(k)});
+         map.emplace(names.back(), clanker::Value{std::to_string(k)});
+      }
+      std::vector<std::string_view> keys(names.begin(), names.end());
+
+      auto time = [&](auto&& find) {
+         std::size_t hits = 0;
+         const auto t0 = Clock::now();
+         for (int i = 0; i < kLookups; ++i)
+            hits += find(keys[static_cast<std::size_t>(i % count)]) ? 1 : 0;
+         g_sink = g_sink + static_cast<int>(hits);
+         return ns_since(t0) / kLookups;
+      };
+      const double flat = time([&](std::string_view n) {
+         return store.find(n) != nullptr;
+      });
+      const double std_map = time([&](std::string_view n) {
+         return map.find(n) != map.end();
+      });
+      std::printf("%-6d %14.1f %18.1f\n", count, flat, std_map);
+   }
+
+   clanker::VarStore vars;
+   vars.set("p", clanker::Value{std::string{"src/lib/archive.tar.gz"}});
+   const clanker::ExpansionLimits limits;
+   clanker::GlobCache globs{1};
+   clanker::ExprVM vm;
+   clanker::ArithVM arith;
+   const clanker::ExpandContext ctx{.limits = limits,
+                                    .globs = globs,
+                                    .vm = vm,
+                                    .arith = arith,
+                                    .vars = &vars};
+   const Parser parser;
+   constexpr int kRounds = 100000;
+
+   std::printf("%-36s %10s %10s\n", "command", "ns/cmd", "allocs");
+   for (const char* src : {"echo $p", "echo ${p##*/} ${p%.*} ${#p}",
+                           "echo ${p//a/A} ${p/#src/dst}",
+                           "echo ${u:-default} ${p:+set}"}) {
+      const auto pr = parser.parse(std::string{src});
+      std::array<std::byte, 4096> buf;
+      std::string err;
+      auto expand = [&] {
+         std::pmr::monotonic_buffer_resource mr{buf.data(), buf.size()};
+         clanker::Pipeline out{&mr};
+         if (clanker::expand_pipeline(pr.pipeline, out, ctx, err))
+            g_sink = g_sink + static_cast<int>(out.stages[0].argv.size());
+      };
+      expand();
+
+      const std::size_t a0 = g_allocs.load();
+      const auto t0 = Clock::now();
+      for (int r = 0; r < kRounds; ++r) expand();
+      const double ns = ns_since(t0) / kRounds;
+      const double allocs =
+         static_cast<double>(g_allocs.load() - a0) / kRounds;
+      std::printf("%-36s %10.1f %10.2f\n", src, ns, allocs);
+   }
+}
+
+// Compiled control flow: three nested `for` loops around a built-in, run as
+// a script, timed per innermost iteration against bash when it is
+// installed. The loops run from one flat instruction array (ir.h), so the
+// cost is the built-in call and binding the loop variable.
+void bench_control_flow(const char* clanker) {
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const std::string script = dir.script();
+
+   constexpr int kIterations = 100 * 100 * 10;
+   std::ofstream(script, std::ios::trunc)
+      << "for a in {0..99}; do for b in {0..99}; do for c in {0..9}; do "
+         "unset x; done; done; done\n";
+   auto per_iteration_ns = [&](const char* shell) {
+      run_script(shell, script); // warm the script cache
+      const auto t0 = Clock::now();
+      run_script(shell, script);
+      return ns_since(t0) / kIterations;
+   };
+
+   std::printf("%-22s %12s %12s\n", "loop", "clanker ns", "bash ns");
+   const double ours = per_iteration_ns(clanker);
+   if (::access("/bin/bash", X_OK) == 0)
+      std::printf("%-22s %12.1f %12.1f\n", "for^3 { unset x }", ours,
+                  per_iteration_ns("/bin/bash"));
+   else
+      std::printf("%-22s %12.1f %12s\n", "for^3 { unset x }", ours, "-");
+}
+
+// A call to a function whose body is one built-in, against the built-in
+// alone: what a call adds is the frame, the positional parameters and the
+// jump into the precompiled body.
+void bench_function_call(const char* clanker) {
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const std::string script = dir.script();
+
+   constexpr int kIterations = 100 * 100 * 10;
+   auto per_call_ns = [&](const char* shell, const char* body) {
+      std::ofstream(script, std::ios::trunc)
+         << "f() { unset x; }\nfor a in v{0..99}; do for b in {0..99}; do "
+            "for c in {0..9}; do "
+         << body << " $a; done; done; done\n";
+      run_script(shell, script); // warm the script cache
+      const auto t0 = Clock::now();
+      run_script(shell, script);
+      return ns_since(t0) / kIterations;
+   };
+
+   const bool bash = ::access("/bin/bash", X_OK) == 0;
+   std::printf("%-22s %12s %12s\n", "command", "clanker ns", "bash ns");
+   for (const char* body : {"unset x", "f"}) {
+      const double ours = per_call_ns(clanker, body);
+      if (bash)
+         std::printf("%-22s %12.1f %12.1f\n", body, ours,
+                     per_call_ns("/bin/bash", body));
+      else
+         std::printf("%-22s %12.1f %12s\n", body, ours, "-");
+   }
+}
+
+// A counting loop in shell arithmetic, per iteration: one (( )) test and
+// one increment. Both are compiled when the script is parsed, with their
+// names bound to variable slots on the first run, so an iteration costs no
+// parsing, lookup or text conversion of the counter.
+void bench_arith(const char* clanker) {
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const std::string script = dir.script();
+
+   constexpr int kIterations = 100000;
+   auto per_iteration_ns = [&](const char* shell, const char* step) {
+      std::ofstream(script, std::ios::trunc)
+         << "i=0; while (( i < " << kIterations << " )); do " << step
+         << "; done\n";
+      run_script(shell, script); // warm the script cache
+      const auto t0 = Clock::now();
+      run_script(shell, script);
+      return ns_since(t0) / kIterations;
+   };
+
+   const bool bash = ::access("/bin/bash", X_OK) == 0;
+   std::printf("%-22s %12s %12s\n", "step", "clanker ns", "bash ns");
+   for (const char* step : {"i=$((i + 1))", "(( i += 1 ))"}) {
+      const double ours = per_iteration_ns(clanker, step);
+      if (bash)
+         std::printf("%-22s %12.1f %12.1f\n", step, ours,
+                     per_iteration_ns("/bin/bash", step));
+      else
+         std::printf("%-22s %12.1f %12s\n", step, ours, "-");
+   }
+}
+
+// A `case` with 200 arms, matched against words that reach the last arms
+// or none: the compiled PatternSet against trying each pattern in turn, as
+// a shell calling fnmatch() per arm does; then whole scripts.
+void bench_case(const char* clanker) {
+   constexpr int kArms = 200;
+   std::vector<std::string> patterns;
+   for (int k = 0; k < kArms; ++k) {
+      const std::string n = std::to_string(k);
+      if (k % 4 == 0) patterns.push_back("cmd" + n + "-*");
+      else if (k % 4 == 1) patterns.push_back("*.ext" + n);
+      else if (k % 4 == 2) patterns.push_back("literal" + n);
+      else patterns.push_back("[ab]x" + n + "?");
+   }
+   const std::vector<std::string> words = {
+      "cmd196-run", "file.ext197", "literal198", "bx199z", "nothing"};
+
+   std::vector<std::string_view> views(patterns.begin(), patterns.end());
+   const clanker::PatternSet set{views};
+   std::vector<clanker::GlobMatcher> each;
+   for (const std::string& p : patterns) each.emplace_back(p, false);
+
+   constexpr int kRounds = 20000;
+   auto per_match_ns = [&](auto&& match) {
+      const auto t0 = Clock::now();
+      std::size_t sum = 0;
+      for (int r = 0; r < kRounds; ++r)
+         for (const std::string& w : words) sum += match(w);
+      g_sink = g_sink + static_cast<int>(sum);
+      return ns_since(t0) / (kRounds * words.size());
+   };
+   const double ns_set = per_match_ns([&](const std::string& w) {
+      return set.match(w);
+   });
+   const double ns_each = per_match_ns([&](const std::string& w) {
+      for (std::size_t k = 0; k < each.size(); ++k)
+         if (each[k].match(w)) return k;
+      return each.size();
+   });
+   const double ns_fnmatch = per_match_ns([&](const std::string& w) {
+      for (std::size_t k = 0; k < patterns.size(); ++k)
+         if (::fnmatch(patterns[k].c_str(), w.c_str(), 0) == 0) return k;
+      return patterns.size();
+   });
+   std::printf("%-30s %10s\n", "200 arms, per word", "ns");
+   std::printf("%-30s %10.1f\n", "PatternSet::match", ns_set);
+   std::printf("%-30s %10.1f\n", "GlobMatcher per arm", ns_each);
+   std::printf("%-30s %10.1f\n", "fnmatch() per arm", ns_fnmatch);
+
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const std::string script = dir.script();
+   constexpr int kLoops = 2000;
+   {
+      std::ofstream out(script, std::ios::trunc);
+      out << "i=0\nwhile (( i < " << kLoops << " )); do\n  i=$((i + 1))\n"
+          << "  for w in";
+      for (const std::string& w : words) out << ' ' << w;
+      out << "; do\n    case $w in\n";
+      for (const std::string& p : patterns) out << "      " << p << ") ;;\n";
+      out << "    esac\n  done\ndone\n";
+   }
+   auto script_ns = [&](const char* shell) {
+      run_script(shell, script); // warm the script cache
+      const auto t0 = Clock::now();
+      run_script(shell, script);
+      return ns_since(t0) / (kLoops * words.size());
+   };
+   const bool bash = ::access("/bin/bash", X_OK) == 0;
+   std::printf("%-30s %10s %10s\n", "script, per case", "clanker ns",
+               "bash ns");
+   const double ours = script_ns(clanker);
+   if (bash)
+      std::printf("%-30s %10.1f %10.1f\n", "case $w in (200 arms)", ours,
+                  script_ns("/bin/bash"));
+   else
+      std::printf("%-30s %10.1f %10s\n", "case $w in (200 arms)", ours, "-");
+}
+
+// `while read -r line` over a generated file, per line and in MB/s, read
+// from the file itself and through a pipe, against bash. bash reads a pipe
+// one byte at a time so as not to consume past the line; `read` here reads
+// ahead through the shell's InputBuffers, and on a pipe looks ahead with
+// tee() and takes just the line. The input is kMiB rather than the
+// gigabyte a real log would be, so that bash on a pipe finishes in seconds.
+void bench_read(const char* clanker) {
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const std::string script = dir.script();
+   const std::string input = script + ".in";
+
+   constexpr std::size_t kMiB = 8;
+   std::size_t lines = 0;
+   {
+      std::ofstream out(input, std::ios::trunc);
+      std::string line;
+      for (std::size_t bytes = 0; bytes < (kMiB << 20); bytes += line.size()) {
+         line = "2026-10-16 12:00:00 host" + std::to_string(lines % 97) +
+                " worker[" + std::to_string(lines) + "]: request served\n";
+         out << line;
+         ++lines;
+      }
+   }
+
+   // Run `shell script` with stdin the input file, or a pipe a child
+   // copies it into.
+   auto run = [&](const char* shell, bool pipe) {
+      int fds[2] = {-1, -1};
+      if (pipe && ::pipe(fds) != 0) return 0.0;
+      const auto t0 = Clock::now();
+      pid_t writer = -1;
+      if (pipe) {
+         writer = ::fork();
+         if (writer == 0) {
+            ::close(fds[0]);
+            const int in = ::open(input.c_str(), O_RDONLY);
+            char buf[1 << 16];
+            for (ssize_t n; (n = ::read(in, buf, sizeof buf)) > 0;)
+               if (::write(fds[1], buf, static_cast<std::size_t>(n)) != n)
+                  break;
+            _exit(0);
+         }
+         ::close(fds[1]);
+      }
+      const pid_t pid = ::fork();
+      if (pid == 0) {
+         const int in = pipe ? fds[0] : ::open(input.c_str(), O_RDONLY);
+         ::dup2(in, STDIN_FILENO);
+         const int devnull = ::open("/dev/null", O_WRONLY);
+         ::dup2(devnull, STDOUT_FILENO);
+         char* const argv[] = {const_cast<char*>(shell),
+                               const_cast<char*>(script.c_str()), nullptr};
+         ::execv(shell, argv);
+         _exit(127);
+      }
+      if (pipe) ::close(fds[0]);
+      int status = 0;
+      ::waitpid(pid, &status, 0);
+      if (writer > 0) ::waitpid(writer, &status, 0);
+      return ns_since(t0);
+   };
+
+   std::ofstream(script, std::ios::trunc)
+      << "while read -r line; do n=$line; done\n";
+   const bool bash = ::access("/bin/bash", X_OK) == 0;
+   std::printf("%zu MiB, %zu lines\n", kMiB, lines);
+   std::printf("%-22s %12s %10s %12s %10s\n", "while read -r line",
+               "clanker ns", "MB/s", "bash ns", "MB/s");
+   for (const bool pipe : {false, true}) {
+      const char* what = pipe ? "from a pipe" : "from a file";
+      run(clanker, pipe); // warm the script cache
+      const double ours = run(clanker, pipe);
+      const double mb = static_cast<double>(kMiB << 20) / 1e6;
+      if (bash) {
+         const double theirs = run("/bin/bash", pipe);
+         std::printf("%-22s %12.1f %10.1f %12.1f %10.1f\n", what,
+                     ours / lines, mb / (ours / 1e9), theirs / lines,
+                     mb / (theirs / 1e9));
+      } else {
+         std::printf("%-22s %12.1f %10.1f %12s %10s\n", what, ours / lines,
+                     mb / (ours / 1e9), "-", "-");
+      }
+   }
+}
+
+// Pipelines of built-ins, per pipeline. A pure built-in in a non-last stage
+// runs on a worker thread, and one that changes shell state in a forked
+// copy of the shell, as every stage does in bash; the last stage runs in
+// the shell either way.
+void bench_pipeline_builtins(const char* clanker) {
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const std::string script = dir.script();
+
+   constexpr int kPipelines = 2000;
+   auto per_pipeline_ns = [&](const char* shell, const char* pipeline) {
+      std::ofstream(script, std::ios::trunc)
+         << "for i in {1.." << kPipelines << "}; do " << pipeline
+         << "; done\n";
+      run_script(shell, script); // warm the script cache
+      const auto t0 = Clock::now();
+      run_script(shell, script);
+      return ns_since(t0) / kPipelines;
+   };
+
+   const bool bash = ::access("/bin/bash", X_OK) == 0;
+   std::printf("%-44s %12s %12s\n", "pipeline", "clanker ns", "bash ns");
+   const char* const rows[][2] = {
+      {"pwd | read x", "worker thread"},
+      {"unset y | read x", "forked stage"},
+      {"pwd | pwd | pwd | read x", "3 worker threads"},
+   };
+   for (const auto& [pipeline, how] : rows) {
+      const double ours = per_pipeline_ns(clanker, pipeline);
+      const std::string label = std::string{pipeline} + " (" + how + ")";
+      if (bash)
+         std::printf("%-44s %12.1f %12.1f\n", label.c_str(), ours,
+                     per_pipeline_ns("/bin/bash", pipeline));
+      else
+         std::printf("%-44s %12.1f %12s\n", label.c_str(), ours, "-");
+   }
+}
+
+// What calling a built-in costs, per call, with and without redirections:
+// each redirection is an open() and a close(), and the built-in gets the
+// opened fd in its BuiltinContext rather than on fds 0-2.
+void bench_builtin_call(const char* clanker) {
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const std::string script = dir.script();
+
+   constexpr int kCalls = 100 * 100 * 10;
+   auto per_call_ns = [&](const char* shell, const char* call) {
+      std::ofstream(script, std::ios::trunc)
+         << "for a in {0..99}; do for b in {0..99}; do for c in {0..9}; do "
+         << call << "; done; done; done\n";
+      run_script(shell, script); // warm the script cache
+      const auto t0 = Clock::now();
+      run_script(shell, script);
+      return ns_since(t0) / kCalls;
+   };
+
+   const bool bash = ::access("/bin/bash", X_OK) == 0;
+   std::printf("%-40s %12s %12s\n", "call", "clanker ns", "bash ns");
+   for (const char* call :
+        {"unset x", "unset x > /dev/null",
+         "unset x < /dev/null > /dev/null 2> /dev/null"}) {
+      const double ours = per_call_ns(clanker, call);
+      if (bash)
+         std::printf("%-40s %12.1f %12.1f\n", call, ours,
+                     per_call_ns("/bin/bash", call));
+      else
+         std::printf("%-40s %12.1f %12s\n", call, ours, "-");
+   }
+}
+
+// Built-ins that print many lines: each line used to be a write() of its
+// own; with the output sink a call is one write() however many it prints.
+void bench_builtin_output(const char* clanker) {
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const std::string script = dir.script();
+
+   constexpr int kCalls = 100 * 100;
+   auto per_call_ns = [&](const char* shell, const char* call) {
+      std::ofstream(script, std::ios::trunc)
+         << "v0=a v1=b v2=c v3=d v4=e v5=f v6=g v7=h v8=i v9=j\n"
+         << "for a in {0..99}; do for b in {0..99}; do "
+         << call << "; done; done\n";
+      run_script(shell, script); // warm the script cache
+      const auto t0 = Clock::now();
+      run_script(shell, script);
+      return ns_since(t0) / kCalls;
+   };
+
+   const bool bash = ::access("/bin/bash", X_OK) == 0;
+   std::printf("%-40s %12s %12s\n", "call (output to /dev/null)", "clanker ns",
+               "bash ns");
+   for (const char* call :
+        {"pwd", "declare -p v0 v1 v2 v3 v4 v5 v6 v7 v8 v9"}) {
+      const double ours = per_call_ns(clanker, call);
+      if (bash)
+         std::printf("%-40s %12.1f %12.1f\n", call, ours,
+                     per_call_ns("/bin/bash", call));
+      else
+         std::printf("%-40s %12.1f %12s\n", call, ours, "-");
+   }
+}
+
+// Finding a command's built-in: the compiled perfect-hash table against an
+// unordered_map<std::string, std::function> probed with a std::string made
+// from the name and returning a copy of the function, as the table used to
+// be. Half the names are built-ins, half are external commands.
+void bench_builtin_lookup() {
+   const clanker::Builtins builtins = clanker::make_builtins();
+   std::unordered_map<std::string, std::function<int(
+                                      const clanker::BuiltinContext&,
+                                      const clanker::Argv&)>>
+      map;
+   std::vector<std::string> names;
+   for (const auto& [name, help] : builtins.help_items()) {
+      map.emplace(name, builtins.lookup(name)->fn);
+      names.push_back(name);
+   }
+   for (const char* ext : {"ls", "grep", "cat", "git", "sed", "awk", "make",
+                           "python3", "find", "xargs", "sort", "head", "tail",
+                           "wc", "clanker-long-command-name", "x"})
+      names.emplace_back(ext);
+
+   constexpr int kRounds = 200000;
+   auto per_lookup = [&](auto&& find) {
+      const std::size_t a0 = g_allocs.load();
+      const auto t0 = Clock::now();
+      std::size_t hits = 0;
+      for (int r = 0; r < kRounds; ++r)
+         for (const std::string& n : names) hits += find(std::string_view{n});
+      const double ns = ns_since(t0);
+      g_sink = g_sink + static_cast<int>(hits);
+      const double lookups = double(kRounds) * double(names.size());
+      return std::pair{ns / lookups, double(g_allocs.load() - a0) / lookups};
+   };
+   const auto [ns_table, allocs_table] = per_lookup([&](std::string_view n) {
+      return builtins.lookup(n) != nullptr;
+   });
+   const auto [ns_map, allocs_map] = per_lookup([&](std::string_view n) {
+      const auto it = map.find(std::string{n});
+      const std::optional<std::function<int(const clanker::BuiltinContext&,
+                                            const clanker::Argv&)>>
+         fn = it == map.end() ? std::nullopt : std::optional{it->second};
+      return fn.has_value();
+   });
+   std::printf("%-34s %10s %12s\n", "per lookup", "ns", "allocs");
+   std::printf("%-34s %10.1f %12.3f\n", "Builtins::lookup (perfect hash)",
+               ns_table, allocs_table);
+   std::printf("%-34s %10.1f %12.3f\n", "unordered_map<string> + function",
+               ns_map, allocs_map);
+}
+
+// Processes the system has created since boot (/proc/stat); -1 if unknown.
+long processes_created() {
+   std::ifstream in("/proc/stat");
+   std::string key;
+   long n = 0;
+   while (in >> key) {
+      if (key == "processes" && in >> n) return n;
+      in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+   }
+   return -1;
+}
+
+// A loop over the utilities that are now built-ins, run in-process and
+// with each one spawned (`command NAME`, which is what ran before they
+// were built-ins), and by bash, whose echo, printf, true, false and test
+// are built-ins and whose basename, dirname and seq are spawned. Spawns
+// are counted system-wide, less the shell itself.
+void bench_coreutils_builtins(const char* clanker) {
+   const ScriptBenchDir dir;
+   if (!dir.ok()) return;
+   const std::string script = dir.script();
+
+   constexpr int kIterations = 500;
+   const std::array<std::string_view, 9> calls{
+      "echo a b c", "printf '%s-%d\\n' x 1", "true", "false",
+      "test -f /etc/passwd", "[ 1 -lt 2 ]", "basename /usr/lib/x.so .so",
+      "dirname /usr/lib/x.so", "seq 3"};
+   struct Run {
+      double ns;
+      double spawns;
+   };
+   auto per_iteration = [&](const char* shell, std::string_view prefix) {
+      std::ofstream out(script, std::ios::trunc);
+      out << "for i in {1.." << kIterations << "}; do\n";
+      for (const std::string_view call : calls)
+         out << "   " << prefix << call << "\n";
+      out << "done > /dev/null\n";
+      out.close();
+      run_script(shell, script); // warm the script cache
+      const long p0 = processes_created();
+      const auto t0 = Clock::now();
+      run_script(shell, script);
+      const double ns = ns_since(t0);
+      const long p1 = processes_created();
+      return Run{.ns = ns / kIterations,
+                 .spawns = p0 < 0 ? -1.0
+                                  : double(p1 - p0 - 1) / kIterations};
+   };
+
+   std::printf("%-34s %14s %14s\n", "per iteration (9 utilities)", "ns",
+               "spawns");
+   const auto row = [](const char* label, Run r) {
+      std::printf("%-34s %14.1f %14.2f\n", label, r.ns, r.spawns);
+   };
+   row("clanker, built-ins", per_iteration(clanker, ""));
+   row("clanker, spawned (command NAME)", per_iteration(clanker, "command "));
+   if (::access("/bin/bash", X_OK) == 0)
+      row("bash", per_iteration("/bin/bash", ""));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+   if (argc < 2) usage();
+
+   const std::string_view which = get_case(argc, argv);
+
+   if (which == "all") {
+      bench_continuation();
+      bench_compound_continuation();
+      bench_lexer_allocs();
+      bench_statement_allocs();
+      bench_lexer_throughput();
+      bench_token_stream();
+      bench_brace_expansion();
+      bench_parse_cache();
+      bench_script_startup(argv[1]);
+      bench_script_memory(argv[1]);
+      bench_check_throughput();
+      bench_glob();
+      bench_substitution(argv[1]);
+      bench_expr();
+      bench_vars();
+      bench_control_flow(argv[1]);
+      bench_function_call(argv[1]);
+      bench_arith(argv[1]);
+      bench_case(argv[1]);
+      bench_read(argv[1]);
+      bench_pipeline_builtins(argv[1]);
+      bench_builtin_call(argv[1]);
+      bench_builtin_output(argv[1]);
+      bench_builtin_lookup();
+      bench_coreutils_builtins(argv[1]);
+   } else if (which == "continuation") {
+      bench_continuation();
+   } else if (which == "compound_continuation") {
+      bench_compound_continuation();
+   } else if (which == "lexer_allocs") {
+      bench_lexer_allocs();
+   } else if (which == "statement_allocs") {
+      bench_statement_allocs();
+   } else if (which == "lexer_throughput") {
+      bench_lexer_throughput();
+   } else if (which == "token_stream") {
+      bench_token_stream();
+   } else if (which == "brace_expansion") {
+      bench_brace_expansion();
+   } else if (which == "glob") {
+      bench_glob();
+   } else if (which == "substitution") {
+      bench_substitution(argv[1]);
+   } else if (which == "expr") {
+      bench_expr();
+   } else if (which == "vars") {
+      bench_vars();
+   } else if (which == "control_flow") {
+      bench_control_flow(argv[1]);
+   } else if (which == "function_call") {
+      bench_function_call(argv[1]);
+   } else if (which == "arith") {
+      bench_arith(argv[1]);
+   } else if (which == "case") {
+      bench_case(argv[1]);
+   } else if (which == "read") {
+      bench_read(argv[1]);
+   } else if (which == "pipeline_builtins") {
+      bench_pipeline_builtins(argv[1]);
+   } else if (which == "builtin_call") {
+      bench_builtin_call(argv[1]);
+   } else if (which == "builtin_output") {
+      bench_builtin_output(argv[1]);
+   } else if (which == "builtin_lookup") {
+      bench_builtin_lookup();
+   } else if (which == "coreutils_builtins") {
+      bench_coreutils_builtins(argv[1]);
+   } else if (which == "parse_cache") {
+      bench_parse_cache();
+   } else if (which == "script_startup") {
+      bench_script_startup(argv[1]);
+   } else if (which == "script_memory") {
+      bench_script_memory(argv[1]);
+   } else if (which == "check_throughput") {
+      bench_check_throughput();
+   } else {
+      usage();
+   }
+
+   return 0;
+}
@@ -0,0 +1,837 @@
+// src/clanker/arith.cpp
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <utility>
+
+#include "clanker/arith.h"
+#include "clanker/lexer.h"
+
+namespace clanker {
+
+namespace {
+
+using Int = Value::Int;
+
+constexpr Int kIntMin = std::numeric_limits<Int>::min();
+constexpr Int kIntMax = std::numeric_limits<Int>::max();
+
+// Longest first, so the first match is the whole operator.
+constexpr std::string_view kOps[] = {
+   "<<=", ">>=", "**", "++", "--", "<<", ">>", "<=", ">=", "==", "!=",
+   "&&",  "||",  "+=", "-=", "*=", "/=", "%=", "&=", "^=", "|=", "+",
+   "-",   "*",   "/",  "%",  "<",  ">",  "&",  "|",  "^",  "!",  "~",
+   "?",   ":",   "=",  ",",  "(",  ")",
+};
+
+struct BinOp {
+   std::string_view text; // empty: unused
+   ArithOp op;
+};
+
+// The left-associative binary operators, loosest first.
+constexpr BinOp kLevels[][4] = {
+   {{"|", ArithOp::BitOr}},
+   {{"^", ArithOp::BitXor}},
+   {{"&", ArithOp::BitAnd}},
+   {{"==", ArithOp::Eq}, {"!=", ArithOp::Ne}},
+   {{"<", ArithOp::Lt},
+    {"<=", ArithOp::Le},
+    {">", ArithOp::Gt},
+    {">=", ArithOp::Ge}},
+   {{"<<", ArithOp::Shl}, {">>", ArithOp::Shr}},
+   {{"+", ArithOp::Add}, {"-", ArithOp::Sub}},
+   {{"*", ArithOp::Mul}, {"/", ArithOp::Div}, {"%", ArithOp::Mod}},
+};
+
+constexpr BinOp kAssignOps[] = {
+   {"+=", ArithOp::Add},    {"-=", ArithOp::Sub},    {"*=", ArithOp::Mul},
+   {"/=", ArithOp::Div},    {"%=", ArithOp::Mod},    {"<<=", ArithOp::Shl},
+   {">>=", ArithOp::Shr},   {"&=", ArithOp::BitAnd}, {"^=", ArithOp::BitXor},
+   {"|=", ArithOp::BitOr},
+};
+
+// Parentheses, unary operators and assignments may nest this deep; the
+// compiler recurses on each.
+constexpr std::size_t kMaxDepth = 256;
+
+bool is_name_start(char c) noexcept {
+   return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool is_name_char(char c) noexcept {
+   return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+bool is_digit(char c) noexcept { return c >= '0' && c <= '9'; }
+
+bool is_space(char c) noexcept {
+   return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// The magnitude of an unsigned constant: decimal, 0x hexadecimal or 0
+// octal. False if `text` is not one; `overflow` says if it only failed to
+// fit.
+bool parse_magnitude(std::string_view text, std::uint64_t& out,
+                     bool& overflow) noexcept {
+   int base = 10;
+   if (text.size() > 1 && text[0] == '0' &&
+       (text[1] == 'x' || text[1] == 'X')) {
+      base = 16;
+      text.remove_prefix(2);
+   } else if (text.size() > 1 && text[0] == '0') {
+      base = 8;
+      text.remove_prefix(1);
+   }
+   if (text.empty()) return false;
+   const auto [ptr, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), out, base);
+   overflow = ec == std::errc::result_out_of_range;
+   return ec == std::errc{} && ptr == text.data() + text.size();
+}
+
+// The integer text `t` holds: an optionally signed constant with blanks
+// around it; empty is 0.
+bool parse_int(std::string_view t, Int& out) noexcept {
+   while (!t.empty() && is_space(t.front())) t.remove_prefix(1);
+   while (!t.empty() && is_space(t.back())) t.remove_suffix(1);
+   if (t.empty()) {
+      out = 0;
+      return true;
+   }
+   const bool minus = t.front() == '-';
+   if (minus || t.front() == '+') t.remove_prefix(1);
+   std::uint64_t m = 0;
+   bool overflow = false;
+   if (!parse_magnitude(t, m, overflow)) return false;
+   if (m > static_cast<std::uint64_t>(kIntMax) + (minus ? 1 : 0)) return false;
+   out = minus ? static_cast<Int>(0 - m) : static_cast<Int>(m);
+   return true;
+}
+
+// The integer a variable holds; a string is read by parse_int().
+bool read_int(const Value& v, Int& out) noexcept {
+   if (const Int* i = v.as_int()) {
+      out = *i;
+      return true;
+   }
+   if (const bool* b = v.as_bool()) {
+      out = *b ? 1 : 0;
+      return true;
+   }
+   if (v.is_null()) {
+      out = 0;
+      return true;
+   }
+   const std::string* s = v.as_string();
+   return s && parse_int(*s, out);
+}
+
+// r = x op y for a binary operator; false with `err` set if that has no
+// value in 64 bits.
+bool apply(ArithOp op, Int x, Int y, Int& r, std::string& err) {
+   switch (op) {
+   case ArithOp::Add:
+      if (__builtin_add_overflow(x, y, &r)) break;
+      return true;
+   case ArithOp::Sub:
+      if (__builtin_sub_overflow(x, y, &r)) break;
+      return true;
+   case ArithOp::Mul:
+      if (__builtin_mul_overflow(x, y, &r)) break;
+      return true;
+   case ArithOp::Div:
+   case ArithOp::Mod:
+      if (y == 0) {
+         err = "division by 0";
+         return false;
+      }
+      if (x == kIntMin && y == -1) {
+         if (op == ArithOp::Div) break;
+         r = 0;
+         return true;
+      }
+      r = op == ArithOp::Div ? x / y : x % y;
+      return true;
+   case ArithOp::Pow: {
+      if (y < 0) {
+         err = "exponent less than 0";
+         return false;
+      }
+      // Once the exponent has bits left, the square is needed, so its
+      // overflow is the result's.
+      Int acc = 1;
+      for (;;) {
+         if ((y & 1) && __builtin_mul_overflow(acc, x, &acc)) break;
+         y >>= 1;
+         if (y == 0) {
+            r = acc;
+            return true;
+         }
+         if (__builtin_mul_overflow(x, x, &x)) break;
+      }
+      break;
+   }
+   case ArithOp::Shl:
+   case ArithOp::Shr:
+      if (y < 0 || y > 63) {
+         err = "shift count out of range";
+         return false;
+      }
+      if (op == ArithOp::Shr) {
+         r = x >> y;
+         return true;
+      }
+      if (x > (kIntMax >> y) || x < (kIntMin >> y)) break;
+      r = static_cast<Int>(static_cast<std::uint64_t>(x) << y);
+      return true;
+   case ArithOp::BitAnd:
+      r = x & y;
+      return true;
+   case ArithOp::BitOr:
+      r = x | y;
+      return true;
+   case ArithOp::BitXor:
+      r = x ^ y;
+      return true;
+   case ArithOp::Lt:
+      r = x < y;
+      return true;
+   case ArithOp::Le:
+      r = x <= y;
+      return true;
+   case ArithOp::Gt:
+      r = x > y;
+      return true;
+   case ArithOp::Ge:
+      r = x >= y;
+      return true;
+   case ArithOp::Eq:
+      r = x == y;
+      return true;
+   case ArithOp::Ne:
+      r = x != y;
+      return true;
+   default:
+      break;
+   }
+   err = "integer overflow";
+   return false;
+}
+
+// r = op x for a unary operator.
+bool apply(ArithOp op, Int x, Int& r, std::string& err) {
+   switch (op) {
+   case ArithOp::Neg:
+      if (x == kIntMin) break;
+      r = -x;
+      return true;
+   case ArithOp::Not:
+      r = x == 0;
+      return true;
+   case ArithOp::BitNot:
+      r = ~x;
+      return true;
+   case ArithOp::Bool:
+      r = x != 0;
+      return true;
+   case ArithOp::Inc:
+      if (x == kIntMax) break;
+      r = x + 1;
+      return true;
+   case ArithOp::Dec:
+      if (x == kIntMin) break;
+      r = x - 1;
+      return true;
+   default:
+      break;
+   }
+   err = "integer overflow";
+   return false;
+}
+
+} // namespace
+
+// Recursive descent straight to register code, as ExprCompiler does, with
+// constant folding on the way: a rule whose value is known when it is
+// compiled returns that value and emits nothing, and the caller puts it in
+// a register only if it needs one there.
+class ArithCompiler {
+ public:
+   explicit ArithCompiler(std::string_view src)
+      : src_(src) {
+      prog_ = std::make_shared<ArithProgram>();
+      prog_->source_ = std::string{src};
+   }
+
+   ArithCompileResult compile() {
+      space();
+      // As in bash, an empty expression is 0.
+      const Operand v = i_ < src_.size() ? comma(0) : Operand{.known = true};
+      space();
+      if (!failed_ && i_ < src_.size()) fail("unexpected '" + rest() + "'");
+      if (failed_)
+         return {.program = nullptr,
+                 .message = std::move(message_),
+                 .error_offset = error_offset_};
+      if (v.known && prog_->code_.empty()) prog_->constant_ = v.value;
+      load(v, 0);
+      return {.program = std::move(prog_), .message = {}, .error_offset = 0};
+   }
+
+ private:
+   // A value known at compile time, or else one left in the register the
+   // rule was given.
+   struct Operand {
+      bool known{false};
+      Int value{0};
+   };
+
+   // ---- Scanning ----
+
+   void space() {
+      while (i_ < src_.size() && is_space(src_[i_])) ++i_;
+   }
+
+   [[nodiscard]] char peek(std::size_t k = 0) const noexcept {
+      return i_ + k < src_.size() ? src_[i_ + k] : '\0';
+   }
+
+   // The operator that comes next, after whitespace; empty if none does.
+   std::string_view op() {
+      space();
+      for (const std::string_view o : kOps)
+         if (src_.substr(i_, o.size()) == o) return o;
+      return {};
+   }
+
+   bool accept(std::string_view o) {
+      if (op() != o) return false;
+      i_ += o.size();
+      return true;
+   }
+
+   void expect(std::string_view o) {
+      if (!accept(o)) fail("expected '" + std::string{o} + "'");
+   }
+
+   std::string rest() const { return std::string{src_.substr(i_, 8)}; }
+
+   void fail(std::string msg) {
+      if (failed_) return;
+      failed_ = true;
+      message_ = std::move(msg);
+      error_offset_ = i_;
+   }
+
+   // NAME, $NAME or ${NAME}; nothing is consumed if none comes next.
+   bool name(std::string_view& out) {
+      space();
+      std::size_t k = i_;
+      const bool dollar = peek() == '$';
+      const bool braced = dollar && peek(1) == '{';
+      k += dollar + braced;
+      if (k >= src_.size() || !is_name_start(src_[k])) return false;
+      const std::size_t start = k;
+      while (k < src_.size() && is_name_char(src_[k])) ++k;
+      out = src_.substr(start, k - start);
+      if (braced) {
+         if (k >= src_.size() || src_[k] != '}') return false;
+         ++k;
+      }
+      i_ = k;
+      return true;
+   }
+
+   // $1 ${10} $# $? $$; nothing is consumed if none comes next.
+   bool param(std::string_view& out) {
+      if (peek() != '$') return false;
+      const char c = peek(1);
+      if (c == '#' || c == '?' || c == '$' || is_digit(c)) {
+         out = src_.substr(i_ + 1, 1);
+         i_ += 2;
+         return true;
+      }
+      if (c != '{') return false;
+      std::size_t k = i_ + 2;
+      while (k < src_.size() && is_digit(src_[k])) ++k;
+      if (k == i_ + 2 || k >= src_.size() || src_[k] != '}') return false;
+      out = src_.substr(i_ + 2, k - i_ - 2);
+      i_ = k + 1;
+      return true;
+   }
+
+   // ---- Emitting ----
+
+   std::size_t emit(ArithOp op, std::size_t a, std::size_t b = 0,
+                    std::size_t c = 0) {
+      prog_->code_.push_back(
+         ArithInstr{.op = op,
+                    .a = static_cast<std::uint16_t>(a),
+                    .b = static_cast<std::uint16_t>(b),
+                    .c = static_cast<std::uint16_t>(c)});
+      if (prog_->code_.size() > kMax) fail("expression too large");
+      return prog_->code_.size() - 1;
+   }
+
+   void patch(std::size_t at) {
+      prog_->code_[at].c = static_cast<std::uint16_t>(prog_->code_.size());
+   }
+
+   // Register `r`, counted in the program's register file.
+   std::size_t reg(std::size_t r) {
+      if (r >= kMax) {
+         fail("expression too large");
+         r = kMax - 1;
+      }
+      prog_->registers_ =
+         std::max(prog_->registers_, static_cast<std::uint16_t>(r + 1));
+      return r;
+   }
+
+   // Index of `s` in `table`, added if it is new.
+   std::size_t intern(std::vector<std::string>& table, std::string_view s) {
+      const auto it = std::find(table.begin(), table.end(), s);
+      if (it != table.end())
+         return static_cast<std::size_t>(it - table.begin());
+      table.emplace_back(s);
+      if (table.size() > kMax) fail("expression too large");
+      return table.size() - 1;
+   }
+
+   // Put `v` in register `r` if it is not there already.
+   void load(Operand v, std::size_t r) {
+      if (!v.known) return;
+      prog_->consts_.push_back(v.value);
+      if (prog_->consts_.size() > kMax) fail("expression too large");
+      emit(ArithOp::Const, r, prog_->consts_.size() - 1);
+   }
+
+   // x op y into `dst`, folded when both are known and the result exists;
+   // a constant 1 / 0 is left to fail when it runs.
+   Operand fold(ArithOp op, Operand x, Operand y, std::size_t dst) {
+      Int r = 0;
+      std::string err;
+      if (x.known && y.known && apply(op, x.value, y.value, r, err))
+         return {.known = true, .value = r};
+      load(x, dst);
+      load(y, reg(dst + 1));
+      emit(op, dst, dst, dst + 1);
+      return {};
+   }
+
+   Operand fold(ArithOp op, Operand x, std::size_t dst) {
+      Int r = 0;
+      std::string err;
+      if (x.known && apply(op, x.value, r, err))
+         return {.known = true, .value = r};
+      load(x, dst);
+      emit(op, dst, dst);
+      return {};
+   }
+
+   // Compile `rule` for its syntax only: the branch of && || ?: that a
+   // constant condition never takes.
+   template<class Rule>
+   void dead(Rule rule) {
+      const std::size_t code = prog_->code_.size();
+      const std::size_t consts = prog_->consts_.size();
+      const std::size_t names = prog_->names_.size();
+      const std::size_t params = prog_->params_.size();
+      rule();
+      prog_->code_.resize(code);
+      prog_->consts_.resize(consts);
+      prog_->names_.resize(names);
+      prog_->params_.resize(params);
+   }
+
+   // Bounds the recursion of a rule that can nest.
+   class Nest {
+    public:
+      explicit Nest(ArithCompiler& c)
+         : c_(c) {
+         if (++c_.depth_ > kMaxDepth) c_.fail("expression nested too deeply");
+      }
+      ~Nest() { --c_.depth_; }
+
+      Nest(const Nest&) = delete;
+      Nest& operator=(const Nest&) = delete;
+
+    private:
+      ArithCompiler& c_;
+   };
+
+   // ---- Grammar (arith.h); each rule evaluates into `dst` ----
+
+   Operand comma(std::size_t dst) {
+      Operand v = assign(dst);
+      while (!failed_ && accept(",")) v = assign(dst);
+      return v;
+   }
+
+   Operand assign(std::size_t dst) {
+      const Nest nest{*this};
+      if (failed_) return {.known = true};
+      const std::size_t at = i_;
+      std::string_view n;
+      if (name(n)) {
+         const std::string_view o = op();
+         const auto* compound =
+            std::find_if(std::begin(kAssignOps), std::end(kAssignOps),
+                         [&](const BinOp& b) { return b.text == o; });
+         if (o == "=" || compound != std::end(kAssignOps)) {
+            i_ += o.size();
+            const std::size_t var = intern(prog_->names_, n);
+            if (o == "=") {
+               load(assign(dst), dst);
+            } else {
+               emit(ArithOp::Load, dst, var);
+               const std::size_t t = reg(dst + 1);
+               load(assign(t), t);
+               emit(compound->op, dst, dst, t);
+            }
+            emit(ArithOp::Store, dst, var);
+            return {};
+         }
+      }
+      i_ = at;
+      return conditional(dst);
+   }
+
+   //    cond; JumpIfZero else; comma; Jump end
+   //    else: conditional
+   //    end:
+   Operand conditional(std::size_t dst) {
+      const Operand c = logical(true, dst);
+      if (!accept("?")) return c;
+      if (c.known) {
+         Operand v;
+         if (c.value != 0) {
+            v = comma(dst);
+            expect(":");
+            dead([&] { conditional(dst); });
+         } else {
+            dead([&] { comma(dst); });
+            expect(":");
+            v = conditional(dst);
+         }
+         return v;
+      }
+      const std::size_t to_else = emit(ArithOp::JumpIfZero, dst);
+      load(comma(dst), dst);
+      const std::size_t to_end = emit(ArithOp::Jump, 0);
+      expect(":");
+      patch(to_else);
+      load(conditional(dst), dst);
+      patch(to_end);
+      return {};
+   }
+
+   // a || b (`is_or`) or a && b: 1 or 0, b evaluated only if a does not
+   // decide it.
+   Operand logical(bool is_or, std::size_t dst) {
+      auto operand = [&] {
+         return is_or ? logical(false, dst) : binary(0, dst);
+      };
+      Operand l = operand();
+      while (!failed_ && accept(is_or ? "||" : "&&")) {
+         if (l.known && (l.value != 0) == is_or) {
+            dead(operand);
+            l = {.known = true, .value = is_or ? 1 : 0};
+         } else if (l.known) {
+            l = fold(ArithOp::Bool, operand(), dst);
+         } else {
+            emit(ArithOp::Bool, dst, dst);
+            const std::size_t skip = emit(
+               is_or ? ArithOp::JumpIfNonZero : ArithOp::JumpIfZero, dst);
+            load(operand(), dst);
+            emit(ArithOp::Bool, dst, dst);
+            patch(skip);
+            l = {};
+         }
+      }
+      return l;
+   }
+
+   Operand binary(std::size_t level, std::size_t dst) {
+      if (level == std::size(kLevels)) return power(dst);
+      Operand l = binary(level + 1, dst);
+      for (;;) {
+         const std::string_view o = op();
+         const BinOp* b = std::find_if(
+            std::begin(kLevels[level]), std::end(kLevels[level]),
+            [&](const BinOp& x) { return !x.text.empty() && x.text == o; });
+         if (failed_ || b == std::end(kLevels[level])) return l;
+         i_ += o.size();
+         const Operand r = binary(level + 1, reg(dst + 1));
+         l = fold(b->op, l, r, dst);
+      }
+   }
+
+   // Right-associative, and below the unary operators: -2**2 is 4.
+   Operand power(std::size_t dst) {
+      const Operand base = unary(dst);
+      if (failed_ || !accept("**")) return base;
+      const Nest nest{*this};
+      const Operand exp = power(reg(dst + 1));
+      return fold(ArithOp::Pow, base, exp, dst);
+   }
+
+   Operand unary(std::size_t dst) {
+      const Nest nest{*this};
+      if (failed_) return {.known = true};
+      const std::string_view o = op();
+      if (o == "++" || o == "--") {
+         const std::size_t at = i_;
+         i_ += 2;
+         std::string_view n;
+         if (name(n)) {
+            const std::size_t var = intern(prog_->names_, n);
+            emit(ArithOp::Load, dst, var);
+            emit(o == "++" ? ArithOp::Inc : ArithOp::Dec, dst, dst);
+            emit(ArithOp::Store, dst, var);
+            return {};
+         }
+         // Not followed by a name: two signs, as in bash.
+         i_ = at;
+      }
+      if (o == "-" || o == "+" || o == "!" || o == "~" || o == "++" ||
+          o == "--") {
+         ++i_;
+         const Operand v = unary(dst);
+         switch (o.front()) {
+         case '-':
+            return fold(ArithOp::Neg, v, dst);
+         case '!':
+            return fold(ArithOp::Not, v, dst);
+         case '~':
+            return fold(ArithOp::BitNot, v, dst);
+         default:
+            return v;
+         }
+      }
+      return primary(dst);
+   }
+
+   Operand primary(std::size_t dst) {
+      if (accept("(")) {
+         const Operand v = comma(dst);
+         expect(")");
+         return v;
+      }
+      space();
+      std::string_view n;
+      if (param(n)) {
+         emit(ArithOp::Param, dst, intern(prog_->params_, n));
+         return {};
+      }
+      if (name(n)) {
+         const std::size_t var = intern(prog_->names_, n);
+         emit(ArithOp::Load, dst, var);
+         const std::string_view o = op();
+         if (o == "++" || o == "--") {
+            i_ += 2;
+            const std::size_t t = reg(dst + 1);
+            emit(o == "++" ? ArithOp::Inc : ArithOp::Dec, t, dst);
+            emit(ArithOp::Store, t, var);
+         }
+         return {};
+      }
+      if (is_digit(peek())) return number();
+      if (i_ >= src_.size())
+         fail("expression expected");
+      else
+         fail("unexpected '" + rest() + "'");
+      return {.known = true};
+   }
+
+   Operand number() {
+      const std::size_t at = i_;
+      while (i_ < src_.size() && is_name_char(src_[i_])) ++i_;
+      const std::string_view text = src_.substr(at, i_ - at);
+      std::uint64_t m = 0;
+      bool overflow = false;
+      if (peek() == '#') {
+         fail("base#number constants are not supported");
+      } else if (!parse_magnitude(text, m, overflow) ||
+                 m > static_cast<std::uint64_t>(kIntMax)) {
+         i_ = at;
+         fail(overflow || m > static_cast<std::uint64_t>(kIntMax)
+                 ? "integer overflow"
+                 : "invalid number '" + std::string{text} + "'");
+      }
+      return {.known = true, .value = static_cast<Int>(m)};
+   }
+
+   static constexpr std::size_t kMax =
+      std::numeric_limits<std::uint16_t>::max();
+
+   std::string_view src_;
+   std::size_t i_{0};
+   std::size_t depth_{0};
+   std::shared_ptr<ArithProgram> prog_;
+   bool failed_{false};
+   std::string message_;
+   std::size_t error_offset_{0};
+};
+
+ArithCompileResult compile_arith(std::string_view source) {
+   return ArithCompiler{source}.compile();
+}
+
+std::optional<std::string_view>
+arith_command_body(std::string_view pattern) noexcept {
+   if (!pattern.starts_with("((")) return std::nullopt;
+   std::size_t e = 2;
+   while (e < pattern.size() && pattern[e] != ')')
+      e += (pattern[e] == '\\') ? 2 : 1;
+   if (pattern.substr(e) != "))") return std::nullopt;
+   return pattern.substr(2, e - 2);
+}
+
+std::optional<std::string_view>
+arith_subst_body(std::string_view body) noexcept {
+   if (body.size() < 2 || body.front() != '(' || body.back() != ')')
+      return std::nullopt;
+   const std::string_view inner = body.substr(1, body.size() - 2);
+   int depth = 0;
+   for (const char c : inner) {
+      if (c == '(') ++depth;
+      if (c == ')' && --depth < 0) return std::nullopt;
+   }
+   return inner;
+}
+
+const ArithProgram* find_arith(std::span<const ArithProgramPtr> programs,
+                               std::string_view source) noexcept {
+   for (const ArithProgramPtr& p : programs)
+      if (p->source() == source) return p.get();
+   return nullptr;
+}
+
+bool compile_word_arith(std::string_view pattern,
+                        std::pmr::vector<ArithProgramPtr>& programs,
+                        std::string& err) {
+   for (std::size_t k = 0; k + 1 < pattern.size();) {
+      if (pattern[k] == '\\') {
+         k += 2;
+         continue;
+      }
+      const bool subst = pattern[k] == '$' && pattern[k + 1] == '(';
+      if (!subst && !(pattern[k] == '@' && pattern[k + 1] == '(')) {
+         ++k;
+         continue;
+      }
+      // Bodies are escaped throughout: the first bare ')' closes them.
+      std::size_t e = k + 2;
+      while (e < pattern.size() && pattern[e] != ')')
+         e += (pattern[e] == '\\') ? 2 : 1;
+      if (subst) {
+         const std::pmr::string body =
+            pattern_literal(pattern.substr(k + 2, e - k - 2));
+         const std::optional<std::string_view> source = arith_subst_body(body);
+         if (source && !find_arith(programs, *source)) {
+            ArithCompileResult r = compile_arith(*source);
+            if (!r.program) {
+               err = "$((" + std::string{*source} + ")): " + r.message;
+               return false;
+            }
+            programs.push_back(std::move(r.program));
+         }
+      }
+      k = e + 1;
+   }
+   return true;
+}
+
+// ---- VM ----
+
+bool ArithVM::run(const ArithProgram& program, VarStore& vars,
+                  const ArithParams& params, Int& out, std::string& err) {
+   if (program.constant_) {
+      out = *program.constant_;
+      return true;
+   }
+   // Interning a name can grow the table and move the slots found so far.
+   while (program.layout_ != vars.layout()) {
+      program.layout_ = vars.layout();
+      program.slots_.clear();
+      for (const std::string& n : program.names_)
+         program.slots_.push_back(vars.slot(n));
+   }
+   if (regs_.size() < program.registers_) regs_.resize(program.registers_);
+
+   Int* r = regs_.data();
+   const ArithInstr* code = program.code_.data();
+   const std::size_t size = program.code_.size();
+   for (std::size_t pc = 0; pc < size;) {
+      const ArithInstr& in = code[pc++];
+      switch (in.op) {
+      case ArithOp::Const:
+         r[in.a] = program.consts_[in.b];
+         break;
+      case ArithOp::Load: {
+         const VarStore::Var& v = vars.var_at(program.slots_[in.b]);
+         if (!v.set) {
+            r[in.a] = 0;
+         } else if (const Int* i = v.value.as_int()) {
+            r[in.a] = *i;
+         } else if (!read_int(v.value, r[in.a])) {
+            err = program.names_[in.b] + ": not an integer";
+            return false;
+         }
+         break;
+      }
+      case ArithOp::Store:
+         vars.set_at(program.slots_[in.b], Value{r[in.a]});
+         break;
+      case ArithOp::Param: {
+         const std::string& p = program.params_[in.b];
+         if (p == "#") {
+            r[in.a] = static_cast<Int>(params.args.size());
+         } else if (p == "?") {
+            r[in.a] = params.status;
+         } else if (p == "$") {
+            r[in.a] = vars.shell_pid();
+         } else {
+            std::size_t n = 0;
+            std::from_chars(p.data(), p.data() + p.size(), n);
+            std::string_view text;
+            if (n == 0)
+               text = "clanker";
+            else if (n <= params.args.size())
+               text = params.args[n - 1];
+            if (!parse_int(text, r[in.a])) {
+               err = "$" + p + ": not an integer";
+               return false;
+            }
+         }
+         break;
+      }
+      case ArithOp::Jump:
+         pc = in.c;
+         break;
+      case ArithOp::JumpIfZero:
+         if (r[in.a] == 0) pc = in.c;
+         break;
+      case ArithOp::JumpIfNonZero:
+         if (r[in.a] != 0) pc = in.c;
+         break;
+      case ArithOp::Neg:
+      case ArithOp::Not:
+      case ArithOp::BitNot:
+      case ArithOp::Bool:
+      case ArithOp::Inc:
+      case ArithOp::Dec:
+         if (!apply(in.op, r[in.b], r[in.a], err)) return false;
+         break;
+      default:
+         if (!apply(in.op, r[in.b], r[in.c], r[in.a], err)) return false;
+         break;
+      }
+   }
+   out = r[0];
+   return true;
+}
+
+} // namespace clanker
@@ -0,0 +1,179 @@
+// src/clanker/arith.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "clanker/vars.h"
+
+namespace clanker {
+
+// Shell arithmetic: the body of $(( ... )) and of the (( ... )) command
+// (execution-model.md §3.7).
+//
+// Values are Value::Int and every operation is checked: an overflow, a
+// division by zero or a shift out of range is an error, never a wrapped
+// result. Grammar, loosest binding first, as in bash:
+//   comma   := assign {',' assign}
+//   assign  := NAME ('=' | '+=' | '-=' | '*=' | '/=' | '%=' | '<<=' | '>>='
+//                    | '&=' | '^=' | '|=') assign
+//            | cond
+//   cond    := lor ['?' comma ':' cond]
+//   lor     := land {'||' land}
+//   land    := bor {'&&' bor}
+//   bor     := bxor {'|' bxor}
+//   bxor    := band {'^' band}
+//   band    := eq {'&' eq}
+//   eq      := rel {('==' | '!=') rel}
+//   rel     := shift {('<' | '<=' | '>' | '>=') shift}
+//   shift   := add {('<<' | '>>') add}
+//   add     := mul {('+' | '-') mul}
+//   mul     := pow {('*' | '/' | '%') pow}
+//   pow     := unary ['**' pow]
+//   unary   := ('-' | '+' | '!' | '~') unary | ('++' | '--') NAME
+//            | NAME ['++' | '--'] | NUMBER | '(' comma ')'
+// NUMBER is decimal, 0x hexadecimal or 0 octal. NAME may also be written
+// $NAME or ${NAME}; $1 ${10} $# $? and $$ read the special parameters.
+// Reading a variable gives 0 if it is unset or empty; otherwise its value
+// must be an integer. Assignments store a Value::Int.
+//
+// Constant sub-expressions are folded when the program is compiled, so
+// $((60 * 60 * 24)) is a constant and `i + 2 * 3` one addition.
+
+enum class ArithOp : std::uint8_t {
+   Const,         // r[a] = consts[b]
+   Load,          // r[a] = the variable names[b]
+   Store,         // the variable names[b] = r[a]
+   Param,         // r[a] = the special parameter params[b]
+   Add,           // r[a] = r[b] + r[c], and so on
+   Sub,
+   Mul,
+   Div,
+   Mod,
+   Pow,
+   Shl,
+   Shr,
+   BitAnd,
+   BitOr,
+   BitXor,
+   Lt,
+   Le,
+   Gt,
+   Ge,
+   Eq,
+   Ne,
+   Neg,           // r[a] = -r[b]
+   Not,           // r[a] = !r[b]
+   BitNot,        // r[a] = ~r[b]
+   Bool,          // r[a] = r[b] != 0
+   Inc,           // r[a] = r[b] + 1
+   Dec,           // r[a] = r[b] - 1
+   Jump,          // pc = c
+   JumpIfZero,    // if r[a] == 0: pc = c
+   JumpIfNonZero, // if r[a] != 0: pc = c
+};
+
+struct ArithInstr {
+   ArithOp op;
+   std::uint16_t a{0};
+   std::uint16_t b{0};
+   std::uint16_t c{0};
+};
+
+// A compiled arithmetic expression; the result is left in register 0.
+// Shared by every copy of the AST, like ExprProgram, but not immutable:
+// the first run against a VarStore resolves its names to that store's
+// slots and keeps them until the store's layout changes, so a program is
+// run by one thread at a time.
+class ArithProgram {
+ public:
+   [[nodiscard]] const std::string& source() const noexcept { return source_; }
+
+   // The value, if the whole expression folded to a constant.
+   [[nodiscard]] std::optional<Value::Int> constant() const noexcept {
+      return constant_;
+   }
+
+   [[nodiscard]] const std::vector<ArithInstr>& code() const noexcept {
+      return code_;
+   }
+
+ private:
+   friend class ArithCompiler;
+   friend class ArithVM;
+
+   std::string source_;
+   std::vector<ArithInstr> code_;
+   std::vector<Value::Int> consts_;
+   std::vector<std::string> names_;
+   std::vector<std::string> params_; // "1", "#", "?", "$"
+   std::uint16_t registers_{1};
+   std::optional<Value::Int> constant_;
+
+   // names_ as slots of the store whose layout() is `layout_`.
+   mutable std::vector<std::uint32_t> slots_;
+   mutable std::uint64_t layout_{0};
+};
+
+using ArithProgramPtr = std::shared_ptr<const ArithProgram>;
+
+struct ArithCompileResult {
+   ArithProgramPtr program; // null on error
+   std::string message;
+   std::size_t error_offset{0}; // into the source
+};
+
+[[nodiscard]] ArithCompileResult compile_arith(std::string_view source);
+
+// The body of `((body))`, still in pattern form, if word pattern `pattern`
+// (lexer.h, "Word patterns") is an arithmetic command: a WORD that starts
+// with a bare "((" and ends with the "))" closing it.
+[[nodiscard]] std::optional<std::string_view>
+arith_command_body(std::string_view pattern) noexcept;
+
+// The arithmetic of $(( body )) if `body` is the inside of a $( ... )
+// substitution whose parentheses make it one; as in bash, $( (a) ) with a
+// blank is a command substitution instead.
+[[nodiscard]] std::optional<std::string_view>
+arith_subst_body(std::string_view body) noexcept;
+
+// Compile every $(( )) in word pattern `pattern` that is not in `programs`
+// yet and append it. Returns false with `err` set at the first one that
+// does not compile.
+[[nodiscard]] bool
+compile_word_arith(std::string_view pattern,
+                   std::pmr::vector<ArithProgramPtr>& programs,
+                   std::string& err);
+
+// The program in `programs` compiled from `source`; null if there is none.
+[[nodiscard]] const ArithProgram*
+find_arith(std::span<const ArithProgramPtr> programs,
+           std::string_view source) noexcept;
+
+// The special parameters an expression can read besides $$.
+struct ArithParams {
+   std::span<const std::pmr::string> args{}; // $1...
+   int status{0};                            // $?
+};
+
+// Runs programs against a VarStore. Registers are kept between runs.
+class ArithVM {
+ public:
+   // The value of `program`; false with `err` set on a runtime error.
+   // Assignments before the error stay made.
+   [[nodiscard]] bool run(const ArithProgram& program, VarStore& vars,
+                          const ArithParams& params, Value::Int& out,
+                          std::string& err);
+
+ private:
+   std::vector<Value::Int> regs_;
+};
+
+} // namespace clanker
@@ -1,12 +1,26 @@
 // src/clanker/ast.h
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace clanker {
 
+// AST nodes are allocator-aware: a node built with a memory_resource hands
+// it to every nested container, so a whole parsed unit (tokens, nodes, argv
+// strings) can live in one per-unit arena. Default construction uses the
+// default resource, as with any std::pmr container.
+using AstAllocator = std::pmr::polymorphic_allocator<>;
+
+class ExprProgram;  // expr.h
+class ArithProgram; // arith.h
+struct CompoundCommand;
+
 enum class RedirKind {
    In,        // <
    OutTrunc,  // >
@@ -14,18 +28,88 @@ enum class RedirKind {
 };
 
 struct Redirection {
+   using allocator_type = AstAllocator;
+
    int fd = -1;            // default 0 for <, default 1 for > / >>
    RedirKind kind{};
-   std::string target;     // filename (WORD)
+   std::pmr::string target; // filename (WORD)
+
+   Redirection() = default;
+   explicit Redirection(const allocator_type& a)
+      : target(a) {}
+   Redirection(const Redirection& o, const allocator_type& a)
+      : fd(o.fd)
+      , kind(o.kind)
+      , target(o.target, a) {}
+   Redirection(Redirection&& o, const allocator_type& a)
+      : fd(o.fd)
+      , kind(o.kind)
+      , target(std::move(o.target), a) {}
+   Redirection(const Redirection&) = default;
+   Redirection(Redirection&&) = default;
+   Redirection& operator=(const Redirection&) = default;
+   Redirection& operator=(Redirection&&) = default;
 };
 
 struct SimpleCommand {
-   std::vector<std::string> argv;
-   std::vector<Redirection> redirs;
+   using allocator_type = AstAllocator;
+
+   std::pmr::vector<std::pmr::string> argv;
+   std::pmr::vector<Redirection> redirs;
+
+   // NAME=value words before the command name, in order, as patterns.
+   // They are expanded as they are bound (expand_assignment). With no argv
+   // they set shell variables, otherwise they are exported to the command
+   // alone.
+   std::pmr::vector<std::pmr::string> assigns;
+
+   // Indices into argv of words that contain an unquoted brace group, an
+   // unquoted '*', '?' or '[', or a command substitution or @( )
+   // expression. Those words hold a pattern (lexer.h, "Word patterns") and
+   // are expanded before execution; see expand.h.
+   std::pmr::vector<std::uint32_t> brace_words;
+   std::pmr::vector<std::uint32_t> glob_words;
+   std::pmr::vector<std::uint32_t> subst_words;
+
+   // The @( ) expressions of subst_words and assigns, compiled by the
+   // parser; one per distinct body.
+   std::pmr::vector<std::shared_ptr<const ExprProgram>> exprs;
+
+   // Likewise the $(( )) expressions (arith.h). Arith: the (( )) body.
+   std::pmr::vector<std::shared_ptr<const ArithProgram>> ariths;
+
+   // An if/while/until/for standing where a simple command would (at most
+   // one element). argv and assigns are then empty and `redirs` apply to
+   // the whole construct.
+   std::pmr::vector<CompoundCommand> compound;
+
+   SimpleCommand() = default;
+   // Defined below CompoundCommand, which must be complete.
+   explicit SimpleCommand(const allocator_type& a);
+   SimpleCommand(const SimpleCommand& o, const allocator_type& a);
+   SimpleCommand(SimpleCommand&& o, const allocator_type& a);
+   SimpleCommand(const SimpleCommand&) = default;
+   SimpleCommand(SimpleCommand&&) = default;
+   SimpleCommand& operator=(const SimpleCommand&) = default;
+   SimpleCommand& operator=(SimpleCommand&&) = default;
 };
 
 struct Pipeline {
-   std::vector<SimpleCommand> stages; // size >= 1
+   using allocator_type = AstAllocator;
+
+   std::pmr::vector<SimpleCommand> stages; // size >= 1
+
+   Pipeline() = default;
+   explicit Pipeline(const allocator_type& a)
+      : stages(a) {}
+   Pipeline(const Pipeline& o, const allocator_type& a)
+      : stages(o.stages, a) {}
+   Pipeline(Pipeline&& o, const allocator_type& a)
+      : stages(std::move(o.stages), a) {}
+   Pipeline(const Pipeline&) = default;
+   Pipeline(Pipeline&&) = default;
+   Pipeline& operator=(const Pipeline&) = default;
+   Pipeline& operator=(Pipeline&&) = default;
 };
 
 enum class AndOrOp {
@@ -34,13 +118,46 @@ enum class AndOrOp {
 };
 
 struct AndOrTail {
-   AndOrOp op;
+   using allocator_type = AstAllocator;
+
+   AndOrOp op{};
    Pipeline rhs;
+
+   AndOrTail() = default;
+   explicit AndOrTail(const allocator_type& a)
+      : rhs(a) {}
+   AndOrTail(const AndOrTail& o, const allocator_type& a)
+      : op(o.op)
+      , rhs(o.rhs, a) {}
+   AndOrTail(AndOrTail&& o, const allocator_type& a)
+      : op(o.op)
+      , rhs(std::move(o.rhs), a) {}
+   AndOrTail(const AndOrTail&) = default;
+   AndOrTail(AndOrTail&&) = default;
+   AndOrTail& operator=(const AndOrTail&) = default;
+   AndOrTail& operator=(AndOrTail&&) = default;
 };
 
 struct AndOr {
+   using allocator_type = AstAllocator;
+
    Pipeline first;
-   std::vector<AndOrTail> rest; // each tail is (op, rhs)
+   std::pmr::vector<AndOrTail> rest; // each tail is (op, rhs)
+
+   AndOr() = default;
+   explicit AndOr(const allocator_type& a)
+      : first(a)
+      , rest(a) {}
+   AndOr(const AndOr& o, const allocator_type& a)
+      : first(o.first, a)
+      , rest(o.rest, a) {}
+   AndOr(AndOr&& o, const allocator_type& a)
+      : first(std::move(o.first), a)
+      , rest(std::move(o.rest), a) {}
+   AndOr(const AndOr&) = default;
+   AndOr(AndOr&&) = default;
+   AndOr& operator=(const AndOr&) = default;
+   AndOr& operator=(AndOr&&) = default;
 };
 
 enum class Terminator {
@@ -51,15 +168,144 @@ enum class Terminator {
 };
 
 struct CommandListItem {
+   using allocator_type = AstAllocator;
+
    AndOr cmd;
-   Terminator term; // terminator that followed this command
+   Terminator term{}; // terminator that followed this command
+
+   CommandListItem() = default;
+   explicit CommandListItem(const allocator_type& a)
+      : cmd(a) {}
+   CommandListItem(const CommandListItem& o, const allocator_type& a)
+      : cmd(o.cmd, a)
+      , term(o.term) {}
+   CommandListItem(CommandListItem&& o, const allocator_type& a)
+      : cmd(std::move(o.cmd), a)
+      , term(o.term) {}
+   CommandListItem(const CommandListItem&) = default;
+   CommandListItem(CommandListItem&&) = default;
+   CommandListItem& operator=(const CommandListItem&) = default;
+   CommandListItem& operator=(CommandListItem&&) = default;
 };
 
 struct CommandList {
-   std::vector<CommandListItem> items;
+   using allocator_type = AstAllocator;
+
+   std::pmr::vector<CommandListItem> items;
    std::optional<Terminator>
       trailing; // present only if input ends with ;, NEWLINE, or &
+
+   CommandList() = default;
+   explicit CommandList(const allocator_type& a)
+      : items(a) {}
+   CommandList(const CommandList& o, const allocator_type& a)
+      : items(o.items, a)
+      , trailing(o.trailing) {}
+   CommandList(CommandList&& o, const allocator_type& a)
+      : items(std::move(o.items), a)
+      , trailing(o.trailing) {}
+   CommandList(const CommandList&) = default;
+   CommandList(CommandList&&) = default;
+   CommandList& operator=(const CommandList&) = default;
+   CommandList& operator=(CommandList&&) = default;
 };
 
-} // namespace clanker
+enum class CompoundKind : std::uint8_t {
+   If,
+   While,
+   Until,
+   For,
+   Group,    // { list; }
+   Function, // NAME() compound-command: defines NAME when run
+   Arith,    // (( expression )): true if its value is not 0
+   Case,     // case WORD in PATTERN[|PATTERN]...) list ;; ... esac
+};
+
+struct CompoundCommand {
+   using allocator_type = AstAllocator;
+
+   CompoundKind kind{};
+
+   // If: the condition and body of the `if` and of each `elif`, then the
+   // `else` body if there is one. While / Until: condition, body. For,
+   // Group: body. Function: a list of one command, the body compound
+   // command with its redirections. Case: the body of each arm, which
+   // alone may be empty. No other list is empty.
+   std::pmr::vector<CommandList> lists;
 
+   // For: the loop variable, and the words after `in` held as the argv of
+   // a command so they expand the same way. Without `in` the loop runs over
+   // the positional parameters (`in_words` false). Function: its name.
+   // Arith: the expression, compiled into `words.ariths`; no lists.
+   // Case: `words` holds the subject word, then every pattern, all in
+   // pattern form (lexer.h, "Word patterns") whatever their flags.
+   std::pmr::string name;
+   SimpleCommand words;
+   bool in_words{true};
+
+   // Case: for each pattern (words.argv[1...]), the index of its arm in
+   // `lists`; never decreasing.
+   std::pmr::vector<std::uint32_t> arms;
+
+   CompoundCommand() = default;
+   explicit CompoundCommand(const allocator_type& a)
+      : lists(a)
+      , name(a)
+      , words(a)
+      , arms(a) {}
+   CompoundCommand(const CompoundCommand& o, const allocator_type& a)
+      : kind(o.kind)
+      , lists(o.lists, a)
+      , name(o.name, a)
+      , words(o.words, a)
+      , in_words(o.in_words)
+      , arms(o.arms, a) {}
+   CompoundCommand(CompoundCommand&& o, const allocator_type& a)
+      : kind(o.kind)
+      , lists(std::move(o.lists), a)
+      , name(std::move(o.name), a)
+      , words(std::move(o.words), a)
+      , in_words(o.in_words)
+      , arms(std::move(o.arms), a) {}
+   CompoundCommand(const CompoundCommand&) = default;
+   CompoundCommand(CompoundCommand&&) = default;
+   CompoundCommand& operator=(const CompoundCommand&) = default;
+   CompoundCommand& operator=(CompoundCommand&&) = default;
+};
+
+inline SimpleCommand::SimpleCommand(const allocator_type& a)
+   : argv(a)
+   , redirs(a)
+   , assigns(a)
+   , brace_words(a)
+   , glob_words(a)
+   , subst_words(a)
+   , exprs(a)
+   , ariths(a)
+   , compound(a) {}
+
+inline SimpleCommand::SimpleCommand(const SimpleCommand& o,
+                                    const allocator_type& a)
+   : argv(o.argv, a)
+   , redirs(o.redirs, a)
+   , assigns(o.assigns, a)
+   , brace_words(o.brace_words, a)
+   , glob_words(o.glob_words, a)
+   , subst_words(o.subst_words, a)
+   , exprs(o.exprs, a)
+   , ariths(o.ariths, a)
+   , compound(o.compound, a) {}
+
+inline SimpleCommand::SimpleCommand(SimpleCommand&& o,
+                                    const allocator_type& a)
+   : argv(std::move(o.argv), a)
+   , redirs(std::move(o.redirs), a)
+   , assigns(std::move(o.assigns), a)
+   , brace_words(std::move(o.brace_words), a)
+   , glob_words(std::move(o.glob_words), a)
+   , subst_words(std::move(o.subst_words), a)
+   , exprs(std::move(o.exprs), a)
+   , ariths(std::move(o.ariths), a)
+   , compound(std::move(o.compound), a) {}
+
+} // namespace clanker
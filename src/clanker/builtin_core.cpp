@@ -1,25 +1,36 @@
 // src/clanker/builtin_core.cpp
 
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
+#include <initializer_list>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
+#include <vector>
 
+#include "clanker/builtin_core.h"
 #include "clanker/builtins.h"
+#include "clanker/input.h"
+#include "clanker/output.h"
+#include "clanker/parse_cache.h"
 #include "clanker/util.h"
+#include "clanker/vars.h"
 
 namespace clanker {
 namespace {
 
-int write_line(int fd, std::string_view s) {
-   std::string line;
-   line.reserve(s.size() + 1);
-   line.append(s);
-   line.push_back('\n');
-   return fd_write_all(fd, line) ? 0 : 1;
+// One line on the built-in's standard error, from `pieces`.
+int write_err(const BuiltinContext& ctx,
+              std::initializer_list<std::string_view> pieces) {
+   OutputSink err = errors_of(ctx);
+   return err.line(pieces) ? 0 : 1;
 }
 
-int write_err(int fd, std::string_view s) { return write_line(fd, s); }
+int write_err(const BuiltinContext& ctx, std::string_view s) {
+   return write_err(ctx, {s});
+}
 
 std::filesystem::path canon(const std::filesystem::path& p) {
    // weakly_canonical tolerates non-existent paths better than canonical().
@@ -90,36 +101,168 @@ std::string root_relative_display(const std::filesystem::path& root,
    return "/" + rel.generic_string();
 }
 
-Builtins* g_for_help = nullptr;
+// Write `s` single-quoted so that the shell reads it back unchanged.
+void write_quoted(OutputSink& out, std::string_view s) {
+   out.write("'");
+   for (std::size_t q; (q = s.find('\'')) != std::string_view::npos;
+        s.remove_prefix(q + 1))
+      out.write({s.substr(0, q), "'\\''"});
+   out.write({s, "'"});
+}
+
+// Write `var` as a command that recreates it: `prefix` NAME='value'. A
+// value with no argv form is left out.
+void print_var(OutputSink& out, std::string_view prefix,
+               std::string_view name, const VarStore::Var& var) {
+   std::string value;
+   std::string err;
+   if (!lower_value(var.value, value, err)) return;
+   out.write({prefix, name, "="});
+   write_quoted(out, value);
+   out.write("\n");
+}
+
+// Print every set variable (or every exported one) with print_var.
+int print_vars(const BuiltinContext& ctx, std::string_view prefix,
+               bool exported_only) {
+   OutputSink out = output_of(ctx);
+   for (const auto& [name, var] : ctx.vars->list())
+      if (!exported_only || var->exported) print_var(out, prefix, name, *var);
+   return out.flush() ? 0 : 1;
+}
+
+// Apply NAME[=value] operands. `each` runs for every valid name before its
+// value (if any) is set; it may fail the operand.
+template<class F>
+int bind_operands(const BuiltinContext& ctx, std::string_view who,
+                  std::span<const std::pmr::string> operands, F each) {
+   int status = 0;
+   for (const auto& arg : operands) {
+      const std::size_t eq = arg.find('=');
+      const std::string_view name = std::string_view{arg}.substr(0, eq);
+      if (!VarStore::is_name(name)) {
+         write_err(ctx, {who, ": `", arg, "': not a valid identifier"});
+         status = 1;
+         continue;
+      }
+      if (!each(name)) {
+         status = 1;
+         continue;
+      }
+      if (eq != std::string::npos) {
+         const std::string_view value = std::string_view{arg}.substr(eq + 1);
+         ctx.vars->set(name, Value{std::string{value}});
+      }
+   }
+   return status;
+}
+
+// One record for `read`. Unless `raw`, a backslash makes the byte after it
+// literal, marked in `literal` (left empty while there is none), a
+// backslash-newline is dropped, and a backslash before the delimiter joins
+// the next record on.
+InputBuffers::Result read_text(InputBuffers& in, int fd, char delim, bool raw,
+                               std::string& text, std::vector<bool>& literal,
+                               int& err) {
+   if (raw) return in.read_record(fd, delim, text, err);
+   std::string rec;
+   for (;;) {
+      rec.clear();
+      const InputBuffers::Result r = in.read_record(fd, delim, rec, err);
+      for (std::size_t i = 0; i < rec.size(); ++i) {
+         if (rec[i] != '\\') {
+            text.push_back(rec[i]);
+            continue;
+         }
+         if (++i == rec.size()) break;
+         if (rec[i] == '\n') continue; // a line continuation, as in bash
+         literal.resize(text.size() + 1);
+         literal.back() = true;
+         text.push_back(rec[i]);
+      }
+      if (r != InputBuffers::Result::Record || !rec.ends_with('\\'))
+         return r;
+      // An odd run of backslashes at the end escapes the delimiter.
+      const std::size_t last = rec.find_last_not_of('\\');
+      const std::size_t run = rec.size() - (last == std::string::npos
+                                               ? 0
+                                               : last + 1);
+      if (run % 2 == 0) return r;
+   }
+}
+
+// Assign the fields of `text` to `names` as `read` does: IFS whitespace
+// around the fields is dropped, a run of it separates two fields, and so
+// does each other IFS byte with the whitespace around it. The last name
+// gets the rest of the text, less a trailing delimiter if only one field
+// is left. Escaped bytes never separate.
+void assign_fields(VarStore& vars, std::span<const std::pmr::string> names,
+                   std::string_view text, const std::vector<bool>& literal,
+                   std::string_view ifs) {
+   const std::size_t n = text.size();
+   const auto sep = [&](std::size_t i) {
+      return !(i < literal.size() && literal[i]) &&
+             ifs.find(text[i]) != std::string_view::npos;
+   };
+   const auto space = [&](std::size_t i) {
+      return sep(i) && (text[i] == ' ' || text[i] == '\t' || text[i] == '\n');
+   };
+   const auto skip_delimiter = [&](std::size_t& i) {
+      while (i < n && space(i)) ++i;
+      if (i < n && sep(i) && !space(i)) ++i;
+      while (i < n && space(i)) ++i;
+   };
+
+   std::size_t pos = 0;
+   while (pos < n && space(pos)) ++pos;
+   for (std::size_t k = 0; k + 1 < names.size(); ++k) {
+      const std::size_t start = pos;
+      while (pos < n && !sep(pos)) ++pos;
+      vars.set(names[k], Value{std::string{text.substr(start, pos - start)}});
+      skip_delimiter(pos);
+   }
+
+   std::size_t end = n;
+   while (end > pos && space(end - 1)) --end;
+   std::size_t word = pos;
+   while (word < end && !sep(word)) ++word;
+   std::size_t after = word;
+   skip_delimiter(after);
+   if (after >= end) end = word;
+   vars.set(names.back(), Value{std::string{text.substr(pos, end - pos)}});
+}
 
 } // namespace
 
-static int bi_exit(const BuiltinContext&, const Argv& argv) {
+int bi_exit(const BuiltinContext& ctx, const Argv& argv) {
    int code = 0;
    if (argv.size() >= 2) code = to_int(argv[1]).value_or(0);
-   std::exit(code);
+   if (!ctx.exit_request) std::exit(code);
+   *ctx.exit_request = code;
+   return code;
 }
 
-static int bi_pwd(const BuiltinContext& ctx, const Argv& argv) {
+int bi_pwd(const BuiltinContext& ctx, const Argv& argv) {
    const bool relative =
       (argv.size() >= 2) && (argv[1] == "--relative" || argv[1] == "-r");
 
    if (!ctx.cwd) {
-      write_err(ctx.err_fd, "pwd: internal error (cwd not set)");
+      write_err(ctx, "pwd: internal error (cwd not set)");
       return 2;
    }
    const std::filesystem::path cwd = *ctx.cwd;
 
-   if (relative) {
-      return write_line(ctx.out_fd, root_relative_display(ctx.root, cwd));
-   }
-
-   return write_line(ctx.out_fd, cwd.string());
+   OutputSink out = output_of(ctx);
+   if (relative)
+      out.line(root_relative_display(ctx.root, cwd));
+   else
+      out.line(cwd.native());
+   return out.flush() ? 0 : 1;
 }
 
-static int bi_cd(const BuiltinContext& ctx, const Argv& argv) {
+int bi_cd(const BuiltinContext& ctx, const Argv& argv) {
    if (!ctx.cwd) {
-      write_err(ctx.err_fd, "cd: internal error (cwd not set)");
+      write_err(ctx, "cd: internal error (cwd not set)");
       return 2;
    }
 
@@ -130,15 +273,14 @@ static int bi_cd(const BuiltinContext& ctx, const Argv& argv) {
    if (argv.size() == 1) arg = std::string_view{};
 
    if (arg == "-" && (!ctx.oldpwd || ctx.oldpwd->empty())) {
-      write_err(ctx.err_fd, "cd: OLDPWD not set");
+      write_err(ctx, "cd: OLDPWD not set");
       return 1;
    }
 
    const std::filesystem::path raw = resolve_cd_target(ctx, arg);
    if (raw.empty()) {
-      write_err(ctx.err_fd, (arg.size() && arg[0] == '~')
-                               ? "cd: unsupported ~ form"
-                               : "cd: invalid target");
+      write_err(ctx, (arg.size() && arg[0] == '~') ? "cd: unsupported ~ form"
+                                                   : "cd: invalid target");
       return 1;
    }
 
@@ -146,16 +288,14 @@ static int bi_cd(const BuiltinContext& ctx, const Argv& argv) {
 
    // Enforce root sandbox for cd.
    if (!within_root(ctx.root, dest)) {
-      write_err(ctx.err_fd, "cd: blocked (outside root)");
+      write_err(ctx, "cd: blocked (outside root)");
       return 1;
    }
 
    std::error_code ec;
    std::filesystem::current_path(dest, ec);
    if (ec) {
-      std::string msg = "cd: ";
-      msg += ec.message();
-      write_err(ctx.err_fd, msg);
+      write_err(ctx, {"cd: ", ec.message()});
       return 1;
    }
 
@@ -164,34 +304,249 @@ static int bi_cd(const BuiltinContext& ctx, const Argv& argv) {
    *ctx.cwd = dest;
 
    // bash prints the new directory for "cd -"
-   if (arg == "-") write_line(ctx.out_fd, dest.string());
+   if (arg == "-") {
+      OutputSink out = output_of(ctx);
+      out.line(dest.native());
+   }
 
    return 0;
 }
 
-static int bi_help(const BuiltinContext& ctx, const Argv&) {
-   if (!g_for_help) return 1;
+int bi_export(const BuiltinContext& ctx, const Argv& argv) {
+   if (!ctx.vars) {
+      write_err(ctx, "export: not available");
+      return 1;
+   }
+   std::size_t i = 1;
+   bool unexport = false;
+   for (; i < argv.size() && argv[i].starts_with('-'); ++i) {
+      if (argv[i] == "--") {
+         ++i;
+         break;
+      }
+      if (argv[i] == "-n") {
+         unexport = true;
+      } else if (argv[i] != "-p") {
+         write_err(ctx, "export: usage: export [-n] [name[=value] ...]");
+         return 2;
+      }
+   }
+   if (i == argv.size()) return print_vars(ctx, "export ", true);
 
-   for (const auto& [name, help] : g_for_help->help_items()) {
-      std::string line;
-      line.reserve(name.size() + 2 + help.size());
-      line += name;
-      line += "  ";
-      line += help;
-      write_line(ctx.out_fd, line);
+   return bind_operands(ctx, "export", std::span{argv}.subspan(i),
+                        [&](std::string_view name) {
+                           ctx.vars->set_exported(name, !unexport);
+                           return true;
+                        });
+}
+
+int bi_unset(const BuiltinContext& ctx, const Argv& argv) {
+   if (!ctx.vars) {
+      write_err(ctx, "unset: not available");
+      return 1;
    }
+   std::size_t i = 1;
+   bool functions = false;
+   if (i < argv.size() && (argv[i] == "-v" || argv[i] == "-f")) {
+      functions = argv[i] == "-f";
+      ++i;
+   }
+   if (i < argv.size() && argv[i] == "--") ++i;
+   int status = 0;
+   for (; i < argv.size(); ++i) {
+      if (!VarStore::is_name(argv[i])) {
+         write_err(ctx, {"unset: `", argv[i], "': not a valid identifier"});
+         status = 1;
+         continue;
+      }
+      if (functions)
+         ctx.vars->unset_function(argv[i]);
+      else
+         ctx.vars->unset(argv[i]);
+   }
+   return status;
+}
+
+// Inside a loop, `break` and `continue` are compiled to jumps (ir.h); a
+// command that runs is outside any loop.
+int bi_loop_control(const BuiltinContext& ctx, const Argv& argv) {
+   write_err(ctx, {argv[0],
+                   ": only meaningful in a `for', `while', or `until' loop"});
    return 0;
 }
 
-void add_core_builtins(Builtins& b) {
-   b.add("exit", bi_exit, "exit [n] — exit the shell");
-   b.add("pwd", bi_pwd, "pwd [--relative|-r] — print current directory");
-   b.add("cd", bi_cd,
-         "cd [dir|-|~|~/path] — change directory (restricted to root)");
-   b.add("help", bi_help, "help — list built-ins");
+// Inside a function body `return` is compiled to the end of the call
+// (ir.h); a command that runs is outside any function.
+int bi_return(const BuiltinContext& ctx, const Argv&) {
+   write_err(ctx, "return: can only `return' from a function");
+   return 1;
 }
 
-void set_help_registry(Builtins& b) { g_for_help = &b; }
+int bi_local(const BuiltinContext& ctx, const Argv& argv) {
+   if (!ctx.vars || ctx.vars->depth() == 0) {
+      write_err(ctx, "local: can only be used in a function");
+      return 1;
+   }
+   return bind_operands(ctx, "local", std::span{argv}.subspan(1),
+                        [&](std::string_view name) {
+                           return ctx.vars->make_local(name);
+                        });
+}
+
+// declare [-x|+x] [-p] [name[=value] ...]: in a function, like local.
+int bi_declare(const BuiltinContext& ctx, const Argv& argv) {
+   if (!ctx.vars) {
+      write_err(ctx, "declare: not available");
+      return 1;
+   }
+   std::size_t i = 1;
+   std::optional<bool> exported;
+   bool print = false;
+   for (; i < argv.size() && (argv[i].starts_with('-') ||
+                              argv[i].starts_with('+'));
+        ++i) {
+      if (argv[i] == "--") {
+         ++i;
+         break;
+      }
+      if (argv[i] == "-x" || argv[i] == "+x") {
+         exported = argv[i] == "-x";
+      } else if (argv[i] == "-p") {
+         print = true;
+      } else {
+         write_err(ctx,
+                   "declare: usage: declare [-x|+x] [-p] [name[=value] ...]");
+         return 2;
+      }
+   }
+   if (i == argv.size())
+      return print_vars(ctx, exported.value_or(false) ? "export " : "",
+                        exported.value_or(false));
+   if (print) {
+      int status = 0;
+      OutputSink out = output_of(ctx);
+      for (std::size_t k = i; k < argv.size(); ++k) {
+         if (const VarStore::Var* v = ctx.vars->find(argv[k])) {
+            print_var(out, v->exported ? "export " : "", argv[k], *v);
+         } else {
+            write_err(ctx, {"declare: ", argv[k], ": not found"});
+            status = 1;
+         }
+      }
+      return out.flush() ? status : 1;
+   }
+
+   return bind_operands(ctx, "declare", std::span{argv}.subspan(i),
+                        [&](std::string_view name) {
+                           if (ctx.vars->depth() > 0)
+                              (void)ctx.vars->make_local(name);
+                           if (exported)
+                              ctx.vars->set_exported(name, *exported);
+                           return true;
+                        });
+}
+
+// read [-r] [-d delim] [name ...]: one line, or record, of input split
+// into the names; without names it goes to REPLY whole. Input is read
+// ahead through the shell's InputBuffers.
+int bi_read(const BuiltinContext& ctx, const Argv& argv) {
+   if (!ctx.vars || !ctx.input) {
+      write_err(ctx, "read: not available");
+      return 1;
+   }
+   constexpr std::string_view usage = "read: usage: read [-r] [-d delim] "
+                                      "[name ...]";
+   bool raw = false;
+   char delim = '\n';
+   std::size_t i = 1;
+   for (; i < argv.size() && argv[i].starts_with('-') && argv[i] != "-";
+        ++i) {
+      if (argv[i] == "--") {
+         ++i;
+         break;
+      }
+      const std::string_view opt = argv[i];
+      for (std::size_t k = 1; k < opt.size(); ++k) {
+         if (opt[k] == 'r') {
+            raw = true;
+         } else if (opt[k] == 'd') {
+            std::string_view arg = opt.substr(k + 1);
+            if (arg.empty()) {
+               if (++i == argv.size()) {
+                  write_err(ctx, "read: -d: option requires an argument");
+                  write_err(ctx, usage);
+                  return 2;
+               }
+               arg = argv[i];
+            }
+            delim = arg.empty() ? '\0' : arg.front();
+            break;
+         } else {
+            write_err(ctx, {"read: -", opt.substr(k, 1), ": invalid option"});
+            write_err(ctx, usage);
+            return 2;
+         }
+      }
+   }
+   const std::span<const std::pmr::string> names = std::span{argv}.subspan(i);
+   for (const auto& name : names) {
+      if (!VarStore::is_name(name)) {
+         write_err(ctx, {"read: `", name, "': not a valid identifier"});
+         return 1;
+      }
+   }
+
+   std::string text;
+   std::vector<bool> literal;
+   int err = 0;
+   const InputBuffers::Result r =
+      read_text(*ctx.input, ctx.in_fd, delim, raw, text, literal, err);
+   if (r == InputBuffers::Result::Error) {
+      write_err(ctx, {"read: read error: ", std::strerror(err)});
+      return 1;
+   }
+
+   if (names.empty()) {
+      ctx.vars->set("REPLY", Value{std::move(text)});
+   } else {
+      std::string ifs = " \t\n";
+      if (const VarStore::Var* v = ctx.vars->find("IFS")) {
+         std::string lowered;
+         std::string ignored;
+         if (lower_value(v->value, lowered, ignored)) ifs = std::move(lowered);
+      }
+      assign_fields(*ctx.vars, names, text, literal, ifs);
+   }
+   return r == InputBuffers::Result::Record ? 0 : 1;
+}
+
+int bi_help(const BuiltinContext& ctx, const Argv&) {
+   if (!ctx.builtins) {
+      write_err(ctx, "help: not available");
+      return 1;
+   }
+
+   OutputSink out = output_of(ctx);
+   for (const auto& [name, help] : ctx.builtins->help_items())
+      out.line({name, "  ", help});
+   return out.flush() ? 0 : 1;
+}
+
+int bi_parsecache(const BuiltinContext& ctx, const Argv&) {
+   if (!ctx.parse_cache) {
+      write_err(ctx, "parsecache: not available");
+      return 1;
+   }
+
+   const ParseCache::Stats st = ctx.parse_cache->stats();
+   OutputSink out = output_of(ctx);
+   out.line({"hits: ", std::to_string(st.hits)});
+   out.line({"misses: ", std::to_string(st.misses)});
+   out.line({"evictions: ", std::to_string(st.evictions)});
+   out.line({"entries: ", std::to_string(st.entries), "/",
+             std::to_string(st.capacity)});
+   return out.flush() ? 0 : 1;
+}
 
 } // namespace clanker
 
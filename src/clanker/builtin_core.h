@@ -0,0 +1,76 @@
+// src/clanker/builtin_core.h
+#pragma once
+
+#include <array>
+
+#include "clanker/builtins.h"
+
+namespace clanker {
+
+// The shell's core built-ins (built-ins.md): lifecycle, navigation,
+// variables, input and introspection.
+int bi_exit(const BuiltinContext& ctx, const Argv& argv);
+int bi_pwd(const BuiltinContext& ctx, const Argv& argv);
+int bi_cd(const BuiltinContext& ctx, const Argv& argv);
+int bi_help(const BuiltinContext& ctx, const Argv& argv);
+int bi_export(const BuiltinContext& ctx, const Argv& argv);
+int bi_unset(const BuiltinContext& ctx, const Argv& argv);
+int bi_local(const BuiltinContext& ctx, const Argv& argv);
+int bi_declare(const BuiltinContext& ctx, const Argv& argv);
+int bi_read(const BuiltinContext& ctx, const Argv& argv);
+int bi_loop_control(const BuiltinContext& ctx, const Argv& argv);
+int bi_return(const BuiltinContext& ctx, const Argv& argv);
+int bi_parsecache(const BuiltinContext& ctx, const Argv& argv);
+
+inline constexpr std::array kCoreBuiltins{
+   Builtin{.name = "exit", .fn = bi_exit, .help = "exit [n] — exit the shell"},
+   Builtin{.name = "pwd",
+           .fn = bi_pwd,
+           .help = "pwd [--relative|-r] — print current directory",
+           .pure = true},
+   Builtin{.name = "cd",
+           .fn = bi_cd,
+           .help = "cd [dir|-|~|~/path] — change directory (restricted to "
+                   "root)"},
+   Builtin{.name = "help",
+           .fn = bi_help,
+           .help = "help — list built-ins",
+           .pure = true},
+   Builtin{.name = "export",
+           .fn = bi_export,
+           .help = "export [-n] [name[=value] ...] — export variables to "
+                   "commands"},
+   Builtin{.name = "unset",
+           .fn = bi_unset,
+           .help = "unset [-v|-f] name ... — remove variables, or functions"},
+   Builtin{.name = "local",
+           .fn = bi_local,
+           .help = "local name[=value] ... — make variables local to a "
+                   "function"},
+   Builtin{.name = "declare",
+           .fn = bi_declare,
+           .help = "declare [-x|+x] [-p] [name[=value] ...] — set or list "
+                   "variables"},
+   Builtin{.name = "read",
+           .fn = bi_read,
+           .help = "read [-r] [-d delim] [name ...] — read a line into "
+                   "variables"},
+   Builtin{.name = "break",
+           .fn = bi_loop_control,
+           .help = "break [n] — leave the n-th enclosing loop",
+           .pure = true},
+   Builtin{.name = "continue",
+           .fn = bi_loop_control,
+           .help = "continue [n] — next iteration of the n-th enclosing loop",
+           .pure = true},
+   Builtin{.name = "return",
+           .fn = bi_return,
+           .help = "return [n] — leave a function with status n",
+           .pure = true},
+   Builtin{.name = "parsecache",
+           .fn = bi_parsecache,
+           .help = "parsecache — show parsed-command cache hits and misses",
+           .pure = true},
+};
+
+} // namespace clanker
@@ -0,0 +1,33 @@
+// src/clanker/builtin_llm.h
+#pragma once
+
+#include <array>
+
+#include "clanker/builtins.h"
+
+namespace clanker {
+
+// Model built-ins (built-ins.md, "LLM built-ins"); stubs for now.
+int bi_models(const BuiltinContext& ctx, const Argv& argv);
+int bi_use(const BuiltinContext& ctx, const Argv& argv);
+int bi_prompt(const BuiltinContext& ctx, const Argv& argv);
+int bi_ask(const BuiltinContext& ctx, const Argv& argv);
+
+inline constexpr std::array kLlmBuiltins{
+   Builtin{.name = "models",
+           .fn = bi_models,
+           .help = "models — list configured model backends",
+           .pure = true},
+   Builtin{.name = "use",
+           .fn = bi_use,
+           .help = "use <backend> [model=<id>] — select default backend "
+                   "(stub)"},
+   Builtin{.name = "prompt",
+           .fn = bi_prompt,
+           .help = "prompt <text...> — send text to default model (stub)"},
+   Builtin{.name = "ask",
+           .fn = bi_ask,
+           .help = "ask <backend> <text...> — send text to backend (stub)"},
+};
+
+} // namespace clanker
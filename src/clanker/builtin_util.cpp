@@ -0,0 +1,1645 @@
+// src/clanker/builtin_util.cpp
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cinttypes>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "clanker/builtin_util.h"
+#include "clanker/builtins.h"
+#include "clanker/expr.h"
+#include "clanker/output.h"
+#include "clanker/process.h"
+#include "clanker/vars.h"
+
+namespace clanker {
+namespace {
+
+using namespace std::literals;
+
+int write_err(const BuiltinContext& ctx,
+              std::initializer_list<std::string_view> pieces) {
+   OutputSink err = errors_of(ctx);
+   return err.line(pieces) ? 0 : 1;
+}
+
+// A coreutils usage error: the message, then where to find help.
+int usage_error(const BuiltinContext& ctx, std::string_view who,
+                std::initializer_list<std::string_view> message) {
+   OutputSink err = errors_of(ctx);
+   err.write({who, ": "});
+   err.line(message);
+   err.line({"Try '", who, " --help' for more information."});
+   return 1;
+}
+
+bool is_digit(char c) noexcept { return c >= '0' && c <= '9'; }
+bool is_octal(char c) noexcept { return c >= '0' && c <= '7'; }
+bool is_blank(char c) noexcept { return c == ' ' || c == '\t'; }
+
+int hex_value(char c) noexcept {
+   if (is_digit(c)) return c - '0';
+   if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+   if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+   return -1;
+}
+
+} // namespace
+
+bool utf8_locale(const BuiltinContext& ctx) {
+   if (!ctx.vars) return ctx.utf8;
+   for (const std::string_view name : {"LC_ALL"sv, "LC_CTYPE"sv, "LANG"sv}) {
+      const VarStore::Var* v = ctx.vars->find(name);
+      std::string value, err;
+      if (!v || !v->exported || !lower_value(v->value, value, err) ||
+          value.empty())
+         continue;
+      for (char& c : value)
+         c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+      return value.find("utf-8") != std::string::npos ||
+             value.find("utf8") != std::string::npos;
+   }
+   return false;
+}
+
+namespace {
+
+// The C escape for a byte that cannot be printed: \t, or \ooo.
+std::string_view control_escape(unsigned char c, char (&buf)[4]) {
+   switch (c) {
+   case '\a': return "\\a";
+   case '\b': return "\\b";
+   case '\f': return "\\f";
+   case '\n': return "\\n";
+   case '\r': return "\\r";
+   case '\t': return "\\t";
+   case '\v': return "\\v";
+   default: break;
+   }
+   buf[0] = '\\';
+   buf[1] = static_cast<char>('0' + (c >> 6));
+   buf[2] = static_cast<char>('0' + ((c >> 3) & 7));
+   buf[3] = static_cast<char>('0' + (c & 7));
+   return {buf, 4};
+}
+
+// Length of the printable UTF-8 character at s[i], a byte >= 0x80; 0 if
+// there is none.
+std::size_t utf8_printable(std::string_view s, std::size_t i) noexcept {
+   const auto b = [&](std::size_t k) {
+      return k < s.size() ? static_cast<unsigned char>(s[k]) : 0u;
+   };
+   const unsigned c = b(i);
+   std::size_t n;
+   std::uint32_t u;
+   if (c >= 0xc2 && c <= 0xdf) {
+      n = 2;
+      u = c & 0x1f;
+   } else if (c >= 0xe0 && c <= 0xef) {
+      n = 3;
+      u = c & 0x0f;
+   } else if (c >= 0xf0 && c <= 0xf4) {
+      n = 4;
+      u = c & 0x07;
+   } else {
+      return 0;
+   }
+   for (std::size_t k = 1; k < n; ++k) {
+      if ((b(i + k) & 0xc0) != 0x80) return 0;
+      u = u << 6 | (b(i + k) & 0x3f);
+   }
+   const bool overlong = (n == 3 && u < 0x800) || (n == 4 && u < 0x10000);
+   if (overlong || u > 0x10ffff || (u >= 0xd800 && u <= 0xdfff) || u < 0xa0)
+      return 0;
+   return n;
+}
+
+// `s` quoted for a diagnostic, as coreutils' quote() does it: 'like
+// this', with backslash escapes, or in curved quotes in a UTF-8 locale.
+std::string quote(const BuiltinContext& ctx, std::string_view s) {
+   const bool utf8 = utf8_locale(ctx);
+   std::string q = utf8 ? "\u2018" : "'";
+   for (std::size_t i = 0; i < s.size();) {
+      const auto c = static_cast<unsigned char>(s[i]);
+      if (const std::size_t n = utf8 ? utf8_printable(s, i) : 0) {
+         q += s.substr(i, n);
+         i += n;
+         continue;
+      }
+      char buf[4];
+      if (c == '\\' || (c == '\'' && !utf8)) {
+         q += '\\';
+         q += static_cast<char>(c);
+      } else if (c < 0x20 || c >= 0x7f) {
+         q += control_escape(c, buf);
+      } else {
+         q += static_cast<char>(c);
+      }
+      ++i;
+   }
+   q += utf8 ? "\u2019" : "'";
+   return q;
+}
+
+// snprintf() into `out`; `fmt` is one the caller has checked.
+template<class... A>
+void format_to(OutputSink& out, const char* fmt, A... args) {
+   char buf[128];
+   const int n = std::snprintf(buf, sizeof buf, fmt, args...);
+   if (n < 0) return;
+   if (static_cast<std::size_t>(n) < sizeof buf) {
+      out.write({buf, static_cast<std::size_t>(n)});
+      return;
+   }
+   std::string big(static_cast<std::size_t>(n), '\0');
+   std::snprintf(big.data(), big.size() + 1, fmt, args...);
+   out.write(big);
+}
+
+void put_byte(OutputSink& out, unsigned v) {
+   const char c = static_cast<char>(v);
+   out.write({&c, 1});
+}
+
+void put_utf8(OutputSink& out, std::uint32_t u) {
+   char b[4];
+   std::size_t n;
+   if (u < 0x80) {
+      b[0] = static_cast<char>(u);
+      n = 1;
+   } else if (u < 0x800) {
+      b[0] = static_cast<char>(0xc0 | (u >> 6));
+      b[1] = static_cast<char>(0x80 | (u & 0x3f));
+      n = 2;
+   } else if (u < 0x10000) {
+      b[0] = static_cast<char>(0xe0 | (u >> 12));
+      b[1] = static_cast<char>(0x80 | ((u >> 6) & 0x3f));
+      b[2] = static_cast<char>(0x80 | (u & 0x3f));
+      n = 3;
+   } else {
+      b[0] = static_cast<char>(0xf0 | (u >> 18));
+      b[1] = static_cast<char>(0x80 | ((u >> 12) & 0x3f));
+      b[2] = static_cast<char>(0x80 | ((u >> 6) & 0x3f));
+      b[3] = static_cast<char>(0x80 | (u & 0x3f));
+      n = 4;
+   }
+   out.write({b, n});
+}
+
+// ---- Backslash escapes ----
+
+// Where an escape is read: `echo -e` and a %b argument take \0NNN for an
+// octal byte, a printf format \NNN; only printf knows \" \u \U, and only
+// echo lets \x without digits through.
+enum class Esc : std::uint8_t { Echo, Format, Arg };
+
+struct Escaped {
+   enum How : std::uint8_t {
+      Ok,
+      Stop, // \c: no more output at all
+      Bad,  // a fatal error, in `error`
+   };
+   std::size_t next; // index of the byte after the escape
+   How how{Ok};
+};
+
+// Write the escape at s[i], a backslash, as coreutils does. \u and \U
+// are written in UTF-8 if the locale of `ctx` is UTF-8, else only if
+// ASCII (echo has neither, and no `ctx`).
+Escaped write_escape(OutputSink& out, std::string_view s, std::size_t i,
+                     Esc mode, const BuiltinContext* ctx,
+                     std::string& error) {
+   const auto at = [&](std::size_t k) { return k < s.size() ? s[k] : '\0'; };
+   std::size_t p = i + 1;
+   const char c = at(p);
+
+   if (c == 'x') {
+      unsigned v = 0;
+      int n = 0;
+      for (++p; n < 2 && hex_value(at(p)) >= 0; ++n, ++p)
+         v = v * 16 + static_cast<unsigned>(hex_value(at(p)));
+      if (n == 0 && mode == Esc::Echo) {
+         out.write("\\x");
+      } else if (n == 0) {
+         error = "missing hexadecimal number in escape";
+         return {p, Escaped::Bad};
+      } else {
+         put_byte(out, v);
+      }
+      return {p, Escaped::Ok};
+   }
+   if (is_octal(c)) {
+      if (mode != Esc::Format && c == '0') ++p;
+      unsigned v = 0;
+      for (int n = 0; n < 3 && is_octal(at(p)); ++n, ++p)
+         v = v * 8 + static_cast<unsigned>(at(p) - '0');
+      put_byte(out, v);
+      return {p, Escaped::Ok};
+   }
+   const std::string_view named =
+      mode == Esc::Echo ? "\\abcefnrtv"sv : "\"\\abcefnrtv"sv;
+   if (p < s.size() && named.find(c) != std::string_view::npos) {
+      switch (c) {
+      case 'a': out.write("\a"); break;
+      case 'b': out.write("\b"); break;
+      case 'c': return {p + 1, Escaped::Stop};
+      case 'e': out.write("\x1b"); break;
+      case 'f': out.write("\f"); break;
+      case 'n': out.write("\n"); break;
+      case 'r': out.write("\r"); break;
+      case 't': out.write("\t"); break;
+      case 'v': out.write("\v"); break;
+      default: put_byte(out, static_cast<unsigned char>(c)); break;
+      }
+      return {p + 1, Escaped::Ok};
+   }
+   if (mode != Esc::Echo && (c == 'u' || c == 'U')) {
+      std::uint32_t u = 0;
+      for (int n = c == 'u' ? 4 : 8; n > 0; --n) {
+         const int h = hex_value(at(++p));
+         if (h < 0) {
+            error = "missing hexadecimal number in escape";
+            return {p, Escaped::Bad};
+         }
+         u = u * 16 + static_cast<std::uint32_t>(h);
+      }
+      ++p;
+      char name[16];
+      if ((u <= 0x9f && u != 0x24 && u != 0x40 && u != 0x60) ||
+          (u >= 0xd800 && u <= 0xdfff)) {
+         std::snprintf(name, sizeof name, "\\%c%0*x", c, c == 'u' ? 4 : 8,
+                       static_cast<unsigned>(u));
+         error = "invalid universal character name "s + name;
+         return {p, Escaped::Bad};
+      }
+      if (u < 0x80 || (u <= 0x10ffff && ctx && utf8_locale(*ctx))) {
+         put_utf8(out, u);
+      } else {
+         std::snprintf(name, sizeof name, u < 0x10000 ? "\\u%04X" : "\\U%08X",
+                       static_cast<unsigned>(u));
+         out.write(name);
+      }
+      return {p, Escaped::Ok};
+   }
+   out.write("\\");
+   if (p < s.size()) out.write(s.substr(p++, 1));
+   return {p, Escaped::Ok};
+}
+
+// Write `s` with its escapes; false at \c or an error.
+bool write_escaped(OutputSink& out, std::string_view s, Esc mode,
+                   const BuiltinContext* ctx, Escaped::How& how,
+                   std::string& error) {
+   for (std::size_t i = 0; i < s.size();) {
+      const std::size_t bs = s.find('\\', i);
+      out.write(s.substr(i, bs - i));
+      if (bs == std::string_view::npos) break;
+      const Escaped e = write_escape(out, s, bs, mode, ctx, error);
+      if (e.how != Escaped::Ok) {
+         how = e.how;
+         return false;
+      }
+      i = e.next;
+   }
+   return true;
+}
+
+// ---- %q: shell quoting ----
+
+
+// How %q treats a byte, after gnulib's shell-escape quoting.
+enum class QuoteClass : std::uint8_t {
+   Plain,   // needs no quotes, and reads the same in double quotes
+   Bare,    // needs no quotes, but not one for double quotes ('a#b')
+   Compat,  // needs quotes, and double quotes will do (space)
+   Special, // needs single quotes ('$', '\\', '*', ...)
+   Quote,   // a single quote
+   Control, // written as $'\t' or $'\ooo'
+};
+
+QuoteClass quote_class(std::string_view s, std::size_t i) noexcept {
+   const char c = s[i];
+   if (is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+      return QuoteClass::Plain;
+   switch (c) {
+   case '%': case '+': case ',': case '-': case '.': case '/': case ':':
+   case '@': case ']': case '_':
+      return QuoteClass::Plain;
+   case '{': case '}':
+      return s.size() == 1 ? QuoteClass::Compat : QuoteClass::Bare;
+   case '#': case '~':
+      return i == 0 ? QuoteClass::Compat : QuoteClass::Bare;
+   case ' ':
+      return QuoteClass::Compat;
+   case '!': case '"': case '$': case '&': case '(': case ')': case '*':
+   case ';': case '<': case '=': case '>': case '?': case '[': case '\\':
+   case '^': case '`': case '|':
+      return QuoteClass::Special;
+   case '\'':
+      return QuoteClass::Quote;
+   default:
+      return QuoteClass::Control; // and bytes >= 0x80, unless printable
+   }
+}
+
+// printf's %q: `s` as a word the shell reads back unchanged, in the
+// fewest quotes: bare if it can be, in double quotes if it has a single
+// quote and nothing else that matters there, else in single quotes with
+// $'...' for bytes that cannot be typed. Other than in a UTF-8 locale,
+// every byte >= 0x80 is one.
+void write_shell_quoted(OutputSink& out, std::string_view s, bool utf8) {
+   if (s.empty()) {
+      out.write("''");
+      return;
+   }
+   bool bare = true, compat = true, quote = false;
+   for (std::size_t i = 0; i < s.size();) {
+      if (const std::size_t n = utf8 ? utf8_printable(s, i) : 0) {
+         i += n;
+         continue;
+      }
+      switch (quote_class(s, i++)) {
+      case QuoteClass::Plain: break;
+      case QuoteClass::Bare: compat = false; break;
+      case QuoteClass::Compat: bare = false; break;
+      case QuoteClass::Quote:
+         bare = false;
+         quote = true;
+         break;
+      default: bare = compat = false; break;
+      }
+   }
+   if (bare) {
+      out.write(s);
+      return;
+   }
+   if (quote && compat) {
+      out.write({"\"", s, "\""});
+      return;
+   }
+
+   out.write("'");
+   bool in_dollar = false; // inside $'...'
+   for (std::size_t i = 0; i < s.size();) {
+      std::size_t n = utf8 ? utf8_printable(s, i) : 0;
+      const QuoteClass q = n ? QuoteClass::Plain : quote_class(s, i);
+      if (n == 0) n = 1;
+      if (q == QuoteClass::Control) {
+         if (!in_dollar) out.write("'$'");
+         in_dollar = true;
+         char buf[4];
+         out.write(control_escape(static_cast<unsigned char>(s[i]), buf));
+      } else if (q == QuoteClass::Quote) {
+         out.write("'\\''");
+         in_dollar = false;
+      } else {
+         if (in_dollar) out.write("''");
+         in_dollar = false;
+         out.write(s.substr(i, n));
+      }
+      i += n;
+   }
+   out.write("'");
+}
+
+// ---- printf ----
+
+class Printf {
+ public:
+   Printf(const BuiltinContext& ctx, OutputSink& out,
+          std::span<const std::pmr::string> args)
+      : ctx_(ctx)
+      , out_(out)
+      , args_(args) {}
+
+   // Run the format over the arguments, again while some are left.
+   int run(std::string_view format) {
+      for (;;) {
+         const std::size_t before = next_;
+         if (!format_once(format)) return ended_status();
+         if (next_ == before || next_ >= args_.size()) break;
+      }
+      if (next_ < args_.size() && next_ == 0)
+         warn({"warning: ignoring excess arguments, starting with ",
+            quote(ctx_, args_[0])});
+      return status_;
+   }
+
+ private:
+   bool format_once(std::string_view f);
+   bool conversion(std::string_view f, std::size_t& i);
+
+   const char* next_arg(bool& had) {
+      had = next_ < args_.size();
+      return had ? args_[next_++].c_str() : "";
+   }
+
+   void warn(std::initializer_list<std::string_view> pieces) {
+      OutputSink err = errors_of(ctx_);
+      err.write("printf: ");
+      err.line(pieces);
+   }
+
+   // Report a fatal error: what was printed stays, nothing more is.
+   bool fail(std::string_view message) {
+      warn({message});
+      status_ = 1;
+      fatal_ = true;
+      return false;
+   }
+
+   int ended_status() const { return fatal_ ? 1 : 0; }
+
+   bool escape_failed(Escaped::How how, std::string_view error) {
+      if (how == Escaped::Bad) return fail(error);
+      return false; // \c
+   }
+
+   // An argument as a number, as coreutils reads it: a leading quote
+   // gives the code of the byte after it; otherwise strtoimax() and the
+   // like, and an error unless all of it was a number.
+   template<class T, class Convert>
+   T number(const char* s, Convert convert) {
+      if ((*s == '"' || *s == '\'') && s[1] != '\0') {
+         const T v = static_cast<unsigned char>(s[1]);
+         if (s[2] != '\0')
+            warn({"warning: ", s + 2,
+                  ": character(s) following character constant have been "
+                  "ignored"});
+         return v;
+      }
+      char* end = nullptr;
+      errno = 0;
+      const T v = convert(s, &end);
+      if (errno != 0) {
+         warn({quote(ctx_, s), ": ", std::strerror(errno)});
+         status_ = 1;
+      } else if (*end != '\0') {
+         warn({quote(ctx_, s),
+               end == s ? ": expected a numeric value"sv
+                        : ": value not completely converted"sv});
+         status_ = 1;
+      }
+      return v;
+   }
+   std::intmax_t to_int(const char* s) {
+      return number<std::intmax_t>(
+         s, [](const char* p, char** e) { return std::strtoimax(p, e, 0); });
+   }
+   std::uintmax_t to_uint(const char* s) {
+      return number<std::uintmax_t>(
+         s, [](const char* p, char** e) { return std::strtoumax(p, e, 0); });
+   }
+   long double to_float(const char* s) {
+      return number<long double>(
+         s, [](const char* p, char** e) { return std::strtold(p, e); });
+   }
+
+   template<class T>
+   void put(const std::string& spec, bool has_width, int width, bool has_prec,
+            int prec, T value) {
+      if (has_width && has_prec)
+         format_to(out_, spec.c_str(), width, prec, value);
+      else if (has_width)
+         format_to(out_, spec.c_str(), width, value);
+      else if (has_prec)
+         format_to(out_, spec.c_str(), prec, value);
+      else
+         format_to(out_, spec.c_str(), value);
+   }
+
+   const BuiltinContext& ctx_;
+   OutputSink& out_;
+   std::span<const std::pmr::string> args_;
+   std::size_t next_{0};
+   int status_{0};
+   bool fatal_{false};
+};
+
+bool Printf::format_once(std::string_view f) {
+   std::string error;
+   for (std::size_t i = 0; i < f.size();) {
+      const std::size_t special = f.find_first_of("%\\", i);
+      out_.write(f.substr(i, special - i));
+      if (special == std::string_view::npos) break;
+      i = special;
+      if (f[i] == '\\') {
+         const Escaped e = write_escape(out_, f, i, Esc::Format, &ctx_, error);
+         if (e.how != Escaped::Ok) return escape_failed(e.how, error);
+         i = e.next;
+      } else if (!conversion(f, i)) {
+         return false;
+      }
+   }
+   return true;
+}
+
+// The conversion at f[i], a '%'; `i` moves past it.
+bool Printf::conversion(std::string_view f, std::size_t& i) {
+   const auto at = [&](std::size_t k) { return k < f.size() ? f[k] : '\0'; };
+   const std::size_t start = i++;
+   bool had = false;
+   if (at(i) == '%') {
+      out_.write("%");
+      ++i;
+      return true;
+   }
+   if (at(i) == 'b' || at(i) == 'q') {
+      const char conv = f[i++];
+      const char* arg = next_arg(had);
+      if (!had) return true;
+      if (conv == 'q') {
+         write_shell_quoted(out_, arg, utf8_locale(ctx_));
+         return true;
+      }
+      std::string error;
+      Escaped::How how = Escaped::Ok;
+      if (!write_escaped(out_, arg, Esc::Arg, &ctx_, how, error))
+         return escape_failed(how, error);
+      return true;
+   }
+
+   // Which conversions the flags allow, as coreutils checks them.
+   std::array<bool, 128> ok{};
+   for (const char c : "aAcdeEfFgGiosuxX"sv)
+      ok[static_cast<unsigned>(c)] = true;
+   const auto forbid = [&](std::string_view cs) {
+      for (const char c : cs) ok[static_cast<unsigned>(c)] = false;
+   };
+   for (;; ++i) {
+      const char c = at(i);
+      if (c == '\'' || c == 'I') {
+         forbid("aAceEosxX");
+      } else if (c == '#') {
+         forbid("cdisu");
+      } else if (c == '0') {
+         forbid("cs");
+      } else if (c != '-' && c != '+' && c != ' ') {
+         break;
+      }
+   }
+
+   bool has_width = false, has_prec = false;
+   int width = 0, prec = 0;
+   if (at(i) == '*') {
+      ++i;
+      const char* arg = next_arg(had);
+      if (had) {
+         const std::intmax_t w = to_int(arg);
+         if (w < INT_MIN || w > INT_MAX)
+            return fail("invalid field width: " + quote(ctx_, arg));
+         width = static_cast<int>(w);
+      }
+      has_width = true;
+   } else {
+      while (is_digit(at(i))) ++i;
+   }
+   if (at(i) == '.') {
+      ++i;
+      forbid("c");
+      if (at(i) == '*') {
+         ++i;
+         const char* arg = next_arg(had);
+         if (had) {
+            const std::intmax_t p = to_int(arg);
+            if (p > INT_MAX)
+               return fail("invalid precision: " + quote(ctx_, arg));
+            prec = p < 0 ? -1 : static_cast<int>(p);
+         }
+         has_prec = true;
+      } else {
+         while (is_digit(at(i))) ++i;
+      }
+   }
+   std::string spec{f.substr(start, i - start)};
+   while (std::string_view{"lLhjtz"}.find(at(i)) != std::string_view::npos)
+      ++i;
+
+   const char conv = at(i);
+   const auto uc = static_cast<unsigned char>(conv);
+   if (uc >= ok.size() || !ok[uc])
+      return fail(
+         std::string{f.substr(start, std::min(i + 1, f.size()) - start)} +
+         ": invalid conversion specification");
+   ++i;
+
+   const char* arg = next_arg(had);
+   switch (conv) {
+   case 'd': case 'i':
+      spec += 'j';
+      spec += conv;
+      put(spec, has_width, width, has_prec, prec, to_int(arg));
+      break;
+   case 'o': case 'u': case 'x': case 'X':
+      spec += 'j';
+      spec += conv;
+      put(spec, has_width, width, has_prec, prec, to_uint(arg));
+      break;
+   case 'c':
+      spec += conv;
+      if (has_width)
+         format_to(out_, spec.c_str(), width, static_cast<int>(*arg));
+      else
+         format_to(out_, spec.c_str(), static_cast<int>(*arg));
+      break;
+   case 's':
+      spec += conv;
+      put(spec, has_width, width, has_prec, prec, arg);
+      break;
+   default: // a floating-point conversion
+      spec += 'L';
+      spec += conv;
+      put(spec, has_width, width, has_prec, prec, to_float(arg));
+      break;
+   }
+   return true;
+}
+
+// ---- test ----
+
+// The expression of `test` or `[`, evaluated as coreutils does: POSIX's
+// rules by argument count up to four, a recursive descent beyond. A
+// syntax error ends the evaluation, with status 2.
+class Test {
+ public:
+   Test(const BuiltinContext& ctx, std::string_view who,
+        std::span<const std::pmr::string> args)
+      : ctx_(ctx)
+      , who_(who)
+      , args_(args) {}
+
+   int run() {
+      if (args_.empty()) return 1;
+      const bool value = posix(args_.size());
+      if (!failed_ && pos_ != args_.size())
+         error({"extra argument ", quote(ctx_, args_[pos_])});
+      return failed_ ? 2 : value ? 0 : 1;
+   }
+
+ private:
+   // What stat() or lstat() said of one path, kept for the rest of the
+   // command, so that `[ -e f -a -f f -a -s f ]` asks once.
+   struct Stat {
+      const std::pmr::string* path{nullptr};
+      bool follow{false};
+      bool ok{false};
+      struct stat st{};
+   };
+
+   std::string_view arg(std::size_t i) const {
+      return i < args_.size() ? std::string_view{args_[i]} : ""sv;
+   }
+   bool is(std::size_t i, std::string_view s) const {
+      return i < args_.size() && args_[i] == s;
+   }
+
+   void error(std::initializer_list<std::string_view> pieces) {
+      if (failed_) return;
+      failed_ = true;
+      pos_ = args_.size();
+      OutputSink err = errors_of(ctx_);
+      err.write({who_, ": "});
+      err.line(pieces);
+   }
+   void beyond() {
+      error({"missing argument after ", quote(ctx_, args_.back())});
+   }
+   void advance(bool need_more) {
+      ++pos_;
+      if (need_more && pos_ >= args_.size()) beyond();
+   }
+
+   static bool is_binop(std::string_view s) {
+      for (const std::string_view op :
+           {"="sv, "!="sv, "=="sv, "-nt"sv, "-ot"sv, "-ef"sv, "-eq"sv, "-ne"sv,
+            "-lt"sv, "-le"sv, "-gt"sv, "-ge"sv})
+         if (s == op) return true;
+      return false;
+   }
+   static bool is_unop(std::string_view s) {
+      return s.size() == 2 && s[0] == '-' &&
+             "bcdefgGhkLnNOprsStuwxz"sv.find(s[1]) != std::string_view::npos;
+   }
+
+   const struct stat* stat_of(std::size_t i, bool follow);
+   bool find_int(std::size_t i, std::string_view& out);
+
+   bool posix(std::size_t nargs);
+   bool one() { return !args_[pos_++].empty(); }
+   bool two();
+   bool three();
+   bool expr();
+   bool term();
+   bool unary();
+   bool binary(bool l_is_l);
+
+   const BuiltinContext& ctx_;
+   std::string_view who_;
+   std::span<const std::pmr::string> args_;
+   std::size_t pos_{0};
+   bool failed_{false};
+   std::array<Stat, 4> stats_{};
+   std::size_t nstats_{0};
+};
+
+const struct stat* Test::stat_of(std::size_t i, bool follow) {
+   const std::pmr::string& path = args_[i];
+   const std::size_t kept = std::min(nstats_, stats_.size());
+   for (std::size_t k = 0; k < kept; ++k) {
+      const Stat& s = stats_[k];
+      if (s.follow == follow && *s.path == path) return s.ok ? &s.st : nullptr;
+   }
+   Stat& s = stats_[nstats_++ % stats_.size()];
+   s.path = &path;
+   s.follow = follow;
+   s.ok = (follow ? ::stat(path.c_str(), &s.st)
+                  : ::lstat(path.c_str(), &s.st)) == 0;
+   return s.ok ? &s.st : nullptr;
+}
+
+// The integer args_[i] holds, optionally signed and with blanks around
+// it, as [-]digits for compare_ints(); any other word is an error.
+bool Test::find_int(std::size_t i, std::string_view& out) {
+   const std::string_view s = args_[i];
+   std::size_t p = 0;
+   while (p < s.size() && is_blank(s[p])) ++p;
+   std::size_t start = p;
+   if (p < s.size() && s[p] == '+') {
+      start = ++p;
+   } else if (p < s.size() && s[p] == '-') {
+      ++p;
+   }
+   const std::size_t digits = p;
+   while (p < s.size() && is_digit(s[p])) ++p;
+   const std::size_t end = p;
+   while (p < s.size() && is_blank(s[p])) ++p;
+   if (end == digits || p != s.size()) {
+      error({"invalid integer ", quote(ctx_, s)});
+      return false;
+   }
+   out = s.substr(start, end - start);
+   return true;
+}
+
+// Compare integers of any length, written [-]digits.
+int compare_ints(std::string_view a, std::string_view b) {
+   const auto split = [](std::string_view& s) {
+      const bool neg = !s.empty() && s[0] == '-';
+      if (neg) s.remove_prefix(1);
+      while (s.size() > 1 && s[0] == '0') s.remove_prefix(1);
+      return neg && s != "0";
+   };
+   const bool an = split(a), bn = split(b);
+   if (an != bn) return an ? -1 : 1;
+   int c = a.size() != b.size() ? (a.size() < b.size() ? -1 : 1)
+                                 : a.compare(b);
+   c = c < 0 ? -1 : c > 0;
+   return an ? -c : c;
+}
+
+bool Test::posix(std::size_t nargs) {
+   switch (nargs) {
+   case 1: return one();
+   case 2: return two();
+   case 3: return three();
+   case 4:
+      if (is(pos_, "!")) {
+         advance(true);
+         return !three();
+      }
+      if (is(pos_, "(") && is(pos_ + 3, ")")) {
+         advance(false);
+         const bool value = two();
+         advance(false);
+         return value;
+      }
+      return expr();
+   default: return expr();
+   }
+}
+
+bool Test::two() {
+   if (is(pos_, "!")) {
+      advance(false);
+      return !one();
+   }
+   const std::string_view a = arg(pos_);
+   if (a.size() == 2 && a[0] == '-') {
+      if (is_unop(a)) return unary();
+      error({quote(ctx_, a), ": unary operator expected"});
+      return false;
+   }
+   beyond();
+   return false;
+}
+
+bool Test::three() {
+   if (is_binop(arg(pos_ + 1))) return binary(false);
+   if (is(pos_, "!")) {
+      advance(true);
+      return !two();
+   }
+   if (is(pos_, "(") && is(pos_ + 2, ")")) {
+      advance(false);
+      const bool value = one();
+      advance(false);
+      return value;
+   }
+   if (is(pos_ + 1, "-a") || is(pos_ + 1, "-o")) return expr();
+   error({quote(ctx_, arg(pos_ + 1)), ": binary operator expected"});
+   return false;
+}
+
+// expr: and ("-o" and)*;  and: term ("-a" term)*.
+bool Test::expr() {
+   if (pos_ >= args_.size()) {
+      beyond();
+      return false;
+   }
+   bool any = false;
+   for (;;) {
+      bool all = true;
+      for (;;) {
+         all &= term();
+         if (!is(pos_, "-a")) break;
+         advance(false);
+      }
+      any |= all;
+      if (!is(pos_, "-o")) return any;
+      advance(false);
+   }
+}
+
+bool Test::term() {
+   if (failed_) return false;
+   bool negated = false;
+   while (is(pos_, "!")) {
+      advance(true);
+      negated = !negated;
+   }
+   if (pos_ >= args_.size()) {
+      beyond();
+      return false;
+   }
+
+   bool value;
+   const std::size_t left = args_.size() - pos_;
+   if (is(pos_, "(")) {
+      advance(true);
+      if (failed_) return false;
+      std::size_t nargs = 1;
+      for (; pos_ + nargs < args_.size() && !is(pos_ + nargs, ")"); ++nargs)
+         if (nargs == 4) {
+            nargs = args_.size() - pos_;
+            break;
+         }
+      value = posix(nargs);
+      if (failed_) return false;
+      if (pos_ >= args_.size()) {
+         error({quote(ctx_, ")"), " expected"});
+      } else if (!is(pos_, ")")) {
+         error({quote(ctx_, ")"), " expected, found ",
+                quote(ctx_, args_[pos_])});
+      }
+      advance(false);
+   } else if (left >= 4 && is(pos_, "-l") && is_binop(arg(pos_ + 2))) {
+      value = binary(true);
+   } else if (left >= 3 && is_binop(arg(pos_ + 1))) {
+      value = binary(false);
+   } else if (arg(pos_).size() == 2 && arg(pos_)[0] == '-') {
+      if (!is_unop(arg(pos_))) {
+         error({quote(ctx_, arg(pos_)), ": unary operator expected"});
+         return false;
+      }
+      value = unary();
+   } else {
+      value = one();
+   }
+   return negated ^ value;
+}
+
+bool Test::unary() {
+   const char op = args_[pos_][1];
+   advance(true);
+   if (failed_) return false;
+   const std::size_t i = pos_++;
+   const char* path = args_[i].c_str();
+
+   switch (op) {
+   case 'n': return !args_[i].empty();
+   case 'z': return args_[i].empty();
+   case 't': {
+      std::string_view n;
+      if (!find_int(i, n)) return false;
+      errno = 0;
+      const long fd = std::strtol(std::string{n}.c_str(), nullptr, 10);
+      if (errno == ERANGE || fd < 0 || fd > INT_MAX) return false;
+      // Fds 0-2 are the built-in's own, which may be redirected.
+      const int real = fd == 0   ? ctx_.in_fd
+                       : fd == 1 ? ctx_.out_fd
+                       : fd == 2 ? ctx_.err_fd
+                                 : static_cast<int>(fd);
+      return ::isatty(real) == 1;
+   }
+   case 'r': return ::faccessat(AT_FDCWD, path, R_OK, AT_EACCESS) == 0;
+   case 'w': return ::faccessat(AT_FDCWD, path, W_OK, AT_EACCESS) == 0;
+   case 'x': return ::faccessat(AT_FDCWD, path, X_OK, AT_EACCESS) == 0;
+   case 'h': case 'L': {
+      const struct stat* st = stat_of(i, false);
+      return st && S_ISLNK(st->st_mode);
+   }
+   default: break;
+   }
+
+   const struct stat* st = stat_of(i, true);
+   if (!st) return false;
+   switch (op) {
+   case 'e': return true;
+   case 'f': return S_ISREG(st->st_mode);
+   case 'd': return S_ISDIR(st->st_mode);
+   case 'b': return S_ISBLK(st->st_mode);
+   case 'c': return S_ISCHR(st->st_mode);
+   case 'p': return S_ISFIFO(st->st_mode);
+   case 'S': return S_ISSOCK(st->st_mode);
+   case 's': return st->st_size > 0;
+   case 'u': return (st->st_mode & S_ISUID) != 0;
+   case 'g': return (st->st_mode & S_ISGID) != 0;
+   case 'k': return (st->st_mode & S_ISVTX) != 0;
+   case 'O': return ::geteuid() == st->st_uid;
+   case 'G': return ::getegid() == st->st_gid;
+   case 'N':
+      return st->st_mtim.tv_sec != st->st_atim.tv_sec
+                ? st->st_mtim.tv_sec > st->st_atim.tv_sec
+                : st->st_mtim.tv_nsec > st->st_atim.tv_nsec;
+   default: return false;
+   }
+}
+
+// The operator is at pos_ + 1 (pos_ + 2 after `-l STRING`); either
+// integer operand may be `-l STRING`, its length.
+bool Test::binary(bool l_is_l) {
+   if (l_is_l) advance(false);
+   const std::size_t op = pos_ + 1;
+   bool r_is_l = false;
+   if (op + 2 < args_.size() && is(op + 1, "-l")) {
+      r_is_l = true;
+      advance(false);
+   }
+   const std::string_view o = args_[op];
+   const std::size_t left = op - 1, right = op + 1;
+   const std::size_t base = pos_; // what = and != compare, as coreutils
+   pos_ += 3;
+
+   if (o == "-eq" || o == "-ne" || o == "-lt" || o == "-le" || o == "-gt" ||
+       o == "-ge") {
+      std::string_view l, r;
+      const std::string ll = std::to_string(args_[left].size());
+      const std::string rl =
+         r_is_l ? std::to_string(args_[op + 2].size()) : std::string{};
+      if (l_is_l) {
+         l = ll;
+      } else if (!find_int(left, l)) {
+         return false;
+      }
+      if (r_is_l) {
+         r = rl;
+      } else if (!find_int(right, r)) {
+         return false;
+      }
+      const int c = compare_ints(l, r);
+      if (o == "-eq") return c == 0;
+      if (o == "-ne") return c != 0;
+      if (o == "-lt") return c < 0;
+      if (o == "-le") return c <= 0;
+      if (o == "-gt") return c > 0;
+      return c >= 0;
+   }
+   if (o == "-nt" || o == "-ot" || o == "-ef") {
+      if (l_is_l || r_is_l) {
+         error({o, " does not accept -l"});
+         return false;
+      }
+      const struct stat* a = stat_of(left, true);
+      const struct stat* b = stat_of(right, true);
+      if (o == "-ef")
+         return a && b && a->st_dev == b->st_dev && a->st_ino == b->st_ino;
+      const auto newer = [](const struct stat* x, const struct stat* y) {
+         return x->st_mtim.tv_sec != y->st_mtim.tv_sec
+                   ? x->st_mtim.tv_sec > y->st_mtim.tv_sec
+                   : x->st_mtim.tv_nsec > y->st_mtim.tv_nsec;
+      };
+      if (o == "-nt") return a && (!b || newer(a, b));
+      return b && (!a || newer(b, a));
+   }
+   const bool equal = args_[base] == args_[base + 2];
+   return o == "!=" ? !equal : equal;
+}
+
+// ---- Options ----
+
+struct LongOption {
+   std::string_view name;
+   char short_name; // the short option it stands for
+};
+
+// Parse argv[1..] as getopt_long() does with `shorts` ("s:" takes an
+// argument): `in_order` stops at the first operand, as a leading '+'
+// does; else options and operands may mix. `numbers` makes "-1" and
+// "-.5" operands (seq). `on(opt, optarg)` sees each option; the operands
+// go to `operands`. False, with the error printed, on a bad option.
+template<class F>
+bool parse_options(const BuiltinContext& ctx, std::string_view who,
+                   const Argv& argv, std::string_view shorts,
+                   std::span<const LongOption> longs, bool in_order,
+                   bool numbers, std::vector<std::string_view>& operands,
+                   F on) {
+   const auto takes_arg = [&](char c) {
+      const std::size_t k = shorts.find(c);
+      return k + 1 < shorts.size() && shorts[k + 1] == ':';
+   };
+   std::size_t i = 1;
+   for (; i < argv.size(); ++i) {
+      const std::string_view a = argv[i];
+      if (a == "--") {
+         ++i;
+         break;
+      }
+      const bool number =
+         numbers && a.size() > 1 && (a[1] == '.' || is_digit(a[1]));
+      if (a.size() < 2 || a[0] != '-' || number) {
+         if (in_order) break;
+         operands.push_back(a);
+         continue;
+      }
+      if (a[1] == '-') {
+         const std::size_t eq = a.find('=');
+         const std::string_view name = a.substr(2, eq - 2);
+         const LongOption* found = nullptr;
+         for (const LongOption& l : longs)
+            if (l.name == name) found = &l;
+         if (!found) {
+            usage_error(ctx, who, {"unrecognized option '", a, "'"});
+            return false;
+         }
+         const std::string_view full = a.substr(0, eq);
+         if (!takes_arg(found->short_name)) {
+            if (eq != std::string_view::npos) {
+               usage_error(ctx, who,
+                           {"option '", full, "' doesn't allow an argument"});
+               return false;
+            }
+            on(found->short_name, ""sv);
+         } else if (eq != std::string_view::npos) {
+            on(found->short_name, a.substr(eq + 1));
+         } else if (i + 1 < argv.size()) {
+            on(found->short_name, std::string_view{argv[++i]});
+         } else {
+            usage_error(ctx, who,
+                        {"option '", full, "' requires an argument"});
+            return false;
+         }
+         continue;
+      }
+      for (std::size_t k = 1; k < a.size(); ++k) {
+         const char c = a[k];
+         if (c == ':' || shorts.find(c) == std::string_view::npos) {
+            usage_error(ctx, who,
+                        {"invalid option -- '", std::string_view{&a[k], 1},
+                         "'"});
+            return false;
+         }
+         if (!takes_arg(c)) {
+            on(c, ""sv);
+         } else if (k + 1 < a.size()) {
+            on(c, a.substr(k + 1));
+            break;
+         } else if (i + 1 < argv.size()) {
+            on(c, std::string_view{argv[++i]});
+            break;
+         } else {
+            usage_error(ctx, who,
+                        {"option requires an argument -- '",
+                         std::string_view{&a[k], 1}, "'"});
+            return false;
+         }
+      }
+   }
+   for (; i < argv.size(); ++i) operands.push_back(argv[i]);
+   return true;
+}
+
+// ---- basename, dirname ----
+
+// The start of the last component of `s`, past leading slashes; at the
+// end if `s` is all slashes (gnulib's last_component).
+std::size_t last_component(std::string_view s) {
+   std::size_t base = s.find_first_not_of('/');
+   if (base == std::string_view::npos) return s.size();
+   bool slash = false;
+   for (std::size_t p = base; p < s.size(); ++p) {
+      if (s[p] == '/') {
+         slash = true;
+      } else if (slash) {
+         base = p;
+         slash = false;
+      }
+   }
+   return base;
+}
+
+// `s` without trailing slashes, but not emptied to nothing but "/".
+std::string_view strip_slashes(std::string_view s) {
+   while (s.size() > 1 && s.back() == '/') s.remove_suffix(1);
+   return s;
+}
+
+std::string_view base_name(std::string_view s, std::string_view suffix) {
+   const std::size_t base = last_component(s);
+   std::string_view name = strip_slashes(base == s.size() ? s
+                                                          : s.substr(base));
+   if (!name.empty() && name[0] != '/' && suffix.size() < name.size() &&
+       name.ends_with(suffix))
+      name.remove_suffix(suffix.size());
+   return name;
+}
+
+std::string_view dir_name(std::string_view s) {
+   const std::size_t prefix = !s.empty() && s[0] == '/';
+   std::size_t len = last_component(s);
+   while (prefix < len && s[len - 1] == '/') --len;
+   return len == 0 ? "."sv : s.substr(0, len);
+}
+
+// ---- seq ----
+
+struct SeqOperand {
+   long double value{0};
+   int width{0};
+   int precision{INT_MAX}; // INT_MAX: not known (hex, inf)
+};
+
+// An operand as coreutils' scan_arg() reads it: its value, and the width
+// and digits after the point it is written with, which set the output
+// format.
+bool scan_seq_operand(const BuiltinContext& ctx, const char* s,
+                      SeqOperand& o) {
+   char* end = nullptr;
+   errno = 0;
+   o.value = std::strtold(s, &end);
+   if (end == s || *end != '\0' ||
+       (errno == ERANGE && std::fabs(o.value) >= 1)) {
+      usage_error(ctx, "seq",
+                  {"invalid floating point argument: ", quote(ctx, s)});
+      return false;
+   }
+   if (std::isnan(o.value)) {
+      usage_error(ctx, "seq",
+                  {"invalid ", quote(ctx, "not-a-number"), " argument: ",
+                   quote(ctx, s)});
+      return false;
+   }
+
+   // Signs and blanks are not printed, so they add no width.
+   std::string_view a = s;
+   while (!a.empty() && std::strchr(" \t\n\v\f\r+", a[0])) a.remove_prefix(1);
+   o.width = static_cast<int>(a.size());
+   o.precision = INT_MAX;
+   if (a.find_first_of("xX") != std::string_view::npos ||
+       !std::isfinite(o.value))
+      return true;
+
+   const std::size_t point = a.find('.');
+   if (point == std::string_view::npos) {
+      o.precision = 0;
+   } else {
+      const std::size_t e = a.find_first_of("eE", point + 1);
+      const std::size_t fraction =
+         (e == std::string_view::npos ? a.size() : e) - point - 1;
+      o.precision = static_cast<int>(fraction);
+      o.width += fraction == 0 ? -1
+                               : (point == 0 || !is_digit(a[point - 1]));
+   }
+   std::size_t e = a.find('e');
+   if (e == std::string_view::npos) e = a.find('E');
+   if (e != std::string_view::npos) {
+      long exponent = std::strtol(std::string{a.substr(e + 1)}.c_str(),
+                                  nullptr, 10);
+      exponent = std::max(exponent, -LONG_MAX);
+      o.precision += exponent < 0
+                        ? static_cast<int>(-exponent)
+                        : -std::min(o.precision, static_cast<int>(exponent));
+      o.width -= static_cast<int>(a.size() - e);
+      if (exponent < 0) {
+         if (point != std::string_view::npos) {
+            if (e == point + 1) ++o.width;
+         } else {
+            ++o.width;
+         }
+         exponent = -exponent;
+      } else {
+         if (point != std::string_view::npos && o.precision == 0) --o.width;
+         exponent = -std::min(static_cast<long>(o.precision), exponent);
+      }
+      o.width += static_cast<int>(exponent);
+   }
+   return true;
+}
+
+// A -f format with "L" put in its one floating-point conversion, and how
+// long the text around that is; empty after an error.
+std::string seq_format(const BuiltinContext& ctx, std::string_view fmt,
+                       std::size_t& prefix, std::size_t& suffix) {
+   const auto at = [&](std::size_t k) {
+      return k < fmt.size() ? fmt[k] : '\0';
+   };
+   const auto fail = [&](std::initializer_list<std::string_view> m) {
+      OutputSink err = errors_of(ctx);
+      err.write("seq: ");
+      err.line(m);
+      return std::string{};
+   };
+   std::size_t i = 0;
+   prefix = suffix = 0;
+   for (; !(at(i) == '%' && at(i + 1) != '%'); i += (at(i) == '%') + 1) {
+      if (i >= fmt.size())
+         return fail({"format ", quote(ctx, fmt), " has no % directive"});
+      ++prefix;
+   }
+   ++i;
+   while (std::string_view{"-+#0 '"}.find(at(i)) != std::string_view::npos)
+      ++i;
+   while (is_digit(at(i))) ++i;
+   if (at(i) == '.') {
+      ++i;
+      while (is_digit(at(i))) ++i;
+   }
+   const std::size_t modifier = i;
+   const bool has_l = at(i) == 'L';
+   i += has_l;
+   if (i >= fmt.size()) return fail({"format ", quote(ctx, fmt), " ends in %"});
+   if (std::string_view{"efgaEFGA"}.find(fmt[i]) == std::string_view::npos)
+      return fail({"format ", quote(ctx, fmt), " has unknown %",
+                   fmt.substr(i, 1), " directive"});
+   for (++i; i < fmt.size(); i += (fmt[i] == '%') + 1) {
+      if (fmt[i] == '%' && at(i + 1) != '%')
+         return fail(
+            {"format ", quote(ctx, fmt), " has too many % directives"});
+      ++suffix;
+   }
+   std::string out{fmt.substr(0, modifier)};
+   out += 'L';
+   out += fmt.substr(modifier + has_l);
+   return out;
+}
+
+// Non-negative integers: counted in decimal, exactly, however long.
+int seq_digits(OutputSink& out, std::string_view first, std::string_view last,
+               unsigned step, std::string_view separator) {
+   const auto trim = [](std::string_view s) {
+      while (s.size() > 1 && s[0] == '0') s.remove_prefix(1);
+      return s;
+   };
+   std::string n{trim(first)};
+   last = trim(last);
+   const auto beyond = [&] {
+      if (n.size() != last.size()) return n.size() > last.size();
+      return std::string_view{n} > last;
+   };
+   if (beyond()) return 0;
+   out.write(n);
+   for (;;) {
+      unsigned carry = step;
+      for (std::size_t k = n.size(); k-- > 0 && carry != 0;) {
+         const unsigned d = static_cast<unsigned>(n[k] - '0') + carry;
+         n[k] = static_cast<char>('0' + d % 10);
+         carry = d / 10;
+      }
+      if (carry != 0) n.insert(0, std::to_string(carry));
+      if (beyond() || !out.ok()) break;
+      out.write({separator, n});
+   }
+   out.write("\n");
+   return out.flush() ? 0 : 1;
+}
+
+bool all_digits(std::string_view s) {
+   return !s.empty() && s.find_first_not_of("0123456789") == s.npos;
+}
+
+} // namespace
+
+int bi_true(const BuiltinContext&, const Argv&) { return 0; }
+int bi_false(const BuiltinContext&, const Argv&) { return 1; }
+
+// coreutils echo: options are words of n, e and E after a '-', and stop
+// at the first word that is not one. `--help` is printed, as by bash.
+int bi_echo(const BuiltinContext& ctx, const Argv& argv) {
+   bool newline = true, escapes = false;
+   std::size_t i = 1;
+   for (; i < argv.size(); ++i) {
+      const std::string_view a = argv[i];
+      if (a.size() < 2 || a[0] != '-' ||
+          a.find_first_not_of("neE", 1) != std::string_view::npos)
+         break;
+      for (const char c : a.substr(1)) {
+         if (c == 'n')
+            newline = false;
+         else
+            escapes = c == 'e';
+      }
+   }
+
+   OutputSink out = output_of(ctx);
+   std::string error;
+   for (const std::size_t first = i; i < argv.size(); ++i) {
+      if (i > first) out.write(" ");
+      Escaped::How how = Escaped::Ok;
+      if (!escapes)
+         out.write(argv[i]);
+      else if (!write_escaped(out, argv[i], Esc::Echo, nullptr, how, error))
+         return out.flush() ? 0 : 1; // \c
+   }
+   if (newline) out.write("\n");
+   return out.flush() ? 0 : 1;
+}
+
+int bi_printf(const BuiltinContext& ctx, const Argv& argv) {
+   std::size_t first = 1;
+   if (argv.size() > 1 && argv[1] == "--") ++first;
+   if (argv.size() <= first)
+      return usage_error(ctx, "printf", {"missing operand"});
+
+   OutputSink out = output_of(ctx);
+   const std::span<const std::pmr::string> args{argv};
+   const int status =
+      Printf(ctx, out, args.subspan(first + 1)).run(argv[first]);
+   return out.flush() ? status : 1;
+}
+
+int bi_test(const BuiltinContext& ctx, const Argv& argv) {
+   std::span<const std::pmr::string> args{argv};
+   const std::string_view who = argv.empty() ? "test"sv : argv[0];
+   if (!args.empty()) args = args.subspan(1);
+   if (who == "[") {
+      if (args.empty() || args.back() != "]") {
+         write_err(ctx, {"[: missing ", quote(ctx, "]")});
+         return 2;
+      }
+      args = args.first(args.size() - 1);
+   }
+   return Test(ctx, who, args).run();
+}
+
+int bi_basename(const BuiltinContext& ctx, const Argv& argv) {
+   static constexpr std::array<LongOption, 3> kLongs{
+      {{"multiple", 'a'}, {"suffix", 's'}, {"zero", 'z'}}};
+   bool multiple = false, zero = false;
+   std::string_view suffix;
+   std::vector<std::string_view> names;
+   const bool parsed = parse_options(
+      ctx, "basename", argv, "as:z", kLongs, true, false, names,
+      [&](char c, std::string_view arg) {
+         if (c == 's') suffix = arg;
+         if (c == 'a' || c == 's') multiple = true;
+         if (c == 'z') zero = true;
+      });
+   if (!parsed) return 1;
+   if (names.empty()) return usage_error(ctx, "basename", {"missing operand"});
+   if (!multiple) {
+      if (names.size() > 2)
+         return usage_error(ctx, "basename",
+                            {"extra operand ", quote(ctx, names[2])});
+      if (names.size() == 2) suffix = names[1];
+      names.resize(1);
+   }
+
+   OutputSink out = output_of(ctx);
+   const std::string_view end = zero ? "\0"sv : "\n"sv;
+   for (const std::string_view name : names)
+      out.write({base_name(name, suffix), end});
+   return out.flush() ? 0 : 1;
+}
+
+int bi_dirname(const BuiltinContext& ctx, const Argv& argv) {
+   static constexpr std::array<LongOption, 1> kLongs{{{"zero", 'z'}}};
+   bool zero = false;
+   std::vector<std::string_view> names;
+   if (!parse_options(ctx, "dirname", argv, "z", kLongs, false, false, names,
+                      [&](char, std::string_view) { zero = true; }))
+      return 1;
+   if (names.empty()) return usage_error(ctx, "dirname", {"missing operand"});
+
+   OutputSink out = output_of(ctx);
+   const std::string_view end = zero ? "\0"sv : "\n"sv;
+   for (const std::string_view name : names) out.write({dir_name(name), end});
+   return out.flush() ? 0 : 1;
+}
+
+int bi_seq(const BuiltinContext& ctx, const Argv& argv) {
+   static constexpr std::array<LongOption, 3> kLongs{
+      {{"format", 'f'}, {"separator", 's'}, {"equal-width", 'w'}}};
+   std::string_view format, separator = "\n";
+   bool has_format = false, equal_width = false;
+   std::vector<std::string_view> ops;
+   const bool parsed = parse_options(
+      ctx, "seq", argv, "f:s:w", kLongs, true, true, ops,
+      [&](char c, std::string_view arg) {
+         if (c == 'f') {
+            format = arg;
+            has_format = true;
+         }
+         if (c == 's') separator = arg;
+         if (c == 'w') equal_width = true;
+      });
+   if (!parsed) return 1;
+   if (ops.empty()) return usage_error(ctx, "seq", {"missing operand"});
+   if (ops.size() > 3)
+      return usage_error(ctx, "seq", {"extra operand ", quote(ctx, ops[3])});
+
+   std::size_t prefix = 0, suffix = 0;
+   std::string fmt;
+   if (has_format) {
+      fmt = seq_format(ctx, format, prefix, suffix);
+      if (fmt.empty()) return 1;
+      if (equal_width)
+         return usage_error(ctx, "seq",
+                            {"format string may not be specified when "
+                             "printing equal width strings"});
+   }
+
+   // The operands are argv's strings, so each is NUL-terminated.
+   const auto c_str = [](std::string_view s) { return s.data(); };
+   OutputSink out = output_of(ctx);
+   const std::size_t n = ops.size();
+   const std::string_view step_text = n == 3 ? ops[1] : "1"sv;
+   if (!has_format && !equal_width && all_digits(ops[0]) &&
+       all_digits(ops[n - 1]) && all_digits(step_text)) {
+      const unsigned step =
+         static_cast<unsigned>(std::strtoul(c_str(step_text), nullptr, 10));
+      if (step >= 1 && step <= 200)
+         return seq_digits(out, n == 1 ? "1"sv : ops[0], ops[n - 1], step,
+                           separator);
+   }
+
+   SeqOperand first{.value = 1, .width = 1, .precision = 0};
+   SeqOperand step{.value = 1, .width = 1, .precision = 0};
+   SeqOperand last;
+   if (!scan_seq_operand(ctx, c_str(ops[n - 1]), last)) return 1;
+   if (n >= 2 && !scan_seq_operand(ctx, c_str(ops[0]), first)) return 1;
+   if (n == 3) {
+      if (!scan_seq_operand(ctx, c_str(ops[1]), step)) return 1;
+      if (step.value == 0)
+         return usage_error(ctx, "seq",
+                            {"invalid Zero increment value: ",
+                             quote(ctx, ops[1])});
+   }
+
+   if (!has_format) {
+      const int prec = std::max(first.precision, step.precision);
+      if (prec == INT_MAX || last.precision == INT_MAX) {
+         fmt = "%Lg";
+      } else if (equal_width) {
+         int first_width = first.width + (prec - first.precision);
+         int last_width = last.width + (prec - last.precision);
+         if (last.precision && prec == 0) --last_width;
+         if (last.precision == 0 && prec) ++last_width;
+         if (first.precision == 0 && prec) ++first_width;
+         fmt = "%0" + std::to_string(std::max(first_width, last_width)) +
+               "." + std::to_string(prec) + "Lf";
+      } else {
+         fmt = "%." + std::to_string(prec) + "Lf";
+      }
+   }
+
+   const long double a = first.value, d = step.value, z = last.value;
+   if (d < 0 ? a < z : z < a) return 0;
+   // Print through a string, to compare the last number with LAST.
+   const auto text = [&](long double x) {
+      char buf[128];
+      const int len = std::snprintf(buf, sizeof buf, fmt.c_str(), x);
+      if (len < 0) return std::string{};
+      if (static_cast<std::size_t>(len) < sizeof buf)
+         return std::string{buf, static_cast<std::size_t>(len)};
+      std::string big(static_cast<std::size_t>(len), '\0');
+      std::snprintf(big.data(), big.size() + 1, fmt.c_str(), x);
+      return big;
+   };
+   const auto number = [&](const std::string& t) {
+      return t.substr(prefix, t.size() - prefix - suffix);
+   };
+   std::string shown = text(a);
+   bool past = false;
+   for (long double i = 1;; ++i) {
+      out.write(shown);
+      if (past || !out.ok()) break;
+      const long double x = a + i * d;
+      std::string next = text(x);
+      if (d < 0 ? x < z : z < x) {
+         // One step past LAST that prints as LAST is rounding error in
+         // the steps: print it, unless it looks like the number before.
+         const std::string digits = number(next);
+         char* end = nullptr;
+         const long double v = std::strtold(digits.c_str(), &end);
+         if (end == digits.c_str() || *end != '\0' || v != z ||
+             number(shown) == digits)
+            break;
+         past = true;
+      }
+      out.write(separator);
+      shown = std::move(next);
+   }
+   out.write("\n");
+   return out.flush() ? 0 : 1;
+}
+
+std::span<const std::pmr::string> forced_external(
+   std::span<const std::pmr::string> argv) noexcept {
+   if (argv.size() < 2 || argv[0] != "command") return {};
+   if (argv[1] == "--") return argv.subspan(2);
+   if (argv[1].size() > 1 && argv[1].starts_with('-')) return {};
+   return argv.subspan(1);
+}
+
+// `command NAME ...` never gets here: the executor spawns NAME. What is
+// left is `command` alone and `command -v`/`-V NAME`, as in bash.
+int bi_command(const BuiltinContext& ctx, const Argv& argv) {
+   bool describe = false, verbose = false;
+   std::size_t i = 1;
+   for (; i < argv.size(); ++i) {
+      const std::string_view a = argv[i];
+      if (a == "--") {
+         ++i;
+         break;
+      }
+      if (a.size() < 2 || a[0] != '-') break;
+      for (const char c : a.substr(1)) {
+         if (c == 'v') {
+            describe = true;
+         } else if (c == 'V') {
+            verbose = true;
+         } else {
+            write_err(ctx, {"command: -", std::string_view{&c, 1},
+                            ": invalid option"});
+            write_err(ctx, {"command: usage: command [-vV] name [arg ...]"});
+            return 2;
+         }
+      }
+   }
+   if (i == argv.size()) return 0;
+   if (!describe && !verbose) {
+      write_err(ctx, {"command: ", argv[i], ": cannot run here"});
+      return 126;
+   }
+
+   std::string path = [&] {
+      std::string value, err;
+      const VarStore::Var* v = ctx.vars ? ctx.vars->find("PATH") : nullptr;
+      if (v && lower_value(v->value, value, err)) return value;
+      const char* own = std::getenv("PATH");
+      return std::string{own ? own : ""};
+   }();
+
+   OutputSink out = output_of(ctx);
+   int status = 0;
+   for (; i < argv.size(); ++i) {
+      const std::string_view name = argv[i];
+      const char* what = nullptr;
+      std::string found;
+      if (ctx.vars && ctx.vars->function(name)) {
+         what = " is a function";
+      } else if (ctx.builtins && ctx.builtins->lookup(name)) {
+         what = " is a shell builtin";
+      } else if (name.find('/') != std::string_view::npos) {
+         if (::access(std::string{name}.c_str(), X_OK) == 0) found = name;
+      } else if (!name.empty()) {
+         found = search_path(name, path);
+      }
+      if (!what && found.empty()) {
+         if (verbose) write_err(ctx, {"command: ", name, ": not found"});
+         status = 1;
+      } else if (!verbose) {
+         out.line(what ? name : std::string_view{found});
+      } else if (what) {
+         out.line({name, what});
+      } else {
+         out.line({name, " is ", found});
+      }
+   }
+   return out.flush() ? status : 1;
+}
+
+} // namespace clanker
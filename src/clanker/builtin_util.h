@@ -0,0 +1,86 @@
+// src/clanker/builtin_util.h
+#pragma once
+
+#include <array>
+#include <memory_resource>
+#include <span>
+#include <string>
+
+#include "clanker/builtins.h"
+
+namespace clanker {
+
+// The small utilities scripts run in loops (built-ins.md, "Utilities"),
+// in the shell rather than spawned. What they print, and their status, is
+// that of GNU coreutils, which is what ran before.
+int bi_true(const BuiltinContext& ctx, const Argv& argv);
+int bi_false(const BuiltinContext& ctx, const Argv& argv);
+int bi_echo(const BuiltinContext& ctx, const Argv& argv);
+int bi_printf(const BuiltinContext& ctx, const Argv& argv);
+int bi_test(const BuiltinContext& ctx, const Argv& argv); // also `[`
+int bi_basename(const BuiltinContext& ctx, const Argv& argv);
+int bi_dirname(const BuiltinContext& ctx, const Argv& argv);
+int bi_seq(const BuiltinContext& ctx, const Argv& argv);
+int bi_command(const BuiltinContext& ctx, const Argv& argv);
+
+// Whether commands run in a UTF-8 locale, going by the LC_ALL, LC_CTYPE or
+// LANG the shell exports to them, as setlocale(LC_ALL, "") in coreutils
+// would; BuiltinContext::utf8 for a built-in run without `vars`.
+[[nodiscard]] bool utf8_locale(const BuiltinContext& ctx);
+
+// `command NAME ARG...` runs NAME ARG... as an external command, even
+// where a built-in or function has that name; the executor spawns the
+// span this returns. Empty for any other command, `command -v NAME`
+// included, which is the built-in.
+[[nodiscard]] std::span<const std::pmr::string> forced_external(
+   std::span<const std::pmr::string> argv) noexcept;
+
+inline constexpr std::array kUtilBuiltins{
+   Builtin{.name = ":",
+           .fn = bi_true,
+           .help = ": — do nothing, successfully",
+           .pure = true},
+   Builtin{.name = "true",
+           .fn = bi_true,
+           .help = "true — return 0",
+           .pure = true},
+   Builtin{.name = "false",
+           .fn = bi_false,
+           .help = "false — return 1",
+           .pure = true},
+   Builtin{.name = "echo",
+           .fn = bi_echo,
+           .help = "echo [-neE] [arg ...] — print the arguments",
+           .pure = true},
+   Builtin{.name = "printf",
+           .fn = bi_printf,
+           .help = "printf format [arg ...] — print the arguments formatted",
+           .pure = true},
+   Builtin{.name = "test",
+           .fn = bi_test,
+           .help = "test expr — evaluate a condition",
+           .pure = true},
+   Builtin{.name = "[",
+           .fn = bi_test,
+           .help = "[ expr ] — evaluate a condition",
+           .pure = true},
+   Builtin{.name = "basename",
+           .fn = bi_basename,
+           .help = "basename [-az] [-s suffix] name ... — strip directories",
+           .pure = true},
+   Builtin{.name = "dirname",
+           .fn = bi_dirname,
+           .help = "dirname [-z] name ... — strip the last component",
+           .pure = true},
+   Builtin{.name = "seq",
+           .fn = bi_seq,
+           .help = "seq [-w] [-f fmt] [-s sep] [first [incr]] last — print "
+                   "numbers",
+           .pure = true},
+   Builtin{.name = "command",
+           .fn = bi_command,
+           .help = "command [-vV] name [arg ...] — run the external name, or "
+                   "describe it"},
+};
+
+} // namespace clanker
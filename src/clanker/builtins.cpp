@@ -1,40 +1,111 @@
 #include "clanker/builtins.h"
 
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+
+#include "clanker/builtin_core.h"
+#include "clanker/builtin_llm.h"
+#include "clanker/builtin_util.h"
 
 namespace clanker {
+namespace {
+
+// Every module's table, as one.
+template<std::size_t... N>
+constexpr auto join(const std::array<Builtin, N>&... tables) {
+   std::array<Builtin, (N + ...)> all{};
+   std::size_t i = 0;
+   ((std::ranges::copy(tables, all.begin() + i), i += N), ...);
+   return all;
+}
+
+constexpr auto kTable = join(kCoreBuiltins, kLlmBuiltins, kUtilBuiltins);
+
+// FNV-1a, with a final mix so that the low bits depend on every byte.
+constexpr std::uint64_t name_hash(std::string_view s,
+                                  std::uint64_t seed) noexcept {
+   std::uint64_t h = 0xcbf29ce484222325ull ^ seed;
+   for (const char c : s) {
+      h ^= static_cast<unsigned char>(c);
+      h *= 0x100000001b3ull;
+   }
+   return h ^ (h >> 31);
+}
+
+// A perfect hash of kTable's names: name_hash(name, seed) & (kSlots - 1)
+// is a different slot for every name. The slots are a quarter full, so a
+// seed that works is found after a few tries, at compile time.
+constexpr std::size_t kSlots = std::bit_ceil(kTable.size() * 4);
+
+struct Index {
+   std::uint64_t seed{0};
+   std::array<std::uint8_t, kSlots> slot{}; // 1 + index into kTable; 0: none
+   bool found{false};
+};
 
-void Builtins::add(std::string name, BuiltinFn fn, std::string help) {
-   map_.insert_or_assign(std::move(name), Entry{std::move(fn), std::move(help)});
+constexpr Index make_index() {
+   static_assert(kTable.size() < 255);
+   Index ix;
+   for (; ix.seed < 4096; ++ix.seed) {
+      ix.slot = {};
+      bool clash = false;
+      for (std::size_t i = 0; i < kTable.size() && !clash; ++i) {
+         auto& s = ix.slot[name_hash(kTable[i].name, ix.seed) & (kSlots - 1)];
+         clash = s != 0;
+         s = static_cast<std::uint8_t>(i + 1);
+      }
+      if (!clash) {
+         ix.found = true;
+         break;
+      }
+   }
+   return ix;
 }
 
-std::optional<BuiltinFn> Builtins::find(std::string_view name) const {
-   auto it = map_.find(std::string{name});
-   if (it == map_.end())
-      return std::nullopt;
-   return it->second.fn;
+constexpr Index kIndex = make_index();
+static_assert(kIndex.found, "built-in names must be distinct");
+
+const Builtin* find_static(std::string_view name) noexcept {
+   const std::uint8_t s =
+      kIndex.slot[name_hash(name, kIndex.seed) & (kSlots - 1)];
+   if (s == 0 || kTable[s - 1].name != name) return nullptr;
+   return &kTable[s - 1];
+}
+
+} // namespace
+
+void Builtins::add(std::string name, BuiltinFn fn, std::string help,
+                   bool pure) {
+   auto [it, _] = added_.insert_or_assign(
+      std::move(name), Added{.help = std::move(help), .builtin = {}});
+   it->second.builtin = Builtin{.name = it->first,
+                                .fn = fn,
+                                .help = it->second.help,
+                                .pure = pure};
+}
+
+const Builtin* Builtins::lookup(std::string_view name) const noexcept {
+   if (!added_.empty()) {
+      const auto it = added_.find(name);
+      if (it != added_.end()) return &it->second.builtin;
+   }
+   return find_static(name);
 }
 
 std::vector<std::pair<std::string, std::string>> Builtins::help_items() const {
    std::vector<std::pair<std::string, std::string>> items;
-   items.reserve(map_.size());
-   for (const auto& [k, v] : map_)
-      items.emplace_back(k, v.help);
+   items.reserve(kTable.size() + added_.size());
+   for (const Builtin& b : kTable)
+      if (!added_.contains(b.name)) items.emplace_back(b.name, b.help);
+   for (const auto& [name, a] : added_)
+      items.emplace_back(name, a.help);
    std::sort(items.begin(), items.end(),
              [](const auto& a, const auto& b) { return a.first < b.first; });
    return items;
 }
 
-void add_core_builtins(Builtins&);
-void add_llm_builtins(Builtins&);
-void set_help_registry(Builtins&);
+Builtins make_builtins() { return Builtins{}; }
 
-Builtins make_builtins() {
-   Builtins b;
-   add_core_builtins(b);
-   add_llm_builtins(b);
-   set_help_registry(b);
-   return b;
-}
 } // namespace clanker
-
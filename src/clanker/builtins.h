@@ -3,7 +3,9 @@
 #pragma once
 
 #include <filesystem>
+#include <cstddef>
 #include <functional>
+#include <memory_resource>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -11,8 +13,15 @@
 #include <utility>
 #include <vector>
 
+#include "clanker/output.h"
+
 namespace clanker {
 
+class Builtins;
+class InputBuffers;
+class ParseCache;
+class VarStore;
+
 struct BuiltinContext {
    std::filesystem::path root;
 
@@ -20,27 +29,78 @@ struct BuiltinContext {
    int in_fd =  0; // STDIN_FILENO
    int out_fd = 1; // STDOUT_FILENO
    int err_fd = 2; // STDERR_FILENO
+   bool out_tty = false; // out_fd is a terminal: output goes a line at a time
 
    // Shell state (bash-like). These are maintained by clanker, not the OS env.
    std::filesystem::path* cwd = nullptr;    // current working directory
    std::filesystem::path* oldpwd = nullptr; // previous working directory
+   VarStore* vars = nullptr;                // shell variables
+   // Without `vars` (a pipeline stage on a worker thread): whether the
+   // locale is UTF-8, taken from them when the stage was set up.
+   bool utf8 = false;
+
+   // `exit` stores its status here and the shell stops once the current
+   // command returns. When null, `exit` ends the process directly.
+   std::optional<int>* exit_request = nullptr;
+
+   // Shell services (may be null, e.g. in tests).
+   const ParseCache* parse_cache = nullptr;
+   InputBuffers* input = nullptr; // read-ahead for `read`
+   const Builtins* builtins = nullptr; // for `help`
 };
 
-using Argv = std::vector<std::string>;
-using BuiltinFn = std::function<int(const BuiltinContext&, const Argv&)>;
+// A built-in writes through these (output.h), not to its fds directly.
+// Error messages are lines, and each is written as it comes.
+inline OutputSink output_of(const BuiltinContext& ctx) noexcept {
+   return OutputSink(ctx.out_fd, ctx.out_tty ? OutputSink::Mode::Line
+                                             : OutputSink::Mode::Full);
+}
+inline OutputSink errors_of(const BuiltinContext& ctx) noexcept {
+   return OutputSink(ctx.err_fd, OutputSink::Mode::Line);
+}
+
+// Same type as SimpleCommand::argv, so built-ins run straight off the AST.
+using Argv = std::pmr::vector<std::pmr::string>;
+using BuiltinFn = int (*)(const BuiltinContext&, const Argv&);
 
+struct Builtin {
+   std::string_view name;
+   BuiltinFn fn;
+   std::string_view help;
+   // A `pure` built-in leaves shell state (cwd, exit, backends) alone, so
+   // it can run in-process where bash would use a subshell, e.g. in a
+   // command substitution.
+   bool pure{false};
+};
+
+// The built-ins of a shell. The shell's own are one table fixed at
+// compile time (builtins.cpp): a name is found with one hash, one probe
+// and one compare, without allocating. Built-ins add()ed at run time are
+// looked up first, in a map searched by string_view.
 class Builtins {
  public:
-   void add(std::string name, BuiltinFn fn, std::string help);
-   std::optional<BuiltinFn> find(std::string_view name) const;
-   std::vector<std::pair<std::string, std::string>> help_items() const;
+   // Add a built-in, or replace one of the same name.
+   void add(std::string name, BuiltinFn fn, std::string help,
+            bool pure = false);
+
+   // Null if there is no such built-in; the pointer stays valid while the
+   // table lives.
+   [[nodiscard]] const Builtin* lookup(std::string_view name) const noexcept;
+   [[nodiscard]] std::vector<std::pair<std::string, std::string>>
+   help_items() const;
 
  private:
-   struct Entry {
-      BuiltinFn fn;
+   struct Hash {
+      using is_transparent = void;
+      std::size_t operator()(std::string_view s) const noexcept {
+         return std::hash<std::string_view>{}(s);
+      }
+   };
+   struct Added {
       std::string help;
+      Builtin builtin; // views the key and `help`
    };
-   std::unordered_map<std::string, Entry> map_;
+   std::unordered_map<std::string, Added, Hash, std::equal_to<>> added_;
 };
 
 Builtins make_builtins();
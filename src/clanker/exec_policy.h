@@ -2,6 +2,7 @@
 #pragma once
 
 #include <filesystem>
+#include <memory_resource>
 #include <span>
 #include <string>
 #include <vector>
@@ -9,7 +10,9 @@
 namespace clanker {
 
 struct SpawnSpec {
-   std::vector<std::string> argv;
+   // Borrowed from the caller (usually SimpleCommand::argv); must stay alive
+   // until spawn_external returns.
+   std::span<const std::pmr::string> argv;
 
    // Use -1 to inherit from the parent.
    int stdin_fd = -1;
@@ -18,6 +21,9 @@ struct SpawnSpec {
 
    // FDs to close in the child before exec (pipeline hygiene).
    std::vector<int> close_fds;
+
+   // NAME=value environment, null-terminated; null for the shell's own.
+   char* const* envp = nullptr;
 };
 
 struct SpawnResult {
@@ -31,7 +37,9 @@ class ExecPolicy {
    virtual ~ExecPolicy() = default;
 
    // Return false and set reason if this external command is disallowed.
-   virtual bool allow_external(std::span<const std::string> argv,
+   // The answer must depend on argv alone: a compiled command list asks
+   // once per command, not once per run (ir.h).
+   virtual bool allow_external(std::span<const std::pmr::string> argv,
                                std::string& reason) const = 0;
 
    // Spawn an external process. Policy may rewrite argv/env/paths.
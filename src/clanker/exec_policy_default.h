@@ -16,7 +16,7 @@ class DefaultExecPolicy final : public ExecPolicy {
    explicit DefaultExecPolicy(std::filesystem::path root)
       : root_(std::move(root)) {}
 
-   bool allow_external(std::span<const std::string>,
+   bool allow_external(std::span<const std::pmr::string>,
                        std::string&) const override {
       return true;
    }
@@ -24,7 +24,7 @@ class DefaultExecPolicy final : public ExecPolicy {
    SpawnResult spawn_external(const SpawnSpec& spec) const override {
       const int pid_or_err =
          clanker::spawn_external(spec.argv, spec.stdin_fd, spec.stdout_fd,
-                                 spec.stderr_fd, spec.close_fds);
+                                 spec.stderr_fd, spec.close_fds, spec.envp);
       return SpawnResult{.pid_or_err = pid_or_err};
    }
 
@@ -1,12 +1,23 @@
 // src/clanker/executor.cpp
+#include <algorithm>
 #include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
+#include <memory_resource>
+#include <span>
+#include <sys/mman.h>
 #include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
 #include <vector>
 
 #include "clanker/executor.h"
+#include "clanker/builtin_util.h"
+#include "clanker/parser.h"
+#include "clanker/signals.h"
 #include "clanker/util.h"
 
 namespace clanker {
@@ -19,8 +30,12 @@ int status_to_exit_code(int status) {
    return 1;
 }
 
-bool is_builtin(const Builtins& b, const SimpleCommand& st) {
-   return !st.argv.empty() && b.find(st.argv.front()).has_value();
+// The words an external command `argv` spawns: NAME ARG... for
+// `command NAME ARG...`.
+std::span<const std::pmr::string> spawn_argv(
+   std::span<const std::pmr::string> argv) noexcept {
+   const auto forced = forced_external(argv);
+   return forced.empty() ? argv : forced;
 }
 
 static int deny_privilege_drift() {
@@ -30,48 +45,9 @@ static int deny_privilege_drift() {
    return 125;
 }
 
-class UniqueFd {
- public:
-   UniqueFd() = default;
-   explicit UniqueFd(int fd)
-      : fd_(fd) {}
-   ~UniqueFd() { reset(); }
-
-   UniqueFd(const UniqueFd&) = delete;
-   UniqueFd& operator=(const UniqueFd&) = delete;
-
-   UniqueFd(UniqueFd&& o) noexcept
-      : fd_(o.fd_) {
-      o.fd_ = -1;
-   }
-   UniqueFd& operator=(UniqueFd&& o) noexcept {
-      if (this != &o) {
-         reset();
-         fd_ = o.fd_;
-         o.fd_ = -1;
-      }
-      return *this;
-   }
-
-   int get() const noexcept { return fd_; }
-   int release() noexcept {
-      const int out = fd_;
-      fd_ = -1;
-      return out;
-   }
-
-   void reset(int fd = -1) noexcept {
-      if (fd_ != -1) ::close(fd_);
-      fd_ = fd;
-   }
-
- private:
-   int fd_{-1};
-};
-
 int make_pipe(UniqueFd& r, UniqueFd& w) {
    int fds[2] = {-1, -1};
-   if (::pipe(fds) != 0) return errno ? errno : 1;
+   if (::pipe2(fds, O_CLOEXEC) != 0) return errno ? errno : 1;
    r.reset(fds[0]);
    w.reset(fds[1]);
    return 0;
@@ -99,7 +75,7 @@ int open_redir_fd(const Redirection& r) {
 
 bool is_std_fd(int fd) noexcept { return fd == 0 || fd == 1 || fd == 2; }
 
-int apply_redirs_to_spawn(const std::vector<Redirection>& redirs, int& in_fd,
+int apply_redirs_to_spawn(std::span<const Redirection> redirs, int& in_fd,
                           int& out_fd, int& err_fd, UniqueFd& in_owner,
                           UniqueFd& out_owner, UniqueFd& err_owner,
                           std::string& err_msg) {
@@ -111,8 +87,11 @@ int apply_redirs_to_spawn(const std::vector<Redirection>& redirs, int& in_fd,
 
       const int ofd = open_redir_fd(r);
       if (ofd < 0) {
-         err_msg = "error: cannot open '" + r.target + "': " +
-                   std::string(::strerror(-ofd)) + "\n";
+         err_msg = "error: cannot open '";
+         err_msg += r.target;
+         err_msg += "': ";
+         err_msg += ::strerror(-ofd);
+         err_msg += "\n";
          return 1;
       }
 
@@ -133,7 +112,7 @@ int apply_redirs_to_spawn(const std::vector<Redirection>& redirs, int& in_fd,
    return 0;
 }
 
-int apply_redirs_in_process(const std::vector<Redirection>& redirs,
+int apply_redirs_in_process(std::span<const Redirection> redirs,
                             UniqueFd& save0, UniqueFd& save1, UniqueFd& save2,
                             std::string& err_msg) {
    auto save_if_needed = [&](int fd, UniqueFd& save) -> bool {
@@ -156,8 +135,11 @@ int apply_redirs_in_process(const std::vector<Redirection>& redirs,
 
       const int ofd = open_redir_fd(r);
       if (ofd < 0) {
-         err_msg = "error: cannot open '" + r.target + "': " +
-                   std::string(::strerror(-ofd)) + "\n";
+         err_msg = "error: cannot open '";
+         err_msg += r.target;
+         err_msg += "': ";
+         err_msg += ::strerror(-ofd);
+         err_msg += "\n";
          return 1;
       }
 
@@ -172,6 +154,40 @@ int apply_redirs_in_process(const std::vector<Redirection>& redirs,
    return 0;
 }
 
+// Append everything readable from `fd` to `out`. Reads go straight into the
+// string's tail, starting at 4 KiB and doubling up to 1 MiB, so large
+// outputs take few syscalls and small ones do not allocate much.
+void read_all(int fd, std::string& out) {
+   constexpr std::size_t kFirstChunk = 4096;
+   constexpr std::size_t kMaxChunk = 1u << 20;
+
+   std::size_t chunk = kFirstChunk;
+   for (;;) {
+      const std::size_t used = out.size();
+      ssize_t n = 0;
+      out.resize_and_overwrite(used + chunk, [&](char* p, std::size_t) {
+         do {
+            n = ::read(fd, p + used, chunk);
+         } while (n < 0 && errno == EINTR);
+         return used + static_cast<std::size_t>(std::max<ssize_t>(n, 0));
+      });
+      if (n <= 0) return;
+      if (static_cast<std::size_t>(n) == chunk)
+         chunk = std::min(chunk * 2, kMaxChunk);
+   }
+}
+
+int wait_exit_code(pid_t pid) {
+   int status = 0;
+   for (;;) {
+      const pid_t w = ::waitpid(pid, &status, 0);
+      if (w == -1 && errno == EINTR) continue;
+      if (w == -1) status = 1;
+      break;
+   }
+   return status_to_exit_code(status);
+}
+
 void restore_std_fds(UniqueFd& save0, UniqueFd& save1, UniqueFd& save2) {
    if (save0.get() != -1) {
       (void)::dup2(save0.get(), 0);
@@ -187,72 +203,186 @@ void restore_std_fds(UniqueFd& save0, UniqueFd& save1, UniqueFd& save2) {
    }
 }
 
+// Calls nest on the C++ stack; the limit turns runaway recursion into an
+// error well before the stack runs out.
+std::size_t max_call_depth_from_environment() {
+   std::size_t n = 1000;
+   const char* s = std::getenv("CLANKER_MAX_CALL_DEPTH");
+   if (s == nullptr || *s == '\0') return n;
+   std::size_t v = 0;
+   const auto [p, ec] = std::from_chars(s, s + std::strlen(s), v);
+   if (ec == std::errc{} && *p == '\0') n = v;
+   return n;
+}
+
 } // namespace
 
 Executor::Executor(Builtins builtins, const ExecPolicy& policy,
                    std::filesystem::path* cwd, std::filesystem::path* oldpwd,
-                   SecurityPolicy sec)
+                   VarStore* vars, SecurityPolicy sec,
+                   const ParseCache* parse_cache)
    : builtins_(std::move(builtins))
    , policy_(policy)
    , sec_(sec)
    , cwd_(cwd)
-   , oldpwd_(oldpwd) {}
+   , oldpwd_(oldpwd)
+   , vars_(vars)
+   , parse_cache_(parse_cache)
+   , max_call_depth_(max_call_depth_from_environment()) {}
+
+bool Executor::bind_assigns(const SimpleCommand& cmd,
+                            std::optional<VarStore::Frame>* scope,
+                            std::string& err) {
+   if (cmd.assigns.empty()) return true;
+   if (scope) scope->emplace(*vars_);
+   const ExpandContext ectx = expand_context();
+   const WordPrograms programs{.exprs = cmd.exprs, .ariths = cmd.ariths};
+   std::string_view name;
+   Value value;
+   for (const auto& a : cmd.assigns) {
+      if (!expand_assignment(a, programs, ectx, name, value, err))
+         return false;
+      if (scope) (void)vars_->make_local(name);
+      vars_->set(name, std::move(value));
+      if (scope) vars_->set_exported(name, true);
+   }
+   return true;
+}
 
 int Executor::run_simple(const SimpleCommand& cmd) {
    // Allow redirection-only commands.
    if (cmd.argv.empty()) {
-      if (cmd.redirs.empty()) return 0;
-      UniqueFd save0, save1, save2;
-      std::string em;
-      const int rc =
-         apply_redirs_in_process(cmd.redirs, save0, save1, save2, em);
-      if (rc != 0) {
-         if (em.empty()) em = "error: redirection failed\n";
-         fd_write_all(STDERR_FILENO, em);
-         restore_std_fds(save0, save1, save2);
-         return (rc == 2) ? 2 : 1;
+      if (!cmd.redirs.empty()) {
+         // For now, do not persist redirections in the shell process: the
+         // files are opened (and created or truncated) and closed again.
+         int in_fd = -1, out_fd = -1, err_fd = -1;
+         UniqueFd in_owner, out_owner, err_owner;
+         std::string em;
+         const int rc =
+            apply_redirs_to_spawn(cmd.redirs, in_fd, out_fd, err_fd, in_owner,
+                                  out_owner, err_owner, em);
+         if (rc != 0) {
+            if (em.empty()) em = "error: redirection failed\n";
+            fd_write_all(STDERR_FILENO, em);
+            return (rc == 2) ? 2 : 1;
+         }
       }
-      // For now, do not persist redirections in the shell process.
-      restore_std_fds(save0, save1, save2);
-      return 0;
-   }
-
-   if (!sec_.identity_unchanged()) return deny_privilege_drift();
 
-   // Built-in
-   if (auto fn = builtins_.find(cmd.argv.front())) {
-      UniqueFd save0, save1, save2;
-      std::string em;
-      const int rc =
-         apply_redirs_in_process(cmd.redirs, save0, save1, save2, em);
-      if (rc != 0) {
-         if (em.empty()) em = "error: redirection failed\n";
-         fd_write_all(STDERR_FILENO, em);
-         restore_std_fds(save0, save1, save2);
-         return (rc == 2) ? 2 : 1;
+      // Assignments alone set shell variables. As in bash, the status is
+      // that of the last substitution they ran, if any.
+      std::string err;
+      if (!bind_assigns(cmd, nullptr, err)) {
+         fd_write_all(STDERR_FILENO, "clanker: " + err + "\n");
+         return 1;
       }
+      return subst_status_.value_or(0);
+   }
 
-      BuiltinContext ctx{.root = policy_.root(),
-                         .in_fd = STDIN_FILENO,
-                         .out_fd = STDOUT_FILENO,
-                         .err_fd = STDERR_FILENO,
-                         .cwd = cwd_,
-                         .oldpwd = oldpwd_};
-
-      const int st = (*fn)(ctx, cmd.argv);
+   // Inside a program one check covers built-ins and functions
+   // (run_program()); an external is checked every time. `command NAME`
+   // is an external whatever NAME is.
+   const Value::ProcPtr* proc = find_function(cmd);
+   const Builtin* b = proc || !forced_external(cmd.argv).empty()
+                         ? nullptr
+                         : builtins_.lookup(cmd.argv.front());
+   if (!(identity_ok_ && (proc || b)) && !sec_.identity_unchanged())
+      return deny_privilege_drift();
 
-      restore_std_fds(save0, save1, save2);
-      return st;
-   }
+   if (proc) return call_function(*proc, cmd);
+   if (b) return run_builtin(cmd, b->fn);
 
-   // External
    std::string reason;
-   if (!policy_.allow_external(cmd.argv, reason)) {
+   if (!policy_.allow_external(spawn_argv(cmd.argv), reason)) {
       if (reason.empty()) reason = "disallowed by policy";
       fd_write_all(STDERR_FILENO, "error: " + reason + "\n");
       return 126;
    }
+   return run_external(cmd);
+}
+
+int Executor::run_builtin(const SimpleCommand& cmd, BuiltinFn fn) {
+   // A built-in does its I/O through the fds in its context, so a
+   // redirection is an open() whose fd goes there: the shell's own fds 0-2
+   // are never touched, and nothing needs restoring afterwards.
+   int in_fd = STDIN_FILENO, out_fd = STDOUT_FILENO, err_fd = STDERR_FILENO;
+   UniqueFd in_owner, out_owner, err_owner;
+   std::string em;
+   const int rc = apply_redirs_to_spawn(cmd.redirs, in_fd, out_fd, err_fd,
+                                        in_owner, out_owner, err_owner, em);
+   if (rc != 0) {
+      if (em.empty()) em = "error: redirection failed\n";
+      fd_write_all(STDERR_FILENO, em);
+      return (rc == 2) ? 2 : 1;
+   }
+
+   BuiltinContext ctx{.root = policy_.root(),
+                      .in_fd = in_fd,
+                      .out_fd = out_fd,
+                      .err_fd = err_fd,
+                      .out_tty = stdout_tty_ && out_fd == STDOUT_FILENO,
+                      .cwd = cwd_,
+                      .oldpwd = oldpwd_,
+                      .vars = vars_,
+                      .exit_request = &exit_request_,
+                      .parse_cache = parse_cache_,
+                      .input = &inputs_,
+                      .builtins = &builtins_};
+
+   std::optional<VarStore::Frame> scope;
+   if (!bind_assigns(cmd, &scope, em)) {
+      fd_write_all(err_fd, "clanker: " + em + "\n");
+      return 1;
+   }
+   return fn(ctx, cmd.argv);
+}
+
+const Value::ProcPtr* Executor::find_function(
+   const SimpleCommand& cmd) const noexcept {
+   if (vars_->function_count() == 0 || cmd.argv.empty()) return nullptr;
+   return vars_->function(cmd.argv.front());
+}
+
+int Executor::call_function(Value::ProcPtr proc, const SimpleCommand& cmd) {
+   if (call_depth_ >= max_call_depth_) {
+      fd_write_all(STDERR_FILENO,
+                   "clanker: " + proc->name +
+                      ": maximum function nesting level exceeded (" +
+                      std::to_string(max_call_depth_) + ")\n");
+      return 1;
+   }
+
+   UniqueFd save0, save1, save2;
+   std::string em;
+   const int rc = apply_redirs_in_process(cmd.redirs, save0, save1, save2, em);
+   if (rc != 0) {
+      if (em.empty()) em = "error: redirection failed\n";
+      fd_write_all(STDERR_FILENO, em);
+      restore_std_fds(save0, save1, save2);
+      return (rc == 2) ? 2 : 1;
+   }
+
+   std::optional<VarStore::Frame> scope;
+   if (!bind_assigns(cmd, &scope, em)) {
+      fd_write_all(STDERR_FILENO, "clanker: " + em + "\n");
+      restore_std_fds(save0, save1, save2);
+      return 1;
+   }
+
+   // `local` in the body binds in this frame.
+   const VarStore::Frame frame{*vars_};
+   const std::span<const std::pmr::string> outer =
+      std::exchange(args_, std::span{cmd.argv}.subspan(1));
+   ++call_depth_;
+   const int st = run_program(proc->program, true);
+   --call_depth_;
+   args_ = outer;
+
+   restore_std_fds(save0, save1, save2);
+   return st;
+}
 
+// The policy has allowed `cmd`.
+int Executor::run_external(const SimpleCommand& cmd) {
    UniqueFd in_owner, out_owner, err_owner;
    int in_fd = -1, out_fd = -1, err_fd = -1;
    std::string em;
@@ -264,11 +394,18 @@ int Executor::run_simple(const SimpleCommand& cmd) {
       return (rc == 2) ? 2 : 1;
    }
 
+   std::optional<VarStore::Frame> scope;
+   if (!bind_assigns(cmd, &scope, em)) {
+      fd_write_all(STDERR_FILENO, "clanker: " + em + "\n");
+      return 1;
+   }
+
    SpawnSpec spec;
-   spec.argv = cmd.argv;
+   spec.argv = spawn_argv(cmd.argv);
    spec.stdin_fd = in_fd;
    spec.stdout_fd = out_fd;
    spec.stderr_fd = err_fd;
+   spec.envp = vars_->environment();
 
    const auto r = policy_.spawn_external(spec);
    if (r.pid_or_err < 0) {
@@ -287,309 +424,425 @@ int Executor::run_simple(const SimpleCommand& cmd) {
    return status_to_exit_code(status);
 }
 
-int Executor::run_pipeline_builtin_first(const SimpleCommand& first,
-                                         const Pipeline& pipeline) {
+int Executor::run_pipeline_stages(const Pipeline& pipeline) {
    if (!sec_.identity_unchanged()) return deny_privilege_drift();
 
-   // Pipe from builtin stdout -> stdin of the external pipeline.
-   UniqueFd read_end;
-   UniqueFd write_end;
-   if (int ec = make_pipe(read_end, write_end); ec != 0) return 1;
-
-   // Spawn external stages: 1..end (must be external for now).
-   std::vector<pid_t> pids;
-   pids.reserve(pipeline.stages.size() - 1);
-
-   UniqueFd prev_read(read_end.release());
-
-   for (std::size_t i = 1; i < pipeline.stages.size(); ++i) {
-      const auto& st = pipeline.stages[i];
-      if (st.argv.empty() && st.redirs.empty()) return 2;
-
-      if (!st.argv.empty() && builtins_.find(st.argv.front())) {
-         fd_write_all(STDERR_FILENO,
-                      "error: built-ins in non-first pipeline stages "
-                      "not implemented yet\n");
-         return 2;
-      }
-
-      if (!st.argv.empty()) {
-         std::string reason;
-         if (!policy_.allow_external(st.argv, reason)) {
-            if (reason.empty()) reason = "disallowed by policy";
-            fd_write_all(STDERR_FILENO, "error: " + reason + "\n");
-            return 126;
-         }
-      }
-
-      UniqueFd next_read;
-      UniqueFd next_write;
-      const bool last = (i + 1 == pipeline.stages.size());
-
-      if (!last) {
-         if (int ec = make_pipe(next_read, next_write); ec != 0) return 1;
-      }
-
-      // Redirection-only stage: treat as no-op.
+   // How each stage runs. Every stage is checked, and every pipe and
+   // redirection opened, before any starts.
+   enum class Run : std::uint8_t { Nothing, External, Thread, Fork, Shell };
+   struct Stage {
+      Run run{Run::Nothing};
+      BuiltinFn fn{nullptr};
+      UniqueFd in, out, err; // pipe ends and redirections
+      int in_fd{-1}, out_fd{-1}, err_fd{-1}; // -1: the shell's own
+   };
+   const std::size_t n = pipeline.stages.size();
+   std::vector<Stage> stages(n);
+   for (std::size_t i = 0; i < n; ++i) {
+      const SimpleCommand& st = pipeline.stages[i];
+      Stage& s = stages[i];
       if (st.argv.empty()) {
-         prev_read.reset();
-         if (!last) {
-            next_write.reset();
-            prev_read = std::move(next_read);
-         }
-         continue;
+         if (st.redirs.empty()) return 2;
+         continue; // redirection-only: a no-op
       }
-
-      SpawnSpec spec;
-      spec.argv = st.argv;
-      spec.stdin_fd = prev_read.get();
-      spec.stdout_fd = last ? -1 : next_write.get();
-      spec.stderr_fd = -1;
-
-      // Ensure the external child does not keep the builtin write end open.
-      spec.close_fds.push_back(write_end.get());
-
-      // Apply stage redirections (override pipe defaults).
-      {
-         UniqueFd rin, rout, rerr;
-         int in_fd = spec.stdin_fd;
-         int out_fd = spec.stdout_fd;
-         int err_fd = spec.stderr_fd;
-         std::string em;
-         const int rc =
-            apply_redirs_to_spawn(st.redirs, in_fd, out_fd, err_fd, rin, rout,
-                                  rerr, em);
-         if (rc != 0) {
-            if (em.empty()) em = "error: redirection failed\n";
-            fd_write_all(STDERR_FILENO, em);
-            return (rc == 2) ? 2 : 1;
-         }
-         spec.stdin_fd = in_fd;
-         spec.stdout_fd = out_fd;
-         spec.stderr_fd = err_fd;
+      const Builtin* b = forced_external(st.argv).empty()
+                            ? builtins_.lookup(st.argv.front())
+                            : nullptr;
+      if (b) {
+         s.fn = b->fn;
+         s.run = i + 1 == n ? Run::Shell : b->pure ? Run::Thread : Run::Fork;
+         continue;
       }
-
-      const auto r = policy_.spawn_external(spec);
-
-      if (r.pid_or_err < 0) {
-         const int err = -r.pid_or_err;
-         if (err == ENOENT) return 127;
+      std::string reason;
+      if (!policy_.allow_external(spawn_argv(st.argv), reason)) {
+         if (reason.empty()) reason = "disallowed by policy";
+         fd_write_all(STDERR_FILENO, "error: " + reason + "\n");
          return 126;
       }
-
-      pids.push_back(static_cast<pid_t>(r.pid_or_err));
-
-      // Parent closes what it no longer needs.
-      prev_read.reset();
-      if (!last) next_write.reset();
-      prev_read = std::move(next_read);
+      s.run = Run::External;
    }
-
-   // Run builtin with stdout wired to the pipe, unless redirections override it.
-   int builtin_status = 0;
-   if (auto fn = builtins_.find(first.argv.front())) {
-      UniqueFd save0, save1, save2;
-
-      // Always save the std fds we might touch.
-      save0.reset(::dup(STDIN_FILENO));
-      save1.reset(::dup(STDOUT_FILENO));
-      save2.reset(::dup(STDERR_FILENO));
-      if (save0.get() < 0 || save1.get() < 0 || save2.get() < 0) {
-         fd_write_all(STDERR_FILENO, "error: dup failed\n");
-         restore_std_fds(save0, save1, save2);
+   for (std::size_t i = 0; i + 1 < n; ++i) {
+      if (make_pipe(stages[i + 1].in, stages[i].out) != 0) {
+         fd_write_all(STDERR_FILENO, "error: pipe failed\n");
          return 1;
       }
-
-      // Pipe is the default stdout for the builtin stage.
-      if (::dup2(write_end.get(), STDOUT_FILENO) < 0) {
-         fd_write_all(STDERR_FILENO, "error: dup2 failed\n");
-         restore_std_fds(save0, save1, save2);
-         return 1;
-      }
-
-      // Apply explicit redirections (override the pipe if they touch fd 1).
+   }
+   for (std::size_t i = 0; i < n; ++i) {
+      Stage& s = stages[i];
+      s.in_fd = s.in.get();
+      s.out_fd = s.out.get();
+      UniqueFd rin, rout, rerr;
       std::string em;
       const int rc =
-         apply_redirs_in_process(first.redirs, save0, save1, save2, em);
+         apply_redirs_to_spawn(pipeline.stages[i].redirs, s.in_fd, s.out_fd,
+                               s.err_fd, rin, rout, rerr, em);
       if (rc != 0) {
          if (em.empty()) em = "error: redirection failed\n";
          fd_write_all(STDERR_FILENO, em);
-         restore_std_fds(save0, save1, save2);
          return (rc == 2) ? 2 : 1;
       }
-
-      BuiltinContext ctx{.root = policy_.root(),
-                         .in_fd = STDIN_FILENO,
-                         .out_fd = STDOUT_FILENO,
-                         .err_fd = STDERR_FILENO,
-                         .cwd = cwd_,
-                         .oldpwd = oldpwd_};
-
-      builtin_status = (*fn)(ctx, first.argv);
-
-      restore_std_fds(save0, save1, save2);
-   } else {
-      builtin_status = 2;
+      // A redirection replaces the pipe end, which closes here.
+      if (rin.get() != -1) s.in = std::move(rin);
+      if (rout.get() != -1) s.out = std::move(rout);
+      s.err = std::move(rerr);
    }
 
-   (void)builtin_status; // pipefail not implemented
+   const auto context = [&](const Stage& s) {
+      return BuiltinContext{
+         .root = policy_.root(),
+         .in_fd = s.in_fd != -1 ? s.in_fd : STDIN_FILENO,
+         .out_fd = s.out_fd != -1 ? s.out_fd : STDOUT_FILENO,
+         .err_fd = s.err_fd != -1 ? s.err_fd : STDERR_FILENO,
+         .out_tty = stdout_tty_ && s.out_fd == -1,
+         .cwd = cwd_,
+         .oldpwd = oldpwd_,
+         .vars = vars_,
+         .exit_request = &exit_request_,
+         .parse_cache = parse_cache_,
+         .input = &inputs_,
+         .builtins = &builtins_};
+   };
+   const auto close_stage = [](Stage& s) {
+      s.in.reset();
+      s.out.reset();
+      s.err.reset();
+   };
 
-   // Close write end to deliver EOF to the external pipeline.
-   write_end.reset();
+   std::vector<int> status(n, 0);
+   std::vector<pid_t> pids(n, -1);
+   std::vector<std::thread> threads;
+   threads.reserve(n);
+
+   // Forks come first, while this is still the only thread.
+   const Run order[] = {Run::Fork, Run::External, Run::Thread};
+   for (const Run run : order) {
+      for (std::size_t i = 0; i < n; ++i) {
+         Stage& s = stages[i];
+         if (s.run != run) continue;
+         const SimpleCommand& st = pipeline.stages[i];
+
+         std::optional<VarStore::Frame> scope;
+         std::string err;
+         if (!bind_assigns(st, &scope, err)) {
+            fd_write_all(STDERR_FILENO, "clanker: " + err + "\n");
+            status[i] = 1;
+            close_stage(s);
+            continue;
+         }
 
-   // Wait for externals; return last stage status (bash default).
-   int last_exit = 0;
-   for (std::size_t i = 0; i < pids.size(); ++i) {
-      int status = 0;
-      for (;;) {
-         const pid_t w = ::waitpid(pids[i], &status, 0);
-         if (w == -1 && errno == EINTR) continue;
-         if (w == -1) status = 1;
-         break;
+         if (run == Run::Fork) {
+            const pid_t pid = ::fork();
+            if (pid == 0) {
+               // Keep only this stage's ends, so that the others see EOF.
+               for (std::size_t k = 0; k < n; ++k) {
+                  if (k == i) continue;
+                  for (const UniqueFd* fd :
+                       {&stages[k].in, &stages[k].out, &stages[k].err})
+                     if (fd->get() != -1) ::close(fd->get());
+               }
+               const int code = s.fn(context(s), st.argv);
+               _exit(exit_request_.value_or(code) & 0xff);
+            }
+            if (pid < 0) {
+               fd_write_all(STDERR_FILENO, "clanker: fork failed\n");
+               status[i] = 1;
+            }
+            pids[i] = pid;
+         } else if (run == Run::External) {
+            SpawnSpec spec;
+            spec.argv = spawn_argv(st.argv);
+            spec.stdin_fd = s.in_fd;
+            spec.stdout_fd = s.out_fd;
+            spec.stderr_fd = s.err_fd;
+            spec.envp = vars_->environment();
+            const auto r = policy_.spawn_external(spec);
+            if (r.pid_or_err < 0)
+               status[i] = -r.pid_or_err == ENOENT ? 127 : 126;
+            else
+               pids[i] = static_cast<pid_t>(r.pid_or_err);
+         } else {
+            // A pure built-in touches no shell state, so it can run beside
+            // the shell; it gets copies of the directories and, instead of
+            // the variables, the locale they set. The thread owns the
+            // stage's ends and closes them when the built-in returns.
+            BuiltinContext ctx = context(s);
+            ctx.utf8 = utf8_locale(ctx);
+            ctx.vars = nullptr;
+            ctx.exit_request = nullptr;
+            ctx.input = nullptr;
+            threads.emplace_back(
+               [&s, &st, &result = status[i], ctx,
+                cwd = cwd_ ? *cwd_ : std::filesystem::path{},
+                oldpwd = oldpwd_ ? *oldpwd_ : std::filesystem::path{}]()
+                  mutable {
+                  // A reader that is gone is EPIPE for the built-in, not
+                  // SIGPIPE for the shell.
+                  sigset_t pipe;
+                  sigemptyset(&pipe);
+                  sigaddset(&pipe, SIGPIPE);
+                  pthread_sigmask(SIG_BLOCK, &pipe, nullptr);
+                  ctx.cwd = &cwd;
+                  ctx.oldpwd = &oldpwd;
+                  result = s.fn(ctx, st.argv);
+                  s.in.reset();
+                  s.out.reset();
+                  s.err.reset();
+               });
+            continue;
+         }
+         close_stage(s);
+      }
+   }
+   for (Stage& s : stages)
+      if (s.run == Run::Nothing) close_stage(s);
+
+   // The last stage, if it is a built-in, runs in the shell itself, so
+   // `... | read x` sets x.
+   Stage& last = stages.back();
+   if (last.run == Run::Shell) {
+      const SimpleCommand& st = pipeline.stages.back();
+      std::optional<VarStore::Frame> scope;
+      std::string err;
+      if (bind_assigns(st, &scope, err)) {
+         status.back() = (*last.fn)(context(last), st.argv);
+      } else {
+         fd_write_all(STDERR_FILENO, "clanker: " + err + "\n");
+         status.back() = 1;
       }
-      if (i + 1 == pids.size()) last_exit = status_to_exit_code(status);
+      close_stage(last);
    }
 
-   return last_exit;
+   for (std::thread& t : threads) t.join();
+   for (std::size_t i = 0; i < n; ++i)
+      if (pids[i] > 0) status[i] = wait_exit_code(pids[i]);
+   return status.back();
 }
 
-int Executor::run_pipeline_all_external(const Pipeline& pipeline) {
+int Executor::run_pipeline(const Pipeline& pipeline) {
+   subst_status_.reset();
    if (pipeline.stages.empty()) return 0;
-   if (!sec_.identity_unchanged()) return deny_privilege_drift();
+   if (has_compound(pipeline))
+      return run_program(compile_ir(pipeline, builtins_, policy_));
+   if (!needs_expansion(pipeline))
+      return last_status_ = run_expanded(pipeline);
+
+   // Expanded words live only while the pipeline runs.
+   std::pmr::monotonic_buffer_resource arena;
+   Pipeline expanded{AstAllocator{&arena}};
+   std::string err;
+   if (!expand_pipeline(pipeline, expanded, expand_context(), err)) {
+      fd_write_all(STDERR_FILENO, "clanker: " + err + "\n");
+      return last_status_ = 1;
+   }
+   return last_status_ = run_expanded(expanded);
+}
 
-   // Validate and policy-check first (fail fast, no partial execution).
-   for (const auto& st : pipeline.stages) {
-      if (st.argv.empty() && st.redirs.empty()) return 2;
+ExpandContext Executor::expand_context() {
+   subst_status_.reset();
+   return {.limits = limits_,
+           .globs = globs_,
+           .vm = vm_,
+           .arith = arith_,
+           .vars = vars_,
+           .status = last_status_,
+           .substitute = [this](std::string_view body, std::string& out,
+                                int& status, std::string& err) {
+              return substitute(body, out, status, err);
+           },
+           .args = args_,
+           .subst_status = &subst_status_};
+}
 
-      if (!st.argv.empty() && builtins_.find(st.argv.front())) {
-         fd_write_all(STDERR_FILENO,
-                      "error: built-ins in pipelines not implemented yet\n");
-         return 2;
-      }
+bool Executor::substitute(std::string_view body, std::string& out,
+                          int& status, std::string& err) {
+   if (!sec_.identity_unchanged()) {
+      err = "security: privilege change detected; refusing to execute";
+      return false;
+   }
 
-      if (!st.argv.empty()) {
-         std::string reason;
-         if (!policy_.allow_external(st.argv, reason)) {
-            if (reason.empty()) reason = "disallowed by policy";
-            fd_write_all(STDERR_FILENO, "error: " + reason + "\n");
-            return 126;
-         }
+   // Bodies are parsed once: a substitution in a loop or a re-run line hits
+   // the cache.
+   ParseResult parsed;
+   ParsedUnitPtr unit = substs_.find(body);
+   if (!unit) {
+      parsed = Parser{}.parse(std::string{body});
+      if (parsed.kind != ParseKind::Complete) {
+         err = "command substitution: ";
+         err += parsed.kind == ParseKind::Incomplete ? "unexpected end of input"
+                                                     : parsed.message;
+         return false;
       }
+      unit = substs_.insert(body, parsed);
    }
+   const ParseResult& pr = unit ? unit->result() : parsed;
 
-   std::vector<pid_t> pids;
-   pids.reserve(pipeline.stages.size());
-
-   UniqueFd prev_read;
-
-   for (std::size_t i = 0; i < pipeline.stages.size(); ++i) {
-      const auto& st = pipeline.stages[i];
-      const bool last = (i + 1 == pipeline.stages.size());
-
-      UniqueFd next_read;
-      UniqueFd next_write;
-      if (!last) {
-         if (int ec = make_pipe(next_read, next_write); ec != 0) return 1;
+   if (pr.result_is_pipeline()) {
+      const Pipeline& pl = pr.pipeline;
+      if (pl.stages.empty()) {
+         status = 0;
+         return true;
       }
-
-      SpawnSpec spec;
-
-      // Redirection-only stage in a pipeline: treat as no-op.
-      // (You can refine semantics later; this keeps execution deterministic.)
-      if (st.argv.empty()) {
-         // Close pipe fds as if this stage consumed/produced nothing.
-         // Upstream writer will see EOF once parent closes its copies.
-         prev_read.reset();
-         if (!last) {
-            next_write.reset();
-            prev_read = std::move(next_read);
-         }
-         continue;
+      if (pl.stages.size() == 1 && pl.stages[0].redirs.empty()) {
+         if (!needs_expansion(pl))
+            return substitute_simple(pl.stages[0], out, status, err);
+
+         std::pmr::monotonic_buffer_resource arena;
+         Pipeline expanded{AstAllocator{&arena}};
+         if (!expand_pipeline(pl, expanded, expand_context(), err))
+            return false;
+         return substitute_simple(expanded.stages[0], out, status, err);
       }
+   }
+   return substitute_forked(
+      [&] {
+         return pr.result_is_list() ? run_list(pr.list)
+                                    : run_pipeline(pr.pipeline);
+      },
+      out, status, err);
+}
 
-      spec.argv = st.argv;
-      spec.stdin_fd = prev_read.get();
-      spec.stdout_fd = last ? -1 : next_write.get();
-      spec.stderr_fd = -1;
-
-      // Apply stage redirections (override pipe defaults for 0/1/2).
-      {
-         UniqueFd rin, rout, rerr;
-         int in_fd = spec.stdin_fd;
-         int out_fd = spec.stdout_fd;
-         int err_fd = spec.stderr_fd;
-         std::string em;
-         const int rc = apply_redirs_to_spawn(st.redirs, in_fd, out_fd, err_fd,
-                                              rin, rout, rerr, em);
-         if (rc != 0) {
-            if (em.empty()) em = "error: redirection failed\n";
-            fd_write_all(STDERR_FILENO, em);
-            return (rc == 2) ? 2 : 1;
+bool Executor::substitute_simple(const SimpleCommand& cmd, std::string& out,
+                                 int& status, std::string& err) {
+   // Assignments alone (the body `x=1`) run in the subshell.
+   if (cmd.argv.empty())
+      return substitute_forked([&] { return run_simple(cmd); }, out, status,
+                               err);
+
+   // A function may change shell state, like most built-ins.
+   if (find_function(cmd))
+      return substitute_forked([&] { return run_simple(cmd); }, out, status,
+                               err);
+
+   // Pure built-in: no process at all. The output goes to a memfd rather
+   // than a pipe so that it can be any size without a reader thread.
+   const Builtin* b = forced_external(cmd.argv).empty()
+                         ? builtins_.lookup(cmd.argv.front())
+                         : nullptr;
+   if (b && b->pure) {
+      if (capture_fd_.get() < 0)
+         capture_fd_.reset(::memfd_create("clanker-subst", MFD_CLOEXEC));
+      const int fd = capture_fd_.get();
+      if (fd >= 0) {
+         BuiltinContext ctx{.root = policy_.root(),
+                            .in_fd = STDIN_FILENO,
+                            .out_fd = fd,
+                            .err_fd = STDERR_FILENO,
+                            .cwd = cwd_,
+                            .oldpwd = oldpwd_,
+                            .vars = vars_,
+                            .exit_request = nullptr,
+                            .parse_cache = parse_cache_,
+                            .input = &inputs_,
+                            .builtins = &builtins_};
+         status = b->fn(ctx, cmd.argv);
+
+         const off_t size = ::lseek(fd, 0, SEEK_CUR);
+         if (size > 0) {
+            const std::size_t used = out.size();
+            out.resize_and_overwrite(
+               used + static_cast<std::size_t>(size),
+               [&](char* p, std::size_t n) {
+                  const ssize_t r = ::pread(fd, p + used, n - used, 0);
+                  return used +
+                         static_cast<std::size_t>(std::max<ssize_t>(r, 0));
+               });
          }
-         spec.stdin_fd = in_fd;
-         spec.stdout_fd = out_fd;
-         spec.stderr_fd = err_fd;
+         (void)::ftruncate(fd, 0);
+         (void)::lseek(fd, 0, SEEK_SET);
+         return true;
       }
+   }
 
-      const auto r = policy_.spawn_external(spec);
-
-      if (r.pid_or_err < 0) {
-         const int err = -r.pid_or_err;
-         if (err == ENOENT) return 127;
-         return 126;
-      }
+   // Other built-ins change shell state; they need a subshell.
+   if (b)
+      return substitute_forked([&] { return run_simple(cmd); }, out, status,
+                               err);
 
-      pids.push_back(static_cast<pid_t>(r.pid_or_err));
+   // External: spawned directly onto the pipe, without a forked shell in
+   // between. It fails as it would as a command of its own.
+   std::string reason;
+   if (!policy_.allow_external(spawn_argv(cmd.argv), reason)) {
+      if (reason.empty()) reason = "disallowed by policy";
+      fd_write_all(STDERR_FILENO, "error: " + reason + "\n");
+      status = 126;
+      return true;
+   }
 
-      // Parent closes what it no longer needs.
-      prev_read.reset();
-      if (!last) next_write.reset();
-      prev_read = std::move(next_read);
+   int fds[2] = {-1, -1};
+   if (::pipe2(fds, O_CLOEXEC) != 0) {
+      err = "command substitution: pipe failed";
+      return false;
    }
+   UniqueFd r(fds[0]), w(fds[1]);
 
-   // Close last read end (if any) in parent.
-   prev_read.reset();
+   std::optional<VarStore::Frame> scope;
+   if (!bind_assigns(cmd, &scope, err)) return false;
 
-   int last_status = 0;
-   for (std::size_t i = 0; i < pids.size(); ++i) {
-      int status = 0;
-      for (;;) {
-         const pid_t w = ::waitpid(pids[i], &status, 0);
-         if (w == -1 && errno == EINTR) continue;
-         if (w == -1) status = 1;
-         break;
-      }
-      if (i + 1 == pids.size()) last_status = status_to_exit_code(status);
+   SpawnSpec spec;
+   spec.argv = spawn_argv(cmd.argv);
+   spec.stdout_fd = w.get();
+   spec.envp = vars_->environment();
+   const auto res = policy_.spawn_external(spec);
+   w.reset();
+   if (res.pid_or_err < 0) {
+      const int e = -res.pid_or_err;
+      fd_write_all(STDERR_FILENO, "clanker: " + std::string{cmd.argv.front()} +
+                                     ": " + ::strerror(e) + "\n");
+      status = (e == ENOENT) ? 127 : 126;
+      return true;
    }
 
-   return last_status;
+   read_all(r.get(), out);
+   status = wait_exit_code(static_cast<pid_t>(res.pid_or_err));
+   return true;
 }
 
-int Executor::run_pipeline(const Pipeline& pipeline) {
-   if (pipeline.stages.empty()) return 0;
-   if (pipeline.stages.size() == 1) return run_simple(pipeline.stages[0]);
+bool Executor::substitute_forked(const std::function<int()>& body,
+                                 std::string& out, int& status,
+                                 std::string& err) {
+   int fds[2] = {-1, -1};
+   if (::pipe2(fds, O_CLOEXEC) != 0) {
+      err = "command substitution: pipe failed";
+      return false;
+   }
+   UniqueFd r(fds[0]), w(fds[1]);
 
-   const auto& first = pipeline.stages.front();
-   if (is_builtin(builtins_, first))
-      return run_pipeline_builtin_first(first, pipeline);
+   const pid_t pid = ::fork();
+   if (pid < 0) {
+      err = "command substitution: fork failed";
+      return false;
+   }
 
-   return run_pipeline_all_external(pipeline);
+   if (pid == 0) {
+      r.reset();
+      if (::dup2(w.get(), STDOUT_FILENO) < 0) _exit(1);
+      w.reset();
+      const int st = body();
+      _exit(exit_request_.value_or(st) & 0xff);
+   }
+
+   w.reset();
+   read_all(r.get(), out);
+   status = wait_exit_code(pid);
+   return true;
 }
 
-int Executor::run_andor(const AndOr& ao) {
-   int st = run_pipeline(ao.first);
-
-   for (const auto& tail : ao.rest) {
-      const bool ok = (st == 0);
-      if (tail.op == AndOrOp::AndIf) {
-         if (!ok) continue;
-      } else { // OrIf
-         if (ok) continue;
+int Executor::run_expanded(const Pipeline& pipeline) {
+   if (pipeline.stages.size() == 1) return run_simple(pipeline.stages[0]);
+
+   for (const SimpleCommand& stage : pipeline.stages) {
+      if (find_function(stage)) {
+         fd_write_all(STDERR_FILENO,
+                      "error: functions in pipelines not implemented yet\n");
+         return 2;
       }
-      st = run_pipeline(tail.rhs);
    }
 
-   return st;
+   return run_pipeline_stages(pipeline);
+}
+
+int Executor::run_andor(const AndOr& ao) {
+   return run_program(compile_ir(ao, builtins_, policy_));
 }
 
 int Executor::run_background(const AndOr& ao) {
@@ -611,17 +864,249 @@ int Executor::run_background(const AndOr& ao) {
 }
 
 int Executor::run_list(const CommandList& list) {
-   int last_status = 0;
+   return run_program(compile_ir(list, builtins_, policy_));
+}
 
-   for (const auto& it : list.items) {
-      if (it.term == Terminator::Ampersand) {
-         last_status = run_background(it.cmd); // 0 if started, else 1/125/etc.
-      } else {
-         last_status = run_andor(it.cmd);
+int Executor::return_status(const SimpleCommand& cmd, int status) {
+   std::pmr::monotonic_buffer_resource arena;
+   SimpleCommand expanded{AstAllocator{&arena}};
+   const SimpleCommand* c = &cmd;
+   if (needs_expansion(cmd)) {
+      std::string err;
+      if (!expand_command(cmd, expanded, expand_context(), err)) {
+         fd_write_all(STDERR_FILENO, "clanker: " + err + "\n");
+         return 1;
+      }
+      c = &expanded;
+   }
+
+   const Argv& argv = c->argv;
+   if (argv.size() < 2) return status;
+   if (argv.size() > 2) {
+      fd_write_all(STDERR_FILENO, "return: too many arguments\n");
+      return 2;
+   }
+   const std::string_view arg = argv[1];
+   long n = 0;
+   const auto [ptr, ec] =
+      std::from_chars(arg.data(), arg.data() + arg.size(), n);
+   if (ec != std::errc{} || ptr != arg.data() + arg.size()) {
+      fd_write_all(STDERR_FILENO,
+                   "return: " + std::string{arg} +
+                      ": numeric argument required\n");
+      return 2;
+   }
+   return static_cast<int>(n & 0xff);
+}
+
+int Executor::run_program(const IrProgram& program, bool identity_ok) {
+   // The words a `for` loop walks: its own when they need no expansion,
+   // otherwise those of `expanded`, globs matched as the loop goes.
+   struct ForState {
+      WordListExpansion expanded;
+      bool expanding{false};
+      std::span<const std::pmr::string> words;
+      std::size_t next{0};
+   };
+   struct SavedFds {
+      UniqueFd fd0, fd1, fd2;
+   };
+
+   std::vector<int> slots(program.slots);
+   std::vector<ForState> loops(program.loops.size());
+   std::vector<SavedFds> saved;
+   int& status = last_status_;
+
+   // Only this process can change its own identity, and built-ins and
+   // functions never do, so one check covers every one of them the program
+   // runs. Spawning an external still checks each time.
+   if (!identity_ok) identity_ok = sec_.identity_unchanged();
+   const bool outer_identity_ok = std::exchange(identity_ok_, identity_ok);
+
+   const std::size_t end = program.code.size();
+   for (std::size_t pc = 0; pc < end && !exit_request_;) {
+      const IrInstr& in = program.code[pc++];
+      switch (in.op) {
+      case IrOp::Pipeline:
+         (void)run_pipeline(*program.pipelines[in.a]);
+         break;
+      case IrOp::Builtin: {
+         const IrBuiltin& b = program.builtins[in.a];
+         if (!identity_ok) {
+            status = deny_privilege_drift();
+         } else if (const Value::ProcPtr* proc = find_function(*b.cmd)) {
+            status = call_function(*proc, *b.cmd);
+         } else {
+            status = run_builtin(*b.cmd, b.fn);
+         }
+         break;
+      }
+      case IrOp::External: {
+         const SimpleCommand& cmd = *program.externals[in.a];
+         if (const Value::ProcPtr* proc = find_function(cmd)) {
+            status = identity_ok ? call_function(*proc, cmd)
+                                 : deny_privilege_drift();
+         } else {
+            status = sec_.identity_unchanged() ? run_external(cmd)
+                                               : deny_privilege_drift();
+         }
+         break;
+      }
+      case IrOp::Error:
+         fd_write_all(STDERR_FILENO, program.messages[in.a]);
+         status = static_cast<int>(in.b);
+         break;
+      case IrOp::Background:
+         status = run_background(*program.background[in.a]);
+         break;
+      case IrOp::Status:
+         status = static_cast<int>(in.a);
+         break;
+      case IrOp::Save:
+         slots[in.a] = status;
+         break;
+      case IrOp::Restore:
+         status = slots[in.a];
+         break;
+      case IrOp::Jump:
+         // A backward jump closes a loop; ^C stops it there.
+         if (in.a < pc && consume_sigint_flag()) {
+            status = 130;
+            pc = end;
+            break;
+         }
+         pc = in.a;
+         break;
+      case IrOp::JumpIfOk:
+         if (status == 0) pc = in.a;
+         break;
+      case IrOp::JumpIfFail:
+         if (status != 0) pc = in.a;
+         break;
+      case IrOp::ForBegin: {
+         const CompoundCommand& cc = *program.loops[in.a];
+         ForState& st = loops[in.a];
+         st.next = 0;
+         st.expanding = false;
+         st.words = args_; // no `in`: the positional parameters
+         if (!cc.in_words) break;
+         if (!needs_expansion(cc.words)) {
+            st.words = cc.words.argv;
+            break;
+         }
+         std::string err;
+         if (!st.expanded.start(cc.words, expand_context(), err)) {
+            fd_write_all(STDERR_FILENO, "clanker: " + err + "\n");
+            status = 1;
+            pc = in.b;
+            break;
+         }
+         st.expanding = true;
+         break;
+      }
+      case IrOp::ForNext: {
+         ForState& st = loops[in.a];
+         std::optional<std::string_view> word;
+         if (st.expanding)
+            word = st.expanded.next();
+         else if (st.next < st.words.size())
+            word = st.words[st.next++];
+         if (!word) {
+            pc = in.b;
+            break;
+         }
+         vars_->set(program.loops[in.a]->name, Value{std::string{*word}});
+         break;
+      }
+      case IrOp::PushRedirs: {
+         SavedFds& s = saved.emplace_back();
+         std::string em;
+         const int rc = apply_redirs_in_process(*program.redirs[in.a], s.fd0,
+                                                s.fd1, s.fd2, em);
+         if (rc != 0) {
+            if (em.empty()) em = "error: redirection failed\n";
+            fd_write_all(STDERR_FILENO, em);
+            restore_std_fds(s.fd0, s.fd1, s.fd2);
+            saved.pop_back();
+            status = (rc == 2) ? 2 : 1;
+            pc = in.b;
+         }
+         break;
+      }
+      case IrOp::PopRedirs:
+         restore_std_fds(saved.back().fd0, saved.back().fd1, saved.back().fd2);
+         saved.pop_back();
+         break;
+      case IrOp::Define: {
+         const CompoundCommand& def = *program.functions[in.a];
+         vars_->define_function(def.name, make_proc(def, builtins_, policy_));
+         status = 0;
+         break;
+      }
+      case IrOp::Return:
+         status = return_status(*program.returns[in.a], status);
+         pc = end;
+         break;
+      case IrOp::Arith: {
+         const CompoundCommand& cc = *program.ariths[in.a];
+         Value::Int v = 0;
+         std::string err;
+         if (!arith_.run(*cc.words.ariths.front(), *vars_,
+                         {.args = args_, .status = status}, v, err)) {
+            fd_write_all(STDERR_FILENO,
+                         "clanker: ((" + std::string{cc.name} + ")): " + err +
+                            "\n");
+            status = 1;
+            break;
+         }
+         status = v != 0 ? 0 : 1;
+         break;
+      }
+      case IrOp::Case: {
+         const IrCase& c = program.cases[in.a];
+         const SimpleCommand& words = c.cmd->words;
+         const WordPrograms progs{.exprs = words.exprs,
+                                  .ariths = words.ariths};
+         std::string err;
+         std::string pattern;
+         std::string expanded;
+         std::string_view subject = c.subject;
+         bool ok = true;
+         if (!words.subst_words.empty() && words.subst_words.front() == 0) {
+            ok = expand_word(words.argv[0], progs, expand_context(), pattern,
+                             err);
+            expanded = pattern_literal(pattern);
+            subject = expanded;
+         }
+         std::size_t match = c.fixed.match(subject);
+         if (match != PatternSet::npos) match = c.fixed_index[match];
+         // Patterns with substitutions, tried in order up to that match.
+         for (const std::uint32_t k : c.dynamic) {
+            if (!ok || k >= match) break;
+            pattern.clear();
+            ok = expand_word(words.argv[k + 1], progs, expand_context(),
+                             pattern, err);
+            if (ok && GlobMatcher(pattern, /*hide_dot=*/false).match(subject))
+               match = k;
+         }
+         if (!ok) {
+            fd_write_all(STDERR_FILENO, "clanker: " + err + "\n");
+            status = 1;
+            pc = in.b;
+            break;
+         }
+         pc = match == PatternSet::npos ? c.targets.back()
+                                        : c.targets[c.cmd->arms[match]];
+         break;
+      }
       }
    }
 
-   return last_status;
+   // `exit`, `return` or ^C may leave redirections applied.
+   for (std::size_t k = saved.size(); k-- > 0;)
+      restore_std_fds(saved[k].fd0, saved[k].fd1, saved[k].fd2);
+   identity_ok_ = outer_identity_ok;
+   return status;
 }
 
 } // namespace clanker
@@ -2,11 +2,21 @@
 #pragma once
 
 #include <filesystem>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
 
 #include "clanker/ast.h"
 #include "clanker/builtins.h"
 #include "clanker/exec_policy.h"
+#include "clanker/expand.h"
+#include "clanker/input.h"
+#include "clanker/ir.h"
+#include "clanker/parse_cache.h"
 #include "clanker/security_policy.h"
+#include "clanker/util.h"
 
 namespace clanker {
 
@@ -14,7 +24,8 @@ class Executor {
  public:
    Executor(Builtins builtins, const ExecPolicy& policy,
             std::filesystem::path* cwd, std::filesystem::path* oldpwd,
-            SecurityPolicy sec);
+            VarStore* vars, SecurityPolicy sec,
+            const ParseCache* parse_cache = nullptr);
 
    int run_pipeline(const Pipeline& pipeline);
 
@@ -22,19 +33,92 @@ class Executor {
    int run_andor(const AndOr& ao);
    int run_list(const CommandList& list);
 
+   // Status passed to `exit`, once it has run. Callers stop executing.
+   [[nodiscard]] std::optional<int> exit_requested() const noexcept {
+      return exit_request_;
+   }
+
  private:
+   // Run a compiled list (ir.h). Every list and and-or chain runs this
+   // way, and so does a pipeline that is a compound command. A caller that
+   // has just checked the shell's identity says so with `identity_ok`.
+   int run_program(const IrProgram& program, bool identity_ok = false);
+
+   // The status `return [n]` leaves, `status` being the current one.
+   int return_status(const SimpleCommand& cmd, int status);
+
+   // The function `cmd` names, if any; functions come before built-ins.
+   [[nodiscard]] const Value::ProcPtr* find_function(
+      const SimpleCommand& cmd) const noexcept;
+
+   // Run `proc` in this process with `cmd`'s words after the name as the
+   // positional parameters, its redirections applied and its assignments
+   // exported for the call, in a new variable frame. Holding `proc` keeps
+   // it alive should the body redefine or unset it.
+   int call_function(Value::ProcPtr proc, const SimpleCommand& cmd);
+
+   int run_expanded(const Pipeline& pipeline);
    int run_simple(const SimpleCommand& cmd);
-   int run_pipeline_builtin_first(const SimpleCommand& first,
-                                  const Pipeline& pipeline);
-   int run_pipeline_all_external(const Pipeline& pipeline);
+   int run_builtin(const SimpleCommand& cmd, BuiltinFn fn);
+   int run_external(const SimpleCommand& cmd);
+   // A pipeline of two or more simple commands (execution-model.md §6):
+   // externals are spawned, a built-in in the last stage runs in the shell,
+   // and one in any other stage on a worker thread if it is pure, else in a
+   // forked copy of the shell.
+   int run_pipeline_stages(const Pipeline& pipeline);
 
    int run_background(const AndOr& ao);
 
+   // Expand and bind the NAME=value words of `cmd` in order, so each sees
+   // the ones before it: in a new `*scope`, exported, for the command's
+   // duration, or for good if `scope` is null. False with `err` set if one
+   // does not expand; those before it stay bound.
+   bool bind_assigns(const SimpleCommand& cmd,
+                     std::optional<VarStore::Frame>* scope, std::string& err);
+
+   // Each context starts a new expansion: $? is last_status_ until one of
+   // its substitutions has run.
+   ExpandContext expand_context();
+
+   // Command substitution (SubstituteFn). A single command without
+   // redirections runs without a subshell: a pure built-in in-process with
+   // its output captured in a memfd, an external spawned straight onto a
+   // pipe. Anything else runs in a forked copy of the shell, so `cd` or
+   // `exit` inside $(...) leave this shell alone.
+   bool substitute(std::string_view body, std::string& out, int& status,
+                   std::string& err);
+   bool substitute_simple(const SimpleCommand& cmd, std::string& out,
+                          int& status, std::string& err);
+   bool substitute_forked(const std::function<int()>& body, std::string& out,
+                          int& status, std::string& err);
+
    Builtins builtins_;
    const ExecPolicy& policy_;
    SecurityPolicy sec_;
    std::filesystem::path* cwd_{nullptr};
    std::filesystem::path* oldpwd_{nullptr};
+   VarStore* vars_{nullptr};
+   const ParseCache* parse_cache_{nullptr};
+   ExpansionLimits limits_{ExpansionLimits::from_environment()};
+   GlobCache globs_;
+   ExprVM vm_;
+   ArithVM arith_;
+   ParseCache substs_;    // parsed substitution bodies
+   UniqueFd capture_fd_;  // memfd for in-process substitutions, lazily made
+   InputBuffers inputs_;  // read-ahead for `read`
+   bool stdout_tty_{::isatty(STDOUT_FILENO) == 1}; // line-buffer built-ins
+   std::optional<int> exit_request_;
+   int last_status_{0}; // $?
+   // Status of the last substitution in the running expansion, if any; an
+   // assignment-only command returns it.
+   std::optional<int> subst_status_;
+   bool identity_ok_{false}; // checked by the running program
+
+   // Positional parameters of the running function call, viewing its
+   // words; empty outside a call.
+   std::span<const std::pmr::string> args_;
+   std::size_t call_depth_{0};
+   std::size_t max_call_depth_; // CLANKER_MAX_CALL_DEPTH, default 1000
 };
 
 } // namespace clanker
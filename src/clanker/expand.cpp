@@ -0,0 +1,1096 @@
+// src/clanker/expand.cpp
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <unistd.h>
+#include <utility>
+
+#include "clanker/expand.h"
+#include "clanker/lexer.h"
+
+extern char** environ;
+
+namespace clanker {
+
+namespace {
+
+constexpr std::uint64_t kSaturated = UINT64_MAX;
+
+// Room left for the executable path and alignment when sizing max_bytes
+// from ARG_MAX.
+constexpr std::size_t kArgMaxSlack = 4096;
+
+std::uint64_t sat_add(std::uint64_t a, std::uint64_t b) noexcept {
+   return (a > kSaturated - b) ? kSaturated : a + b;
+}
+
+std::uint64_t sat_mul(std::uint64_t a, std::uint64_t b) noexcept {
+   if (a == 0 || b == 0) return 0;
+   return (a > kSaturated / b) ? kSaturated : a * b;
+}
+
+bool is_space(char c) noexcept {
+   return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Offset of the bare '}' that closes the bare '{' at `open`, or npos.
+// `nested` is set if another bare '{' opens in between.
+std::size_t match_brace(std::string_view p, std::size_t open, bool& nested) {
+   int depth = 0;
+   for (std::size_t k = open; k < p.size(); ++k) {
+      if (p[k] == '\\') {
+         ++k;
+      } else if (p[k] == '{') {
+         if (++depth > 1) nested = true;
+      } else if (p[k] == '}') {
+         if (--depth == 0) return k;
+      }
+   }
+   return std::string_view::npos;
+}
+
+// Pattern text with its escapes removed, unless `keep`.
+void append_literal(std::string& out, std::string_view p, bool keep) {
+   if (keep) {
+      out += p;
+      return;
+   }
+   for (std::size_t k = 0; k < p.size(); ++k) {
+      if (p[k] == '\\' && k + 1 < p.size()) ++k;
+      out.push_back(p[k]);
+   }
+}
+
+// Split a group body at bare commas, dropping bare whitespace around each
+// element. False if there is no bare comma (not a list).
+bool split_list(std::string_view body, std::vector<std::string>& items,
+                bool keep_escapes) {
+   bool comma = false;
+   std::string cur;
+   std::size_t end = 0; // cur without trailing bare whitespace
+   for (std::size_t k = 0; k < body.size(); ++k) {
+      const char c = body[k];
+      if (c == '\\' && k + 1 < body.size()) {
+         if (keep_escapes) cur.push_back('\\');
+         cur.push_back(body[++k]);
+         end = cur.size();
+      } else if (c == ',') {
+         cur.resize(end);
+         items.push_back(std::move(cur));
+         cur.clear();
+         end = 0;
+         comma = true;
+      } else if (is_space(c)) {
+         if (!cur.empty()) cur.push_back(c);
+      } else {
+         cur.push_back(c);
+         end = cur.size();
+      }
+   }
+   cur.resize(end);
+   items.push_back(std::move(cur));
+   return comma;
+}
+
+std::optional<std::int64_t> to_int64(std::string_view s) noexcept {
+   if (!s.empty() && s.front() == '+') s.remove_prefix(1);
+   std::int64_t v = 0;
+   const auto [p, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+   if (ec != std::errc{} || p != s.data() + s.size()) return std::nullopt;
+   return v;
+}
+
+// "-007" -> true: the range is zero-padded.
+bool zero_padded(std::string_view s) noexcept {
+   if (!s.empty() && (s.front() == '-' || s.front() == '+')) s.remove_prefix(1);
+   return s.size() > 1 && s.front() == '0';
+}
+
+bool is_alpha(char c) noexcept {
+   return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+} // namespace
+
+// ---- ExpansionLimits ----
+
+ExpansionLimits ExpansionLimits::from_environment() {
+   ExpansionLimits l;
+
+   if (const long arg_max = ::sysconf(_SC_ARG_MAX); arg_max > 0) {
+      std::size_t env = sizeof(char*);
+      for (char** e = environ; e != nullptr && *e != nullptr; ++e)
+         env += std::strlen(*e) + 1 + sizeof(char*);
+      const auto total = static_cast<std::size_t>(arg_max);
+      l.max_bytes =
+         (total > env + kArgMaxSlack) ? total - env - kArgMaxSlack : 0;
+   }
+
+   auto override = [](const char* name, std::size_t& v) {
+      const char* s = std::getenv(name);
+      if (s == nullptr || *s == '\0') return;
+      std::size_t n = 0;
+      const auto [p, ec] = std::from_chars(s, s + std::strlen(s), n);
+      if (ec == std::errc{} && *p == '\0') v = n;
+   };
+   override("CLANKER_EXPAND_MAX_WORDS", l.max_words);
+   override("CLANKER_EXPAND_MAX_BYTES", l.max_bytes);
+   return l;
+}
+
+// ---- BraceExpansion ----
+
+namespace {
+
+// A group body that is a range: A..B or A..B..STEP, all bare.
+bool parse_range(std::string_view body, std::int64_t& first,
+                 std::int64_t& last, std::int64_t& step, bool& chars,
+                 std::size_t& width) {
+   if (body.find('\\') != std::string_view::npos) return false;
+
+   const std::size_t d1 = body.find("..");
+   if (d1 == std::string_view::npos) return false;
+   const std::string_view a = body.substr(0, d1);
+   std::string_view rest = body.substr(d1 + 2);
+   std::string_view b = rest;
+   std::string_view c;
+   if (const std::size_t d2 = rest.find(".."); d2 != std::string_view::npos) {
+      b = rest.substr(0, d2);
+      c = rest.substr(d2 + 2);
+   }
+
+   step = 1;
+   if (!c.empty()) {
+      const auto s = to_int64(c);
+      if (!s || *s == INT64_MIN) return false;
+      step = (*s == 0) ? 1 : std::abs(*s);
+   }
+
+   if (a.size() == 1 && b.size() == 1 && is_alpha(a[0]) && is_alpha(b[0])) {
+      chars = true;
+      first = a[0];
+      last = b[0];
+      width = 0;
+      return true;
+   }
+
+   const auto x = to_int64(a);
+   const auto y = to_int64(b);
+   if (!x || !y) return false;
+   chars = false;
+   first = *x;
+   last = *y;
+   width = (zero_padded(a) || zero_padded(b)) ? std::max(a.size(), b.size())
+                                              : 0;
+   return true;
+}
+
+} // namespace
+
+BraceExpansion::BraceExpansion(std::string_view p, bool keep_escapes)
+   : keep_escapes_(keep_escapes) {
+   std::string lit;
+
+   auto take_group = [&](std::string_view body) {
+      Group g;
+      g.escape = keep_escapes_;
+      if (split_list(body, g.items, keep_escapes_)) {
+         g.size = g.items.size();
+      } else {
+         g.items.clear();
+         std::int64_t last = 0;
+         if (!parse_range(body, g.first, last, g.step, g.chars, g.width))
+            return false;
+         g.range = true;
+         // |last - first| / step + 1, in unsigned arithmetic so the full
+         // int64 range cannot overflow.
+         const auto ufirst = static_cast<std::uint64_t>(g.first);
+         const auto ulast = static_cast<std::uint64_t>(last);
+         const std::uint64_t span =
+            (last >= g.first) ? ulast - ufirst : ufirst - ulast;
+         g.size = span / static_cast<std::uint64_t>(g.step) + 1;
+         if (last < g.first) g.step = -g.step;
+      }
+      count_ = sat_mul(count_, g.size);
+      literals_.push_back(std::move(lit));
+      lit.clear();
+      groups_.push_back(std::move(g));
+      return true;
+   };
+
+   for (std::size_t k = 0; k < p.size();) {
+      const char c = p[k];
+      if (c == '\\' && k + 1 < p.size()) {
+         if (keep_escapes_) lit.push_back('\\');
+         lit.push_back(p[k + 1]);
+         k += 2;
+         continue;
+      }
+
+      // "${...}" is a parameter, never a group.
+      if (c == '$' && k + 1 < p.size() && p[k + 1] == '{') {
+         bool nested = false;
+         std::size_t e = match_brace(p, k + 1, nested);
+         if (e == std::string_view::npos) e = p.size() - 1;
+         append_literal(lit, p.substr(k, e + 1 - k), keep_escapes_);
+         k = e + 1;
+         continue;
+      }
+
+      if (c == '{') {
+         bool nested = false;
+         const std::size_t e = match_brace(p, k, nested);
+         if (e != std::string_view::npos) {
+            // Nested groups are literal text (execution-model.md §3.1).
+            if (nested) {
+               append_literal(lit, p.substr(k, e + 1 - k), keep_escapes_);
+               k = e + 1;
+               continue;
+            }
+            if (take_group(p.substr(k + 1, e - k - 1))) {
+               k = e + 1;
+               continue;
+            }
+         }
+      }
+
+      lit.push_back(c);
+      ++k;
+   }
+   literals_.push_back(std::move(lit));
+
+   index_.assign(groups_.size(), 0);
+   offset_.assign(groups_.size(), 0);
+}
+
+void BraceExpansion::Group::append(std::uint64_t i, std::string& out) const {
+   if (!range) {
+      out += items[i];
+      return;
+   }
+
+   // first + i * step, which lies between the range ends.
+   const auto v = static_cast<std::int64_t>(
+      static_cast<std::uint64_t>(first) + i * static_cast<std::uint64_t>(step));
+   if (chars) {
+      const char c = static_cast<char>(v);
+      if (escape && (c == '[' || c == ']' || c == '\\')) out.push_back('\\');
+      out.push_back(c);
+      return;
+   }
+
+   char buf[24];
+   const auto [p, ec] = std::to_chars(buf, buf + sizeof(buf), v);
+   (void)ec;
+   std::string_view digits(buf, static_cast<std::size_t>(p - buf));
+   if (digits.size() < width) {
+      if (v < 0) {
+         out.push_back('-');
+         digits.remove_prefix(1);
+      }
+      out.append(width - digits.size() - (v < 0 ? 1 : 0), '0');
+   }
+   out += digits;
+}
+
+std::uint64_t BraceExpansion::bytes() const {
+   std::uint64_t total = 0;
+   for (const auto& l : literals_)
+      total = sat_add(total, sat_mul(l.size(), count_));
+
+   std::string scratch;
+   for (const Group& g : groups_) {
+      std::uint64_t sum = 0;
+      if (g.range) {
+         for (std::uint64_t i = 0; i < g.size; ++i) {
+            scratch.clear();
+            g.append(i, scratch);
+            sum += scratch.size();
+         }
+      } else {
+         for (const auto& item : g.items) sum += item.size();
+      }
+      // Each element appears count_ / size times.
+      total = sat_add(total, sat_mul(sum, count_ / g.size));
+   }
+   return total;
+}
+
+void BraceExpansion::append_from(std::size_t g) {
+   for (std::size_t j = g; j < groups_.size(); ++j) {
+      offset_[j] = word_.size();
+      groups_[j].append(index_[j], word_);
+      word_ += literals_[j + 1];
+   }
+}
+
+std::optional<std::string_view> BraceExpansion::next() {
+   if (done_) return std::nullopt;
+
+   if (!started_) {
+      started_ = true;
+      word_ = literals_.front();
+      append_from(0);
+      return std::string_view(word_);
+   }
+
+   // Advance the odometer; only the groups from the one that moved onward
+   // are rebuilt.
+   for (std::size_t g = groups_.size(); g-- > 0;) {
+      if (++index_[g] < groups_[g].size) {
+         word_.resize(offset_[g]);
+         append_from(g);
+         return std::string_view(word_);
+      }
+      index_[g] = 0;
+   }
+   done_ = true;
+   return std::nullopt;
+}
+
+// ---- Pipelines ----
+
+namespace {
+
+bool contains(const std::pmr::vector<std::uint32_t>& v, std::size_t i) {
+   return std::binary_search(v.begin(), v.end(), i);
+}
+
+// A field produced by substitute_word.
+struct Field {
+   std::string pattern;
+   bool glob{false}; // substituted text brought a wildcard
+};
+
+// Append `text` to a pattern with every metacharacter escaped.
+void append_escaped(std::string_view text, std::string& pattern) {
+   for (const char c : text) {
+      if (kPatternMeta.find(c) != std::string_view::npos)
+         pattern.push_back('\\');
+      pattern.push_back(c);
+   }
+}
+
+// The compiled program for expression `body`: the parser's, or compiled
+// here for an AST that was built without one.
+ExprProgramPtr find_program(std::span<const ExprProgramPtr> exprs,
+                            std::string_view body, std::string& err) {
+   for (const ExprProgramPtr& p : exprs)
+      if (p->source() == body) return p;
+   ExprCompileResult r = compile_expr(body);
+   if (!r.program) err = "@(" + std::string{body} + "): " + r.message;
+   return std::move(r.program);
+}
+
+// The value of $(( source )): the parser's program for it, or one compiled
+// here for an AST that was built without one.
+bool arithmetic(std::string_view source, const WordPrograms& progs,
+                const ExpandContext& ctx, Value::Int& out, std::string& err) {
+   ArithProgramPtr compiled;
+   const ArithProgram* prog = find_arith(progs.ariths, source);
+   if (!prog) {
+      ArithCompileResult r = compile_arith(source);
+      if (!r.program) {
+         err = "$((" + std::string{source} + ")): " + r.message;
+         return false;
+      }
+      compiled = std::move(r.program);
+      prog = compiled.get();
+   }
+   std::optional<VarStore> none;
+   VarStore& vars = ctx.vars ? *ctx.vars : none.emplace();
+   if (!ctx.arith.run(*prog, vars,
+                      {.args = ctx.args, .status = ctx.last_status()}, out,
+                      err)) {
+      err = "$((" + std::string{source} + ")): " + err;
+      return false;
+   }
+   return true;
+}
+
+bool substitute_word(std::string_view p, const WordPrograms& progs,
+                     const ExpandContext& ctx, std::vector<Field>& fields,
+                     std::string& err, bool split = true);
+
+// Pattern `p` with its substitutions run but not split: the word of
+// ${x:-word}, or the value of an assignment.
+bool substitute_text(std::string_view p, const WordPrograms& progs,
+                     const ExpandContext& ctx, std::string& pattern,
+                     std::string& err) {
+   std::vector<Field> fields;
+   if (!substitute_word(p, progs, ctx, fields, err, /*split=*/false))
+      return false;
+   pattern = fields.empty() ? std::string{} : std::move(fields.front().pattern);
+   return true;
+}
+
+bool is_name_start(char c) noexcept { return is_alpha(c) || c == '_'; }
+
+bool is_name_char(char c) noexcept {
+   return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+bool is_digit(char c) noexcept { return c >= '0' && c <= '9'; }
+
+// The one-byte parameters after '$' besides digits.
+bool is_special_param(char c) noexcept {
+   return c == '?' || c == '$' || c == '#' || c == '@' || c == '*';
+}
+
+// Append the text of parameter `name` (specials and positionals included)
+// to `out`. `set` tells an unset variable from an empty one.
+bool read_param(std::string_view name, const ExpandContext& ctx,
+                std::string& out, bool& set, std::string& err) {
+   set = true;
+   auto append_number = [&](long v) {
+      char buf[24];
+      const auto [e, ec] = std::to_chars(buf, buf + sizeof(buf), v);
+      (void)ec;
+      out.append(buf, e);
+   };
+   if (name == "?" || name == "$") {
+      append_number((name == "?") ? ctx.last_status()
+                    : ctx.vars    ? ctx.vars->shell_pid()
+                                  : ::getpid());
+      return true;
+   }
+   if (name == "#") {
+      append_number(static_cast<long>(ctx.args.size()));
+      return true;
+   }
+   if (name == "@" || name == "*") {
+      for (std::size_t i = 0; i < ctx.args.size(); ++i) {
+         if (i != 0) out.push_back(' ');
+         out += ctx.args[i];
+      }
+      return true;
+   }
+   if (is_digit(name.front())) {
+      std::size_t n = 0;
+      const auto [ptr, ec] =
+         std::from_chars(name.data(), name.data() + name.size(), n);
+      (void)ptr;
+      if (ec == std::errc{} && n == 0) {
+         out += "clanker";
+         return true;
+      }
+      set = ec == std::errc{} && n <= ctx.args.size();
+      if (set) out += ctx.args[n - 1];
+      return true;
+   }
+   const VarStore::Var* v = ctx.vars ? ctx.vars->find(name) : nullptr;
+   set = v != nullptr;
+   if (v && !lower_value(v->value, out, err)) {
+      err = std::string{name} + ": " + err;
+      return false;
+   }
+   return true;
+}
+
+// `s` less the shortest (or longest) prefix that `m` matches.
+std::string_view strip_prefix(std::string_view s, const GlobMatcher& m,
+                              bool longest) {
+   if (m.is_literal())
+      return s.starts_with(m.literal()) ? s.substr(m.literal().size()) : s;
+   for (std::size_t k = 0; k <= s.size(); ++k) {
+      const std::size_t n = longest ? s.size() - k : k;
+      if (s.substr(0, n).ends_with(m.tail()) && m.match(s.substr(0, n)))
+         return s.substr(n);
+   }
+   return s;
+}
+
+// `s` less the shortest (or longest) suffix that `m` matches.
+std::string_view strip_suffix(std::string_view s, const GlobMatcher& m,
+                              bool longest) {
+   if (m.is_literal())
+      return s.ends_with(m.literal())
+                ? s.substr(0, s.size() - m.literal().size())
+                : s;
+   for (std::size_t k = 0; k <= s.size(); ++k) {
+      const std::size_t at = longest ? k : s.size() - k;
+      if (s.substr(at).starts_with(m.head()) && m.match(s.substr(at)))
+         return s.substr(0, at);
+   }
+   return s;
+}
+
+// Append `s` to `out` with matches of `m` replaced by `rep`: the first
+// (longest at the earliest position) or `all`, or with `anchor` '#' or '%'
+// only a match at the start or end.
+void replace_matches(std::string_view s, const GlobMatcher& m,
+                     std::string_view rep, bool all, char anchor,
+                     std::string& out) {
+   if (anchor == '#' || anchor == '%') {
+      const std::string_view rest = (anchor == '#')
+                                       ? strip_prefix(s, m, /*longest=*/true)
+                                       : strip_suffix(s, m, /*longest=*/true);
+      const bool hit = rest.size() != s.size() ||
+                       (m.is_literal() && m.literal().empty()) ||
+                       (!m.is_literal() && m.match({}));
+      if (!hit) {
+         out += s;
+      } else if (anchor == '#') {
+         out += rep;
+         out += rest;
+      } else {
+         out += rest;
+         out += rep;
+      }
+      return;
+   }
+
+   std::size_t i = 0;
+   while (i < s.size()) {
+      std::size_t n = 0;
+      if (m.is_literal()) {
+         const std::size_t j = m.literal().empty()
+                                  ? std::string_view::npos
+                                  : s.find(m.literal(), i);
+         if (j == std::string_view::npos) break;
+         out += s.substr(i, j - i);
+         i = j;
+         n = m.literal().size();
+      } else {
+         if (!s.substr(i).starts_with(m.head())) {
+            out.push_back(s[i++]);
+            continue;
+         }
+         for (n = s.size() - i; n > 0 && !m.match(s.substr(i, n)); --n) {}
+         if (n == 0) {
+            out.push_back(s[i++]);
+            continue;
+         }
+      }
+      out += rep;
+      i += n;
+      if (!all) break;
+   }
+   out += s.substr(i);
+}
+
+// Append the value of ${body} to `out` (lexer.h: `body` is the pattern
+// between the braces).
+bool expand_braced(std::string_view body, const WordPrograms& progs,
+                   const ExpandContext& ctx, std::string& out,
+                   std::string& err) {
+   auto bad = [&] {
+      err = "${" + std::string{pattern_literal(body)} + "}: bad substitution";
+      return false;
+   };
+
+   std::string_view rest = body;
+   const bool length = rest.size() > 1 && rest.front() == '#';
+   if (length) rest.remove_prefix(1);
+
+   // '@' is a pattern metacharacter, so it arrives escaped.
+   std::size_t n = 0;
+   std::string_view name;
+   if (rest.starts_with("\\@")) {
+      n = 2;
+      name = "@";
+   } else {
+      if (!rest.empty() && is_special_param(rest.front()))
+         n = 1;
+      else if (!rest.empty() && is_digit(rest.front()))
+         while (n < rest.size() && is_digit(rest[n])) ++n;
+      else if (!rest.empty() && is_name_start(rest.front()))
+         while (n < rest.size() && is_name_char(rest[n])) ++n;
+      name = rest.substr(0, n);
+   }
+   if (n == 0) return bad();
+   rest.remove_prefix(n);
+
+   std::string value;
+   bool set = false;
+   if (!read_param(name, ctx, value, set, err)) return false;
+   if (length) {
+      if (!rest.empty()) return bad();
+      out += std::to_string(value.size());
+      return true;
+   }
+   if (rest.empty()) {
+      out += value;
+      return true;
+   }
+
+   // ${name:-word} ${name:+word} ${name:?word}, ':' also counting empty as
+   // unset.
+   const bool colon = rest.front() == ':';
+   if (colon) rest.remove_prefix(1);
+   if (rest.empty()) return bad();
+   const char op = rest.front();
+   if (op == '-' || op == '+' || op == '?') {
+      const bool present = set && !(colon && value.empty());
+      std::string word;
+      if ((op == '-' && !present) || (op == '+' && present) ||
+          (op == '?' && !present)) {
+         if (!substitute_text(rest.substr(1), progs, ctx, word, err))
+            return false;
+         word = pattern_literal(word);
+      }
+      if (op == '?' && !present) {
+         err = std::string{name} + ": " +
+               (word.empty() ? "parameter not set" : word);
+         return false;
+      }
+      if (op == '-')
+         out += present ? value : word;
+      else if (op == '+')
+         out += word;
+      else
+         out += value;
+      return true;
+   }
+   if (colon) return bad();
+
+   // Pattern operators. Text substituted into the pattern is literal; its
+   // own wildcards are not.
+   auto matcher = [&](std::string_view p, std::optional<GlobMatcher>& m) {
+      std::string pattern;
+      if (!substitute_text(p, progs, ctx, pattern, err)) return false;
+      m.emplace(pattern, /*hide_dot=*/false);
+      return true;
+   };
+   std::optional<GlobMatcher> m;
+   if (op == '#' || op == '%') {
+      const bool longest = rest.size() > 1 && rest[1] == op;
+      if (!matcher(rest.substr(longest ? 2 : 1), m)) return false;
+      out += (op == '#') ? strip_prefix(value, *m, longest)
+                         : strip_suffix(value, *m, longest);
+      return true;
+   }
+   if (op == '/') {
+      rest.remove_prefix(1);
+      char anchor = '\0';
+      bool all = false;
+      if (!rest.empty() && (rest.front() == '/' || rest.front() == '#' ||
+                            rest.front() == '%')) {
+         all = rest.front() == '/';
+         if (!all) anchor = rest.front();
+         rest.remove_prefix(1);
+      }
+      // The pattern ends at the first bare '/'.
+      std::size_t slash = 0;
+      while (slash < rest.size() && rest[slash] != '/')
+         slash += (rest[slash] == '\\') ? 2 : 1;
+      std::string rep;
+      if (slash < rest.size()) {
+         if (!substitute_text(rest.substr(slash + 1), progs, ctx, rep, err))
+            return false;
+         rep = pattern_literal(rep);
+      }
+      if (!matcher(rest.substr(0, std::min(slash, rest.size())), m))
+         return false;
+      replace_matches(value, *m, rep, all, anchor, out);
+      return true;
+   }
+   return bad();
+}
+
+// Run the parameters, substitutions and expressions in word pattern `p`,
+// left to right, appending the resulting fields to `fields` in pattern form.
+// Without `split` there is at most one field and nothing is globbed.
+//
+// $name, ${...}: the value, escaped and never split (expand.h has the
+// forms).
+//
+// $(...): trailing newlines are dropped and the output is split into fields
+// at whitespace (there is no IFS yet). As in bash, wildcards in it take part
+// in pathname expansion; all other bytes are escaped. In double quotes
+// (lexer.h) the output is escaped and never split.
+//
+// @(...): the value is lowered (expr.h) into the current field, escaped, and
+// never split; a splice @(*...) must be the whole word and gives one field
+// per list element.
+bool substitute_word(std::string_view p, const WordPrograms& progs,
+                     const ExpandContext& ctx, std::vector<Field>& fields,
+                     std::string& err, bool split) {
+   Field cur;
+   bool open = false; // cur is a field, even if empty
+   std::string output;
+   for (std::size_t k = 0; k < p.size();) {
+      if (p[k] == '\\' && k + 1 < p.size()) {
+         cur.pattern.append(p.substr(k, 2));
+         open = true;
+         k += 2;
+         continue;
+      }
+
+      // Parameters.
+      if (p[k] == '$' && k + 1 < p.size() && p[k + 1] != '(') {
+         const char c = p[k + 1];
+         output.clear();
+         if (c == '{') {
+            bool nested = false;
+            const std::size_t e = match_brace(p, k + 1, nested);
+            if (e == std::string_view::npos) {
+               err = std::string{pattern_literal(p.substr(k))} +
+                     ": bad substitution";
+               return false;
+            }
+            if (!expand_braced(p.substr(k + 2, e - k - 2), progs, ctx, output,
+                               err))
+               return false;
+            k = e + 1;
+         } else if (c == '@' && split && k == 0 && p.size() == 2) {
+            // A whole-word $@: one field per positional parameter.
+            for (const std::pmr::string& arg : ctx.args) {
+               append_escaped(arg, cur.pattern);
+               fields.push_back(std::move(cur));
+               cur = Field{};
+            }
+            return true;
+         } else if (is_special_param(c) || is_digit(c) || is_name_start(c)) {
+            std::size_t e = k + 2;
+            if (is_name_start(c))
+               while (e < p.size() && is_name_char(p[e])) ++e;
+            bool set = false;
+            if (!read_param(p.substr(k + 1, e - k - 1), ctx, output, set, err))
+               return false;
+            k = e;
+         } else {
+            cur.pattern.push_back(p[k++]);
+            open = true;
+            continue;
+         }
+         append_escaped(output, cur.pattern);
+         open = true;
+         continue;
+      }
+
+      const bool expr = p[k] == '@';
+      if ((p[k] != '$' && !expr) || k + 1 >= p.size() || p[k + 1] != '(') {
+         cur.pattern.push_back(p[k++]);
+         open = true;
+         continue;
+      }
+
+      // The body is escaped throughout, so the first bare ')' closes it.
+      const std::size_t start = k;
+      const bool quoted = !expr && k + 2 < p.size() && p[k + 2] == '"';
+      const std::size_t from = k + (quoted ? 3 : 2);
+      std::size_t e = from;
+      while (e < p.size() && p[e] != ')') e += (p[e] == '\\') ? 2 : 1;
+      const std::pmr::string body = pattern_literal(p.substr(from, e - from));
+      k = e + 1;
+
+      output.clear();
+      if (expr) {
+         const ExprProgramPtr prog = find_program(progs.exprs, body, err);
+         if (!prog) return false;
+         const Value* v = ctx.vm.run(*prog, ctx.vars, err);
+         if (!v) {
+            err = "@(" + std::string{body} + "): " + err;
+            return false;
+         }
+         if (prog->splice()) {
+            const Value::List* items = v->as_list();
+            if (!items) {
+               err = "@(" + std::string{body} + "): splice needs a list, got " +
+                     kind_name(kind_of(*v));
+               return false;
+            }
+            if (!split || start != 0 || k != p.size()) {
+               err = "@(" + std::string{body} +
+                     "): a splice must be a whole word";
+               return false;
+            }
+            for (const Value& item : *items) {
+               if (!lower_value(item, output, err)) return false;
+               append_escaped(output, cur.pattern);
+               fields.push_back(std::move(cur));
+               cur = Field{};
+               output.clear();
+            }
+            return true;
+         }
+         if (!lower_value(*v, output, err)) {
+            err = "@(" + std::string{body} + "): " + err;
+            return false;
+         }
+         append_escaped(output, cur.pattern);
+         open = true;
+         continue;
+      }
+
+      if (const auto source = arith_subst_body(body)) {
+         Value::Int v = 0;
+         if (!arithmetic(*source, progs, ctx, v, err)) return false;
+         cur.pattern.append(std::to_string(v));
+         open = true;
+         continue;
+      }
+
+      if (!ctx.substitute) {
+         err = "command substitution: not available here";
+         return false;
+      }
+      int status = 0;
+      if (!ctx.substitute(body, output, status, err)) return false;
+      if (ctx.subst_status) *ctx.subst_status = status;
+      while (!output.empty() && output.back() == '\n') output.pop_back();
+      if (!split || quoted) {
+         append_escaped(output, cur.pattern);
+         open = true;
+         continue;
+      }
+      for (const char c : output) {
+         if (is_space(c)) {
+            if (open) fields.push_back(std::move(cur));
+            cur = Field{};
+            open = false;
+            continue;
+         }
+         if (c == '*' || c == '?' || c == '[')
+            cur.glob = true;
+         else if (kPatternMeta.find(c) != std::string_view::npos)
+            cur.pattern.push_back('\\');
+         cur.pattern.push_back(c);
+         open = true;
+      }
+   }
+   if (open) fields.push_back(std::move(cur));
+   return true;
+}
+
+} // namespace
+
+bool expand_word(std::string_view word, const WordPrograms& programs,
+                 const ExpandContext& ctx, std::string& out,
+                 std::string& err) {
+   return substitute_text(word, programs, ctx, out, err);
+}
+
+namespace {
+
+// expand_command(), except that with `deferred` a word that would be
+// globbed stays in pattern form in `out`; its index and compiled pattern go
+// to `deferred` instead.
+bool expand_words(
+   const SimpleCommand& in, SimpleCommand& out, const ExpandContext& ctx,
+   std::vector<std::pair<std::size_t, GlobPatternPtr>>* deferred,
+   std::string& err) {
+   const ExpansionLimits& limits = ctx.limits;
+   out.redirs = in.redirs;
+
+   // Assignments are expanded as they are bound (expand_assignment).
+   if (!in.assigns.empty()) {
+      out.assigns = in.assigns;
+      out.exprs = in.exprs;
+      out.ariths = in.ariths;
+   }
+
+   const WordPrograms progs{.exprs = in.exprs, .ariths = in.ariths};
+
+   // Words that take further expansion after braces stay in pattern form.
+   auto later = [&](std::size_t i) {
+      return contains(in.glob_words, i) || contains(in.subst_words, i);
+   };
+
+   std::vector<BraceExpansion> braces;
+   braces.reserve(in.brace_words.size());
+   for (const std::uint32_t w : in.brace_words)
+      braces.emplace_back(in.argv[w], later(w));
+
+   // Check the budget before producing anything. Glob matches and
+   // substitution output cannot be counted up front; they are checked as
+   // they arrive.
+   constexpr std::uint64_t kPerWord = 1 + sizeof(char*);
+   std::uint64_t words = in.argv.size() - in.brace_words.size();
+   std::uint64_t bytes = 0;
+   for (std::size_t i = 0; i < in.argv.size(); ++i) {
+      if (contains(in.brace_words, i) || later(i)) continue;
+      bytes = sat_add(bytes, in.argv[i].size() + kPerWord);
+   }
+   for (const BraceExpansion& e : braces) words = sat_add(words, e.count());
+   if (words > limits.max_words) {
+      err = "brace expansion: " + std::to_string(words) +
+            " words exceeds the limit of " + std::to_string(limits.max_words);
+      return false;
+   }
+   for (std::size_t k = 0; k < braces.size(); ++k) {
+      if (later(in.brace_words[k])) continue;
+      const BraceExpansion& e = braces[k];
+      bytes = sat_add(bytes, sat_add(e.bytes(), sat_mul(e.count(), kPerWord)));
+   }
+   if (bytes > limits.max_bytes) {
+      err = "brace expansion: argument list too long (" +
+            std::to_string(bytes) + " bytes, limit " +
+            std::to_string(limits.max_bytes) + ")";
+      return false;
+   }
+
+   auto over_budget = [&] {
+      if (out.argv.size() > limits.max_words) {
+         err = "expansion: more than " + std::to_string(limits.max_words) +
+               " words";
+         return true;
+      }
+      if (bytes > limits.max_bytes) {
+         err = "expansion: argument list too long (limit " +
+               std::to_string(limits.max_bytes) + " bytes)";
+         return true;
+      }
+      return false;
+   };
+
+   // A final word in pattern form: globbed, or taken literally. A glob
+   // without a match stays as written.
+   auto finish = [&](std::string_view pattern, bool globbed) {
+      bool matched = false;
+      if (globbed) {
+         const GlobPatternPtr compiled = ctx.globs.compile(pattern);
+         if (compiled->has_wildcards() && deferred) {
+            deferred->emplace_back(out.argv.size(), compiled);
+            out.argv.emplace_back(pattern);
+            bytes = sat_add(bytes, pattern.size() + kPerWord);
+            return !over_budget();
+         }
+         if (compiled->has_wildcards()) {
+            GlobExpansion g{compiled, ctx.globs};
+            while (const auto w = g.next()) {
+               out.argv.emplace_back(*w);
+               bytes = sat_add(bytes, w->size() + kPerWord);
+               matched = true;
+            }
+         }
+      }
+      if (!matched) {
+         out.argv.push_back(
+            pattern_literal(pattern, out.argv.get_allocator().resource()));
+         bytes = sat_add(bytes, out.argv.back().size() + kPerWord);
+      }
+      return !over_budget();
+   };
+
+   auto expand_word = [&](std::string_view pattern, std::size_t i) {
+      const bool globbed = contains(in.glob_words, i);
+      if (!contains(in.subst_words, i)) return finish(pattern, globbed);
+      std::vector<Field> fields;
+      if (!substitute_word(pattern, progs, ctx, fields, err)) return false;
+      for (const Field& f : fields)
+         if (!finish(f.pattern, globbed || f.glob)) return false;
+      return true;
+   };
+
+   // Stream the words straight into argv.
+   out.argv.reserve(static_cast<std::size_t>(words));
+   auto e = braces.begin();
+   for (std::size_t i = 0; i < in.argv.size(); ++i) {
+      if (contains(in.brace_words, i)) {
+         if (later(i)) {
+            while (const auto w = e->next())
+               if (!expand_word(*w, i)) return false;
+         } else {
+            while (const auto w = e->next()) out.argv.emplace_back(*w);
+         }
+         ++e;
+      } else if (later(i)) {
+         if (!expand_word(in.argv[i], i)) return false;
+      } else {
+         out.argv.emplace_back(in.argv[i]);
+      }
+   }
+   return true;
+}
+
+} // namespace
+
+bool expand_command(const SimpleCommand& in, SimpleCommand& out,
+                    const ExpandContext& ctx, std::string& err) {
+   return expand_words(in, out, ctx, nullptr, err);
+}
+
+bool WordListExpansion::start(const SimpleCommand& in,
+                              const ExpandContext& ctx, std::string& err) {
+   words_.argv.clear();
+   globs_.clear();
+   cache_ = &ctx.globs;
+   glob_.reset();
+   pos_ = 0;
+   next_glob_ = 0;
+   return expand_words(in, words_, ctx, &globs_, err);
+}
+
+std::optional<std::string_view> WordListExpansion::next() {
+   for (;;) {
+      if (glob_) {
+         if (const auto w = glob_->next()) {
+            matched_ = true;
+            return w;
+         }
+         glob_.reset();
+         // A glob without matches stays as written.
+         if (!matched_) {
+            literal_ = pattern_literal(words_.argv[pos_ - 1]);
+            return literal_;
+         }
+      }
+      if (pos_ == words_.argv.size()) return std::nullopt;
+      const std::size_t i = pos_++;
+      if (next_glob_ < globs_.size() && globs_[next_glob_].first == i) {
+         glob_.emplace(globs_[next_glob_++].second, *cache_);
+         matched_ = false;
+         continue;
+      }
+      return words_.argv[i];
+   }
+}
+
+bool needs_expansion(const SimpleCommand& sc) noexcept {
+   return !sc.brace_words.empty() || !sc.glob_words.empty() ||
+          !sc.subst_words.empty();
+}
+
+bool needs_expansion(const Pipeline& pl) noexcept {
+   for (const SimpleCommand& sc : pl.stages)
+      if (needs_expansion(sc)) return true;
+   return false;
+}
+
+bool expand_assignment(std::string_view assign, const WordPrograms& progs,
+                       const ExpandContext& ctx, std::string_view& name,
+                       Value& value, std::string& err) {
+   const std::size_t eq = assign.find('=');
+   name = assign.substr(0, eq);
+   const std::string_view rhs = assign.substr(eq + 1);
+
+   // A lone $(( )) keeps its integer: i=$((i + 1)) never goes through text.
+   if (rhs.starts_with("$(") && rhs.ends_with(')')) {
+      std::size_t e = 2;
+      while (e < rhs.size() && rhs[e] != ')') e += (rhs[e] == '\\') ? 2 : 1;
+      if (e + 1 == rhs.size()) {
+         const std::pmr::string body =
+            pattern_literal(rhs.substr(2, e - 2));
+         if (const auto source = arith_subst_body(body)) {
+            Value::Int v = 0;
+            if (!arithmetic(*source, progs, ctx, v, err)) return false;
+            value = Value{v};
+            return true;
+         }
+      }
+   }
+
+   std::string pattern;
+   if (!substitute_text(rhs, progs, ctx, pattern, err)) return false;
+   std::string text;
+   append_literal(text, pattern, /*keep=*/false);
+   value = Value{std::move(text)};
+   return true;
+}
+
+bool expand_pipeline(const Pipeline& in, Pipeline& out,
+                     const ExpandContext& ctx, std::string& err) {
+   out.stages.clear();
+   out.stages.reserve(in.stages.size());
+   for (const SimpleCommand& sc : in.stages) {
+      SimpleCommand& dst = out.stages.emplace_back();
+      if (!expand_command(sc, dst, ctx, err)) return false;
+   }
+   return true;
+}
+
+} // namespace clanker
@@ -0,0 +1,214 @@
+// src/clanker/expand.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "clanker/arith.h"
+#include "clanker/ast.h"
+#include "clanker/expr.h"
+#include "clanker/glob.h"
+#include "clanker/vars.h"
+
+namespace clanker {
+
+// Expansion phase (execution-model.md §3): runs between the parser and the
+// executor and turns the words of each SimpleCommand into the argv that is
+// classified and executed: brace expansion, then parameter expansion,
+// command substitution with field splitting and @( ) expressions (expr.h),
+// left to right, then pathname expansion (glob.h) of the words produced.
+//
+// Parameters (execution-model.md §3.6), never split or globbed:
+//   $name ${name}  $? $$   value; unset is empty
+//   $1 ${10} $# $0         positional parameter, their count, "clanker"
+//   $@ $*                  the positional parameters joined by spaces; a
+//                          whole word $@ is one field per parameter
+//   ${#name}               length in bytes
+//   ${name:-word}          word if unset or empty (without ':', if unset)
+//   ${name:+word}          word if set and not empty (without ':', if set)
+//   ${name:?word}          error with word if unset or empty
+//   ${name#pat} ${name##pat}  shortest / longest matching prefix removed
+//   ${name%pat} ${name%%pat}  shortest / longest matching suffix removed
+//   ${name/pat/rep}        first longest match replaced; // every match,
+//                          /# only a prefix, /% only a suffix
+
+// Per-command budget. Expansion that would exceed it fails before a single
+// word is produced.
+struct ExpansionLimits {
+   std::size_t max_words{1u << 18};
+
+   // argv bytes as execve() counts them: each word plus its terminator and
+   // its pointer.
+   std::size_t max_bytes{2u << 20};
+
+   // Defaults: max_bytes is what execve() will accept (ARG_MAX less the
+   // environment), so an expansion that fails here would have failed with
+   // E2BIG anyway. CLANKER_EXPAND_MAX_WORDS and CLANKER_EXPAND_MAX_BYTES
+   // override either.
+   [[nodiscard]] static ExpansionLimits from_environment();
+};
+
+// One brace pattern (see Token::brace), expanded lazily.
+//
+// Supported groups:
+//   {a,b,c}        elements; whitespace around commas is ignored
+//   {1..10[..2]}   integer range, zero-padded if an end is ("01")
+//   {a..e[..2]}    character range
+// A group containing another group, or one that is neither a list nor a
+// range, is literal text. "${" never starts a group.
+//
+// Words are produced in order by walking the cartesian product of the
+// groups with an odometer: the last group varies fastest, and only the
+// current word is held, however many there are.
+class BraceExpansion {
+ public:
+   // With `keep_escapes`, words stay in pattern form (escapes intact, and
+   // added to range characters that are glob metacharacters) so that they
+   // can be expanded further (substitution, globbing).
+   explicit BraceExpansion(std::string_view pattern, bool keep_escapes = false);
+
+   // Number of words; saturates at UINT64_MAX. Computed without expanding.
+   [[nodiscard]] std::uint64_t count() const noexcept { return count_; }
+
+   // Total size of all words in bytes, without terminators; saturates.
+   // Costs one pass over each group's elements (not over the product).
+   [[nodiscard]] std::uint64_t bytes() const;
+
+   // The next word, empty after the last. Valid until the following call.
+   [[nodiscard]] std::optional<std::string_view> next();
+
+ private:
+   struct Group {
+      std::vector<std::string> items; // list form
+      bool range{false};
+      bool chars{false};
+      std::int64_t first{0};
+      std::int64_t step{1};
+      std::uint64_t size{0};
+      std::size_t width{0}; // zero-pad integers to this width
+      bool escape{false};   // escape glob metacharacters in char ranges
+
+      void append(std::uint64_t i, std::string& out) const;
+   };
+
+   void append_from(std::size_t g);
+
+   bool keep_escapes_;
+   std::vector<std::string> literals_; // literals_[i] precedes groups_[i]
+   std::vector<Group> groups_;
+   std::uint64_t count_{1};
+
+   // Odometer state.
+   std::vector<std::uint64_t> index_;
+   std::vector<std::size_t> offset_; // where group i starts in word_
+   std::string word_;
+   bool started_{false};
+   bool done_{false};
+};
+
+// Runs the body of a command substitution, appends its standard output to
+// `out` and sets `status` to its exit status. Returns false with `err` set
+// if the body cannot be run at all (a syntax error); a command that runs and
+// fails is not an error.
+using SubstituteFn =
+   std::function<bool(std::string_view body, std::string& out, int& status,
+                      std::string& err)>;
+
+// What expansion needs from the shell.
+struct ExpandContext {
+   const ExpansionLimits& limits;
+   GlobCache& globs;
+   ExprVM& vm;
+   ArithVM& arith;
+   VarStore* vars; // $name, names in @( ) and $(( )), which may assign them;
+                   // may be null
+   int status{0};             // $?
+   SubstituteFn substitute{}; // empty: substitutions are an error
+   std::span<const std::pmr::string> args{}; // $1...: the running call's
+   // Set to the status of each substitution run, if not null; from then on
+   // $? is that status, as in bash.
+   std::optional<int>* subst_status{nullptr};
+
+   // $?
+   [[nodiscard]] int last_status() const noexcept {
+      return subst_status && *subst_status ? **subst_status : status;
+   }
+};
+
+// Expand every stage of `in` into `out` (whose allocator receives the new
+// words); assignments are copied as they are. Returns false with `err` set
+// if a command would exceed the limits, a substitution cannot run or an
+// expression or parameter fails; the pipeline must not run then. A glob
+// without matches stays as written.
+[[nodiscard]] bool expand_pipeline(const Pipeline& in, Pipeline& out,
+                                   const ExpandContext& ctx,
+                                   std::string& err);
+
+// The programs the parser compiled for a command's words
+// (SimpleCommand::exprs and ::ariths).
+struct WordPrograms {
+   std::span<const ExprProgramPtr> exprs;
+   std::span<const ArithProgramPtr> ariths;
+};
+
+// Split assignment `assign` (SimpleCommand::assigns) into its name and
+// value, the value substituted but neither split nor globbed: a string, or
+// the Value::Int of a value that is a lone $(( )). Assignments are
+// expanded one at a time as they are bound, so each sees the ones before
+// it, as in bash.
+[[nodiscard]] bool expand_assignment(std::string_view assign,
+                                     const WordPrograms& programs,
+                                     const ExpandContext& ctx,
+                                     std::string_view& name, Value& value,
+                                     std::string& err);
+
+// Substitute word pattern `word` into `out` without splitting or globbing
+// it, as the subject and patterns of a `case` are. `out` stays in pattern
+// form: substituted text is escaped, the word's own wildcards are not.
+[[nodiscard]] bool expand_word(std::string_view word,
+                               const WordPrograms& programs,
+                               const ExpandContext& ctx, std::string& out,
+                               std::string& err);
+
+// Expand the words of one command into `out`, as expand_pipeline() does
+// for each stage.
+[[nodiscard]] bool expand_command(const SimpleCommand& in, SimpleCommand& out,
+                                  const ExpandContext& ctx, std::string& err);
+
+// The word list of a `for` loop, walked as the loop runs. Braces,
+// parameters and substitutions are expanded up front, as in bash, but a
+// glob's matches come one at a time from its GlobExpansion: a loop over a
+// large tree starts at once and never holds all the names.
+class WordListExpansion {
+ public:
+   // Expand `in` as expand_command() would, globs aside. False with `err`
+   // set if that fails; nothing is produced then.
+   [[nodiscard]] bool start(const SimpleCommand& in, const ExpandContext& ctx,
+                            std::string& err);
+
+   // The next word, empty after the last. Valid until the following call.
+   [[nodiscard]] std::optional<std::string_view> next();
+
+ private:
+   SimpleCommand words_; // globs still in pattern form
+   std::vector<std::pair<std::size_t, GlobPatternPtr>> globs_; // by index
+   GlobCache* cache_{nullptr};
+   std::optional<GlobExpansion> glob_; // walking words_.argv[pos_ - 1]
+   bool matched_{false};
+   std::size_t pos_{0};
+   std::size_t next_glob_{0};
+   std::pmr::string literal_;
+};
+
+// True if the command (any stage) has a word to expand.
+[[nodiscard]] bool needs_expansion(const SimpleCommand& sc) noexcept;
+[[nodiscard]] bool needs_expansion(const Pipeline& pl) noexcept;
+
+} // namespace clanker
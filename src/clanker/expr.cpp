@@ -0,0 +1,875 @@
+// src/clanker/expr.cpp
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <utility>
+
+#include "clanker/expr.h"
+#include "clanker/lexer.h"
+
+namespace clanker {
+
+namespace {
+
+enum Fn : std::uint8_t { Len, Str, IntFn, Range, Join, Split };
+
+struct FnInfo {
+   std::string_view name;
+   std::uint8_t min_args;
+   std::uint8_t max_args;
+};
+
+constexpr FnInfo kFns[] = {
+   {"len", 1, 1},   {"str", 1, 1},  {"int", 1, 1},
+   {"range", 1, 2}, {"join", 2, 2}, {"split", 2, 2},
+};
+
+// Lists built by range() and split() stop here rather than exhaust memory.
+constexpr std::size_t kMaxListSize = 1u << 24;
+
+bool is_name_start(char c) noexcept {
+   return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool is_name_char(char c) noexcept {
+   return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+} // namespace
+
+// Recursive descent straight to register code; there is no expression
+// tree. Each rule evaluates into the register it is given and may use the
+// registers above it as temporaries.
+class ExprCompiler {
+ public:
+   explicit ExprCompiler(std::string_view src)
+      : src_(src) {
+      prog_ = std::make_shared<ExprProgram>();
+      prog_->source_ = std::string{src};
+   }
+
+   ExprCompileResult compile() {
+      space();
+      if (peek() == '*') {
+         ++i_;
+         prog_->splice_ = true;
+      }
+      next_ = 1;
+      cond(0);
+      space();
+      if (!failed_ && i_ < src_.size()) fail("unexpected '" + rest() + "'");
+      if (failed_)
+         return {.program = nullptr,
+                 .message = std::move(message_),
+                 .error_offset = error_offset_};
+      return {.program = std::move(prog_), .message = {}, .error_offset = 0};
+   }
+
+ private:
+   // ---- Scanning ----
+
+   void space() {
+      while (i_ < src_.size() && (src_[i_] == ' ' || src_[i_] == '\t' ||
+                                  src_[i_] == '\r' || src_[i_] == '\n'))
+         ++i_;
+   }
+
+   [[nodiscard]] char peek(std::size_t k = 0) const noexcept {
+      return i_ + k < src_.size() ? src_[i_ + k] : '\0';
+   }
+
+   // Skip whitespace, then consume `op` if it comes next.
+   bool accept(std::string_view op) {
+      space();
+      if (src_.substr(i_, op.size()) != op) return false;
+      // "<" must not take the first byte of "<=", and so on.
+      if (op.size() == 1 && (op == "<" || op == ">" || op == "!") &&
+          peek(1) == '=')
+         return false;
+      i_ += op.size();
+      return true;
+   }
+
+   void expect(std::string_view op) {
+      if (!accept(op)) fail("expected '" + std::string{op} + "'");
+   }
+
+   std::string rest() const {
+      return std::string{src_.substr(i_, 8)};
+   }
+
+   void fail(std::string msg) {
+      if (failed_) return;
+      failed_ = true;
+      message_ = std::move(msg);
+      error_offset_ = i_;
+   }
+
+   // ---- Emitting ----
+
+   std::size_t emit(ExprOp op, std::size_t a, std::size_t b = 0,
+                    std::size_t c = 0, std::uint8_t fn = 0) {
+      prog_->code_.push_back(ExprInstr{.op = op,
+                                       .fn = fn,
+                                       .a = static_cast<std::uint16_t>(a),
+                                       .b = static_cast<std::uint16_t>(b),
+                                       .c = static_cast<std::uint16_t>(c)});
+      return prog_->code_.size() - 1;
+   }
+
+   void patch(std::size_t at) {
+      prog_->code_[at].c = static_cast<std::uint16_t>(prog_->code_.size());
+      if (prog_->code_.size() > kMax) fail("expression too large");
+   }
+
+   std::size_t alloc() {
+      const std::size_t r = next_++;
+      if (next_ > kMax) {
+         fail("expression too large");
+         next_ = kMax;
+      }
+      prog_->registers_ =
+         std::max(prog_->registers_, static_cast<std::uint16_t>(next_));
+      return r;
+   }
+
+   std::size_t constant(Value v) {
+      prog_->consts_.push_back(std::move(v));
+      if (prog_->consts_.size() > kMax) fail("expression too large");
+      return prog_->consts_.size() - 1;
+   }
+
+   // ---- Rules ----
+
+   void cond(std::size_t dst) {
+      or_(dst);
+      if (!accept("?")) return;
+      const std::size_t to_else = emit(ExprOp::JumpIfNot, dst);
+      cond(dst);
+      const std::size_t to_end = emit(ExprOp::Jump, 0);
+      patch(to_else);
+      expect(":");
+      cond(dst);
+      patch(to_end);
+   }
+
+   // a || b || c: stop at the first true operand. Every operand must be a
+   // bool; the jumps check all but the last, Test checks that one.
+   void or_(std::size_t dst) { short_circuit(dst, "||", ExprOp::JumpIf); }
+   void and_(std::size_t dst) { short_circuit(dst, "&&", ExprOp::JumpIfNot); }
+
+   void short_circuit(std::size_t dst, std::string_view op, ExprOp jump) {
+      const bool is_or = op == "||";
+      if (is_or)
+         and_(dst);
+      else
+         not_(dst);
+      if (src_.substr(skip_space(), op.size()) != op) return;
+
+      std::vector<std::size_t> exits;
+      while (accept(op)) {
+         exits.push_back(emit(jump, dst));
+         if (is_or)
+            and_(dst);
+         else
+            not_(dst);
+      }
+      emit(ExprOp::Test, dst, is_or);
+      for (const std::size_t at : exits) patch(at);
+   }
+
+   std::size_t skip_space() {
+      space();
+      return i_;
+   }
+
+   void not_(std::size_t dst) {
+      if (accept("!")) {
+         not_(dst);
+         emit(ExprOp::Not, dst, dst);
+         return;
+      }
+      cmp(dst);
+   }
+
+   void cmp(std::size_t dst) {
+      add(dst);
+      static constexpr std::pair<std::string_view, ExprOp> kOps[] = {
+         {"==", ExprOp::Eq}, {"!=", ExprOp::Ne}, {"<=", ExprOp::Le},
+         {">=", ExprOp::Ge}, {"<", ExprOp::Lt},  {">", ExprOp::Gt},
+      };
+      for (const auto& [text, op] : kOps) {
+         if (!accept(text)) continue;
+         const std::size_t t = alloc();
+         add(t);
+         emit(op, dst, dst, t);
+         next_ = t;
+         return;
+      }
+   }
+
+   void add(std::size_t dst) {
+      mul(dst);
+      for (;;) {
+         ExprOp op;
+         if (accept("+"))
+            op = ExprOp::Add;
+         else if (accept("-"))
+            op = ExprOp::Sub;
+         else
+            return;
+         const std::size_t t = alloc();
+         mul(t);
+         emit(op, dst, dst, t);
+         next_ = t;
+      }
+   }
+
+   void mul(std::size_t dst) {
+      unary(dst);
+      for (;;) {
+         ExprOp op;
+         if (accept("*"))
+            op = ExprOp::Mul;
+         else if (accept("/"))
+            op = ExprOp::Div;
+         else if (accept("%"))
+            op = ExprOp::Mod;
+         else
+            return;
+         const std::size_t t = alloc();
+         unary(t);
+         emit(op, dst, dst, t);
+         next_ = t;
+      }
+   }
+
+   void unary(std::size_t dst) {
+      if (accept("-")) {
+         unary(dst);
+         emit(ExprOp::Neg, dst, dst);
+         return;
+      }
+      postfix(dst);
+   }
+
+   void postfix(std::size_t dst) {
+      primary(dst);
+      while (!failed_ && accept("[")) {
+         const std::size_t t = alloc();
+         cond(t);
+         expect("]");
+         emit(ExprOp::Index, dst, dst, t);
+         next_ = t;
+      }
+   }
+
+   // Evaluate a comma-separated list up to `close` into consecutive
+   // registers; returns the first and the count.
+   std::pair<std::size_t, std::size_t> items(std::string_view close) {
+      const std::size_t first = next_;
+      std::size_t n = 0;
+      if (!accept(close)) {
+         do {
+            cond(alloc());
+            ++n;
+         } while (!failed_ && accept(","));
+         expect(close);
+      }
+      return {first, n};
+   }
+
+   void primary(std::size_t dst) {
+      if (failed_) return;
+      space();
+      const char c = peek();
+
+      if (c == '(') {
+         ++i_;
+         cond(dst);
+         expect(")");
+         return;
+      }
+      if (c == '[') {
+         ++i_;
+         const std::size_t mark = next_;
+         const auto [first, n] = items("]");
+         emit(ExprOp::List, dst, first, n);
+         next_ = mark;
+         return;
+      }
+      if (c >= '0' && c <= '9') {
+         Value::Int v = 0;
+         const char* b = src_.data() + i_;
+         const char* e = src_.data() + src_.size();
+         const auto [p, ec] = std::from_chars(b, e, v);
+         if (ec != std::errc{}) return fail("integer out of range");
+         i_ += static_cast<std::size_t>(p - b);
+         if (is_name_char(peek())) return fail("bad number");
+         emit(ExprOp::Const, dst, constant(Value{v}));
+         return;
+      }
+      if (c == '\'' || c == '"') {
+         std::string s;
+         if (!string_literal(s)) return;
+         emit(ExprOp::Const, dst, constant(Value{std::move(s)}));
+         return;
+      }
+      if (is_name_start(c)) {
+         const std::size_t b = i_;
+         while (is_name_char(peek())) ++i_;
+         const std::string_view name = src_.substr(b, i_ - b);
+         if (name == "true" || name == "false") {
+            emit(ExprOp::Const, dst, constant(Value{name == "true"}));
+            return;
+         }
+         if (name == "null") {
+            emit(ExprOp::Const, dst, constant(Value{}));
+            return;
+         }
+         space();
+         if (peek() == '(') return call(dst, name, b);
+         prog_->names_.emplace_back(name);
+         emit(ExprOp::Name, dst, prog_->names_.size() - 1);
+         return;
+      }
+      if (i_ >= src_.size()) return fail("unexpected end of expression");
+      fail("unexpected '" + rest() + "'");
+   }
+
+   void call(std::size_t dst, std::string_view name, std::size_t at) {
+      const auto* f =
+         std::find_if(std::begin(kFns), std::end(kFns),
+                      [&](const FnInfo& x) { return x.name == name; });
+      if (f == std::end(kFns)) {
+         i_ = at;
+         return fail("unknown function '" + std::string{name} + "'");
+      }
+      ++i_; // '('
+      const std::size_t mark = next_;
+      const auto [first, n] = items(")");
+      if (n < f->min_args || n > f->max_args) {
+         i_ = at;
+         return fail(std::string{name} + "(): wrong number of arguments");
+      }
+      emit(ExprOp::Call, dst, first, n,
+           static_cast<std::uint8_t>(f - std::begin(kFns)));
+      next_ = mark;
+   }
+
+   bool string_literal(std::string& out) {
+      const char q = src_[i_++];
+      for (;;) {
+         if (i_ >= src_.size()) {
+            fail("unterminated string");
+            return false;
+         }
+         const char c = src_[i_++];
+         if (c == q) return true;
+         if (q == '"' && c == '\\' && i_ < src_.size()) {
+            const char n = src_[i_++];
+            if (n == 'n')
+               out.push_back('\n');
+            else if (n == '"' || n == '\\')
+               out.push_back(n);
+            else {
+               --i_;
+               fail("unsupported escape in string");
+               return false;
+            }
+            continue;
+         }
+         out.push_back(c);
+      }
+   }
+
+   static constexpr std::size_t kMax =
+      std::numeric_limits<std::uint16_t>::max();
+
+   std::string_view src_;
+   std::size_t i_{0};
+   std::size_t next_{1};
+   std::shared_ptr<ExprProgram> prog_;
+   bool failed_{false};
+   std::string message_;
+   std::size_t error_offset_{0};
+};
+
+ExprCompileResult compile_expr(std::string_view source) {
+   return ExprCompiler{source}.compile();
+}
+
+bool compile_word_exprs(std::string_view pattern,
+                        std::pmr::vector<ExprProgramPtr>& programs,
+                        std::string& err) {
+   for (std::size_t k = 0; k + 1 < pattern.size();) {
+      if (pattern[k] == '\\') {
+         k += 2;
+         continue;
+      }
+      const bool expr = pattern[k] == '@' && pattern[k + 1] == '(';
+      if (!expr && !(pattern[k] == '$' && pattern[k + 1] == '(')) {
+         ++k;
+         continue;
+      }
+      // Bodies are escaped throughout: the first bare ')' closes them.
+      std::size_t e = k + 2;
+      while (e < pattern.size() && pattern[e] != ')')
+         e += (pattern[e] == '\\') ? 2 : 1;
+      if (expr) {
+         const std::pmr::string body =
+            pattern_literal(pattern.substr(k + 2, e - k - 2));
+         const bool known =
+            std::any_of(programs.begin(), programs.end(),
+                        [&](const ExprProgramPtr& p) {
+                           return std::string_view{p->source()} == body;
+                        });
+         if (!known) {
+            ExprCompileResult r = compile_expr(body);
+            if (!r.program) {
+               err = "@(" + std::string{body} + "): " + r.message;
+               return false;
+            }
+            programs.push_back(std::move(r.program));
+         }
+      }
+      k = e + 1;
+   }
+   return true;
+}
+
+// ---- VM ----
+
+namespace {
+
+bool values_equal(const Value& x, const Value& y) {
+   if (x.storage().index() != y.storage().index()) return false;
+   if (const auto* l = x.as_list()) {
+      const auto& r = *y.as_list();
+      return std::equal(l->begin(), l->end(), r.begin(), r.end(),
+                        values_equal);
+   }
+   return std::visit(
+      [&](const auto& a) {
+         using T = std::decay_t<decltype(a)>;
+         if constexpr (std::is_same_v<T, Value::Null>)
+            return true;
+         else if constexpr (std::is_same_v<T, Value::List>)
+            return false; // handled above
+         else
+            return a == std::get<T>(y.storage());
+      },
+      x.storage());
+}
+
+std::string type_error(std::string_view op, const Value& x) {
+   return std::string{op} + ": unsupported operand (" +
+          kind_name(kind_of(x)) + ")";
+}
+
+std::string type_error(std::string_view op, const Value& x, const Value& y) {
+   return std::string{op} + ": unsupported operands (" +
+          kind_name(kind_of(x)) + ", " + kind_name(kind_of(y)) + ")";
+}
+
+} // namespace
+
+const Value* ExprVM::run(const ExprProgram& p, const ExprEnv* env,
+                         std::string& err) {
+   if (regs_.size() < p.registers_) regs_.resize(p.registers_);
+   Reg* const r = regs_.data();
+   const ExprInstr* const code = p.code_.data();
+   const std::size_t size = p.code_.size();
+
+   // `fn` returns false on overflow.
+   auto int_op = [&](const ExprInstr& in, std::string_view name, auto&& fn) {
+      const Value& x = r[in.b].get();
+      const Value& y = r[in.c].get();
+      const auto* a = x.as_int();
+      const auto* b = y.as_int();
+      if (!a || !b) {
+         err = type_error(name, x, y);
+         return false;
+      }
+      if ((in.op == ExprOp::Div || in.op == ExprOp::Mod) && *b == 0) {
+         err = "division by zero";
+         return false;
+      }
+      Value::Int out = 0;
+      if (!fn(*a, *b, out)) {
+         err = std::string{name} + ": integer overflow";
+         return false;
+      }
+      r[in.a].set(Value{out});
+      return true;
+   };
+
+   auto as_bool = [&](const Value& v, std::string_view what,
+                      bool& out) -> bool {
+      const bool* b = v.as_bool();
+      if (!b) {
+         err = std::string{what} + ": expected a bool, got " +
+               kind_name(kind_of(v));
+         return false;
+      }
+      out = *b;
+      return true;
+   };
+
+   for (std::size_t pc = 0; pc < size;) {
+      const ExprInstr& in = code[pc++];
+      Reg& d = r[in.a];
+      switch (in.op) {
+      case ExprOp::Const:
+         d.ref = &p.consts_[in.b];
+         break;
+
+      case ExprOp::Name: {
+         const std::string& name = p.names_[in.b];
+         const Value* v = env ? env->lookup(name) : nullptr;
+         if (!v) {
+            err = "'" + name + "' is not defined";
+            return nullptr;
+         }
+         d.ref = v;
+         break;
+      }
+
+      case ExprOp::Add: {
+         const Value& x = r[in.b].get();
+         const Value& y = r[in.c].get();
+         if (x.is_int() && y.is_int()) {
+            if (!int_op(in, "+", [](auto a, auto b, auto& o) {
+                   return !__builtin_add_overflow(a, b, &o);
+                }))
+               return nullptr;
+            break;
+         }
+         const auto* xs = x.as_string();
+         const auto* ys = y.as_string();
+         if (xs && ys) {
+            // Appending to a string this register already owns (a + b + c)
+            // reuses its buffer.
+            if (&x == &d.owned) {
+               std::get<Value::String>(d.owned.storage()).append(*ys);
+            } else {
+               Value::String s;
+               s.reserve(xs->size() + ys->size());
+               s.append(*xs).append(*ys);
+               d.set(Value{std::move(s)});
+            }
+            break;
+         }
+         const auto* xl = x.as_list();
+         const auto* yl = y.as_list();
+         if (xl && yl) {
+            if (&x == &d.owned) {
+               auto& l = std::get<Value::List>(d.owned.storage());
+               l.insert(l.end(), yl->begin(), yl->end());
+            } else {
+               Value::List l;
+               l.reserve(xl->size() + yl->size());
+               l.insert(l.end(), xl->begin(), xl->end());
+               l.insert(l.end(), yl->begin(), yl->end());
+               d.set(Value{std::move(l)});
+            }
+            break;
+         }
+         err = type_error("+", x, y);
+         return nullptr;
+      }
+
+      case ExprOp::Sub:
+         if (!int_op(in, "-", [](auto a, auto b, auto& o) {
+                return !__builtin_sub_overflow(a, b, &o);
+             }))
+            return nullptr;
+         break;
+
+      case ExprOp::Mul:
+         if (!int_op(in, "*", [](auto a, auto b, auto& o) {
+                return !__builtin_mul_overflow(a, b, &o);
+             }))
+            return nullptr;
+         break;
+
+      case ExprOp::Div:
+      case ExprOp::Mod: {
+         const bool div = in.op == ExprOp::Div;
+         if (!int_op(in, div ? "/" : "%", [&](auto a, auto b, auto& o) {
+                if (a == std::numeric_limits<Value::Int>::min() && b == -1)
+                   return false;
+                o = div ? a / b : a % b;
+                return true;
+             }))
+            return nullptr;
+         break;
+      }
+
+      case ExprOp::Neg: {
+         const Value& x = r[in.b].get();
+         const auto* a = x.as_int();
+         if (!a) {
+            err = type_error("-", x);
+            return nullptr;
+         }
+         if (*a == std::numeric_limits<Value::Int>::min()) {
+            err = "-: integer overflow";
+            return nullptr;
+         }
+         d.set(Value{-*a});
+         break;
+      }
+
+      case ExprOp::Not: {
+         bool b = false;
+         if (!as_bool(r[in.b].get(), "!", b)) return nullptr;
+         d.set(Value{!b});
+         break;
+      }
+
+      case ExprOp::Test: {
+         bool b = false;
+         if (!as_bool(d.get(), in.b ? "||" : "&&", b)) return nullptr;
+         break;
+      }
+
+      case ExprOp::Eq:
+      case ExprOp::Ne: {
+         const bool eq = values_equal(r[in.b].get(), r[in.c].get());
+         d.set(Value{in.op == ExprOp::Eq ? eq : !eq});
+         break;
+      }
+
+      case ExprOp::Lt:
+      case ExprOp::Le:
+      case ExprOp::Gt:
+      case ExprOp::Ge: {
+         const Value& x = r[in.b].get();
+         const Value& y = r[in.c].get();
+         int c = 0;
+         if (x.is_int() && y.is_int()) {
+            c = (*x.as_int() > *y.as_int()) - (*x.as_int() < *y.as_int());
+         } else if (x.is_string() && y.is_string()) {
+            c = x.as_string()->compare(*y.as_string());
+         } else {
+            err = type_error("comparison", x, y);
+            return nullptr;
+         }
+         bool out = false;
+         switch (in.op) {
+         case ExprOp::Lt: out = c < 0; break;
+         case ExprOp::Le: out = c <= 0; break;
+         case ExprOp::Gt: out = c > 0; break;
+         default: out = c >= 0; break;
+         }
+         d.set(Value{out});
+         break;
+      }
+
+      case ExprOp::Index: {
+         Reg& xr = r[in.b];
+         const Value& x = xr.get();
+         const Value& i = r[in.c].get();
+         const auto* n = i.as_int();
+         const std::size_t size = x.as_list()     ? x.as_list()->size()
+                                  : x.as_string() ? x.as_string()->size()
+                                                  : 0;
+         if (!n || (!x.is_list() && !x.is_string())) {
+            err = type_error("[]", x, i);
+            return nullptr;
+         }
+         // Negative indices count from the end.
+         const Value::Int k =
+            *n < 0 ? *n + static_cast<Value::Int>(size) : *n;
+         if (k < 0 || static_cast<std::size_t>(k) >= size) {
+            err = "[]: index " + std::to_string(*n) + " out of range (size " +
+                  std::to_string(size) + ")";
+            return nullptr;
+         }
+         const auto at = static_cast<std::size_t>(k);
+         if (const auto* l = x.as_list()) {
+            if (xr.ref) {
+               // Still inside a constant or the env: refer to the element.
+               d.ref = &(*l)[at];
+            } else if (&xr == &d) {
+               // A temporary list: take the element, drop the rest.
+               Value e = std::move(
+                  std::get<Value::List>(xr.owned.storage())[at]);
+               d.set(std::move(e));
+            } else {
+               d.set((*l)[at]);
+            }
+         } else {
+            d.set(Value{Value::String(1, (*x.as_string())[at])});
+         }
+         break;
+      }
+
+      case ExprOp::List: {
+         Value::List l;
+         l.reserve(in.c);
+         for (std::size_t k = 0; k < in.c; ++k) {
+            Reg& e = r[in.b + k];
+            if (e.ref)
+               l.push_back(*e.ref);
+            else
+               l.push_back(std::move(e.owned));
+         }
+         d.set(Value{std::move(l)});
+         break;
+      }
+
+      case ExprOp::Call:
+         if (!call(in, err)) return nullptr;
+         break;
+
+      case ExprOp::Jump:
+         pc = in.c;
+         break;
+
+      case ExprOp::JumpIf:
+      case ExprOp::JumpIfNot: {
+         bool b = false;
+         if (!as_bool(d.get(), in.op == ExprOp::JumpIf ? "||" : "&&", b))
+            return nullptr;
+         if (b == (in.op == ExprOp::JumpIf)) pc = in.c;
+         break;
+      }
+      }
+   }
+   return &r[0].get();
+}
+
+bool ExprVM::call(const ExprInstr& in, std::string& err) {
+   Reg* const r = regs_.data();
+   Reg& d = r[in.a];
+   Reg& xr = r[in.b];
+   const Value& x = xr.get();
+   const std::string_view name = kFns[in.fn].name;
+
+   auto fail = [&](std::string msg) {
+      err = std::move(msg);
+      return false;
+   };
+   // Pass an argument through unchanged. Argument registers are
+   // temporaries, so an owned value can be moved.
+   auto forward = [&] {
+      if (xr.ref)
+         d.ref = xr.ref;
+      else
+         d.set(std::move(xr.owned));
+      return true;
+   };
+
+   switch (static_cast<Fn>(in.fn)) {
+   case Len:
+      if (const auto* s = x.as_string())
+         d.set(Value{static_cast<Value::Int>(s->size())});
+      else if (const auto* l = x.as_list())
+         d.set(Value{static_cast<Value::Int>(l->size())});
+      else
+         return fail(type_error(name, x));
+      return true;
+
+   case Str: {
+      if (x.is_string()) return forward();
+      std::string s;
+      if (!lower_value(x, s, err)) return false;
+      d.set(Value{std::move(s)});
+      return true;
+   }
+
+   case IntFn: {
+      if (x.is_int()) return forward();
+      const auto* s = x.as_string();
+      if (!s) return fail(type_error(name, x));
+      Value::Int v = 0;
+      const char* b = s->data();
+      const char* e = b + s->size();
+      const auto [p, ec] = std::from_chars(b, e, v);
+      if (ec != std::errc{} || p != e || b == e)
+         return fail("int: not an integer: '" + *s + "'");
+      d.set(Value{v});
+      return true;
+   }
+
+   case Range: {
+      const Value& y = in.c == 2 ? r[in.b + 1].get() : x;
+      if (!x.is_int() || !y.is_int()) return fail(type_error(name, x, y));
+      const Value::Int lo = in.c == 2 ? *x.as_int() : 0;
+      const Value::Int hi = *y.as_int();
+      if (hi > lo && static_cast<std::uint64_t>(hi) -
+                           static_cast<std::uint64_t>(lo) >
+                        kMaxListSize)
+         return fail("range: more than " + std::to_string(kMaxListSize) +
+                     " items");
+      Value::List l;
+      if (hi > lo) l.reserve(static_cast<std::size_t>(hi - lo));
+      for (Value::Int i = lo; i < hi; ++i) l.emplace_back(i);
+      d.set(Value{std::move(l)});
+      return true;
+   }
+
+   case Join: {
+      const Value& sep = r[in.b + 1].get();
+      const auto* l = x.as_list();
+      const auto* s = sep.as_string();
+      if (!l || !s) return fail(type_error(name, x, sep));
+      std::string out;
+      for (std::size_t k = 0; k < l->size(); ++k) {
+         if (k) out += *s;
+         if (!lower_value((*l)[k], out, err)) return false;
+      }
+      d.set(Value{std::move(out)});
+      return true;
+   }
+
+   case Split: {
+      const Value& sep = r[in.b + 1].get();
+      const auto* s = x.as_string();
+      const auto* by = sep.as_string();
+      if (!s || !by) return fail(type_error(name, x, sep));
+      if (by->empty()) return fail("split: empty separator");
+      Value::List l;
+      for (std::size_t from = 0;;) {
+         if (l.size() == kMaxListSize)
+            return fail("split: more than " + std::to_string(kMaxListSize) +
+                        " items");
+         const std::size_t at = s->find(*by, from);
+         l.emplace_back(s->substr(from, at - from));
+         if (at == std::string::npos) break;
+         from = at + by->size();
+      }
+      d.set(Value{std::move(l)});
+      return true;
+   }
+   }
+   return false;
+}
+
+bool lower_value(const Value& v, std::string& out, std::string& err) {
+   if (const auto* s = v.as_string()) {
+      out += *s;
+      return true;
+   }
+   if (const auto* i = v.as_int()) {
+      char buf[24];
+      const auto [p, ec] = std::to_chars(buf, buf + sizeof buf, *i);
+      out.append(buf, p);
+      return true;
+   }
+   if (const auto* b = v.as_bool()) {
+      out += *b ? "true" : "false";
+      return true;
+   }
+   if (v.is_null()) return true;
+   if (v.is_list())
+      err = "a list is not a word; splice it with @(*...)";
+   else
+      err = std::string{"cannot use a "} + kind_name(kind_of(v)) +
+            " value as a word";
+   return false;
+}
+
+} // namespace clanker
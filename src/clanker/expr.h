@@ -0,0 +1,167 @@
+// src/clanker/expr.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "clanker/value.h"
+
+namespace clanker {
+
+// Value expressions: the body of an @( ... ) expansion
+// (docs/normative/expansion-model.md; execution-model.md §3.5).
+//
+// Grammar, loosest binding first:
+//   expr    := ['*'] cond           '*' splices a list into separate words
+//   cond    := or ['?' cond ':' cond]
+//   or      := and {'||' and}
+//   and     := not {'&&' not}
+//   not     := '!' not | cmp
+//   cmp     := add [('==' | '!=' | '<' | '<=' | '>' | '>=') add]
+//   add     := mul {('+' | '-') mul}
+//   mul     := unary {('*' | '/' | '%') unary}
+//   unary   := '-' unary | postfix
+//   postfix := primary {'[' cond ']'}
+//   primary := INT | STRING | 'true' | 'false' | 'null' | NAME
+//            | FUNC '(' [cond {',' cond}] ')' | '(' cond ')'
+//            | '[' [cond {',' cond}] ']'
+// STRING is '...' (no escapes) or "..." (\" \\ \n), as in shell words.
+// FUNC is one of len, str, int, range, join, split.
+//
+// There are no implicit conversions: '+' adds two ints or joins two strings
+// or two lists, '&&', '||', '!' and '?' take bools, and anything else is a
+// runtime error.
+
+// Names an expression can read. Values must not change while a program
+// runs; the VM refers to them instead of copying.
+class ExprEnv {
+ public:
+   virtual ~ExprEnv() = default;
+
+   // The value bound to `name`, or null if there is none.
+   [[nodiscard]] virtual const Value* lookup(std::string_view name) const = 0;
+};
+
+enum class ExprOp : std::uint8_t {
+   Const,     // a = consts[b]
+   Name,      // a = env[names[b]]
+   Add,       // a = b + c, and so on
+   Sub,
+   Mul,
+   Div,
+   Mod,
+   Neg,       // a = -b
+   Not,       // a = !b
+   Test,      // check that a is a bool (operand of && if b is 0, else ||)
+   Eq,
+   Ne,
+   Lt,
+   Le,
+   Gt,
+   Ge,
+   Index,     // a = b[c]
+   List,      // a = [b, b+1, ..., b+c-1]
+   Call,      // a = fn(b, ..., b+c-1)
+   Jump,      // pc = c
+   JumpIf,    // if a: pc = c
+   JumpIfNot, // if !a: pc = c
+};
+
+// One register instruction, 8 bytes.
+struct ExprInstr {
+   ExprOp op;
+   std::uint8_t fn{0}; // Call only
+   std::uint16_t a{0};
+   std::uint16_t b{0};
+   std::uint16_t c{0};
+};
+
+// A compiled expression: register code, its constants and the names it
+// reads. Immutable, so one program is shared by every copy of the AST and
+// run by any number of VMs. The result is left in register 0.
+class ExprProgram {
+ public:
+   [[nodiscard]] const std::string& source() const noexcept { return source_; }
+
+   // The expression started with '*': its list becomes separate words.
+   [[nodiscard]] bool splice() const noexcept { return splice_; }
+
+   [[nodiscard]] std::size_t registers() const noexcept { return registers_; }
+   [[nodiscard]] const std::vector<ExprInstr>& code() const noexcept {
+      return code_;
+   }
+
+ private:
+   friend class ExprCompiler;
+   friend class ExprVM;
+
+   std::string source_;
+   std::vector<ExprInstr> code_;
+   std::vector<Value> consts_;
+   std::vector<std::string> names_;
+   std::uint16_t registers_{1};
+   bool splice_{false};
+};
+
+using ExprProgramPtr = std::shared_ptr<const ExprProgram>;
+
+struct ExprCompileResult {
+   ExprProgramPtr program; // null on error
+   std::string message;
+   std::size_t error_offset{0}; // into the source
+};
+
+[[nodiscard]] ExprCompileResult compile_expr(std::string_view source);
+
+// Compile every @( ) in word pattern `pattern` (lexer.h, "Word patterns")
+// that is not in `programs` yet and append it. Returns false with `err` set
+// at the first one that does not compile.
+[[nodiscard]] bool
+compile_word_exprs(std::string_view pattern,
+                   std::pmr::vector<ExprProgramPtr>& programs,
+                   std::string& err);
+
+// Runs programs. Registers are kept between runs, so evaluating the same
+// expression over and over (a loop over a list) does not allocate unless
+// the expression builds new strings or lists.
+class ExprVM {
+ public:
+   // The value of `program`, valid until the next run(); null with `err`
+   // set on a runtime error. `env` may be null: every name is then unbound.
+   [[nodiscard]] const Value* run(const ExprProgram& program,
+                                  const ExprEnv* env, std::string& err);
+
+ private:
+   // Either a value of its own or a reference to a constant, an env value
+   // or an element of one; reading a name or indexing into it copies
+   // nothing.
+   struct Reg {
+      Value owned;
+      const Value* ref{nullptr};
+
+      [[nodiscard]] const Value& get() const noexcept {
+         return ref ? *ref : owned;
+      }
+      void set(Value v) {
+         owned = std::move(v);
+         ref = nullptr;
+      }
+   };
+
+   bool call(const ExprInstr& in, std::string& err);
+
+   std::vector<Reg> regs_;
+};
+
+// Append the argv form of `v` (expansion-model.md §4) to `out`: strings
+// unchanged, ints in decimal, bools as true/false, null as nothing. Lists,
+// JSON and procedures cannot be lowered; returns false with `err` set.
+[[nodiscard]] bool lower_value(const Value& v, std::string& out,
+                               std::string& err);
+
+} // namespace clanker
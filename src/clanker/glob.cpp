@@ -0,0 +1,672 @@
+// src/clanker/glob.cpp
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <condition_variable>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <span>
+#include <sys/stat.h>
+#include <thread>
+
+#include "clanker/glob.h"
+#include "clanker/lexer.h"
+
+namespace clanker {
+
+namespace {
+
+// getdents64 buffer; enough for a few hundred names per call.
+constexpr std::size_t kDentBufBytes = 32 * 1024;
+
+// "**" walks stay on the calling thread until this many directories have
+// been read, so small trees never pay for starting threads.
+constexpr std::size_t kSerialDirs = 64;
+
+constexpr int kDirFlags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+
+std::int64_t to_ns(const timespec& ts) noexcept {
+   return static_cast<std::int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+bool is_dot_or_dotdot(std::string_view n) noexcept {
+   return n == "." || n == "..";
+}
+
+// Whether `name` in the directory at `fd` is a directory, following
+// symlinks; `type` avoids the stat when getdents64 already knows. "" is the
+// directory itself.
+bool is_dir(int fd, const std::string& name, unsigned char type) {
+   if (type == DT_DIR || name.empty()) return true;
+   if (type != DT_UNKNOWN && type != DT_LNK) return false;
+   struct stat st {};
+   return ::fstatat(fd, name.c_str(), &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Same, without following symlinks ("**" never leaves the tree).
+bool is_real_dir(int fd, const std::string& name, unsigned char type) {
+   if (type != DT_UNKNOWN) return type == DT_DIR;
+   struct stat st {};
+   return ::fstatat(fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+          S_ISDIR(st.st_mode);
+}
+
+bool add_class(std::string_view name, std::bitset<256>& set) {
+   int (*pred)(int) = nullptr;
+   if (name == "alpha") pred = ::isalpha;
+   else if (name == "digit") pred = ::isdigit;
+   else if (name == "alnum") pred = ::isalnum;
+   else if (name == "upper") pred = ::isupper;
+   else if (name == "lower") pred = ::islower;
+   else if (name == "space") pred = ::isspace;
+   else if (name == "blank") pred = ::isblank;
+   else if (name == "punct") pred = ::ispunct;
+   else if (name == "xdigit") pred = ::isxdigit;
+   else if (name == "cntrl") pred = ::iscntrl;
+   else if (name == "print") pred = ::isprint;
+   else if (name == "graph") pred = ::isgraph;
+   else return false;
+   // Byte-wise, in the C locale.
+   for (int c = 0; c < 128; ++c)
+      if (pred(c)) set.set(static_cast<std::size_t>(c));
+   return true;
+}
+
+// Parse the bracket expression starting at p[k] == '['. Returns the offset
+// just past its ']', or 0 if it is not one (the '[' is then literal).
+std::size_t parse_bracket(std::string_view p, std::size_t k,
+                          std::bitset<256>& set) {
+   std::size_t j = k + 1;
+   bool negate = false;
+   if (j < p.size() && (p[j] == '!' || p[j] == '^')) {
+      negate = true;
+      ++j;
+   }
+
+   auto take = [&](unsigned char& out) {
+      if (p[j] == '\\' && j + 1 < p.size()) ++j;
+      out = static_cast<unsigned char>(p[j++]);
+   };
+
+   for (bool first = true;; first = false) {
+      if (j >= p.size()) return 0;
+      if (p[j] == ']' && !first) break;
+
+      if (p[j] == '[' && j + 1 < p.size() && p[j + 1] == ':') {
+         const std::size_t e = p.find(":]", j + 2);
+         if (e != std::string_view::npos &&
+             add_class(p.substr(j + 2, e - j - 2), set)) {
+            j = e + 2;
+            continue;
+         }
+      }
+
+      unsigned char lo = 0;
+      take(lo);
+      unsigned char hi = lo;
+      if (j + 1 < p.size() && p[j] == '-' && p[j + 1] != ']') {
+         ++j;
+         take(hi);
+      }
+      for (unsigned c = lo; c <= hi; ++c) set.set(c);
+   }
+
+   if (negate) set.flip();
+   return j + 1;
+}
+
+} // namespace
+
+// ---- GlobMatcher ----
+
+GlobMatcher::GlobMatcher(std::string_view p, bool hide_dot) {
+   auto text = [&](char c) {
+      if (!steps_.empty() && steps_.back().op == Op::Text &&
+          steps_.back().pos + steps_.back().len == text_.size()) {
+         ++steps_.back().len;
+      } else {
+         steps_.push_back({Op::Text, static_cast<std::uint32_t>(text_.size()),
+                           1});
+      }
+      text_.push_back(c);
+   };
+
+   dot_ = !hide_dot ||
+          (!p.empty() && (p[0] == '.' || p.starts_with("\\.")));
+
+   for (std::size_t k = 0; k < p.size();) {
+      const char c = p[k];
+      if (c == '\\' && k + 1 < p.size()) {
+         text(p[k + 1]);
+         k += 2;
+      } else if (c == '*') {
+         if (steps_.empty() || steps_.back().op != Op::Star)
+            steps_.push_back({Op::Star, 0, 0});
+         literal_ = false;
+         ++k;
+      } else if (c == '?') {
+         steps_.push_back({Op::Any, 0, 0});
+         literal_ = false;
+         ++k;
+      } else if (std::bitset<256> set; c == '[') {
+         if (const std::size_t e = parse_bracket(p, k, set); e != 0) {
+            steps_.push_back(
+               {Op::Set, static_cast<std::uint32_t>(sets_.size()), 0});
+            sets_.push_back(set);
+            literal_ = false;
+            k = e;
+         } else {
+            text(c);
+            ++k;
+         }
+      } else {
+         text(c);
+         ++k;
+      }
+   }
+
+   if (literal_) steps_.clear();
+}
+
+std::string_view GlobMatcher::head() const noexcept {
+   if (literal_) return text_;
+   const Step& s = steps_.front();
+   return s.op == Op::Text ? std::string_view(text_).substr(s.pos, s.len)
+                           : std::string_view{};
+}
+
+std::string_view GlobMatcher::tail() const noexcept {
+   if (literal_) return text_;
+   const Step& s = steps_.back();
+   return s.op == Op::Text ? std::string_view(text_).substr(s.pos, s.len)
+                           : std::string_view{};
+}
+
+std::bitset<256> GlobMatcher::first_bytes() const noexcept {
+   std::bitset<256> bytes;
+   if (literal_ ? text_.empty() : steps_.front().op == Op::Star ||
+                                     steps_.front().op == Op::Any)
+      return bytes.set();
+   const Step& s = steps_.front();
+   if (!literal_ && s.op == Op::Set) return sets_[s.pos];
+   bytes.set(static_cast<unsigned char>(text_[literal_ ? 0 : s.pos]));
+   return bytes;
+}
+
+std::bitset<256> GlobMatcher::last_bytes() const noexcept {
+   std::bitset<256> bytes;
+   if (literal_ ? text_.empty() : steps_.back().op == Op::Star ||
+                                     steps_.back().op == Op::Any)
+      return bytes.set();
+   const Step& s = steps_.back();
+   if (!literal_ && s.op == Op::Set) return sets_[s.pos];
+   bytes.set(static_cast<unsigned char>(
+      literal_ ? text_.back() : text_[s.pos + s.len - 1]));
+   return bytes;
+}
+
+bool GlobMatcher::match(std::string_view name) const noexcept {
+   if (literal_) return name == text_;
+   if (!name.empty() && name[0] == '.' && !dot_) return false;
+
+   // Greedy with backtracking to the most recent '*' only: a later star can
+   // absorb anything an earlier one could, so that is enough for glob.
+   std::size_t i = 0;
+   std::size_t n = 0;
+   std::size_t star_i = steps_.size();
+   std::size_t star_n = 0;
+   const auto sv = std::string_view(text_);
+   while (i < steps_.size() || n < name.size()) {
+      if (i < steps_.size()) {
+         const Step& s = steps_[i];
+         switch (s.op) {
+         case Op::Text:
+            if (name.substr(n, s.len) == sv.substr(s.pos, s.len)) {
+               ++i;
+               n += s.len;
+               continue;
+            }
+            break;
+         case Op::Any:
+            if (n < name.size()) {
+               ++i;
+               ++n;
+               continue;
+            }
+            break;
+         case Op::Set:
+            if (n < name.size() &&
+                sets_[s.pos].test(static_cast<unsigned char>(name[n]))) {
+               ++i;
+               ++n;
+               continue;
+            }
+            break;
+         case Op::Star:
+            star_i = i++;
+            star_n = n;
+            continue;
+         }
+      }
+      if (star_i == steps_.size() || star_n >= name.size()) return false;
+      i = star_i + 1;
+      n = ++star_n;
+   }
+   return true;
+}
+
+// ---- PatternSet ----
+
+PatternSet::PatternSet(const std::vector<std::string_view>& patterns,
+                       bool hide_dot) {
+   matchers_.reserve(patterns.size());
+   std::vector<std::pair<std::uint32_t, std::bitset<256>>> by_first;
+   std::vector<std::pair<std::uint32_t, std::bitset<256>>> by_last;
+   for (std::size_t i = 0; i < patterns.size(); ++i) {
+      const GlobMatcher& m = matchers_.emplace_back(patterns[i], hide_dot);
+      const auto k = static_cast<std::uint32_t>(i);
+      if (m.is_literal()) {
+         literals_.try_emplace(m.literal(), k); // the first one wins
+      } else if (const auto first = m.first_bytes(); !first.all()) {
+         by_first.emplace_back(k, first);
+      } else if (const auto last = m.last_bytes(); !last.all()) {
+         by_last.emplace_back(k, last);
+      } else {
+         open_.push_back(k);
+      }
+   }
+   first_.build(by_first);
+   last_.build(by_last);
+}
+
+void PatternSet::ByteIndex::build(
+   const std::vector<std::pair<std::uint32_t, std::bitset<256>>>& patterns) {
+   // Counting sort by byte; each bucket stays in list order.
+   start.assign(257, 0);
+   for (const auto& [k, bytes] : patterns)
+      for (std::size_t c = 0; c < 256; ++c)
+         if (bytes.test(c)) ++start[c + 1];
+   for (std::size_t c = 0; c < 256; ++c) start[c + 1] += start[c];
+   entries.resize(start[256]);
+   std::vector<std::uint32_t> fill(start.begin(), start.end() - 1);
+   for (const auto& [k, bytes] : patterns)
+      for (std::size_t c = 0; c < 256; ++c)
+         if (bytes.test(c)) entries[fill[c]++] = k;
+}
+
+std::span<const std::uint32_t>
+PatternSet::ByteIndex::bucket(unsigned char c) const noexcept {
+   if (start.empty()) return {};
+   return std::span(entries).subspan(start[c], start[c + 1] - start[c]);
+}
+
+std::size_t PatternSet::match(std::string_view s) const {
+   std::size_t best = npos;
+   if (const auto it = literals_.find(s); it != literals_.end())
+      best = it->second;
+
+   // Merge the candidate lists in list order, up to the best so far. A
+   // pattern in either index needs at least one byte.
+   std::span<const std::uint32_t> lists[3] = {open_, {}, {}};
+   if (!s.empty()) {
+      lists[1] = first_.bucket(static_cast<unsigned char>(s.front()));
+      lists[2] = last_.bucket(static_cast<unsigned char>(s.back()));
+   }
+   std::size_t pos[3] = {0, 0, 0};
+   for (;;) {
+      std::size_t k = best;
+      std::size_t from = 0;
+      for (std::size_t l = 0; l < 3; ++l) {
+         if (pos[l] < lists[l].size() && lists[l][pos[l]] < k) {
+            k = lists[l][pos[l]];
+            from = l;
+         }
+      }
+      if (k == best) break;
+      ++pos[from];
+      const GlobMatcher& m = matchers_[k];
+      if (s.starts_with(m.head()) && s.ends_with(m.tail()) && m.match(s))
+         return k;
+   }
+   return best;
+}
+
+// ---- GlobPattern ----
+
+GlobPattern::GlobPattern(std::string_view p) {
+   // Split at '/', skipping escaped bytes.
+   std::vector<std::string_view> parts;
+   std::size_t start = 0;
+   for (std::size_t k = 0; k < p.size(); ++k) {
+      if (p[k] == '\\') {
+         ++k;
+      } else if (p[k] == '/') {
+         parts.push_back(p.substr(start, k - start));
+         start = k + 1;
+      }
+   }
+   parts.push_back(p.substr(start));
+   dir_only_ = parts.size() > 1 && parts.back().empty();
+
+   // Leading literal components become the prefix, as written.
+   std::size_t i = 0;
+   std::size_t prefix_end = 0;
+   for (; i + 1 < parts.size(); ++i) {
+      if (!GlobMatcher(parts[i]).is_literal()) break;
+      prefix_end = static_cast<std::size_t>(parts[i + 1].data() - p.data());
+   }
+   prefix_ = pattern_literal(p.substr(0, prefix_end));
+
+   for (; i < parts.size(); ++i) {
+      if (parts[i].empty()) continue;
+      const bool globstar = parts[i] == "**";
+      if (globstar && !components_.empty() && components_.back().globstar)
+         continue; // "**/**" is "**"
+      components_.push_back(
+         {.matcher = GlobMatcher(parts[i]), .globstar = globstar});
+   }
+
+   const bool any = std::ranges::any_of(components_, [](const Component& c) {
+      return c.globstar || !c.matcher.is_literal();
+   });
+   if (!any) components_.clear();
+}
+
+// ---- DirCache ----
+
+DirCache::Listing DirCache::list(int fd) {
+   struct stat st {};
+   if (::fstat(fd, &st) != 0) return nullptr;
+   const Key key{.dev = static_cast<std::uint64_t>(st.st_dev),
+                 .ino = static_cast<std::uint64_t>(st.st_ino)};
+   const std::int64_t mtime = to_ns(st.st_mtim);
+   const std::int64_t ctime = to_ns(st.st_ctim);
+
+   {
+      const std::lock_guard lock{mu_};
+      if (const auto it = index_.find(key); it != index_.end()) {
+         const Node& node = *it->second;
+         if (node.mtime_ns == mtime && node.ctime_ns == ctime) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            ++hits_;
+            return node.listing;
+         }
+      }
+   }
+
+   auto entries = std::make_shared<std::vector<Entry>>();
+   std::array<char, kDentBufBytes> buf;
+   if (::lseek(fd, 0, SEEK_SET) != 0) return nullptr;
+   for (;;) {
+      const ssize_t n = ::getdents64(fd, buf.data(), buf.size());
+      if (n < 0) return nullptr;
+      if (n == 0) break;
+      for (ssize_t off = 0; off < n;) {
+         const auto* d = reinterpret_cast<const dirent64*>(buf.data() + off);
+         off += d->d_reclen;
+         const std::string_view name{d->d_name};
+         if (is_dot_or_dotdot(name)) continue;
+         entries->push_back({.name = std::string(name), .type = d->d_type});
+      }
+   }
+   std::ranges::sort(entries->begin(), entries->end(), {}, &Entry::name);
+
+   timespec now{};
+   ::clock_gettime(CLOCK_REALTIME, &now);
+   const bool racy = mtime > to_ns(now) - kRacySeconds * 1'000'000'000;
+
+   const std::lock_guard lock{mu_};
+   ++misses_;
+   if (const auto it = index_.find(key); it != index_.end()) {
+      names_ -= it->second->listing->size();
+      lru_.erase(it->second);
+      index_.erase(it);
+   }
+   if (!racy && entries->size() <= capacity_) {
+      names_ += entries->size();
+      lru_.push_front(Node{.key = key,
+                           .mtime_ns = mtime,
+                           .ctime_ns = ctime,
+                           .listing = entries});
+      index_.emplace(key, lru_.begin());
+      while (names_ > capacity_) {
+         names_ -= lru_.back().listing->size();
+         index_.erase(lru_.back().key);
+         lru_.pop_back();
+      }
+   }
+   return entries;
+}
+
+DirCache::Stats DirCache::stats() const {
+   const std::lock_guard lock{mu_};
+   return Stats{.hits = hits_,
+                .misses = misses_,
+                .directories = lru_.size(),
+                .names = names_};
+}
+
+void DirCache::clear() {
+   const std::lock_guard lock{mu_};
+   lru_.clear();
+   index_.clear();
+   names_ = 0;
+}
+
+// ---- GlobCache ----
+
+GlobCache::GlobCache(unsigned jobs)
+   : jobs_(jobs) {
+   if (jobs_ == 0)
+      jobs_ = std::clamp(std::thread::hardware_concurrency(), 1u, 4u);
+}
+
+GlobPatternPtr GlobCache::compile(std::string_view pattern) {
+   const std::string key{pattern};
+   if (const auto it = patterns_.find(key); it != patterns_.end())
+      return it->second;
+   if (patterns_.size() >= kMaxPatterns) patterns_.clear();
+   auto compiled = std::make_shared<const GlobPattern>(pattern);
+   patterns_.emplace(key, compiled);
+   return compiled;
+}
+
+// ---- "**" tree walk ----
+
+namespace {
+
+// Reads every directory below `root` (hidden ones and symlinks excluded),
+// fanning out to a small pool of threads once the tree proves large, then
+// lists the tree in sorted preorder.
+class TreeWalk {
+ public:
+   TreeWalk(int root, DirCache& dirs, unsigned jobs)
+      : root_(root)
+      , dirs_(dirs)
+      , jobs_(jobs) {}
+
+   // Relative paths: "" (the root itself) if `self`, every directory, and
+   // every other entry if `files`.
+   std::vector<std::string> run(bool self, bool files) {
+      queue_.emplace_back();
+      {
+         std::vector<std::jthread> pool;
+         work(&pool);
+      } // joins
+
+      std::vector<std::string> out;
+      if (self) out.emplace_back();
+      emit("", files, out);
+      return out;
+   }
+
+ private:
+   static std::string join(const std::string& dir, const std::string& name) {
+      return dir.empty() ? name : dir + '/' + name;
+   }
+
+   // The calling thread passes `pool` and may start the helpers.
+   void work(std::vector<std::jthread>* pool) {
+      std::unique_lock lock{mu_};
+      std::size_t visited = 0;
+      for (;;) {
+         cv_.wait(lock, [&] { return !queue_.empty() || busy_ == 0; });
+         if (queue_.empty()) return;
+         std::string rel = std::move(queue_.back());
+         queue_.pop_back();
+         ++busy_;
+         lock.unlock();
+
+         std::vector<std::string> subdirs;
+         DirCache::Listing listing = visit(rel, subdirs);
+
+         lock.lock();
+         listings_.emplace(std::move(rel), std::move(listing));
+         for (auto& s : subdirs) queue_.push_back(std::move(s));
+         --busy_;
+         cv_.notify_all();
+
+         if (pool != nullptr && pool->empty() && jobs_ > 1 &&
+             ++visited >= kSerialDirs && queue_.size() > 1) {
+            for (unsigned t = 1; t < jobs_; ++t)
+               pool->emplace_back([this] { work(nullptr); });
+         }
+      }
+   }
+
+   DirCache::Listing visit(const std::string& rel,
+                           std::vector<std::string>& subdirs) {
+      const UniqueFd fd{::openat(root_, rel.empty() ? "." : rel.c_str(),
+                                 kDirFlags | O_NOFOLLOW)};
+      if (fd.get() < 0) return nullptr;
+      DirCache::Listing listing = dirs_.list(fd.get());
+      if (!listing) return nullptr;
+      for (const auto& e : *listing) {
+         if (e.name[0] == '.') continue;
+         if (is_real_dir(fd.get(), e.name, e.type))
+            subdirs.push_back(join(rel, e.name));
+      }
+      return listing;
+   }
+
+   void emit(const std::string& rel, bool files,
+             std::vector<std::string>& out) const {
+      const auto it = listings_.find(rel);
+      if (it == listings_.end() || !it->second) return;
+      for (const auto& e : *it->second) {
+         if (e.name[0] == '.') continue;
+         std::string child = join(rel, e.name);
+         if (listings_.contains(child)) {
+            out.push_back(child);
+            emit(child, files, out);
+         } else if (files) {
+            out.push_back(std::move(child));
+         }
+      }
+   }
+
+   int root_;
+   DirCache& dirs_;
+   unsigned jobs_;
+
+   std::mutex mu_;
+   std::condition_variable cv_;
+   std::vector<std::string> queue_;
+   std::size_t busy_{0};
+   std::unordered_map<std::string, DirCache::Listing> listings_;
+};
+
+} // namespace
+
+// ---- GlobExpansion ----
+
+GlobExpansion::GlobExpansion(GlobPatternPtr pattern, GlobCache& cache)
+   : pattern_(std::move(pattern))
+   , cache_(cache) {}
+
+void GlobExpansion::push(UniqueFd fd, std::size_t comp) {
+   const auto& c = pattern_->components_[comp];
+   const bool last = comp + 1 == pattern_->components_.size();
+
+   Frame f{.fd = std::move(fd), .comp = comp, .base = path_.size()};
+   if (c.globstar) {
+      TreeWalk walk{f.fd.get(), cache_.dirs(), cache_.jobs()};
+      // The directory itself is a match too ("d/**" yields "d/"), except
+      // as the empty name of a bare "**".
+      f.tree = walk.run(/*self=*/!last || !path_.empty(),
+                        /*files=*/last && !pattern_->dir_only_);
+   } else if (!c.matcher.is_literal()) {
+      f.listing = cache_.dirs().list(f.fd.get());
+      if (!f.listing) return;
+   }
+   stack_.push_back(std::move(f));
+}
+
+std::optional<std::string_view> GlobExpansion::next() {
+   if (!started_) {
+      started_ = true;
+      const auto& prefix = pattern_->prefix_;
+      UniqueFd root{::open(prefix.empty() ? "." : prefix.c_str(), kDirFlags)};
+      if (root.get() < 0 || !pattern_->has_wildcards()) return std::nullopt;
+      path_ = prefix;
+      push(std::move(root), 0);
+   }
+
+   while (!stack_.empty()) {
+      Frame& f = stack_.back();
+      const auto& c = pattern_->components_[f.comp];
+      const bool last = f.comp + 1 == pattern_->components_.size();
+
+      // The next candidate name in this directory.
+      const std::string* name = nullptr;
+      unsigned char type = DT_UNKNOWN;
+      if (c.globstar) {
+         if (f.pos < f.tree.size()) name = &f.tree[f.pos++];
+      } else if (c.matcher.is_literal()) {
+         if (f.pos++ == 0) name = &c.matcher.literal();
+      } else {
+         const auto& entries = *f.listing;
+         while (f.pos < entries.size() &&
+                !c.matcher.match(entries[f.pos].name))
+            ++f.pos;
+         if (f.pos < entries.size()) {
+            name = &entries[f.pos].name;
+            type = entries[f.pos].type;
+            ++f.pos;
+         }
+      }
+      if (name == nullptr) {
+         path_.resize(f.base);
+         stack_.pop_back();
+         continue;
+      }
+
+      path_.resize(f.base);
+      path_ += *name;
+
+      if (last) {
+         if (pattern_->dir_only_) {
+            if (!is_dir(f.fd.get(), *name, type)) continue;
+            if (!name->empty()) path_ += '/';
+         } else if (c.matcher.is_literal()) {
+            struct stat st {};
+            if (::fstatat(f.fd.get(), name->c_str(), &st,
+                          AT_SYMLINK_NOFOLLOW) != 0)
+               continue;
+         }
+         return std::string_view(path_);
+      }
+
+      // Descend. "" is the "**" frame's own directory.
+      if (!name->empty() && !is_dir(f.fd.get(), *name, type)) continue;
+      UniqueFd sub{::openat(f.fd.get(), name->empty() ? "." : name->c_str(),
+                            kDirFlags)};
+      if (sub.get() < 0) continue;
+      if (!name->empty()) path_ += '/';
+      push(std::move(sub), f.comp + 1);
+   }
+   return std::nullopt;
+}
+
+} // namespace clanker
@@ -0,0 +1,264 @@
+// src/clanker/glob.h
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "clanker/util.h"
+
+namespace clanker {
+
+// Pathname expansion (execution-model.md §3.3).
+//
+// Patterns are in the pattern form of a WORD (lexer.h, "Word patterns"): a
+// backslash makes the next byte literal. Supported:
+//   *  ?  [abc]  [a-z]  [!x] / [^x]  [[:alpha:]] and the other POSIX classes
+//   **   as a whole component: any number of directories (bash globstar)
+// Wildcards never match a leading '.', "." or "..". "**" does not descend
+// into hidden directories or through symlinks. A trailing '/' matches
+// directories only.
+
+// One path component, compiled once into a sequence of steps. Without
+// `hide_dot` it matches any string, leading '.' and '/' included, as the
+// pattern of a parameter expansion does.
+class GlobMatcher {
+ public:
+   explicit GlobMatcher(std::string_view component, bool hide_dot = true);
+
+   [[nodiscard]] bool match(std::string_view name) const noexcept;
+
+   // No wildcard: the component matches exactly literal().
+   [[nodiscard]] bool is_literal() const noexcept { return literal_; }
+   [[nodiscard]] const std::string& literal() const noexcept { return text_; }
+
+   // Text every match starts (ends) with: the pattern's leading (trailing)
+   // literal run. Lets a caller testing many candidates skip most of them.
+   [[nodiscard]] std::string_view head() const noexcept;
+   [[nodiscard]] std::string_view tail() const noexcept;
+
+   // The bytes a match can start (end) with: every byte if the pattern
+   // starts (ends) with '*' or '?'.
+   [[nodiscard]] std::bitset<256> first_bytes() const noexcept;
+   [[nodiscard]] std::bitset<256> last_bytes() const noexcept;
+
+ private:
+   enum class Op : std::uint8_t { Text, Any, Star, Set };
+   struct Step {
+      Op op;
+      std::uint32_t pos; // Text: offset into text_; Set: index into sets_
+      std::uint32_t len; // Text only
+   };
+
+   std::vector<Step> steps_;
+   std::string text_; // Text operands, back to back
+   std::vector<std::bitset<256>> sets_;
+   bool literal_{true};
+   bool dot_{false}; // starts with a literal '.'
+};
+
+// An ordered list of patterns matched as one: match() gives the first
+// pattern, in list order, that matches a string, as the arms of a `case`
+// are tried. Patterns without wildcards are found with one hash lookup.
+// The others are indexed by the bytes a match can start with, or if that
+// is any byte, end with, so a string is tested only against the patterns
+// that can match its first and last bytes. Nothing in it depends on the
+// shell; any list of pattern rules can use one.
+class PatternSet {
+ public:
+   static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+   PatternSet() = default;
+   // Patterns in pattern form; `hide_dot` as for GlobMatcher.
+   explicit PatternSet(const std::vector<std::string_view>& patterns,
+                       bool hide_dot = false);
+
+   [[nodiscard]] std::size_t size() const noexcept { return matchers_.size(); }
+
+   // Index of the first pattern that matches `s`; npos if there is none.
+   [[nodiscard]] std::size_t match(std::string_view s) const;
+
+ private:
+   struct Hash {
+      using is_transparent = void;
+      std::size_t operator()(std::string_view s) const noexcept {
+         return std::hash<std::string_view>{}(s);
+      }
+   };
+
+   // Patterns by byte, each bucket in list order: bucket c is
+   // entries[start[c]..start[c + 1]).
+   struct ByteIndex {
+      std::vector<std::uint32_t> start;
+      std::vector<std::uint32_t> entries;
+
+      void build(const std::vector<std::pair<std::uint32_t,
+                                             std::bitset<256>>>& patterns);
+      [[nodiscard]] std::span<const std::uint32_t>
+      bucket(unsigned char c) const noexcept;
+   };
+
+   std::vector<GlobMatcher> matchers_;
+   // Literal text to the first pattern that is exactly that.
+   std::unordered_map<std::string, std::uint32_t, Hash, std::equal_to<>>
+      literals_;
+   ByteIndex first_; // by first byte
+   ByteIndex last_;  // by last byte, if the first can be any
+   std::vector<std::uint32_t> open_; // either can be any: always tried
+};
+
+// A pattern split at '/'. The leading components without wildcards are
+// kept as one path prefix that is opened directly instead of searched.
+class GlobPattern {
+ public:
+   explicit GlobPattern(std::string_view pattern);
+
+   // False if no component has a wildcard; the pattern then stands for
+   // itself and no directory is read.
+   [[nodiscard]] bool has_wildcards() const noexcept {
+      return !components_.empty();
+   }
+
+ private:
+   friend class GlobExpansion;
+
+   struct Component {
+      GlobMatcher matcher;
+      bool globstar{false};
+   };
+
+   std::string prefix_; // unescaped, with its trailing '/'
+   std::vector<Component> components_;
+   bool dir_only_{false};
+};
+
+using GlobPatternPtr = std::shared_ptr<const GlobPattern>;
+
+// Directory listings keyed by (device, inode). A listing is reused while
+// the directory's mtime and ctime are unchanged, so repeated globs over the
+// same tree cost one fstat() per directory instead of a full read.
+//
+// Timestamps have limited resolution: a directory modified in the same tick
+// it was read would keep its mtime. Listings of directories whose mtime is
+// within the last kRacySeconds are therefore not kept.
+//
+// Thread-safe; "**" walks list directories from several threads.
+class DirCache {
+ public:
+   static constexpr std::size_t kDefaultCapacity = 1u << 18; // names
+   static constexpr long kRacySeconds = 2;
+
+   struct Entry {
+      std::string name;
+      unsigned char type; // DT_* as reported by getdents64
+   };
+   using Listing = std::shared_ptr<const std::vector<Entry>>;
+
+   struct Stats {
+      std::size_t hits{0};
+      std::size_t misses{0}; // directories that had to be read
+      std::size_t directories{0};
+      std::size_t names{0};
+   };
+
+   explicit DirCache(std::size_t capacity = kDefaultCapacity)
+      : capacity_(capacity) {}
+
+   // Entries of the directory open at `fd` sorted by name, without "." and
+   // "..". Null if it cannot be read.
+   [[nodiscard]] Listing list(int fd);
+
+   [[nodiscard]] Stats stats() const;
+   void clear();
+
+ private:
+   struct Key {
+      std::uint64_t dev;
+      std::uint64_t ino;
+      bool operator==(const Key&) const = default;
+   };
+   struct KeyHash {
+      std::size_t operator()(const Key& k) const noexcept {
+         return std::hash<std::uint64_t>{}(k.dev * 0x9E3779B97F4A7C15ull ^
+                                           k.ino);
+      }
+   };
+   struct Node {
+      Key key;
+      std::int64_t mtime_ns;
+      std::int64_t ctime_ns;
+      Listing listing;
+   };
+
+   mutable std::mutex mu_;
+   std::size_t capacity_;
+   std::size_t names_{0};
+   std::list<Node> lru_; // most recently used first
+   std::unordered_map<Key, std::list<Node>::iterator, KeyHash> index_;
+   std::size_t hits_{0};
+   std::size_t misses_{0};
+};
+
+// Compiled patterns and directory listings, kept for the life of an
+// Executor so that a script globbing the same pattern in a loop compiles it
+// once and reads each directory once.
+class GlobCache {
+ public:
+   static constexpr std::size_t kMaxPatterns = 256;
+
+   // Threads used to walk large trees for "**"; 0 picks up to 4 from the
+   // hardware.
+   explicit GlobCache(unsigned jobs = 0);
+
+   [[nodiscard]] GlobPatternPtr compile(std::string_view pattern);
+
+   [[nodiscard]] DirCache& dirs() noexcept { return dirs_; }
+   [[nodiscard]] unsigned jobs() const noexcept { return jobs_; }
+
+ private:
+   std::unordered_map<std::string, GlobPatternPtr> patterns_;
+   DirCache dirs_;
+   unsigned jobs_;
+};
+
+// The matches of one pattern, relative to the current directory (or
+// absolute), produced lazily: directories are opened only as the walk
+// reaches them, and each component's matches come out sorted by name.
+class GlobExpansion {
+ public:
+   GlobExpansion(GlobPatternPtr pattern, GlobCache& cache);
+
+   // The next match, empty after the last. Valid until the following call.
+   [[nodiscard]] std::optional<std::string_view> next();
+
+ private:
+   struct Frame {
+      UniqueFd fd;
+      std::size_t comp; // component matched against this directory
+      std::size_t base; // length of path_ up to this directory
+      DirCache::Listing listing{};     // wildcard component
+      std::vector<std::string> tree{}; // "**": relative paths
+      std::size_t pos{0};
+   };
+
+   void push(UniqueFd fd, std::size_t comp);
+
+   GlobPatternPtr pattern_;
+   GlobCache& cache_;
+   std::vector<Frame> stack_;
+   std::string path_;
+   bool started_{false};
+};
+
+} // namespace clanker
@@ -0,0 +1,182 @@
+// src/clanker/input.cpp
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "clanker/input.h"
+
+namespace clanker {
+
+InputBuffers::File& InputBuffers::file(dev_t dev, ino_t ino) {
+   ++clock_;
+   for (File& f : files_) {
+      if (f.dev == dev && f.ino == ino) {
+         f.used = clock_;
+         return f;
+      }
+   }
+
+   File* slot = nullptr;
+   if (files_.size() < kMaxFiles) {
+      slot = &files_.emplace_back();
+      slot->data = std::make_unique<char[]>(kChunk);
+   } else {
+      // Dropping a buffer loses nothing; it is read again if needed.
+      slot = &*std::min_element(
+         files_.begin(), files_.end(),
+         [](const File& a, const File& b) { return a.used < b.used; });
+   }
+   slot->dev = dev;
+   slot->ino = ino;
+   slot->offset = -1;
+   slot->begin = slot->end = 0;
+   slot->used = clock_;
+   return *slot;
+}
+
+InputBuffers::Result InputBuffers::read_record(int fd, char delim,
+                                               std::string& out, int& err) {
+   struct stat st{};
+   if (::fstat(fd, &st) != 0) {
+      err = errno;
+      return Result::Error;
+   }
+   if (S_ISREG(st.st_mode))
+      return read_file(fd, file(st.st_dev, st.st_ino), delim, out, err);
+   if (S_ISFIFO(st.st_mode) && !no_tee_) return read_pipe(fd, delim, out, err);
+   return read_bytes(fd, delim, out, err);
+}
+
+InputBuffers::Result InputBuffers::read_file(int fd, File& f, char delim,
+                                             std::string& out, int& err) {
+   const off_t at = ::lseek(fd, 0, SEEK_CUR);
+   if (at < 0) {
+      err = errno;
+      return Result::Error;
+   }
+   // Something else moved the offset, or this is another open of the file:
+   // the buffer is not what comes next.
+   if (at != f.offset) {
+      f.offset = at;
+      f.begin = f.end = 0;
+   }
+
+   Result result = Result::Record;
+   for (;;) {
+      const char* p = f.data.get() + f.begin;
+      const std::size_t n = f.end - f.begin;
+      if (const void* hit = std::memchr(p, delim, n)) {
+         const auto len =
+            static_cast<std::size_t>(static_cast<const char*>(hit) - p);
+         out.append(p, len);
+         f.begin += len + 1;
+         f.offset += static_cast<off_t>(len + 1);
+         break;
+      }
+      out.append(p, n);
+      f.offset += static_cast<off_t>(n);
+      f.begin = f.end = 0;
+
+      ssize_t got;
+      do {
+         got = ::pread(fd, f.data.get(), kChunk, f.offset);
+      } while (got < 0 && errno == EINTR);
+      if (got < 0) {
+         err = errno;
+         result = Result::Error;
+         break;
+      }
+      if (got == 0) {
+         result = Result::Eof;
+         break;
+      }
+      f.end = static_cast<std::size_t>(got);
+   }
+
+   if (::lseek(fd, f.offset, SEEK_SET) < 0 && result != Result::Error) {
+      err = errno;
+      f.offset = -1;
+      return Result::Error;
+   }
+   return result;
+}
+
+InputBuffers::Result InputBuffers::read_pipe(int fd, char delim,
+                                             std::string& out, int& err) {
+   if (peek_[0].get() < 0) {
+      int fds[2] = {-1, -1};
+      if (::pipe2(fds, O_CLOEXEC) != 0) return read_bytes(fd, delim, out, err);
+      peek_[0].reset(fds[0]);
+      peek_[1].reset(fds[1]);
+      peeked_ = std::make_unique<char[]>(kChunk);
+   }
+
+   for (;;) {
+      // Copy what the pipe holds (waiting for some, as read() would) and
+      // read the copy back; the pipe itself is untouched.
+      ssize_t n;
+      do {
+         n = ::tee(fd, peek_[1].get(), kChunk, 0);
+      } while (n < 0 && errno == EINTR);
+      if (n < 0) {
+         if (errno != EINVAL && errno != ENOSYS) {
+            err = errno;
+            return Result::Error;
+         }
+         no_tee_ = true;
+         return read_bytes(fd, delim, out, err);
+      }
+      if (n == 0) return Result::Eof;
+      const auto size = static_cast<std::size_t>(n);
+      for (std::size_t got = 0; got < size;) {
+         const ssize_t r = ::read(peek_[0].get(), peeked_.get() + got,
+                                  size - got);
+         if (r < 0 && errno == EINTR) continue;
+         if (r <= 0) {
+            err = r < 0 ? errno : EIO;
+            return Result::Error;
+         }
+         got += static_cast<std::size_t>(r);
+      }
+
+      // Now consume the record, or all of it if the record goes on.
+      const void* hit = std::memchr(peeked_.get(), delim, size);
+      const std::size_t take =
+         hit ? static_cast<std::size_t>(static_cast<const char*>(hit) -
+                                        peeked_.get()) +
+                  1
+             : size;
+      for (std::size_t done = 0; done < take;) {
+         const ssize_t r = ::read(fd, peeked_.get() + done, take - done);
+         if (r < 0 && errno == EINTR) continue;
+         if (r <= 0) {
+            err = r < 0 ? errno : EIO;
+            return Result::Error;
+         }
+         done += static_cast<std::size_t>(r);
+      }
+      out.append(peeked_.get(), hit ? take - 1 : take);
+      if (hit) return Result::Record;
+   }
+}
+
+InputBuffers::Result InputBuffers::read_bytes(int fd, char delim,
+                                              std::string& out, int& err) {
+   for (;;) {
+      char c;
+      const ssize_t r = ::read(fd, &c, 1);
+      if (r < 0 && errno == EINTR) continue;
+      if (r < 0) {
+         err = errno;
+         return Result::Error;
+      }
+      if (r == 0) return Result::Eof;
+      if (c == delim) return Result::Record;
+      out.push_back(c);
+   }
+}
+
+} // namespace clanker
@@ -0,0 +1,80 @@
+// src/clanker/input.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "clanker/util.h"
+
+namespace clanker {
+
+// Read-ahead for the `read` built-in (built-ins.md), owned by the shell and
+// shared by every `read` it runs.
+//
+// bash reads a pipe one byte at a time so that it never takes input past
+// the line it wants. `read` never consumes past it either, but looks ahead
+// in larger pieces where the input allows:
+//
+// * A regular file gets a buffer, per open file told apart by device and
+//   inode, that is filled kChunk bytes at a time with pread() at the
+//   descriptor's offset and drained one record per call; the offset is set
+//   back to the end of the record before returning, so a command run after
+//   `read` starts right where it stopped. A buffer is only used while the
+//   offset is where the last call left it. A `while read` loop costs about
+//   one fstat() per line.
+// * A pipe is looked at without consuming it: tee() copies what it holds
+//   into a pipe of the shell's own, and then exactly one record is read
+//   from it. Whatever follows stays in the pipe for the next reader,
+//   external or not, at three system calls per line.
+// * Anything else (a terminal, a socket) is read one byte at a time.
+class InputBuffers {
+ public:
+   static constexpr std::size_t kChunk = std::size_t{64} << 10;
+   static constexpr std::size_t kMaxFiles = 16;
+
+   enum class Result : std::uint8_t {
+      Record, // `delim` was found
+      Eof,    // the input ended first; `out` has what there was
+      Error,  // errno in `err`
+   };
+
+   InputBuffers() = default;
+
+   InputBuffers(const InputBuffers&) = delete;
+   InputBuffers& operator=(const InputBuffers&) = delete;
+
+   // Consume the bytes of `fd` up to and including the next `delim`, and
+   // append them to `out` without it. Interrupted reads are retried.
+   Result read_record(int fd, char delim, std::string& out, int& err);
+
+ private:
+   struct File {
+      dev_t dev;
+      ino_t ino;
+      off_t offset; // file offset of data[begin]
+      std::unique_ptr<char[]> data;
+      std::size_t begin{0};
+      std::size_t end{0};
+      std::uint64_t used{0}; // for eviction
+   };
+
+   File& file(dev_t dev, ino_t ino);
+
+   Result read_file(int fd, File& f, char delim, std::string& out, int& err);
+   Result read_pipe(int fd, char delim, std::string& out, int& err);
+   static Result read_bytes(int fd, char delim, std::string& out, int& err);
+
+   std::vector<File> files_;
+   std::uint64_t clock_{0};
+
+   // For pipes: what tee() copied, read back from peek_[0].
+   UniqueFd peek_[2];
+   std::unique_ptr<char[]> peeked_;
+   bool no_tee_{false}; // tee() is not supported here
+};
+
+} // namespace clanker
@@ -0,0 +1,360 @@
+// src/clanker/ir.cpp
+#include <algorithm>
+#include <charconv>
+#include <string_view>
+
+#include "clanker/builtin_util.h"
+#include "clanker/expand.h"
+#include "clanker/ir.h"
+#include "clanker/lexer.h"
+
+namespace clanker {
+
+namespace {
+
+class Compiler {
+ public:
+   Compiler(IrProgram& out, const Builtins& builtins, const ExecPolicy& policy,
+            bool in_function = false)
+      : p_(out)
+      , builtins_(builtins)
+      , policy_(policy)
+      , in_function_(in_function) {}
+
+   void list(const CommandList& list) {
+      for (const CommandListItem& it : list.items) {
+         if (it.term == Terminator::Ampersand) {
+            emit(IrOp::Background, index(p_.background, &it.cmd));
+         } else {
+            and_or(it.cmd);
+         }
+      }
+   }
+
+   void and_or(const AndOr& ao) {
+      pipeline(ao.first);
+      for (const auto& tail : ao.rest) {
+         const std::uint32_t skip = emit(
+            tail.op == AndOrOp::AndIf ? IrOp::JumpIfFail : IrOp::JumpIfOk);
+         pipeline(tail.rhs);
+         p_.code[skip].a = here();
+      }
+   }
+
+   void pipeline(const Pipeline& pl) {
+      if (pl.stages.size() == 1 && !pl.stages[0].compound.empty())
+         return compound(pl.stages[0]);
+      if (has_compound(pl))
+         return error(
+            "error: compound commands in pipelines not implemented yet\n", 2);
+      if (pl.stages.size() == 1 && simple(pl.stages[0])) return;
+      emit(IrOp::Pipeline, index(p_.pipelines, &pl));
+   }
+
+ private:
+   // A loop being compiled: where `continue` goes, the jumps `break` left
+   // to patch, and how many redirection scopes are open inside it.
+   struct Loop {
+      std::uint32_t next;
+      std::vector<std::uint32_t> breaks;
+      std::size_t redirs;
+   };
+
+   template <class T>
+   static std::uint32_t index(std::vector<T>& table, T entry) {
+      table.push_back(entry);
+      return static_cast<std::uint32_t>(table.size() - 1);
+   }
+
+   std::uint32_t here() const {
+      return static_cast<std::uint32_t>(p_.code.size());
+   }
+
+   std::uint32_t emit(IrOp op, std::uint32_t a = 0, std::uint32_t b = 0) {
+      p_.code.push_back({.op = op, .a = a, .b = b});
+      return here() - 1;
+   }
+
+   void error(std::string message, std::uint32_t status) {
+      emit(IrOp::Error, index(p_.messages, std::move(message)), status);
+   }
+
+   // A single command with nothing to expand, resolved now. False if it
+   // has to go through run_pipeline(), as does an external the policy
+   // denies: a function of that name may be defined by the time it runs.
+   bool simple(const SimpleCommand& sc) {
+      if (sc.argv.empty()) return false;
+      const std::string_view name = sc.argv.front();
+      if (!loops_.empty() && (name == "break" || name == "continue"))
+         return loop_control(sc, name == "break");
+      if (in_function_ && name == "return") {
+         emit(IrOp::Return, index(p_.returns, &sc));
+         return true;
+      }
+      if (needs_expansion(sc)) return false;
+
+      // `command NAME` is an external whatever NAME is.
+      const auto forced = forced_external(sc.argv);
+      if (const Builtin* b =
+             forced.empty() ? builtins_.lookup(name) : nullptr) {
+         emit(IrOp::Builtin,
+              index(p_.builtins, IrBuiltin{.cmd = &sc, .fn = b->fn}));
+         return true;
+      }
+      std::string reason;
+      if (!policy_.allow_external(forced.empty() ? sc.argv : forced, reason))
+         return false;
+      emit(IrOp::External, index(p_.externals, &sc));
+      return true;
+   }
+
+   // `break [n]` or `continue [n]` inside a loop: leave the redirection
+   // scopes between here and the n-th enclosing loop, then jump.
+   bool loop_control(const SimpleCommand& sc, bool is_break) {
+      const char* what = is_break ? "break" : "continue";
+      std::size_t n = 1;
+      if (sc.argv.size() > 2) {
+         error(std::string{what} + ": too many arguments\n", 1);
+         return true;
+      }
+      if (sc.argv.size() == 2) {
+         if (needs_expansion(sc)) {
+            error(std::string{what} +
+                     ": loop count must be a literal number\n",
+                  1);
+            return true;
+         }
+         const std::string_view arg = sc.argv[1];
+         const auto [ptr, ec] =
+            std::from_chars(arg.data(), arg.data() + arg.size(), n);
+         if (ec != std::errc{} || ptr != arg.data() + arg.size() || n == 0) {
+            error(std::string{what} + ": " + std::string{arg} +
+                     ": loop count out of range\n",
+                  1);
+            return true;
+         }
+      }
+      // As in bash, a count past the outermost loop means the outermost.
+      Loop& target = loops_[loops_.size() - std::min(n, loops_.size())];
+      for (std::size_t k = redirs_; k > target.redirs; --k)
+         emit(IrOp::PopRedirs);
+      emit(IrOp::Status, 0);
+      if (is_break) {
+         target.breaks.push_back(emit(IrOp::Jump));
+      } else {
+         emit(IrOp::Jump, target.next);
+      }
+      return true;
+   }
+
+   void compound(const SimpleCommand& stage) {
+      const CompoundCommand& cc = stage.compound.front();
+      std::uint32_t push = 0;
+      if (!stage.redirs.empty()) {
+         push = emit(IrOp::PushRedirs, index(p_.redirs, &stage.redirs));
+         ++redirs_;
+      }
+
+      switch (cc.kind) {
+      case CompoundKind::If:
+         if_command(cc);
+         break;
+      case CompoundKind::While:
+      case CompoundKind::Until:
+         while_loop(cc);
+         break;
+      case CompoundKind::For:
+         for_loop(cc);
+         break;
+      case CompoundKind::Group:
+         list(cc.lists[0]);
+         break;
+      case CompoundKind::Function:
+         emit(IrOp::Define, index(p_.functions, &cc));
+         break;
+      case CompoundKind::Arith:
+         emit(IrOp::Arith, index(p_.ariths, &cc));
+         break;
+      case CompoundKind::Case:
+         case_command(cc);
+         break;
+      }
+
+      if (!stage.redirs.empty()) {
+         --redirs_;
+         emit(IrOp::PopRedirs);
+         p_.code[push].b = here();
+      }
+   }
+
+   //    cond; JumpIfFail next; body; Jump end
+   //    next: ...
+   //    else body, or Status 0
+   //    end:
+   void if_command(const CompoundCommand& cc) {
+      std::vector<std::uint32_t> ends;
+      std::size_t i = 0;
+      for (; i + 1 < cc.lists.size(); i += 2) {
+         list(cc.lists[i]);
+         const std::uint32_t next = emit(IrOp::JumpIfFail);
+         list(cc.lists[i + 1]);
+         ends.push_back(emit(IrOp::Jump));
+         p_.code[next].a = here();
+      }
+      if (i < cc.lists.size()) {
+         list(cc.lists[i]);
+      } else {
+         emit(IrOp::Status, 0);
+      }
+      for (const std::uint32_t e : ends) p_.code[e].a = here();
+   }
+
+   // The loop's status is that of the last body run, or 0, kept in a slot
+   // while the condition overwrites the register.
+   //
+   //    Status 0; Save s
+   //    top: cond; JumpIfFail (until: JumpIfOk) exit
+   //    body; Save s; Jump top
+   //    exit: Restore s
+   //    end:
+   void while_loop(const CompoundCommand& cc) {
+      const std::uint32_t slot = p_.slots++;
+      emit(IrOp::Status, 0);
+      emit(IrOp::Save, slot);
+      const std::uint32_t top = here();
+      loops_.push_back({.next = top, .breaks = {}, .redirs = redirs_});
+
+      list(cc.lists[0]);
+      const std::uint32_t exit = emit(cc.kind == CompoundKind::While
+                                         ? IrOp::JumpIfFail
+                                         : IrOp::JumpIfOk);
+      list(cc.lists[1]);
+      emit(IrOp::Save, slot);
+      emit(IrOp::Jump, top);
+      p_.code[exit].a = here();
+      emit(IrOp::Restore, slot);
+      end_loop();
+   }
+
+   //    Status 0; Save s; ForBegin l, end
+   //    next: ForNext l, exit
+   //    body; Save s; Jump next
+   //    exit: Restore s
+   //    end:
+   void for_loop(const CompoundCommand& cc) {
+      const std::uint32_t slot = p_.slots++;
+      const std::uint32_t loop = index(p_.loops, &cc);
+      emit(IrOp::Status, 0);
+      emit(IrOp::Save, slot);
+      const std::uint32_t begin = emit(IrOp::ForBegin, loop);
+      const std::uint32_t next = emit(IrOp::ForNext, loop);
+      loops_.push_back({.next = next, .breaks = {}, .redirs = redirs_});
+
+      list(cc.lists[0]);
+      emit(IrOp::Save, slot);
+      emit(IrOp::Jump, next);
+      p_.code[next].b = here();
+      emit(IrOp::Restore, slot);
+      p_.code[begin].b = here();
+      end_loop();
+   }
+
+   //    Case c, end
+   //    arm: body (or Status 0); Jump end
+   //    ...
+   //    no match: Status 0
+   //    end:
+   void case_command(const CompoundCommand& cc) {
+      const SimpleCommand& words = cc.words;
+      IrCase c{.cmd = &cc};
+      std::vector<std::string_view> fixed;
+      for (std::uint32_t k = 1; k < words.argv.size(); ++k) {
+         if (contains(words.subst_words, k)) {
+            c.dynamic.push_back(k - 1);
+         } else {
+            fixed.push_back(words.argv[k]);
+            c.fixed_index.push_back(k - 1);
+         }
+      }
+      c.fixed = PatternSet(fixed);
+      if (!contains(words.subst_words, 0))
+         c.subject = pattern_literal(words.argv[0]);
+
+      const std::uint32_t at = index(p_.cases, std::move(c));
+      const std::uint32_t begin = emit(IrOp::Case, at);
+      std::vector<std::uint32_t> ends;
+      for (const CommandList& arm : cc.lists) {
+         p_.cases[at].targets.push_back(here());
+         if (arm.items.empty())
+            emit(IrOp::Status, 0);
+         else
+            list(arm);
+         ends.push_back(emit(IrOp::Jump));
+      }
+      p_.cases[at].targets.push_back(here());
+      emit(IrOp::Status, 0);
+      for (const std::uint32_t e : ends) p_.code[e].a = here();
+      p_.code[begin].b = here();
+   }
+
+   static bool contains(const std::pmr::vector<std::uint32_t>& v,
+                        std::uint32_t k) {
+      return std::find(v.begin(), v.end(), k) != v.end();
+   }
+
+   void end_loop() {
+      for (const std::uint32_t b : loops_.back().breaks) p_.code[b].a = here();
+      loops_.pop_back();
+   }
+
+   IrProgram& p_;
+   const Builtins& builtins_;
+   const ExecPolicy& policy_;
+   std::vector<Loop> loops_;
+   std::size_t redirs_{0}; // PushRedirs scopes open
+   bool in_function_;      // `return` ends the program
+};
+
+} // namespace
+
+Proc::Proc(const CompoundCommand& def, const Builtins& builtins,
+           const ExecPolicy& policy)
+   : name(def.name)
+   , body(def.lists[0], AstAllocator{&arena}) {
+   Compiler{program, builtins, policy, true}.list(body);
+}
+
+std::shared_ptr<const Proc> make_proc(const CompoundCommand& def,
+                                      const Builtins& builtins,
+                                      const ExecPolicy& policy) {
+   return std::make_shared<const Proc>(def, builtins, policy);
+}
+
+bool has_compound(const Pipeline& pl) noexcept {
+   for (const SimpleCommand& sc : pl.stages)
+      if (!sc.compound.empty()) return true;
+   return false;
+}
+
+IrProgram compile_ir(const CommandList& list, const Builtins& builtins,
+                     const ExecPolicy& policy) {
+   IrProgram p;
+   Compiler{p, builtins, policy}.list(list);
+   return p;
+}
+
+IrProgram compile_ir(const AndOr& ao, const Builtins& builtins,
+                     const ExecPolicy& policy) {
+   IrProgram p;
+   Compiler{p, builtins, policy}.and_or(ao);
+   return p;
+}
+
+IrProgram compile_ir(const Pipeline& pl, const Builtins& builtins,
+                     const ExecPolicy& policy) {
+   IrProgram p;
+   Compiler{p, builtins, policy}.pipeline(pl);
+   return p;
+}
+
+} // namespace clanker
@@ -0,0 +1,137 @@
+// src/clanker/ir.h
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "clanker/ast.h"
+#include "clanker/builtins.h"
+#include "clanker/exec_policy.h"
+#include "clanker/glob.h"
+
+namespace clanker {
+
+// Command lists compiled for the executor (execution-model.md §7).
+//
+// A list, with every compound command in it, is lowered into one flat
+// array of instructions whose jumps are instruction indices, so a loop is a
+// walk over contiguous memory rather than a recursion over the AST. && and
+// || become conditional jumps too. Work that does not depend on run-time
+// state is done here once: a command with nothing to expand is resolved to
+// its built-in function, or has its external command checked against the
+// policy, and `break` / `continue` with a literal count become jumps.
+//
+// There is one register, the exit status ($?): commands set it and the
+// conditional jumps test it.
+//
+// A shell function is compiled the same way, once, when its definition
+// runs (Proc below).
+enum class IrOp : std::uint8_t {
+   Pipeline,   // run pipelines[a]: expanded and dispatched at run time
+   Builtin,    // run builtins[a].cmd with built-in builtins[a].fn
+   External,   // spawn externals[a]; the policy has allowed it
+   Error,      // print messages[a]; status = b
+   Background, // run background[a] in a forked shell
+   Status,     // status = a
+   Save,       // slots[a] = status
+   Restore,    // status = slots[a]
+   Jump,       // pc = a
+   JumpIfOk,   // if status == 0: pc = a
+   JumpIfFail, // if status != 0: pc = a
+   ForBegin,   // expand the words of loops[a]; on error: status = 1, pc = b
+   ForNext,    // bind the next word of loops[a]; when there is none: pc = b
+   PushRedirs, // apply redirs[a] to the shell's fds 0-2, saving them; on
+               // error pc = b
+   PopRedirs,  // restore the fds saved by the innermost PushRedirs
+   Define,     // define the function functions[a]; status = 0
+   Return,     // returns[a] is `return [n]`: status = n, end the program
+   Arith,      // evaluate the (( )) ariths[a]: status = 0 if not 0, else 1
+   Case,       // pc = the arm of cases[a] that matches; on error: status =
+               // 1, pc = b
+};
+
+struct IrInstr {
+   IrOp op;
+   std::uint32_t a{0};
+   std::uint32_t b{0};
+};
+
+struct IrBuiltin {
+   const SimpleCommand* cmd;
+   BuiltinFn fn;
+};
+
+// A `case`. Its patterns without substitutions are compiled into one
+// PatternSet, so finding the arm takes one pass over the subject whatever
+// the number of arms; the others are expanded when they run, in order, and
+// only if they come before the set's match.
+struct IrCase {
+   const CompoundCommand* cmd{nullptr};
+   PatternSet fixed{};
+   std::vector<std::uint32_t> fixed_index{}; // into the patterns, per entry
+   std::vector<std::uint32_t> dynamic{};     // patterns with substitutions
+   std::string subject{}; // the subject as text, if it has no substitution
+
+   // Where each arm's body starts; the last entry is where no match goes.
+   std::vector<std::uint32_t> targets{};
+};
+
+// A compiled list. It points into the AST it was compiled from and into
+// the Builtins table, and is valid while both are.
+struct IrProgram {
+   std::vector<IrInstr> code;
+
+   std::vector<const Pipeline*> pipelines;
+   std::vector<IrBuiltin> builtins;
+   std::vector<const SimpleCommand*> externals;
+   std::vector<const AndOr*> background;
+   std::vector<const CompoundCommand*> loops; // `for` loops
+   std::vector<const std::pmr::vector<Redirection>*> redirs;
+   std::vector<std::string> messages;
+   std::vector<const CompoundCommand*> functions; // definitions
+   std::vector<const SimpleCommand*> returns;
+   std::vector<const CompoundCommand*> ariths; // (( ))
+   std::vector<IrCase> cases;
+
+   // Status saved across a loop's condition, one slot per loop.
+   std::uint32_t slots{0};
+};
+
+[[nodiscard]] IrProgram compile_ir(const CommandList& list,
+                                   const Builtins& builtins,
+                                   const ExecPolicy& policy);
+[[nodiscard]] IrProgram compile_ir(const AndOr& ao, const Builtins& builtins,
+                                   const ExecPolicy& policy);
+[[nodiscard]] IrProgram compile_ir(const Pipeline& pl, const Builtins& builtins,
+                                   const ExecPolicy& policy);
+
+// A shell function. The definition's body is copied into the Proc's own
+// arena and compiled once; every call runs that program, so a call costs
+// no parsing, copying or compiling, and a redefinition, or the unit that
+// defined it going away, leaves running calls alone.
+struct Proc {
+   Proc(const CompoundCommand& def, const Builtins& builtins,
+        const ExecPolicy& policy);
+
+   Proc(const Proc&) = delete;
+   Proc& operator=(const Proc&) = delete;
+
+   std::string name;
+   std::pmr::monotonic_buffer_resource arena;
+   CommandList body;
+   IrProgram program; // `return` ends it
+};
+
+// The function `def` (a CompoundKind::Function) defines.
+[[nodiscard]] std::shared_ptr<const Proc> make_proc(
+   const CompoundCommand& def, const Builtins& builtins,
+   const ExecPolicy& policy);
+
+// True if a stage of `pl` is a compound command; such a pipeline only runs
+// compiled.
+[[nodiscard]] bool has_compound(const Pipeline& pl) noexcept;
+
+} // namespace clanker
@@ -1,7 +1,11 @@
 // src/clanker/lexer.cpp
+#include <algorithm>
+#include <cstdint>
 #include <string>
+#include <utility>
 
 #include "clanker/lexer.h"
+#include "clanker/scan.h"
 
 namespace clanker {
 
@@ -10,7 +14,6 @@ namespace {
 struct Cursor {
    std::string_view s;
    std::size_t i{0};
-   SourceLoc loc{0, 1, 1};
 
    bool eof() const noexcept { return i >= s.size(); }
 
@@ -22,17 +25,12 @@ struct Cursor {
    }
 
    void advance() noexcept {
-      if (eof()) return;
-      const char c = s[i++];
-      ++loc.index;
-      if (c == '\n') {
-         ++loc.line;
-         loc.column = 1;
-      } else {
-         ++loc.column;
-      }
+      if (!eof()) ++i;
    }
 
+   // Advance over a run of n bytes found by find_first_of().
+   void advance_run(std::size_t n) noexcept { i += n; }
+
    bool consume(char c) noexcept {
       if (peek() != c) return false;
       advance();
@@ -50,35 +48,93 @@ struct Cursor {
    }
 };
 
+// Bytes that need a per-byte decision inside a WORD, by lexing mode.
+// Everything else is taken in bulk runs found by find_first_of().
+constexpr ByteSet kWordStop{" \t\r\n;#|&<>'\"$@`\\{}()*?[]"};
+constexpr ByteSet kWordParamStop{" \t\r\n;#|&<>'\"$@`\\{}()*?[]/"}; // in ${...}
+constexpr ByteSet kSingleStop{"'"};
+constexpr ByteSet kDoubleStop{"\"\\$`"};
+constexpr ByteSet kDoubleParamStop{"\"\\$`}*?[]/"}; // inside "${...}"
+constexpr ByteSet kTripleSingleStop{"'"};
+constexpr ByteSet kTripleDoubleStop{"\""};
+constexpr ByteSet kBacktickStop{"`\\"};
+constexpr ByteSet kNewline{"\n"};
+
+constexpr std::size_t kMaxInput = UINT32_MAX;
+
 } // namespace
 
 bool Lexer::is_hspace(char c) noexcept {
    return c == ' ' || c == '\t' || c == '\r';
 }
 
-static LexResult error_at(const std::string& msg, const SourceLoc& loc) {
+static LexResult error_at(const std::string& msg, std::size_t offset) {
    LexResult r;
    r.kind = LexKind::Error;
    r.message = msg;
-   r.error_loc = loc;
+   r.error_offset = offset;
    return r;
 }
 
-static LexResult incomplete_at(const SourceLoc& loc) {
+static LexResult incomplete_at(std::size_t offset) {
    LexResult r;
    r.kind = LexKind::Incomplete;
-   r.error_loc = loc;
+   r.error_offset = offset;
    return r;
 }
 
 LexResult Lexer::lex(std::string_view input) const {
-   Cursor cur{input};
+   LexState st;
+   LexResult r = lex(input, st);
+   if (r.kind == LexKind::Complete) {
+      r.tokens = std::move(st.tokens);
+      r.storage = std::move(st.storage);
+   }
+   return r;
+}
+
+// The caller's buffer may have moved since the previous call (it grew).
+// Re-point token views that referred to the old buffer; views into
+// `storage` are unaffected.
+static void rebase_tokens(LexState& st, std::string_view input) {
+   if (st.base != nullptr && st.base != input.data()) {
+      const auto old_begin = reinterpret_cast<std::uintptr_t>(st.base);
+      const auto old_end = old_begin + st.base_size;
+      for (Token& t : st.tokens) {
+         if (t.text.empty()) continue;
+         const auto p = reinterpret_cast<std::uintptr_t>(t.text.data());
+         if (p < old_begin || p >= old_end) continue;
+         t.text = input.substr(p - old_begin, t.text.size());
+      }
+   }
+   st.base = input.data();
+   st.base_size = input.size();
+}
+
+void LexState::drop_tokens(std::size_t n) {
+   tokens.erase(tokens.begin(), tokens.begin() + static_cast<std::ptrdiff_t>(n));
+   resume_tokens -= n;
+}
+
+LexResult Lexer::lex(std::string_view input, LexState& st) const {
+   rebase_tokens(st, input);
+
+   // Roll back a previous Complete result: drop End, and re-lex the last
+   // lexeme if it touched the old end of input.
+   if (st.complete) {
+      st.tokens.resize(st.resume_tokens);
+      st.index = st.resume_index;
+      st.complete = false;
+   }
+
+   // Token offsets are 32-bit.
+   if (input.size() > kMaxInput) return error_at("input too large", 0);
 
-   LexResult out;
-   out.kind = LexKind::Complete;
+   Cursor cur{input, st.index};
 
-   auto push_op = [&](TokenKind k, SourceLoc loc) {
-      out.tokens.push_back(Token{.kind = k, .text = {}, .loc = loc});
+   auto push_op = [&](TokenKind k, std::size_t at) {
+      st.tokens.push_back(Token{
+         .kind = k, .offset = static_cast<std::uint32_t>(at), .text = {}});
    };
 
    auto skip_hspace = [&]() {
@@ -87,30 +143,111 @@ LexResult Lexer::lex(std::string_view input) const {
 
    auto skip_comment = [&]() {
       // assumes current char is '#'
-      while (!cur.eof() && cur.peek() != '\n') cur.advance();
+      cur.advance_run(find_first_of(input, cur.i, kNewline) - cur.i);
       // do NOT consume '\n' here; it is a terminator token
    };
 
+   // Remember where the next call picks up.
+   auto suspend = [&](std::size_t i) { st.index = i; };
+
    auto lex_word = [&]() -> LexResult {
-      const SourceLoc start = cur.loc;
-      std::string w;
+      // All WORD state lives in `st` so an open construct survives an
+      // Incomplete result and continues on the next call.
+      //
+      // The WORD stays a view of the input for as long as every byte taken
+      // is adjacent to the previous one; skipping a byte (a quote, an
+      // escaping backslash) or synthesizing one switches to an owned copy.
+      auto materialize = [&] {
+         if (st.word_owned) return;
+         st.word.assign(
+            input.substr(st.span_begin, st.span_end - st.span_begin));
+         st.word_owned = true;
+      };
 
-      bool in_single = false;
-      bool in_double = false;
+      // Take the input byte under the cursor into the WORD and advance.
+      auto take = [&] {
+         const std::size_t i = cur.i;
+         if (!st.word_owned) {
+            if (st.span_begin == st.span_end) {
+               st.span_begin = i;
+               st.span_end = i + 1;
+            } else if (st.span_end == i) {
+               ++st.span_end;
+            } else {
+               materialize();
+               st.word.push_back(input[i]);
+            }
+         } else {
+            st.word.push_back(input[i]);
+         }
+         cur.advance();
+      };
+
+      // Take the next n input bytes (a run with no special bytes) at once.
+      auto take_run = [&](std::size_t n) {
+         const std::size_t i = cur.i;
+         if (!st.word_owned) {
+            if (st.span_begin == st.span_end) {
+               st.span_begin = i;
+               st.span_end = i + n;
+            } else if (st.span_end == i) {
+               st.span_end += n;
+            } else {
+               materialize();
+               st.word.append(input.substr(i, n));
+            }
+         } else {
+            st.word.append(input.substr(i, n));
+         }
+         cur.advance_run(n);
+      };
 
-      bool in_triple = false;
-      char triple_q = '\0'; // '\'' or '"'
+      auto stop_set = [&]() -> const ByteSet& {
+         if (st.in_triple)
+            return st.triple_q == '\'' ? kTripleSingleStop : kTripleDoubleStop;
+         if (st.in_backtick) return kBacktickStop;
+         if (st.in_single) return kSingleStop;
+         if (st.in_double)
+            return st.param_depth > 0 ? kDoubleParamStop : kDoubleStop;
+         return st.param_depth > 0 ? kWordParamStop : kWordStop;
+      };
 
-      bool in_backtick = false;
+      // Append a byte that does not appear verbatim in the input.
+      auto push = [&](char c) {
+         materialize();
+         st.word.push_back(c);
+      };
 
-      int brace_depth = 0;
-      int subst_paren_depth = 0; // for $(...)
+      // Record that the next byte taken is an unquoted pattern
+      // metacharacter. Those inside $(...) belong to the substitution.
+      auto mark = [&] {
+         if (st.subst_paren_depth > 0) return;
+         const std::size_t len =
+            st.word_owned ? st.word.size() : st.span_end - st.span_begin;
+         st.pattern_marks.push_back(static_cast<std::uint32_t>(len));
+      };
 
-      auto append = [&](char c) { w.push_back(c); };
+      // Drop a quoting byte (delimiter, escaping backslash). Inside $(...)
+      // it is kept instead: the body is run later as a script of its own and
+      // must reach it as written.
+      auto skip = [&] {
+         if (st.subst_paren_depth > 0)
+            take();
+         else
+            cur.advance();
+      };
+
+      auto unquoted = [&] {
+         return !st.in_single && !st.in_double && !st.in_triple &&
+                !st.in_backtick;
+      };
 
       auto is_token_boundary = [&](char c) -> bool {
-         if (in_single || in_double || in_triple || in_backtick) return false;
-         if (brace_depth > 0 || subst_paren_depth > 0) return false;
+         if (st.in_single || st.in_double || st.in_triple || st.in_backtick)
+            return false;
+         if (st.brace_depth > 0 || st.subst_paren_depth > 0 ||
+             st.param_depth > 0)
+            return false;
 
          if (is_hspace(c)) return true;
          if (c == '\n') return true;
@@ -124,156 +261,290 @@ LexResult Lexer::lex(std::string_view input) const {
          return false;
       };
 
-      auto lex_triple = [&](char q) -> LexResult {
-         // current cursor points at the first quote of the triple sequence
-         const SourceLoc qloc = cur.loc;
-         if (q == '\'' && !cur.consume3('\'', '\'', '\'')) return {};
-         if (q == '"' && !cur.consume3('"', '"', '"')) return {};
-         // do not include the delimiters in the produced WORD; they affect
-         // lexing only. If you prefer keeping them, append them here.
-         in_triple = true;
-         triple_q = q;
-         (void)qloc;
-         return LexResult{.kind = LexKind::Complete};
-      };
-
       auto try_start_triple = [&]() -> bool {
+         // Current cursor points at the first quote of a possible triple.
+         // Do not include the delimiters in the produced WORD; they affect
+         // lexing only.
          const char c = cur.peek();
          if (c != '\'' && c != '"') return false;
-         if (cur.peek_n(1) != c) return false;
-         if (cur.peek_n(2) != c) return false;
-         LexResult r = lex_triple(c);
-         if (r.kind == LexKind::Error) return true;
-         if (r.kind == LexKind::Incomplete) return true;
+         if (cur.peek_n(1) != c || cur.peek_n(2) != c) return false;
+         skip();
+         skip();
+         skip();
+         st.in_triple = true;
+         st.triple_q = c;
          return true;
       };
 
       auto finish_triple_if_present = [&]() -> bool {
-         if (!in_triple) return false;
-         const char q = triple_q;
+         if (!st.in_triple) return false;
+         const char q = st.triple_q;
          if (cur.peek() != q) return false;
          if (cur.peek_n(1) != q) return false;
          if (cur.peek_n(2) != q) return false;
-         cur.advance();
-         cur.advance();
-         cur.advance();
-         in_triple = false;
-         triple_q = '\0';
+         skip();
+         skip();
+         skip();
+         st.in_triple = false;
+         st.triple_q = '\0';
          return true;
       };
 
+      // $(...), or an @(...) expression, which is lexed the same way. So
+      // is a WORD that starts with "((", the arithmetic command (arith.h):
+      // the first '(' stands in for the '$'.
       auto try_start_command_subst = [&]() -> bool {
-         // $(...)
-         if (cur.peek() != '$') return false;
+         const bool arith = cur.peek() == '(' && cur.i == st.word_start &&
+                            st.subst_paren_depth == 0 && unquoted() &&
+                            st.brace_depth == 0 && st.param_depth == 0;
+         if (cur.peek() != '$' && cur.peek() != '@' && !arith) return false;
          if (cur.peek_n(1) != '(') return false;
-         append('$');
-         append('(');
-         cur.advance();
-         cur.advance();
-         ++subst_paren_depth;
+         if (st.subst_paren_depth == 0) st.subst_open = true;
+         mark();
+         take();
+         mark();
+         take();
+         ++st.subst_paren_depth;
+         return true;
+      };
+
+      // $name, ${...}, and $?, $$, $#, $@, $* or $0-$9 outside any
+      // substitution: parameter expansions, quoted or not. The name itself
+      // is taken as ordinary bytes; the braces of ${...} are tracked apart
+      // from brace groups.
+      auto try_start_param = [&]() -> bool {
+         if (cur.peek() != '$' || st.subst_paren_depth > 0) return false;
+         const char n = cur.peek_n(1);
+         const bool name = (n >= 'a' && n <= 'z') || (n >= 'A' && n <= 'Z') ||
+                           n == '_';
+         const bool special = n == '?' || n == '$' || n == '#' || n == '@' ||
+                              n == '*' || (n >= '0' && n <= '9');
+         if (!name && n != '{' && !special) return false;
+         st.subst_open = true;
+         mark();
+         take();
+         if (name) return true;
+         if (n == '{') ++st.param_depth;
+         mark();
+         take();
+         return true;
+      };
+
+      // "$(...)" and "`...`": a substitution whose output is not split. A
+      // bare '"' after its "$(" says so ($(( )) is never split anyway). The
+      // body of a $(...) is lexed as if unquoted, as in bash, and the double
+      // quotes resume after its ')'.
+      auto try_start_quoted_subst = [&]() -> bool {
+         if (st.subst_paren_depth > 0) return false;
+         if (cur.peek() == '`') {
+            st.subst_open = true;
+            mark();
+            push('$');
+            mark();
+            push('(');
+            mark();
+            push('"');
+            cur.advance();
+            st.in_backtick = true;
+            return true;
+         }
+         if (cur.peek() != '$' || cur.peek_n(1) != '(') return false;
+         const bool arith = cur.peek_n(2) == '(';
+         st.subst_open = true;
+         mark();
+         take();
+         mark();
+         take();
+         if (!arith) {
+            mark();
+            push('"');
+         }
+         ++st.subst_paren_depth;
+         st.in_double = false;
+         st.subst_in_double = true;
          return true;
       };
 
+      // A '$' at the end of input inside an open construct: whether it
+      // starts a parameter depends on the byte after it, so stop in front of
+      // it. (A WORD that simply ends there is re-lexed anyway.)
+      auto param_needs_more = [&] {
+         return cur.peek() == '$' && cur.i + 1 == input.size() &&
+                st.subst_paren_depth == 0 &&
+                (st.in_double || st.brace_depth > 0 || st.param_depth > 0);
+      };
+
+      // An outermost `...` is handed on in the same form as $(...); its
+      // escapes are resolved here, as for any backtick body.
       auto try_start_backtick = [&]() -> bool {
          if (cur.peek() != '`') return false;
-         // We do not include the delimiters in the WORD output, matching how
-         // quotes are handled. If you prefer to preserve them, append them.
-         cur.advance();
-         in_backtick = true;
+         if (st.subst_paren_depth > 0) {
+            take();
+         } else {
+            st.subst_open = true;
+            mark();
+            push('$');
+            mark();
+            push('(');
+            cur.advance();
+         }
+         st.in_backtick = true;
          return true;
       };
 
       auto finish_backtick_if_present = [&]() -> bool {
-         if (!in_backtick) return false;
+         if (!st.in_backtick) return false;
          if (cur.peek() != '`') return false;
-         cur.advance();
-         in_backtick = false;
+         if (st.subst_paren_depth > 0) {
+            take();
+         } else {
+            mark();
+            push(')');
+            cur.advance();
+         }
+         st.in_backtick = false;
          return true;
       };
 
+      // A backslash at end of input needs the next byte. Resume at the
+      // backslash itself so the escape is re-read once that byte exists.
+      auto incomplete_escape = [&](std::size_t i) {
+         suspend(i);
+         return incomplete_at(i);
+      };
+
       while (!cur.eof()) {
+         // Fast path: bulk-take the run up to the next byte that matters in
+         // the current mode.
+         if (const std::size_t j = find_first_of(input, cur.i, stop_set());
+             j > cur.i) {
+            // Inside an unquoted brace group, ',' and '.' separate elements
+            // and ranges.
+            if (st.brace_depth > 0 && st.subst_paren_depth == 0 &&
+                unquoted()) {
+               const std::size_t len = st.word_owned
+                                          ? st.word.size()
+                                          : st.span_end - st.span_begin;
+               for (std::size_t k = cur.i; k < j; ++k) {
+                  if (input[k] == ',' || input[k] == '.')
+                     st.pattern_marks.push_back(
+                        static_cast<std::uint32_t>(len + (k - cur.i)));
+               }
+            }
+            take_run(j - cur.i);
+            if (cur.eof()) break;
+         }
+
          const char c = cur.peek();
 
          // Triple-quoted body: everything is literal until matching delimiter.
-         if (in_triple) {
+         if (st.in_triple) {
             if (finish_triple_if_present()) continue;
-            append(c);
-            cur.advance();
+            // A partial delimiter at end of input cannot close the body yet;
+            // stop in front of it so the next call sees all three quotes.
+            if (c == st.triple_q && cur.i + 3 > cur.s.size()) break;
+            take();
             continue;
          }
 
          // Backtick body: allow escapes; terminate on unescaped backtick.
-         if (in_backtick) {
+         if (st.in_backtick) {
             if (finish_backtick_if_present()) continue;
 
             if (c == '\\') {
-               const SourceLoc esc_loc = cur.loc;
-               cur.advance();
-               if (cur.eof()) return incomplete_at(esc_loc);
+               const std::size_t esc_i = cur.i;
+               if (cur.i + 1 == input.size()) return incomplete_escape(esc_i);
+               skip();
                const char n = cur.peek();
                if (n == '\n') {
                   // continuation
-                  cur.advance();
+                  skip();
                   continue;
                }
                // bash/zsh-like: backslash escapes next char including '`'
-               append(n);
-               cur.advance();
+               take();
                continue;
             }
 
-            append(c);
-            cur.advance();
+            take();
             continue;
          }
 
          // Single-quoted body
-         if (in_single) {
+         if (st.in_single) {
             if (c == '\'') {
-               in_single = false;
-               cur.advance();
+               st.in_single = false;
+               skip();
                continue;
             }
-            append(c);
-            cur.advance();
+            take();
             continue;
          }
 
          // Double-quoted body
-         if (in_double) {
+         if (st.in_double) {
             if (c == '"') {
-               in_double = false;
-               cur.advance();
+               st.in_double = false;
+               skip();
                continue;
             }
             if (c == '\\') {
-               const SourceLoc esc_loc = cur.loc;
-               cur.advance();
-               if (cur.eof()) return incomplete_at(esc_loc);
+               const std::size_t esc_i = cur.i;
+               if (cur.i + 1 == input.size()) return incomplete_escape(esc_i);
+               skip();
                const char n = cur.peek();
+               // Inside a substitution the body is kept as written; it is
+               // checked here all the same so errors show up early.
+               if (st.subst_paren_depth > 0 &&
+                   (n == '"' || n == '\\' || n == '$' || n == 'n' ||
+                    n == '\n')) {
+                  take();
+                  continue;
+               }
                if (n == '\n') {
                   cur.advance();
                   continue;
                }
                switch (n) {
                case '"':
-                  append('"');
-                  break;
                case '\\':
-                  append('\\');
+               case '$':
+                  take();
                   break;
                case 'n':
-                  append('\n');
+                  push('\n');
+                  cur.advance();
                   break;
                default:
                   return error_at("unsupported escape in double quotes",
-                                  esc_loc);
+                                  esc_i);
                }
-               cur.advance();
                continue;
             }
-            append(c);
-            cur.advance();
+            if (param_needs_more()) return incomplete_escape(cur.i);
+            // "$(" or "$((": wait for the byte that tells them apart.
+            if (c == '$' && cur.peek_n(1) == '(' && cur.i + 2 == input.size() &&
+                st.subst_paren_depth == 0)
+               return incomplete_escape(cur.i);
+            if (try_start_quoted_subst()) continue;
+            if (try_start_param()) continue;
+            if (st.param_depth > 0 && st.subst_paren_depth == 0) {
+               if (c == '}') {
+                  mark();
+                  take();
+                  --st.param_depth;
+                  continue;
+               }
+               // A '/' is a delimiter only if its ${ is inside these quotes:
+               // in ${name/"/"/x} it is quoted.
+               if (c == '*' || c == '?' || c == '[' || c == ']' ||
+                   (c == '/' && st.param_depth > st.double_param_base)) {
+                  mark();
+                  take();
+                  continue;
+               }
+            }
+            take();
             continue;
          }
 
@@ -287,109 +558,242 @@ LexResult Lexer::lex(std::string_view input) const {
          // (E.g. foo#bar is a WORD.)
 
          // Triple quotes start (Python-style).
-         if (try_start_triple()) {
-            // started triple; do not include delimiters
-            continue;
-         }
+         if (try_start_triple()) continue;
 
          // Quotes
          if (c == '\'') {
-            in_single = true;
-            cur.advance();
+            st.in_single = true;
+            skip();
             continue;
          }
          if (c == '"') {
-            in_double = true;
-            cur.advance();
+            st.in_double = true;
+            st.double_param_base = st.param_depth;
+            skip();
             continue;
          }
 
-         // Command substitution: $(...)
+         // Command substitution $(...) and expressions @(...)
          if (try_start_command_subst()) continue;
 
+         // Parameters
+         if (param_needs_more()) return incomplete_escape(cur.i);
+         if (try_start_param()) continue;
+
          // Backticks
          if (try_start_backtick()) continue;
 
          // Backslash escape (outside quotes)
          if (c == '\\') {
-            const SourceLoc esc_loc = cur.loc;
-            cur.advance();
-            if (cur.eof()) return incomplete_at(esc_loc);
+            const std::size_t esc_i = cur.i;
+            if (cur.i + 1 == input.size()) return incomplete_escape(esc_i);
+            skip();
             const char n = cur.peek();
             if (n == '\n') {
-               cur.advance();
+               skip();
                continue;
             }
-            append(n);
-            cur.advance();
+            take();
             continue;
          }
 
          // Track brace-groups as lexical WORD constructs.
          if (c == '{') {
-            ++brace_depth;
-            append(c);
-            cur.advance();
+            if (st.subst_paren_depth == 0) st.brace_open = true;
+            mark();
+            ++st.brace_depth;
+            take();
             continue;
          }
          if (c == '}') {
-            if (brace_depth > 0) --brace_depth;
-            append(c);
-            cur.advance();
+            mark();
+            if (st.brace_depth > 0)
+               --st.brace_depth;
+            else if (st.param_depth > 0 && st.subst_paren_depth == 0)
+               --st.param_depth;
+            take();
+            continue;
+         }
+
+         // Glob metacharacters. ']' alone never makes a pattern, but it
+         // closes a bracket expression only when unquoted. Inside ${...}
+         // they belong to the parameter's pattern.
+         if (c == '*' || c == '?' || c == '[' || c == ']') {
+            if (c != ']' && st.subst_paren_depth == 0 && st.param_depth == 0)
+               st.glob_open = true;
+            mark();
+            take();
             continue;
          }
 
          // Track $(...) nesting by parentheses depth within substitution.
-         if (subst_paren_depth > 0) {
+         if (st.subst_paren_depth > 0) {
             if (c == '(') {
-               ++subst_paren_depth;
-               append(c);
-               cur.advance();
+               ++st.subst_paren_depth;
+               take();
                continue;
             }
             if (c == ')') {
-               --subst_paren_depth;
-               append(c);
-               cur.advance();
+               --st.subst_paren_depth;
+               mark();
+               take();
+               if (st.subst_paren_depth == 0 && st.subst_in_double) {
+                  st.subst_in_double = false;
+                  st.in_double = true;
+               }
                continue;
             }
          }
 
-         // Ordinary character
-         append(c);
-         cur.advance();
+         // Inside ${...} a '/' delimits ${name/pattern/string} unless it is
+         // quoted or escaped.
+         if (c == '/' && st.param_depth > 0 && st.subst_paren_depth == 0) {
+            mark();
+            take();
+            continue;
+         }
+
+         // Ordinary character. '$' is marked so that "${" is not taken for
+         // a brace group; whitespace only reaches here inside one. Parens
+         // are marked for `case`, whose patterns end at a bare ')'.
+         if (c == '$' || c == '(' || c == ')' || is_hspace(c) || c == '\n')
+            mark();
+         take();
       }
 
       // If any construct is still open, we need more input.
-      if (in_single || in_double || in_triple || in_backtick) {
-         return incomplete_at(start);
+      if (st.in_single || st.in_double || st.in_triple || st.in_backtick ||
+          st.brace_depth > 0 || st.subst_paren_depth > 0 ||
+          st.param_depth > 0) {
+         suspend(cur.i);
+         return incomplete_at(st.word_start);
       }
-      if (brace_depth > 0 || subst_paren_depth > 0) return incomplete_at(start);
 
-      if (w.empty()) return error_at("expected word", start);
+      std::string_view text;
+      if (st.word_owned) {
+         if (st.word.empty()) return error_at("expected word", st.word_start);
+         st.storage.push_front(std::move(st.word));
+         text = st.storage.front();
+      } else {
+         text = input.substr(st.span_begin, st.span_end - st.span_begin);
+         if (text.empty()) return error_at("expected word", st.word_start);
+      }
 
-      out.tokens.push_back(
-         Token{.kind = TokenKind::Word, .text = std::move(w), .loc = start});
+      // An unquoted '{', wildcard or substitution: hand the WORD on as a
+      // pattern.
+      const bool brace = st.brace_open;
+      const bool glob = st.glob_open;
+      const bool subst = st.subst_open;
+      if (brace || glob || subst) {
+         std::pmr::string pattern{st.resource()};
+         pattern.reserve(text.size() + 8);
+         auto m = st.pattern_marks.begin();
+         // '/' is no metacharacter, except inside ${...}, where a bare one
+         // ends the pattern of ${name/pattern/string}: a quoted one is
+         // escaped there. Bare braces nest; bit n of `params` is set if the
+         // n-th open one is a "${".
+         std::uint64_t params = 0;
+         bool after_dollar = false;
+         for (std::size_t k = 0; k < text.size(); ++k) {
+            const char c = text[k];
+            const bool bare = m != st.pattern_marks.end() && *m == k;
+            if (bare) {
+               ++m;
+               if (c == '{')
+                  params = (params << 1) | (after_dollar ? 1 : 0);
+               else if (c == '}')
+                  params >>= 1;
+            } else if (kPatternMeta.find(c) != std::string_view::npos ||
+                       (c == '/' && params != 0)) {
+               pattern.push_back('\\');
+            }
+            after_dollar = bare && c == '$';
+            pattern.push_back(c);
+         }
+         st.storage.push_front(std::move(pattern));
+         text = st.storage.front();
+      }
+
+      // NAME= as written: no quote or escape can hide in those bytes.
+      bool assign = false;
+      {
+         std::size_t k = st.word_start;
+         auto name_byte = [&](bool first) {
+            const char b = input[k];
+            return (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') ||
+                   b == '_' || (!first && b >= '0' && b <= '9');
+         };
+         if (k < input.size() && name_byte(true)) {
+            while (++k < input.size() && name_byte(false)) {}
+            assign = k < input.size() && input[k] == '=';
+         }
+      }
+
+      const bool bare = !st.word_owned && !brace && !glob && !subst &&
+                        st.span_begin == st.word_start &&
+                        cur.i - st.word_start == text.size();
+
+      st.tokens.push_back(
+         Token{.kind = TokenKind::Word,
+               .brace = brace,
+               .glob = glob,
+               .subst = subst,
+               .assign = assign,
+               .bare = bare,
+               .offset = static_cast<std::uint32_t>(st.word_start),
+               .text = text});
+      st.word.clear();
+      st.word_owned = false;
+      st.span_begin = st.span_end = 0;
+      st.pattern_marks.clear();
+      st.brace_open = false;
+      st.glob_open = false;
+      st.subst_open = false;
+      st.in_word = false;
       return LexResult{.kind = LexKind::Complete};
    };
 
+   // Start of the most recent lexeme, for rolling back a Complete result.
+   // A WORD carried over from the previous call started at word_start.
+   std::size_t lexeme_i = st.in_word ? st.word_start : cur.i;
+   std::size_t lexeme_tokens = st.tokens.size();
+
+   // Continue a WORD left open by the previous call.
+   if (st.in_word) {
+      LexResult r = lex_word();
+      if (r.kind != LexKind::Complete) return r;
+   }
+
+   bool ends_in_space = false;
+
    while (!cur.eof()) {
+      if (st.pull && !st.tokens.empty()) {
+         suspend(cur.i);
+         return LexResult{.kind = LexKind::Complete};
+      }
+
       skip_hspace();
-      if (cur.eof()) break;
+      if (cur.eof()) {
+         ends_in_space = true;
+         break;
+      }
 
       const char c = cur.peek();
 
+      lexeme_i = cur.i;
+      lexeme_tokens = st.tokens.size();
+
       if (c == '\n') {
-         const SourceLoc loc = cur.loc;
+         const std::size_t at = cur.i;
          cur.advance();
-         push_op(TokenKind::Newline, loc);
+         push_op(TokenKind::Newline, at);
          continue;
       }
 
       if (c == ';') {
-         const SourceLoc loc = cur.loc;
+         const std::size_t at = cur.i;
          cur.advance();
-         push_op(TokenKind::Semicolon, loc);
+         push_op(TokenKind::Semicolon, at);
          continue;
       }
 
@@ -398,10 +802,52 @@ LexResult Lexer::lex(std::string_view input) const {
          continue;
       }
 
+      // Group braces. Input that ends right after one is re-lexed when it
+      // grows, so "{" + "a,b}" still makes a brace group.
+      if (c == '{' || c == '}') {
+         const char n = cur.i + 1 < input.size() ? input[cur.i + 1] : ' ';
+         const bool alone = c == '{' ? (is_hspace(n) || n == '\n')
+                                     : (is_hspace(n) || n == '\n' || n == ';' ||
+                                        n == '&' || n == '|' || n == '<' ||
+                                        n == '>');
+         if (alone) {
+            const std::size_t at = cur.i;
+            cur.advance();
+            st.tokens.push_back(
+               Token{.kind = c == '{' ? TokenKind::LBrace : TokenKind::RBrace,
+                     .bare = true,
+                     .offset = static_cast<std::uint32_t>(at),
+                     .text = input.substr(at, 1)});
+            continue;
+         }
+      }
+
+      // `NAME(){ `: a function header written against its group brace.
+      if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
+         std::size_t e = cur.i + 1;
+         while (e < input.size() &&
+                ((input[e] >= 'a' && input[e] <= 'z') ||
+                 (input[e] >= 'A' && input[e] <= 'Z') ||
+                 (input[e] >= '0' && input[e] <= '9') || input[e] == '_'))
+            ++e;
+         if (input.substr(e, 3) == "(){" &&
+             (e + 3 == input.size() || is_hspace(input[e + 3]) ||
+              input[e + 3] == '\n')) {
+            const std::size_t at = cur.i;
+            while (cur.i < e + 2) cur.advance();
+            st.tokens.push_back(
+               Token{.kind = TokenKind::Word,
+                     .bare = true,
+                     .offset = static_cast<std::uint32_t>(at),
+                     .text = input.substr(at, e + 2 - at)});
+            continue;
+         }
+      }
+
       // IO number: digits immediately followed by a redirection operator.
       // Example: 2>file, 12>>file
       if (c >= '0' && c <= '9') {
-         const SourceLoc loc = cur.loc;
+         const std::size_t at = cur.i;
 
          std::size_t j = cur.i;
          while (j < cur.s.size()) {
@@ -412,73 +858,140 @@ LexResult Lexer::lex(std::string_view input) const {
 
          const char next = (j < cur.s.size()) ? cur.s[j] : '\0';
          if (next == '<' || next == '>') {
-            std::string digits;
-            digits.reserve(j - cur.i);
-            while (cur.i < j) {
-               digits.push_back(cur.peek());
-               cur.advance();
-            }
-            out.tokens.push_back(
+            const std::string_view digits = input.substr(cur.i, j - cur.i);
+            cur.advance_run(j - cur.i);
+            st.tokens.push_back(
                Token{.kind = TokenKind::IoNumber,
-                     .text = std::move(digits),
-                     .loc = loc});
+                     .offset = static_cast<std::uint32_t>(at),
+                     .text = digits});
             continue;
          }
          // Otherwise: fall through; it will lex as a WORD.
       }
 
       if (c == '<') {
-         const SourceLoc loc = cur.loc;
+         const std::size_t at = cur.i;
          cur.advance();
-         push_op(TokenKind::RedirectIn, loc);
+         push_op(TokenKind::RedirectIn, at);
          continue;
       }
 
       if (c == '>') {
-         const SourceLoc loc = cur.loc;
+         const std::size_t at = cur.i;
          cur.advance();
          if (cur.consume('>')) {
-            push_op(TokenKind::RedirectAppend, loc);
+            push_op(TokenKind::RedirectAppend, at);
          } else {
-            push_op(TokenKind::RedirectOut, loc);
+            push_op(TokenKind::RedirectOut, at);
          }
          continue;
       }
 
       if (c == '|') {
-         const SourceLoc loc = cur.loc;
+         const std::size_t at = cur.i;
          cur.advance();
          if (cur.consume('|')) {
-            push_op(TokenKind::OrIf, loc);
+            push_op(TokenKind::OrIf, at);
          } else {
-            push_op(TokenKind::Pipe, loc);
+            push_op(TokenKind::Pipe, at);
          }
          continue;
       }
 
       if (c == '&') {
-         const SourceLoc loc = cur.loc;
+         const std::size_t at = cur.i;
          cur.advance();
          if (cur.consume('&')) {
-            push_op(TokenKind::AndIf, loc);
+            push_op(TokenKind::AndIf, at);
          } else {
-            push_op(TokenKind::Ampersand, loc);
+            push_op(TokenKind::Ampersand, at);
          }
          continue;
       }
 
       // word
       {
+         st.in_word = true;
+         st.word_start = cur.i;
+         st.pattern_marks.clear();
+         st.brace_open = false;
+         st.glob_open = false;
+         st.subst_open = false;
          LexResult r = lex_word();
-         if (r.kind == LexKind::Error) return r;
-         if (r.kind == LexKind::Incomplete) return r;
+         if (r.kind != LexKind::Complete) return r;
       }
    }
 
-   out.tokens.push_back(
-      Token{.kind = TokenKind::End, .text = {}, .loc = cur.loc});
+   // Complete. If the last lexeme runs up to the end of input, appended text
+   // could still extend it ("a" + "b", "|" + "|", a comment), so the next
+   // call re-lexes it. Otherwise the next call resumes at end of input.
+   const bool touches_end = !ends_in_space && lexeme_i < input.size();
+   st.complete = true;
+   st.resume_index = touches_end ? lexeme_i : cur.i;
+   st.resume_tokens = touches_end ? lexeme_tokens : st.tokens.size();
+   st.index = cur.i;
+
+   push_op(TokenKind::End, cur.i);
+   return LexResult{.kind = LexKind::Complete};
+}
+
+std::pmr::string pattern_literal(std::string_view pattern,
+                                 std::pmr::memory_resource* mr) {
+   std::pmr::string out{mr};
+   out.reserve(pattern.size());
+   for (std::size_t k = 0; k < pattern.size(); ++k) {
+      if (pattern[k] == '\\' && k + 1 < pattern.size()) ++k;
+      out.push_back(pattern[k]);
+   }
    return out;
 }
 
-} // namespace clanker
+std::pmr::string pattern_escaped(std::string_view text,
+                                 std::pmr::memory_resource* mr) {
+   std::pmr::string out{mr};
+   out.reserve(text.size() + 8);
+   for (const char c : text) {
+      if (kPatternMeta.find(c) != std::string_view::npos) out.push_back('\\');
+      out.push_back(c);
+   }
+   return out;
+}
+
+// ---- TokenStream ----
 
+TokenStream::TokenStream(std::string_view input, std::pmr::memory_resource* mr)
+   : input_(input)
+   , pool_(mr)
+   , state_(&pool_) {
+   state_.pull = true;
+}
+
+const Token& TokenStream::next() {
+   if (pos_ < state_.tokens.size()) return state_.tokens[pos_++];
+   if (done_) return end_;
+
+   // The previous lexeme has been consumed; recycle its memory.
+   state_.tokens.clear();
+   state_.storage.clear();
+   pos_ = 0;
+
+   const LexResult r = Lexer{}.lex(input_, state_);
+   if (r.kind != LexKind::Complete) {
+      status_ = r.kind;
+      message_ = r.message;
+      error_offset_ = r.error_offset;
+      done_ = true;
+      end_ = Token{.kind = TokenKind::End,
+                   .offset = static_cast<std::uint32_t>(
+                      std::min<std::size_t>(r.error_offset, UINT32_MAX)),
+                   .text = {}};
+      return end_;
+   }
+   if (state_.tokens.back().kind == TokenKind::End) {
+      done_ = true;
+      end_ = state_.tokens.back();
+   }
+   return state_.tokens[pos_++];
+}
+
+} // namespace clanker
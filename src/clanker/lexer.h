@@ -2,19 +2,24 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <forward_list>
+#include <memory_resource>
 #include <string>
 #include <string_view>
 #include <vector>
 
 namespace clanker {
 
+// A resolved position, for diagnostics. Tokens only carry a byte offset;
+// see locate() (source_map.h) for turning one into a SourceLoc.
 struct SourceLoc {
    std::size_t index{0};
    std::size_t line{1};
    std::size_t column{1};
 };
 
-enum class TokenKind {
+enum class TokenKind : std::uint8_t {
    Word,
 
    Pipe,
@@ -29,31 +34,238 @@ enum class TokenKind {
    RedirectAppend,
    IoNumber,
 
+   // '{' followed by whitespace and '}' standing alone at the start of a
+   // WORD: a group command's braces if they come where a command may start,
+   // otherwise the parser takes them as WORDs. Any other brace belongs to
+   // a brace group.
+   LBrace,
+   RBrace,
+
    End
 };
 
 struct Token {
    TokenKind kind{TokenKind::End};
-   std::string text; // for Word; empty for operators
-   SourceLoc loc{};
+
+   // WORD contains an unquoted brace group, glob metacharacter, or a
+   // command substitution, parameter expansion or @( ) expression; `text`
+   // is then a pattern (see "Word patterns" below).
+   bool brace{false};
+   bool glob{false};
+   bool subst{false};
+
+   // WORD starts with NAME= as written, unquoted: an assignment if it
+   // comes before the command name.
+   bool assign{false};
+
+   // WORD is exactly its input bytes: no quote, escape or expansion. Only
+   // such a word can be a reserved word (`if`, `do`, ...).
+   bool bare{false};
+
+   // Byte offset of the token's first byte in the lexed input. Inputs are
+   // limited to 4 GiB so this fits in 32 bits.
+   std::uint32_t offset{0};
+
+   // For Word / IoNumber; empty for operators.
+   // Points straight into the lexed input when the WORD's bytes appear there
+   // verbatim (no escapes, at most one quoted run). Otherwise it points into
+   // the owning LexResult / LexState `storage`. Either way it is valid only
+   // while both the input and that owner are alive.
+   std::string_view text;
 };
 
+// Backing store for WORD text that had to be rewritten (escapes, quotes in
+// the middle of a word). List nodes keep their addresses as the store grows
+// and when it is moved, and an empty store does not allocate.
+using TokenStorage = std::pmr::forward_list<std::pmr::string>;
+
 enum class LexKind { Complete, Incomplete, Error };
 
 struct LexResult {
    LexKind kind{LexKind::Error};
-   std::vector<Token> tokens;
-   std::string message;
-   SourceLoc error_loc{};
+   std::pmr::vector<Token> tokens{};
+   TokenStorage storage{};
+   std::string message{};
+   std::size_t error_offset{0}; // byte offset for Error / Incomplete
 };
 
+// Resumable lexer state (continuation).
+//
+// Pass the same LexState to successive Lexer::lex calls whose input grows by
+// appending text (e.g. a REPL continuation line "\n..."). Only the new bytes
+// are scanned: the state remembers the cursor, the tokens produced so far and
+// any WORD that is still open (quotes, triple quotes, backticks, brace-groups,
+// $( depth).
+//
+// After Complete, `tokens` holds the full token stream (ending in End). After
+// Error the state is unspecified; call reset() before reusing it.
+//
+// Tokens and rewritten WORD text are allocated from the memory resource the
+// state was constructed with (typically a per-unit arena).
+struct LexState {
+   explicit LexState(
+      std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+      : tokens(mr)
+      , storage(mr)
+      , word(mr)
+      , pattern_marks(mr) {}
+
+   std::pmr::vector<Token> tokens;
+   TokenStorage storage;
+
+   // Input seen by the previous call. Token views into it are re-pointed if
+   // the caller's buffer moved (e.g. std::string growth).
+   const char* base{nullptr};
+   std::size_t base_size{0};
+
+   // Where scanning resumes.
+   std::size_t index{0};
+
+   // Resume point after a Complete lex: the start of the last lexeme if it
+   // touches the end of input (it could still grow), with the token count to
+   // roll back to.
+   std::size_t resume_index{0};
+   std::size_t resume_tokens{0};
+   bool complete{false};
+
+   // Open WORD (valid when in_word). While the WORD's bytes are a verbatim
+   // run of the input it is tracked as [span_begin, span_end); the first
+   // rewrite copies the run into `word` and sets word_owned.
+   bool in_word{false};
+   std::size_t span_begin{0};
+   std::size_t span_end{0};
+   bool word_owned{false};
+   std::pmr::string word;
+   std::size_t word_start{0};
+   bool in_single{false};
+   bool in_double{false};
+   bool in_triple{false};
+   char triple_q{'\0'};
+   bool in_backtick{false};
+   int brace_depth{0};
+   int subst_paren_depth{0};
+   int param_depth{0}; // open ${ (their braces are not brace groups)
+   int double_param_base{0}; // param_depth where the open "..." began
+   bool subst_in_double{false}; // the open $(...) began inside "..."
+
+   // Positions (in WORD text) of unquoted bytes that matter to expansion,
+   // and whether they include a '{', a wildcard or a substitution.
+   std::pmr::vector<std::uint32_t> pattern_marks;
+   bool brace_open{false};
+   bool glob_open{false};
+   bool subst_open{false};
+
+   // Pull mode (TokenStream): return Complete as soon as `tokens` is
+   // non-empty instead of lexing to the end of input. `index` is where the
+   // next call resumes; End is only pushed at the real end of input.
+   bool pull{false};
+
+   [[nodiscard]] std::pmr::memory_resource* resource() const noexcept {
+      return tokens.get_allocator().resource();
+   }
+
+   // Start a new unit. Keeps the memory resource; releases everything else
+   // back to it, so an arena can be released right after.
+   void reset() { *this = LexState{resource()}; }
+
+   // After a Complete lex: forget the first `n` tokens, which a consumer
+   // has used up. `n` must not pass resume_tokens (those after it can still
+   // be re-lexed). Later calls append after the tokens that remain.
+   void drop_tokens(std::size_t n);
+};
+
+// Word patterns.
+//
+// The lexer removes quotes, so "{a,b}" and {a,b}, or "*" and *, would look
+// the same in the WORD text. A WORD with an unquoted '{' (Token::brace),
+// '*', '?' or '[' (Token::glob), or a command substitution (Token::subst) is
+// therefore emitted as a pattern instead: every byte in kPatternMeta that
+// came from quoting or escaping is preceded by a backslash, and the unquoted
+// ones are left bare. Expansion (expand.h, glob.h) reads the pattern;
+// pattern_literal() turns it back into plain text where no expansion
+// applies.
+//
+// A substitution is a bare "$(" and its matching bare ")"; everything in
+// between is escaped. The body is its source text, quotes and all (`...`
+// bodies with their escapes resolved). One in double quotes has a bare '"'
+// in front of its body. An @( ) expression (expr.h) is kept
+// the same way, opened by a bare "@(", and also sets Token::subst. So is a
+// WORD that starts with "((", an arithmetic command (arith.h): its first
+// two bytes are bare and the ')' matching the second is the first bare one.
+//
+// A parameter expansion, quoted or not, is a bare '$' followed by a name,
+// a bare '?', '$', '#', '@', '*' or digit, or a bare '{' up to its
+// matching bare '}'; it also sets Token::subst. Wildcards inside "${...}"
+// are bare even in double quotes, since they form the pattern of # % and /.
+// So is a '/' there, which delimits ${name/pattern/string}; inside a
+// "${...}", and only there, a '/' that was quoted (escaped, or in quotes
+// opened within the braces) is preceded by a backslash as if it were in
+// kPatternMeta.
+inline constexpr std::string_view kPatternMeta{"{},.$@\\ \t\r\n*?[]()\""};
+
+[[nodiscard]] std::pmr::string pattern_literal(
+   std::string_view pattern,
+   std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+
+// The pattern that stands for plain `text`: every metacharacter escaped.
+[[nodiscard]] std::pmr::string pattern_escaped(
+   std::string_view text,
+   std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+
 class Lexer {
  public:
    LexResult lex(std::string_view input) const;
 
+   // Incremental form. `input` must start with the text given on the previous
+   // call with this state. The returned LexResult carries no tokens; they are
+   // in `state.tokens`.
+   LexResult lex(std::string_view input, LexState& state) const;
+
  private:
    static bool is_hspace(char c) noexcept; // space/tab/cr (NOT newline)
 };
 
+// Tokens of a complete input, lexed on demand as a consumer pulls them.
+//
+// Only the lexeme being handed out is held, so token memory stays constant
+// however large the input is, and a consumer that stops early (the parser
+// at its first syntax error) never lexes the rest. Rewritten WORD text is
+// recycled through a pool, so it does not accumulate either.
+class TokenStream {
+ public:
+   explicit TokenStream(
+      std::string_view input,
+      std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+
+   TokenStream(const TokenStream&) = delete;
+   TokenStream& operator=(const TokenStream&) = delete;
+
+   // The next token; End at the end of input and from then on. A lexical
+   // error or unterminated construct also ends the stream with End (see
+   // status()). The token's text is valid until the following call.
+   const Token& next();
+
+   // Complete, or why the stream ended early.
+   [[nodiscard]] LexKind status() const noexcept { return status_; }
+   [[nodiscard]] const std::string& message() const noexcept {
+      return message_;
+   }
+   [[nodiscard]] std::size_t error_offset() const noexcept {
+      return error_offset_;
+   }
+
+ private:
+   std::string_view input_;
+   std::pmr::unsynchronized_pool_resource pool_;
+   LexState state_;
+   std::size_t pos_{0}; // next token in state_.tokens
+   bool done_{false};   // state_.tokens ends the stream
+   Token end_;
+
+   LexKind status_{LexKind::Complete};
+   std::string message_;
+   std::size_t error_offset_{0};
+};
+
 } // namespace clanker
 
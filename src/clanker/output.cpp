@@ -0,0 +1,70 @@
+// src/clanker/output.cpp
+#include <cerrno>
+#include <cstring>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "clanker/output.h"
+#include "clanker/util.h"
+
+namespace clanker {
+
+bool OutputSink::put(std::initializer_list<std::string_view> pieces,
+                     bool newline) noexcept {
+   if (failed_) return false;
+   bool ends_line = newline;
+   for (const std::string_view s : pieces) {
+      if (s.empty()) continue;
+      if (s.size() <= kBuffer - used_) {
+         std::memcpy(buf_ + used_, s.data(), s.size());
+         used_ += s.size();
+      } else if (!write_through(s)) {
+         return false;
+      }
+      if (mode_ == Mode::Line && !ends_line)
+         ends_line = std::memchr(s.data(), '\n', s.size()) != nullptr;
+   }
+   if (newline) {
+      if (used_ == kBuffer && !flush()) return false;
+      buf_[used_++] = '\n';
+   }
+   if (mode_ == Mode::Line && ends_line) return flush();
+   return true;
+}
+
+// Write the buffer and then `s`, in one writev() unless it is cut short.
+bool OutputSink::write_through(std::string_view s) noexcept {
+   iovec iov[2] = {
+      {.iov_base = buf_, .iov_len = used_},
+      {.iov_base = const_cast<char*>(s.data()), .iov_len = s.size()},
+   };
+   iovec* v = used_ == 0 ? iov + 1 : iov;
+   int n = static_cast<int>(iov + 2 - v);
+   used_ = 0;
+   while (n > 0) {
+      const ssize_t w = ::writev(fd_, v, n);
+      if (w < 0) {
+         if (errno == EINTR) continue;
+         failed_ = true;
+         return false;
+      }
+      auto left = static_cast<std::size_t>(w);
+      for (; n > 0 && left >= v->iov_len; ++v, --n) left -= v->iov_len;
+      if (n > 0) {
+         v->iov_base = static_cast<char*>(v->iov_base) + left;
+         v->iov_len -= left;
+      }
+   }
+   return true;
+}
+
+bool OutputSink::flush() noexcept {
+   if (failed_) return false;
+   if (used_ == 0) return true;
+   const std::size_t n = used_;
+   used_ = 0;
+   if (!fd_write_all(fd_, {buf_, n})) failed_ = true;
+   return !failed_;
+}
+
+} // namespace clanker
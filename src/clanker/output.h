@@ -0,0 +1,68 @@
+// src/clanker/output.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+
+namespace clanker {
+
+// Buffered output for built-ins (built-ins.md), one per fd a built-in
+// writes to, made on its stack from its BuiltinContext (output_of(),
+// errors_of() in builtins.h).
+//
+// Output collects in a fixed buffer and goes out in one write when the
+// built-in returns, so `help` or `declare -p` costs one syscall however
+// many lines it prints. Text that does not fit is written together with
+// what is buffered in one writev(), without being copied. In Line mode,
+// for a terminal, each write that ends a line is flushed at once.
+//
+// A write error is sticky: later output is dropped and ok() stays false,
+// which a built-in reports as status 1, as for any failed write.
+class OutputSink {
+ public:
+   static constexpr std::size_t kBuffer = std::size_t{8} << 10;
+
+   enum class Mode : std::uint8_t {
+      Full, // flush when full and at the end
+      Line, // also flush after each write that ends a line
+   };
+
+   explicit OutputSink(int fd, Mode mode = Mode::Full) noexcept
+      : fd_(fd)
+      , mode_(mode) {}
+   ~OutputSink() { (void)flush(); }
+
+   OutputSink(const OutputSink&) = delete;
+   OutputSink& operator=(const OutputSink&) = delete;
+
+   // Queue the pieces, in order. line() adds a newline after them.
+   bool write(std::string_view s) noexcept { return put({s}, false); }
+   bool write(std::initializer_list<std::string_view> pieces) noexcept {
+      return put(pieces, false);
+   }
+   bool line(std::string_view s) noexcept { return put({s}, true); }
+   bool line(std::initializer_list<std::string_view> pieces) noexcept {
+      return put(pieces, true);
+   }
+
+   // Write out what is buffered. False if this or an earlier write failed.
+   bool flush() noexcept;
+
+   [[nodiscard]] bool ok() const noexcept { return !failed_; }
+   [[nodiscard]] int fd() const noexcept { return fd_; }
+
+ private:
+   bool put(std::initializer_list<std::string_view> pieces,
+            bool newline) noexcept;
+   bool write_through(std::string_view s) noexcept;
+
+   int fd_;
+   Mode mode_;
+   bool failed_{false};
+   std::size_t used_{0};
+   char buf_[kBuffer];
+};
+
+} // namespace clanker
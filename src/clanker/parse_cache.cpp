@@ -0,0 +1,66 @@
+// src/clanker/parse_cache.cpp
+#include <functional>
+
+#include "clanker/parse_cache.h"
+
+namespace clanker {
+
+ParsedUnit::ParsedUnit(const ParseResult& pr, std::size_t size_hint)
+   : arena_(size_hint)
+   , result_{.kind = pr.kind,
+             .pipeline = Pipeline(pr.pipeline, AstAllocator{&arena_}),
+             .list = CommandList(pr.list, AstAllocator{&arena_}),
+             .message = {},
+             .error_offset = 0} {}
+
+ParsedUnitPtr ParseCache::find(std::string_view text) {
+   // insert() never stores such text; don't hash it on every continuation
+   // line of a long unit.
+   if (index_.empty() || text.size() > kMaxTextBytes) return nullptr;
+
+   const std::size_t h = std::hash<std::string_view>{}(text);
+   const auto it = index_.find(h);
+   if (it == index_.end() || it->second->text != text) return nullptr;
+
+   lru_.splice(lru_.begin(), lru_, it->second);
+   ++hits_;
+   return it->second->unit;
+}
+
+ParsedUnitPtr ParseCache::insert(std::string_view text, const ParseResult& pr) {
+   ++misses_;
+   if (capacity_ == 0 || text.size() > kMaxTextBytes) return nullptr;
+
+   // The AST is a few times larger than its source text.
+   auto unit = std::make_shared<const ParsedUnit>(pr, 4 * text.size() + 256);
+
+   const std::size_t h = std::hash<std::string_view>{}(text);
+   if (const auto it = index_.find(h); it != index_.end()) {
+      // Same text re-parsed, or a hash collision: the newer unit wins.
+      lru_.erase(it->second);
+      index_.erase(it);
+   } else if (lru_.size() >= capacity_) {
+      index_.erase(lru_.back().hash);
+      lru_.pop_back();
+      ++evictions_;
+   }
+
+   lru_.push_front(Entry{.hash = h, .text = std::string(text), .unit = unit});
+   index_.emplace(h, lru_.begin());
+   return unit;
+}
+
+ParseCache::Stats ParseCache::stats() const noexcept {
+   return Stats{.hits = hits_,
+                .misses = misses_,
+                .evictions = evictions_,
+                .entries = lru_.size(),
+                .capacity = capacity_};
+}
+
+void ParseCache::clear() noexcept {
+   lru_.clear();
+   index_.clear();
+}
+
+} // namespace clanker
@@ -0,0 +1,85 @@
+// src/clanker/parse_cache.h
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "clanker/parser.h"
+
+namespace clanker {
+
+// A Complete parse that owns its AST. Nodes and strings live in the unit's
+// own arena and are never modified after construction, so the same unit can
+// sit in the cache and be run by the Executor at the same time, shared by
+// pointer rather than copied.
+class ParsedUnit {
+ public:
+   // Deep-copies the AST of `pr` into the unit's arena. `size_hint` sizes
+   // the arena's first block.
+   ParsedUnit(const ParseResult& pr, std::size_t size_hint);
+
+   ParsedUnit(const ParsedUnit&) = delete;
+   ParsedUnit& operator=(const ParsedUnit&) = delete;
+
+   [[nodiscard]] const ParseResult& result() const noexcept { return result_; }
+
+ private:
+   std::pmr::monotonic_buffer_resource arena_;
+   ParseResult result_;
+};
+
+using ParsedUnitPtr = std::shared_ptr<const ParsedUnit>;
+
+// LRU cache of parsed units keyed by a hash of their exact source text.
+// Only Complete parses are stored; the text itself is kept to rule out hash
+// collisions.
+class ParseCache {
+ public:
+   static constexpr std::size_t kDefaultCapacity = 256;
+   // Larger units (big scripts run in one piece) are not worth keeping.
+   static constexpr std::size_t kMaxTextBytes = 64 * 1024;
+
+   struct Stats {
+      std::size_t hits{0};
+      std::size_t misses{0}; // units that had to be parsed
+      std::size_t evictions{0};
+      std::size_t entries{0};
+      std::size_t capacity{0};
+   };
+
+   explicit ParseCache(std::size_t capacity = kDefaultCapacity)
+      : capacity_(capacity) {}
+
+   // The cached unit for `text`, or null. Counts a hit when found; callers
+   // look up every partial buffer of a multi-line unit, so misses are
+   // counted by insert() instead.
+   [[nodiscard]] ParsedUnitPtr find(std::string_view text);
+
+   // Store a Complete parse of `text` and return the shared unit, or null
+   // when the text is too large to cache (run `pr` directly then).
+   ParsedUnitPtr insert(std::string_view text, const ParseResult& pr);
+
+   [[nodiscard]] Stats stats() const noexcept;
+   void clear() noexcept;
+
+ private:
+   struct Entry {
+      std::size_t hash;
+      std::string text;
+      ParsedUnitPtr unit;
+   };
+
+   std::size_t capacity_;
+   std::list<Entry> lru_; // most recently used first
+   std::unordered_map<std::size_t, std::list<Entry>::iterator> index_;
+   std::size_t hits_{0};
+   std::size_t misses_{0};
+   std::size_t evictions_{0};
+};
+
+} // namespace clanker
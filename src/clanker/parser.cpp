@@ -1,16 +1,21 @@
 // src/clanker/parser.cpp
+#include <algorithm>
 #include <cctype>
 #include <optional>
 #include <utility>
 
+#include "clanker/arith.h"
+#include "clanker/expr.h"
 #include "clanker/lexer.h"
 #include "clanker/parser.h"
+#include "clanker/vars.h"
 
 namespace clanker {
 
-static bool is_trailing_control_operator(const LexResult& lr) {
-   if (lr.tokens.size() < 2) return false;
-   const auto& last = lr.tokens[lr.tokens.size() - 2];
+static bool
+is_trailing_control_operator(const std::pmr::vector<Token>& tokens) {
+   if (tokens.size() < 2) return false;
+   const auto& last = tokens[tokens.size() - 2];
    return last.kind == TokenKind::Pipe || last.kind == TokenKind::AndIf ||
           last.kind == TokenKind::OrIf;
 }
@@ -19,7 +24,8 @@ static bool pipeline_is_empty(const Pipeline& pl) {
    if (pl.stages.empty()) return true;
 
    auto stage_empty = [](const SimpleCommand& st) {
-      return st.argv.empty() && st.redirs.empty();
+      return st.argv.empty() && st.redirs.empty() && st.assigns.empty() &&
+             st.compound.empty();
    };
 
    if (pl.stages.size() == 1 && stage_empty(pl.stages[0])) return true;
@@ -54,14 +60,20 @@ static const char* token_spelling(TokenKind k) noexcept {
       return "io-number";
    case TokenKind::Newline:
       return "newline";
+   case TokenKind::LBrace:
+      return "{";
+   case TokenKind::RBrace:
+      return "}";
    case TokenKind::End:
       return "<end>";
    }
    return "<unknown>";
 }
 
-static ParseResult parse_error(std::string msg) {
-   return {.kind = ParseKind::Error, .message = std::move(msg)};
+static ParseResult parse_error(std::string msg, std::size_t offset) {
+   return {.kind = ParseKind::Error,
+           .message = std::move(msg),
+           .error_offset = offset};
 }
 
 static Terminator token_to_terminator(TokenKind k) {
@@ -89,56 +101,226 @@ static AndOrOp token_to_andor_op(TokenKind k) {
    }
 }
 
-ParseResult Parser::parse(const std::string& input) const {
-   Lexer lx;
-   const LexResult lr = lx.lex(input);
-
-   switch (lr.kind) {
-   case LexKind::Incomplete:
-      return {.kind = ParseKind::Incomplete};
-   case LexKind::Error:
-      return {.kind = ParseKind::Error, .message = lr.message};
-   case LexKind::Complete:
-      break;
+namespace {
+
+// Token source for parse_from() over tokens already lexed into a vector
+// (ending in End), starting at index `first`. Like TokenStream, next() hands
+// out tokens in order and keeps returning End once they run out.
+class TokenVectorSource {
+ public:
+   TokenVectorSource(const std::pmr::vector<Token>& tokens,
+                     std::size_t first) noexcept
+      : tokens_(tokens)
+      , i_(first) {}
+
+   const Token& next() noexcept {
+      const Token& t = tokens_[i_];
+      if (i_ + 1 < tokens_.size()) ++i_;
+      return t;
    }
 
-   // Trailing control operators require more input.
-   // Trailing ';' / NEWLINE / '&' is complete (it terminates a list element).
-   if (is_trailing_control_operator(lr)) return {.kind = ParseKind::Incomplete};
+ private:
+   const std::pmr::vector<Token>& tokens_;
+   std::size_t i_;
+};
 
-   CommandList list;
+// Compound commands may nest this deep. The AST is walked recursively
+// (copies, script images, the compiler), so the depth is bounded here.
+constexpr std::size_t kMaxNesting = 256;
 
+// A command list under construction: the list so far, the pipeline being
+// filled and the and-or chain it will join.
+struct ListBuilder {
+   CommandList list;
    Pipeline current;
-   current.stages.push_back(SimpleCommand{});
+   AndOr andor;
+   bool has_andor_first{false};
+   std::optional<AndOrOp> pending_andor_op;
 
-   auto reset_current = [&] {
-      current = Pipeline{};
-      current.stages.push_back(SimpleCommand{});
+   explicit ListBuilder(const AstAllocator& a)
+      : list(a)
+      , current(a)
+      , andor(a) {
+      current.stages.emplace_back();
+   }
+};
+
+// Where an open compound command is: what it has read, and so which
+// reserved words may come next.
+enum class Clause {
+   IfCondition,   // then
+   IfBody,        // elif, else, fi
+   ElseBody,      // fi
+   LoopCondition, // do
+   LoopBody,      // done
+   GroupBody,     // }
+   FunctionBody,  // the compound command, then anything ending a command
+   CaseArm,       // ;; or esac
+};
+
+// A compound command whose closing word has not been read yet, with the
+// list it interrupted.
+struct OpenCompound {
+   ListBuilder outer;
+   CompoundCommand node;
+   Clause clause;
+};
+
+} // namespace
+
+// Everything the parser knows between two tokens. Parser::parse keeps it in
+// the ParseState when the input runs out, and the next call carries on from
+// there.
+struct ParseProgress {
+   explicit ParseProgress(const AstAllocator& a)
+      : lb(a) {}
+
+   ListBuilder lb;
+   std::vector<OpenCompound> open;
+   std::optional<int> pending_fd;
+
+   // Kind of the last token used: a trailing control operator needs more
+   // input, and the second ';' of a `;;` ends a `case` arm.
+   TokenKind prev_kind{TokenKind::End};
+
+   // Resume by reading the patterns of a `case` arm rather than a command.
+   bool in_case_patterns{false};
+
+   // Index of the first token the next call reads.
+   std::size_t next{0};
+
+   // Tokens before `next` that the lexer re-lexes when input is appended
+   // (the last lexeme could have grown). Resuming is only valid if they
+   // come out the same.
+   struct Seen {
+      std::size_t index{0};
+      Token token;
+      std::string text;
    };
+   std::vector<Seen> tentative;
+};
 
-   AndOr current_andor;
-   bool has_andor_first = false;
-   std::optional<AndOrOp> pending_andor_op;
+namespace {
+
+bool stage_is_empty(const SimpleCommand& st) {
+   return st.argv.empty() && st.redirs.empty() && st.assigns.empty() &&
+          st.compound.empty();
+}
+
+// Append WORD `t` to `sc.argv`; false with `err` set if an @( ) or $(( ))
+// in it does not compile. The only copy of the WORD's bytes: straight from
+// the token view.
+bool append_word(SimpleCommand& sc, const Token& t, std::string& err) {
+   const auto index = static_cast<std::uint32_t>(sc.argv.size());
+   if (t.brace) sc.brace_words.push_back(index);
+   if (t.glob) sc.glob_words.push_back(index);
+   if (t.subst) {
+      sc.subst_words.push_back(index);
+      if (!compile_word_exprs(t.text, sc.exprs, err) ||
+          !compile_word_arith(t.text, sc.ariths, err))
+         return false;
+   }
+   sc.argv.emplace_back(t.text);
+   return true;
+}
+
+bool is_keyword(const Token& t, std::string_view word) {
+   return t.kind == TokenKind::Word && t.bare && t.text == word;
+}
+
+// Append WORD `t` to `sc.argv` in pattern form, as `case` keeps its words,
+// with `text` standing for its text. Like append_word otherwise.
+bool append_pattern(SimpleCommand& sc, const Token& t, std::string_view text,
+                    std::string& err) {
+   if (!(t.brace || t.glob || t.subst)) {
+      sc.argv.push_back(pattern_escaped(text, sc.argv.get_allocator()
+                                                 .resource()));
+      return true;
+   }
+   if (t.subst) {
+      sc.subst_words.push_back(static_cast<std::uint32_t>(sc.argv.size()));
+      if (!compile_word_exprs(text, sc.exprs, err) ||
+          !compile_word_arith(text, sc.ariths, err))
+         return false;
+   }
+   sc.argv.emplace_back(text);
+   return true;
+}
+
+// Whether pattern `p` ends in a bare ')': one not escaped by an odd run of
+// backslashes.
+bool ends_in_bare_paren(std::string_view p) noexcept {
+   if (!p.ends_with(')')) return false;
+   std::size_t n = 0;
+   while (n + 1 < p.size() && p[p.size() - 2 - n] == '\\') ++n;
+   return n % 2 == 0;
+}
+
+// The parser proper. Needs one token of lookahead (the redirection target)
+// and holds no token after it has been turned into AST, so it runs in
+// constant token memory over a stream and stops at the first error.
+//
+// Compound commands do not recurse: opening one saves the list being built
+// on a stack and starts a new one, and its closing word puts it back with
+// the finished command as its current stage.
+//
+// Parsing starts from (and leaves off in) `st`. When the input ends before
+// the unit does the result is Incomplete and `st.next` is the token to
+// resume at: the End, or the start of a construct read with lookahead
+// (`for` and `case` headers, the patterns of a `case` arm), which is then
+// dropped from `st` and read again in full.
+template<class Source>
+ParseResult parse_from(Source& src, ParseProgress& st,
+                       std::pmr::memory_resource* mr) {
+   const AstAllocator alloc{mr};
+
+   ListBuilder& lb = st.lb;
+   std::vector<OpenCompound>& open = st.open;
+   std::optional<int>& pending_fd = st.pending_fd;
+   TokenKind& prev_kind = st.prev_kind;
+
+   // Tokens are counted as they are pulled, so that incomplete_at(k) can
+   // make the k-th one of this call (from 0) the first of the next.
+   const std::size_t first = st.next;
+   std::size_t pulled = 0;
+   auto pull = [&]() -> const Token& {
+      ++pulled;
+      return src.next();
+   };
+   auto incomplete_at = [&](std::size_t k) -> ParseResult {
+      st.next = first + k;
+      return {.kind = ParseKind::Incomplete};
+   };
+
+   auto reset_current = [&] {
+      lb.current = Pipeline{alloc};
+      lb.current.stages.emplace_back();
+   };
 
    auto reset_andor = [&] {
-      current_andor = AndOr{};
-      has_andor_first = false;
-      pending_andor_op.reset();
+      lb.andor = AndOr{alloc};
+      lb.has_andor_first = false;
+      lb.pending_andor_op.reset();
    };
 
+   // Offset of the token being parsed, for diagnostics raised while
+   // committing the pending pipeline, and its index among those pulled.
+   std::size_t here = 0;
+   std::size_t at = 0;
+
    auto validate_current_pipeline_complete = [&]() -> ParseResult {
-      if (pipeline_is_empty(current)) return {.kind = ParseKind::Complete};
+      if (pipeline_is_empty(lb.current)) return {.kind = ParseKind::Complete};
 
-      if (!current.stages.empty() && current.stages.back().argv.empty() &&
-          current.stages.back().redirs.empty()) {
-         return parse_error("syntax error: empty pipeline stage");
+      if (!lb.current.stages.empty() &&
+          stage_is_empty(lb.current.stages.back())) {
+         return parse_error("syntax error: empty pipeline stage", here);
       }
 
       return {.kind = ParseKind::Complete};
    };
 
    auto commit_current_pipeline_into_andor = [&]() -> ParseResult {
-      if (pipeline_is_empty(current)) {
+      if (pipeline_is_empty(lb.current)) {
          // Nothing to commit.
          reset_current();
          return {.kind = ParseKind::Complete};
@@ -147,23 +329,24 @@ ParseResult Parser::parse(const std::string& input) const {
       const ParseResult v = validate_current_pipeline_complete();
       if (v.kind == ParseKind::Error) return v;
 
-      Pipeline pl = std::move(current);
+      Pipeline pl = std::move(lb.current);
       reset_current();
 
-      if (!has_andor_first) {
-         current_andor.first = std::move(pl);
-         has_andor_first = true;
+      if (!lb.has_andor_first) {
+         lb.andor.first = std::move(pl);
+         lb.has_andor_first = true;
          return {.kind = ParseKind::Complete};
       }
 
-      if (!pending_andor_op.has_value()) {
+      if (!lb.pending_andor_op.has_value()) {
          return parse_error(
-            "syntax error: missing '&&' or '||' between pipelines");
+            "syntax error: missing '&&' or '||' between pipelines", here);
       }
 
-      current_andor.rest.push_back(
-         AndOrTail{.op = *pending_andor_op, .rhs = std::move(pl)});
-      pending_andor_op.reset();
+      AndOrTail& tail = lb.andor.rest.emplace_back();
+      tail.op = *lb.pending_andor_op;
+      tail.rhs = std::move(pl);
+      lb.pending_andor_op.reset();
       return {.kind = ParseKind::Complete};
    };
 
@@ -172,38 +355,427 @@ ParseResult Parser::parse(const std::string& input) const {
       const ParseResult c = commit_current_pipeline_into_andor();
       if (c.kind == ParseKind::Error) return c;
 
-      if (pending_andor_op.has_value()) {
-         return parse_error("syntax error: trailing control operator");
+      if (lb.pending_andor_op.has_value()) {
+         return parse_error("syntax error: trailing control operator", here);
       }
 
-      if (!has_andor_first) {
+      if (!lb.has_andor_first) {
          // Nothing to flush; this is just a trailing terminator.
-         list.trailing = term;
+         lb.list.trailing = term;
          return {.kind = ParseKind::Complete};
       }
 
-      list.items.push_back(
-         CommandListItem{.cmd = std::move(current_andor), .term = term});
+      CommandListItem& item = lb.list.items.emplace_back();
+      item.cmd = std::move(lb.andor);
+      item.term = term;
       reset_andor();
-      list.trailing.reset();
+      lb.list.trailing.reset();
       return {.kind = ParseKind::Complete};
    };
 
-   std::optional<int> pending_fd;
+   // Start compound command `kind` at reserved word `t`: the list being
+   // built waits on the stack while its parts are parsed.
+   auto open_compound = [&](CompoundKind kind, Clause clause,
+                            const Token& t) -> ParseResult {
+      if (open.size() >= kMaxNesting)
+         return parse_error(
+            "syntax error: compound commands nested too deeply", t.offset);
+      OpenCompound& oc = open.emplace_back(
+         OpenCompound{.outer = std::move(lb),
+                      .node = CompoundCommand{alloc},
+                      .clause = clause});
+      oc.node.kind = kind;
+      lb = ListBuilder{alloc};
+      return {.kind = ParseKind::Complete};
+   };
+
+   // Reserved word `t` ends the list of the innermost compound command's
+   // current part; the list must not be empty.
+   auto end_part = [&](const Token& t) -> ParseResult {
+      const ParseResult f = flush_andor_to_list(Terminator::None);
+      if (f.kind == ParseKind::Error) return f;
+      if (lb.list.items.empty())
+         return parse_error("syntax error: unexpected '" +
+                               std::string{t.text} + "'",
+                            t.offset);
+      lb.list.trailing.reset();
+      open.back().node.lists.push_back(std::move(lb.list));
+      lb = ListBuilder{alloc};
+      return {.kind = ParseKind::Complete};
+   };
+
+   // The input ended in the header of the command just opened: put back
+   // the list it interrupted, as if its first word had not been read.
+   auto cancel_compound = [&] {
+      lb = std::move(open.back().outer);
+      open.pop_back();
+   };
+
+   // The closing word has been read: the command takes its place as the
+   // current stage of the list it interrupted.
+   auto close_compound = [&] {
+      CompoundCommand node = std::move(open.back().node);
+      lb = std::move(open.back().outer);
+      open.pop_back();
+      lb.current.stages.back().compound.push_back(std::move(node));
+   };
+
+   // `NAME()` has been read: the compound command that follows is the
+   // body.
+   auto open_function = [&](std::string name, const Token& t) -> ParseResult {
+      const ParseResult o =
+         open_compound(CompoundKind::Function, Clause::FunctionBody, t);
+      if (o.kind == ParseKind::Complete) open.back().node.name = name;
+      return o;
+   };
+
+   // Nothing but the body may follow `NAME()`.
+   auto in_function_header = [&] {
+      return !open.empty() && open.back().clause == Clause::FunctionBody &&
+             lb.list.items.empty() && !lb.has_andor_first &&
+             lb.current.stages.size() == 1 &&
+             stage_is_empty(lb.current.stages.back());
+   };
+
+   // `for NAME [in WORD...] ; do`, up to and including `do`. Incomplete if
+   // the input ends first.
+   auto parse_for_header = [&](const Token& t) -> ParseResult {
+      const std::size_t start = at;
+      auto incomplete = [&] {
+         cancel_compound();
+         return incomplete_at(start);
+      };
+      const ParseResult o =
+         open_compound(CompoundKind::For, Clause::LoopBody, t);
+      if (o.kind != ParseKind::Complete) return o;
+      CompoundCommand& node = open.back().node;
+
+      Token n = pull();
+      if (n.kind == TokenKind::End) return incomplete();
+      if (n.kind != TokenKind::Word || !n.bare || !VarStore::is_name(n.text))
+         return parse_error("syntax error: expected a name after 'for'",
+                            n.offset);
+      node.name = n.text;
+
+      n = pull();
+      while (n.kind == TokenKind::Newline) n = pull();
+      if (is_keyword(n, "in")) {
+         for (n = pull(); n.kind == TokenKind::Word; n = pull()) {
+            std::string err;
+            if (!append_word(node.words, n, err))
+               return parse_error("syntax error: " + err, n.offset);
+         }
+         if (n.kind == TokenKind::End) return incomplete();
+         if (n.kind != TokenKind::Semicolon && n.kind != TokenKind::Newline)
+            return parse_error(std::string("syntax error: unexpected '") +
+                                  token_spelling(n.kind) + "' in 'for'",
+                               n.offset);
+         n = pull();
+      } else {
+         node.in_words = false;
+         if (n.kind == TokenKind::Semicolon) n = pull();
+      }
+      while (n.kind == TokenKind::Newline) n = pull();
+      if (n.kind == TokenKind::End) return incomplete();
+      if (!is_keyword(n, "do"))
+         return parse_error("syntax error: expected 'do' in 'for'", n.offset);
+      return {.kind = ParseKind::Complete};
+   };
+
+   // The patterns of the next `case` arm, up to and including their ')',
+   // or the `esac` that closes the command. Incomplete if the input ends
+   // first; the patterns read so far are dropped, and the next call starts
+   // by reading them again.
+   auto parse_case_patterns = [&]() -> ParseResult {
+      CompoundCommand& node = open.back().node;
+      SimpleCommand& words = node.words;
+      const auto arm = static_cast<std::uint32_t>(node.lists.size());
+      const std::size_t start = pulled;
+      const std::size_t n_argv = words.argv.size();
+      const std::size_t n_subst = words.subst_words.size();
+      const std::size_t n_exprs = words.exprs.size();
+      const std::size_t n_ariths = words.ariths.size();
+      const std::size_t n_arms = node.arms.size();
+      auto incomplete = [&] {
+         auto truncate = [](auto& v, std::size_t n) {
+            v.erase(v.begin() + static_cast<std::ptrdiff_t>(n), v.end());
+         };
+         truncate(words.argv, n_argv);
+         truncate(words.subst_words, n_subst);
+         truncate(words.exprs, n_exprs);
+         truncate(words.ariths, n_ariths);
+         truncate(node.arms, n_arms);
+         st.in_case_patterns = true;
+         return incomplete_at(start);
+      };
+      Token n = pull();
+      while (n.kind == TokenKind::Newline) n = pull();
+      if (n.kind == TokenKind::End) return incomplete();
+      if (is_keyword(n, "esac")) {
+         close_compound();
+         return {.kind = ParseKind::Complete};
+      }
+      // PATTERN {'|' PATTERN} ')', with an optional '(' first.
+      const std::size_t first = node.words.argv.size();
+      for (bool want = true;; n = pull()) {
+         if (n.kind == TokenKind::End) return incomplete();
+         if (!want) {
+            // After a pattern: '|' and another, or the ')'.
+            if (n.kind == TokenKind::Pipe) {
+               want = true;
+               continue;
+            }
+            if (is_keyword(n, ")")) break;
+            return parse_error("syntax error: expected ')' in 'case'",
+                               n.offset);
+         }
+         if (n.kind != TokenKind::Word)
+            return parse_error("syntax error: expected a pattern in 'case'",
+                               n.offset);
+         const bool pattern = n.brace || n.glob || n.subst;
+         std::string_view text = n.text;
+         if (node.words.argv.size() == first && text.starts_with('('))
+            text.remove_prefix(1);
+         const bool closed =
+            pattern ? ends_in_bare_paren(text) : text.ends_with(')');
+         if (closed) text.remove_suffix(1);
+         // A "(" or ")" alone only delimits.
+         if (!text.empty()) {
+            std::string err;
+            if (!append_pattern(node.words, n, text, err))
+               return parse_error("syntax error: " + err, n.offset);
+            node.arms.push_back(arm);
+            want = false;
+         }
+         if (closed) {
+            if (want)
+               return parse_error(
+                  "syntax error: expected a pattern in 'case'", n.offset);
+            break;
+         }
+      }
+      open.back().clause = Clause::CaseArm;
+      return {.kind = ParseKind::Complete};
+   };
+
+   // `case WORD in`, then the first arm's patterns.
+   auto parse_case_header = [&](const Token& t) -> ParseResult {
+      const std::size_t start = at;
+      auto incomplete = [&] {
+         cancel_compound();
+         return incomplete_at(start);
+      };
+      const ParseResult o =
+         open_compound(CompoundKind::Case, Clause::CaseArm, t);
+      if (o.kind != ParseKind::Complete) return o;
+      Token n = pull();
+      if (n.kind == TokenKind::End) return incomplete();
+      if (n.kind != TokenKind::Word)
+         return parse_error("syntax error: expected a word after 'case'",
+                            n.offset);
+      std::string err;
+      if (!append_pattern(open.back().node.words, n, n.text, err))
+         return parse_error("syntax error: " + err, n.offset);
+      n = pull();
+      while (n.kind == TokenKind::Newline) n = pull();
+      if (n.kind == TokenKind::End) return incomplete();
+      if (!is_keyword(n, "in"))
+         return parse_error("syntax error: expected 'in' in 'case'",
+                            n.offset);
+      return parse_case_patterns();
+   };
+
+   // `;;` or `esac` ends the arm being read; its body may be empty.
+   auto end_case_arm = [&]() -> ParseResult {
+      const ParseResult f = flush_andor_to_list(Terminator::None);
+      if (f.kind == ParseKind::Error) return f;
+      lb.list.trailing.reset();
+      open.back().node.lists.push_back(std::move(lb.list));
+      lb = ListBuilder{alloc};
+      return {.kind = ParseKind::Complete};
+   };
+
+   // A bare WORD at the start of a command: a reserved word opens, splits
+   // or closes a compound command. Sets `handled` if it was one.
+   auto reserved_word = [&](const Token& t, bool& handled) -> ParseResult {
+      handled = true;
+      const std::string_view w = t.text;
+      if (w == "if")
+         return open_compound(CompoundKind::If, Clause::IfCondition, t);
+      if (w == "while")
+         return open_compound(CompoundKind::While, Clause::LoopCondition, t);
+      if (w == "until")
+         return open_compound(CompoundKind::Until, Clause::LoopCondition, t);
+      if (w == "for") return parse_for_header(t);
+      if (w == "case") return parse_case_header(t);
+      if (w == "esac") {
+         if (open.empty() || open.back().clause != Clause::CaseArm)
+            return parse_error("syntax error: unexpected 'esac'", t.offset);
+         const ParseResult e = end_case_arm();
+         if (e.kind == ParseKind::Complete) close_compound();
+         return e;
+      }
+      if (w.size() > 2 && w.ends_with("()") &&
+          VarStore::is_name(w.substr(0, w.size() - 2)))
+         return open_function(std::string{w.substr(0, w.size() - 2)}, t);
+
+      struct Step {
+         std::string_view word;
+         Clause from;
+         std::optional<Clause> to; // none: the command is complete
+      };
+      static constexpr Step kSteps[] = {
+         {"then", Clause::IfCondition, Clause::IfBody},
+         {"elif", Clause::IfBody, Clause::IfCondition},
+         {"else", Clause::IfBody, Clause::ElseBody},
+         {"fi", Clause::IfBody, std::nullopt},
+         {"fi", Clause::ElseBody, std::nullopt},
+         {"do", Clause::LoopCondition, Clause::LoopBody},
+         {"done", Clause::LoopBody, std::nullopt},
+      };
+      bool reserved = false;
+      for (const Step& s : kSteps) {
+         if (s.word != w) continue;
+         reserved = true;
+         if (open.empty() || open.back().clause != s.from) continue;
+         const ParseResult e = end_part(t);
+         if (e.kind != ParseKind::Complete) return e;
+         if (s.to)
+            open.back().clause = *s.to;
+         else
+            close_compound();
+         return {.kind = ParseKind::Complete};
+      }
+      if (reserved)
+         return parse_error("syntax error: unexpected '" + std::string{w} +
+                               "'",
+                            t.offset);
+      handled = false;
+      return {.kind = ParseKind::Complete};
+   };
+
+   // Resuming inside a `case`: the next arm's patterns come first.
+   if (st.in_case_patterns) {
+      st.in_case_patterns = false;
+      const ParseResult r = parse_case_patterns();
+      if (r.kind != ParseKind::Complete) return r;
+      prev_kind = TokenKind::Newline;
+   }
+
+   for (bool at_end = false; !at_end;) {
+      // A copy: pulling the next token may recycle the current one.
+      Token t = pull();
+      here = t.offset;
+      at = pulled - 1;
+
+      // A function's body is complete once the command around it ends. At
+      // the end of input that is only decided when it completes the unit:
+      // otherwise the result is Incomplete, and the next call sees the
+      // token that really follows.
+      if (!open.empty() && open.back().clause == Clause::FunctionBody &&
+          !lb.current.stages.back().compound.empty() &&
+          (t.kind != TokenKind::End || open.size() == 1) &&
+          t.kind != TokenKind::Word && t.kind != TokenKind::LBrace &&
+          t.kind != TokenKind::RBrace && t.kind != TokenKind::IoNumber &&
+          t.kind != TokenKind::RedirectIn && t.kind != TokenKind::RedirectOut &&
+          t.kind != TokenKind::RedirectAppend) {
+         const ParseResult e = end_part(t);
+         if (e.kind != ParseKind::Complete) return e;
+         close_compound();
+      }
 
-   for (std::size_t i = 0; i < lr.tokens.size(); ++i) {
-      const Token& t = lr.tokens[i];
+      // A brace that cannot open or close a group here is an ordinary word.
+      if (t.kind == TokenKind::LBrace || t.kind == TokenKind::RBrace) {
+         const bool command_start =
+            stage_is_empty(lb.current.stages.back()) && !pending_fd;
+         const bool closes = !open.empty() &&
+                             open.back().clause == Clause::GroupBody;
+         if (!command_start || (t.kind == TokenKind::RBrace && !closes))
+            t.kind = TokenKind::Word;
+      }
 
       switch (t.kind) {
-      case TokenKind::Word:
-         current.stages.back().argv.push_back(t.text);
+      case TokenKind::LBrace: {
+         const ParseResult o =
+            open_compound(CompoundKind::Group, Clause::GroupBody, t);
+         if (o.kind != ParseKind::Complete) return o;
+         break;
+      }
+
+      case TokenKind::RBrace: {
+         const ParseResult e = end_part(t);
+         if (e.kind != ParseKind::Complete) return e;
+         close_compound();
+         break;
+      }
+
+      case TokenKind::Word: {
+         SimpleCommand& sc = lb.current.stages.back();
+         // `(( expression ))`, compiled now like any $(( )).
+         if (t.subst && stage_is_empty(sc) && !pending_fd) {
+            if (const auto body = arith_command_body(t.text)) {
+               CompoundCommand node{alloc};
+               node.kind = CompoundKind::Arith;
+               node.name = pattern_literal(*body, mr);
+               ArithCompileResult r = compile_arith(node.name);
+               if (!r.program)
+                  return parse_error("syntax error: ((" +
+                                        std::string{node.name} +
+                                        ")): " + r.message,
+                                     t.offset);
+               node.words.ariths.push_back(std::move(r.program));
+               sc.compound.push_back(std::move(node));
+               break;
+            }
+         }
+         if (t.bare && stage_is_empty(sc) && !pending_fd) {
+            bool handled = false;
+            const ParseResult r = reserved_word(t, handled);
+            if (r.kind != ParseKind::Complete) return r;
+            if (handled) break;
+         }
+         if (in_function_header())
+            return parse_error(
+               "syntax error: a function body must be a compound command",
+               t.offset);
+         // `NAME ()`, the POSIX spelling with a blank.
+         if (t.bare && t.text == "()" && !pending_fd &&
+             lb.current.stages.size() == 1 && sc.argv.size() == 1 &&
+             sc.assigns.empty() && sc.redirs.empty() &&
+             sc.brace_words.empty() && sc.glob_words.empty() &&
+             sc.subst_words.empty() && VarStore::is_name(sc.argv.front())) {
+            std::string name{sc.argv.front()};
+            sc.argv.clear();
+            const ParseResult o = open_function(std::move(name), t);
+            if (o.kind != ParseKind::Complete) return o;
+            break;
+         }
+         if (!sc.compound.empty())
+            return parse_error("syntax error: unexpected word '" +
+                                  std::string{t.text} +
+                                  "' after compound command",
+                               t.offset);
+         std::string err;
+         if (t.assign && sc.argv.empty()) {
+            if (t.brace || t.glob || t.subst)
+               sc.assigns.emplace_back(t.text);
+            else
+               sc.assigns.push_back(pattern_escaped(t.text, mr));
+            if (t.subst && (!compile_word_exprs(t.text, sc.exprs, err) ||
+                            !compile_word_arith(t.text, sc.ariths, err)))
+               return parse_error("syntax error: " + err, t.offset);
+            break;
+         }
+         if (!append_word(sc, t, err))
+            return parse_error("syntax error: " + err, t.offset);
          break;
+      }
 
       case TokenKind::IoNumber: {
          int fd = 0;
          for (char ch : t.text) {
             if (!std::isdigit(static_cast<unsigned char>(ch)))
-               return parse_error("syntax error: invalid io-number");
+               return parse_error("syntax error: invalid io-number", t.offset);
             fd = fd * 10 + (ch - '0');
          }
          pending_fd = fd;
@@ -213,12 +785,10 @@ ParseResult Parser::parse(const std::string& input) const {
       case TokenKind::RedirectIn:
       case TokenKind::RedirectOut:
       case TokenKind::RedirectAppend: {
-         if (i + 1 >= lr.tokens.size())
-            return parse_error("syntax error: expected redirection target");
-
-         const Token& target = lr.tokens[i + 1];
+         const Token& target = pull();
          if (target.kind != TokenKind::Word)
-            return parse_error("syntax error: expected redirection target");
+            return parse_error("syntax error: expected redirection target",
+                               t.offset);
 
          const int fd =
             pending_fd.value_or((t.kind == TokenKind::RedirectIn) ? 0 : 1);
@@ -232,39 +802,47 @@ ParseResult Parser::parse(const std::string& input) const {
          else
             rk = RedirKind::OutAppend;
 
-         current.stages.back().redirs.push_back(
-            Redirection{.fd = fd, .kind = rk, .target = target.text});
-
-         ++i; // consume target
+         Redirection& r = lb.current.stages.back().redirs.emplace_back();
+         r.fd = fd;
+         r.kind = rk;
+         // Expansion does not apply to redirection targets.
+         if (target.brace || target.glob || target.subst)
+            r.target = pattern_literal(target.text, mr);
+         else
+            r.target = target.text;
          break;
       }
 
       case TokenKind::Pipe:
          if (pending_fd.has_value())
-            return parse_error("syntax error: io-number without redirection");
-         if (current.stages.back().argv.empty() &&
-             current.stages.back().redirs.empty()) {
-            return parse_error("syntax error: empty pipeline stage before '|'");
+            return parse_error("syntax error: io-number without redirection",
+                               t.offset);
+         if (stage_is_empty(lb.current.stages.back())) {
+            return parse_error("syntax error: empty pipeline stage before '|'",
+                               t.offset);
          }
-         current.stages.push_back(SimpleCommand{});
+         lb.current.stages.emplace_back();
          break;
 
       case TokenKind::AndIf:
       case TokenKind::OrIf: {
          if (pending_fd.has_value())
-            return parse_error("syntax error: io-number without redirection");
+            return parse_error("syntax error: io-number without redirection",
+                               t.offset);
          const ParseResult c = commit_current_pipeline_into_andor();
          if (c.kind == ParseKind::Error) return c;
 
-         if (!has_andor_first) {
+         if (!lb.has_andor_first) {
             return parse_error(std::string("syntax error: operator '") +
-                               token_spelling(t.kind) +
-                               "' without left operand");
+                                  token_spelling(t.kind) +
+                                  "' without left operand",
+                               t.offset);
          }
-         if (pending_andor_op.has_value())
-            return parse_error("syntax error: consecutive control operators");
+         if (lb.pending_andor_op.has_value())
+            return parse_error("syntax error: consecutive control operators",
+                               t.offset);
 
-         pending_andor_op = token_to_andor_op(t.kind);
+         lb.pending_andor_op = token_to_andor_op(t.kind);
          break;
       }
 
@@ -272,7 +850,19 @@ ParseResult Parser::parse(const std::string& input) const {
       case TokenKind::Newline:
       case TokenKind::Ampersand: {
          if (pending_fd.has_value())
-            return parse_error("syntax error: io-number without redirection");
+            return parse_error("syntax error: io-number without redirection",
+                               t.offset);
+         // The second ';' of a `;;` ends a `case` arm.
+         if (t.kind == TokenKind::Semicolon &&
+             prev_kind == TokenKind::Semicolon && !open.empty() &&
+             open.back().clause == Clause::CaseArm) {
+            ParseResult r = end_case_arm();
+            if (r.kind == ParseKind::Complete) r = parse_case_patterns();
+            if (r.kind != ParseKind::Complete) return r;
+            // The `;;` is used up: a ';' after the patterns is a new one.
+            prev_kind = TokenKind::Newline;
+            continue;
+         }
          const Terminator term = token_to_terminator(t.kind);
          const ParseResult f = flush_andor_to_list(term);
          if (f.kind == ParseKind::Error) return f;
@@ -280,10 +870,18 @@ ParseResult Parser::parse(const std::string& input) const {
       }
 
       case TokenKind::End:
+         if (prev_kind == TokenKind::Pipe || prev_kind == TokenKind::AndIf ||
+             prev_kind == TokenKind::OrIf)
+            return incomplete_at(at);
          if (pending_fd.has_value())
-            return parse_error("syntax error: io-number without redirection");
+            return parse_error("syntax error: io-number without redirection",
+                               t.offset);
+         // An open compound command needs its closing word.
+         if (!open.empty()) return incomplete_at(at);
+         at_end = true;
          break;
       }
+      prev_kind = t.kind;
    }
 
    // Final flush at EOF (no terminator).
@@ -292,6 +890,8 @@ ParseResult Parser::parse(const std::string& input) const {
       if (f.kind == ParseKind::Error) return f;
    }
 
+   CommandList& list = lb.list;
+
    // Empty input (or comment-only): keep legacy behavior.
    if (list.items.empty()) {
       return {.kind = ParseKind::Complete, .pipeline = Pipeline{}};
@@ -308,5 +908,113 @@ ParseResult Parser::parse(const std::string& input) const {
    return {.kind = ParseKind::Complete, .list = std::move(list)};
 }
 
-} // namespace clanker
+// Whether parsing can resume at `st.next` over `tokens`: the tokens it has
+// used are the same as last time.
+bool resumable(const ParseProgress& st, const std::pmr::vector<Token>& tokens) {
+   if (st.next >= tokens.size()) return false;
+   for (const ParseProgress::Seen& seen : st.tentative) {
+      const Token& a = seen.token;
+      const Token& b = tokens[seen.index];
+      if (a.kind != b.kind || a.offset != b.offset || a.brace != b.brace ||
+          a.glob != b.glob || a.subst != b.subst || a.assign != b.assign ||
+          a.bare != b.bare || seen.text != b.text)
+         return false;
+   }
+   return true;
+}
+
+} // namespace
+
+ParseState::ParseState(std::pmr::memory_resource* mr)
+   : lex(mr) {}
+
+ParseState::~ParseState() = default;
+
+void ParseState::reset() {
+   progress_.reset();
+   lex.reset();
+}
+
+ParseResult Parser::parse(const std::string& input,
+                          std::pmr::memory_resource* mr) const {
+   TokenStream ts{input, mr};
+   ParseProgress st{AstAllocator{mr}};
+   ParseResult pr = parse_from(ts, st, mr);
+
+   // The lexer cut the stream short, and the parser got that far without
+   // an error of its own: whatever it made of the early End, the lexer's
+   // verdict stands.
+   switch (ts.status()) {
+   case LexKind::Complete:
+      return pr;
+   case LexKind::Incomplete:
+      return {.kind = ParseKind::Incomplete};
+   case LexKind::Error:
+      break;
+   }
+   return {.kind = ParseKind::Error,
+           .message = ts.message(),
+           .error_offset = ts.error_offset()};
+}
 
+ParseResult Parser::parse(std::string_view input, ParseState& state) const {
+   const Lexer lx;
+   LexResult lr = lx.lex(input, state.lex);
+
+   // The appended text changed a token the previous Incomplete parse used
+   // (it extended the last word). Those before it are gone, so the unit
+   // starts over.
+   if (lr.kind == LexKind::Complete && state.progress_ &&
+       !resumable(*state.progress_, state.lex.tokens)) {
+      state.reset();
+      lr = lx.lex(input, state.lex);
+   }
+
+   switch (lr.kind) {
+   case LexKind::Incomplete:
+      return {.kind = ParseKind::Incomplete};
+   case LexKind::Error:
+      return {.kind = ParseKind::Error,
+              .message = lr.message,
+              .error_offset = lr.error_offset};
+   case LexKind::Complete:
+      break;
+   }
+
+   const std::pmr::vector<Token>& tokens = state.lex.tokens;
+
+   // Trailing control operators require more input. With every token at
+   // hand this is checked before any syntax error, so a line ending in an
+   // operator always asks for a continuation.
+   if (is_trailing_control_operator(tokens))
+      return {.kind = ParseKind::Incomplete};
+
+   // Carry on from the previous Incomplete parse, if any.
+   std::optional<ParseProgress> fresh;
+   ParseProgress& st = state.progress_
+                          ? *state.progress_
+                          : fresh.emplace(AstAllocator{state.resource()});
+
+   TokenVectorSource src{tokens, st.next};
+   ParseResult pr = parse_from(src, st, state.resource());
+   if (pr.kind != ParseKind::Incomplete) return pr;
+
+   // The tokens before the resume point are in the AST now: drop them, so
+   // only those still to be parsed are held however long the unit gets.
+   const std::size_t used = std::min(st.next, state.lex.resume_tokens);
+   state.lex.drop_tokens(used);
+   st.next -= used;
+
+   st.tentative.clear();
+   for (std::size_t i = state.lex.resume_tokens; i < st.next; ++i) {
+      Token t = tokens[i];
+      t.text = {}; // compared through `text`, which outlives the buffer
+      st.tentative.push_back(
+         {.index = i, .token = t, .text = std::string{tokens[i].text}});
+   }
+   if (!state.progress_)
+      state.progress_ = std::make_unique<ParseProgress>(std::move(st));
+   return pr;
+}
+
+} // namespace clanker
@@ -1,9 +1,15 @@
 // src/clanker/parser.h
 #pragma once
 
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "clanker/ast.h"
+#include "clanker/lexer.h"
 
 namespace clanker {
 
@@ -14,10 +20,11 @@ struct ParseResult {
 
    // Backwards-compatible: legacy callers can keep reading `pipeline`.
    // When parsing a list, `list` is populated and `pipeline` can be ignored.
-   Pipeline pipeline; // valid when Complete and result_is_pipeline()
-   CommandList list;  // valid when Complete and result_is_list()
+   Pipeline pipeline{}; // valid when Complete and result_is_pipeline()
+   CommandList list{};  // valid when Complete and result_is_list()
 
-   std::string message; // valid when Error
+   std::string message{};       // valid when Error
+   std::size_t error_offset{0}; // byte offset into the input, when Error
 
    [[nodiscard]] bool result_is_pipeline() const noexcept {
       return kind == ParseKind::Complete && list.items.empty();
@@ -28,9 +35,64 @@ struct ParseResult {
    }
 };
 
+// How far an Incomplete parse got (parser.cpp).
+struct ParseProgress;
+
+// Continuation state for Parser::parse(std::string_view, ParseState&): the
+// lexer's state, and the parser's when the last call was Incomplete. Each
+// call then lexes only the appended bytes and parses only the tokens the
+// previous call had not used, so a unit of N lines costs O(N) in time and
+// memory rather than a full re-parse per line. Used tokens are dropped: as
+// with a TokenStream, only the tokens not yet parsed are held.
+//
+// Everything is allocated from the memory resource the state was
+// constructed with (typically a per-unit arena).
+class ParseState {
+ public:
+   explicit ParseState(
+      std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+   ~ParseState();
+
+   ParseState(const ParseState&) = delete;
+   ParseState& operator=(const ParseState&) = delete;
+
+   LexState lex;
+
+   [[nodiscard]] std::pmr::memory_resource* resource() const noexcept {
+      return lex.resource();
+   }
+
+   // Start a new unit. Keeps the memory resource; releases everything else
+   // back to it, so an arena can be released right after.
+   void reset();
+
+ private:
+   friend class Parser;
+
+   // Null until a parse is Incomplete: a unit parsed in one call never
+   // allocates it.
+   std::unique_ptr<ParseProgress> progress_;
+};
+
 class Parser {
  public:
-   [[nodiscard]] ParseResult parse(const std::string& input) const;
+   // One-shot parse of a complete input. Tokens are pulled from a
+   // TokenStream as the parser needs them, so token memory does not grow
+   // with the input and parsing stops at the first error without lexing the
+   // rest. The AST (nodes and argv strings) is allocated from `mr`; it must
+   // outlive the returned ParseResult.
+   [[nodiscard]] ParseResult
+   parse(const std::string& input,
+         std::pmr::memory_resource* mr = std::pmr::get_default_resource()) const;
+
+   // Incremental form for continuation input (REPL, batch scripts). `input`
+   // must extend the text passed on the previous call with this `state`;
+   // only the appended bytes are lexed, and parsing resumes where the
+   // previous Incomplete result stopped. Reset the state after a Complete or
+   // Error result before starting the next unit. The AST is allocated from
+   // the state's memory resource.
+   [[nodiscard]] ParseResult parse(std::string_view input,
+                                   ParseState& state) const;
 };
 
 } // namespace clanker
@@ -1,6 +1,8 @@
 // src/clanker/process.cpp
 #include <cerrno>
+#include <cstdlib>
 #include <spawn.h>
+#include <string_view>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <vector>
@@ -19,7 +21,7 @@ int status_to_exit_code(int status) {
    return 1;
 }
 
-std::vector<char*> to_cargv(const std::vector<std::string>& argv) {
+std::vector<char*> to_cargv(std::span<const std::pmr::string> argv) {
    std::vector<char*> out;
    out.reserve(argv.size() + 1);
    for (const auto& s : argv) out.push_back(const_cast<char*>(s.c_str()));
@@ -27,13 +29,47 @@ std::vector<char*> to_cargv(const std::vector<std::string>& argv) {
    return out;
 }
 
+// The value of PATH in `envp`, or null if it has none.
+const char* find_path(char* const* envp) {
+   for (; *envp != nullptr; ++envp)
+      if (std::string_view{*envp}.starts_with("PATH=")) return *envp + 5;
+   return nullptr;
+}
+
 } // namespace
 
-int spawn_external(const std::vector<std::string>& argv, int stdin_fd,
+std::string search_path(std::string_view name, std::string_view path) {
+   std::string candidate;
+   while (true) {
+      const std::size_t colon = path.find(':');
+      const std::string_view dir = path.substr(0, colon);
+      candidate.assign(dir.empty() ? "." : dir);
+      candidate.push_back('/');
+      candidate += name;
+      if (::access(candidate.c_str(), X_OK) == 0) return candidate;
+      if (colon == std::string_view::npos) return {};
+      path.remove_prefix(colon + 1);
+   }
+}
+
+int spawn_external(std::span<const std::pmr::string> argv, int stdin_fd,
                    int stdout_fd, int stderr_fd,
-                   const std::vector<int>& close_fds) {
+                   const std::vector<int>& close_fds, char* const* envp) {
    if (argv.empty()) return -EINVAL;
 
+   // posix_spawnp() searches the shell's PATH; a changed one is searched
+   // here instead.
+   std::string resolved;
+   if (envp != nullptr && argv[0].find('/') == std::string::npos) {
+      const char* path = find_path(envp);
+      const char* own = std::getenv("PATH");
+      if (path != nullptr &&
+          (own == nullptr || std::string_view{path} != own)) {
+         resolved = search_path(argv[0], path);
+         if (resolved.empty()) return -ENOENT;
+      }
+   }
+
    posix_spawn_file_actions_t actions;
    posix_spawn_file_actions_init(&actions);
 
@@ -62,8 +98,12 @@ int spawn_external(const std::vector<std::string>& argv, int stdin_fd,
    auto cargv = to_cargv(argv);
 
    pid_t pid{};
+   char* const* env = envp != nullptr ? envp : environ;
    const int rc =
-      posix_spawnp(&pid, cargv[0], &actions, nullptr, cargv.data(), environ);
+      resolved.empty()
+         ? posix_spawnp(&pid, cargv[0], &actions, nullptr, cargv.data(), env)
+         : posix_spawn(&pid, resolved.c_str(), &actions, nullptr, cargv.data(),
+                       env);
 
    posix_spawn_file_actions_destroy(&actions);
 
@@ -75,7 +115,8 @@ int spawn_external(const std::vector<std::string>& argv, int stdin_fd,
    return static_cast<int>(pid);
 }
 
-int run_external_pipeline(const std::vector<std::vector<std::string>>& stages) {
+int run_external_pipeline(
+   const std::vector<std::pmr::vector<std::pmr::string>>& stages) {
    if (stages.empty()) return 0;
 
    const std::size_t n = stages.size();
@@ -1,7 +1,10 @@
 // src/clanker/process.h
 #pragma once
 
+#include <memory_resource>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace clanker {
@@ -10,13 +13,20 @@ namespace clanker {
 // Use -1 to mean "inherit".
 // close_fds are forcibly closed in the child before exec (critical for
 // pipelines).
-int spawn_external(const std::vector<std::string>& argv, int stdin_fd,
+// `envp` is the program's environment (null: the shell's own); its PATH is
+// the one searched.
+int spawn_external(std::span<const std::pmr::string> argv, int stdin_fd,
                    int stdout_fd, int stderr_fd,
-                   const std::vector<int>& close_fds);
+                   const std::vector<int>& close_fds,
+                   char* const* envp = nullptr);
+
+// `name` searched in `path` as execvp() would; empty if not found.
+std::string search_path(std::string_view name, std::string_view path);
 
 // Run a pipeline of external programs (stdin inherited).
 // Returns exit status of the last stage.
-int run_external_pipeline(const std::vector<std::vector<std::string>>& stages);
+int run_external_pipeline(
+   const std::vector<std::pmr::vector<std::pmr::string>>& stages);
 
 } // namespace clanker
 
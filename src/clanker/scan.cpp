@@ -0,0 +1,187 @@
+// src/clanker/scan.cpp
+#include <atomic>
+#include <bit>
+
+#include "clanker/scan.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define CLANKER_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace clanker {
+
+namespace {
+
+std::size_t find_scalar(std::string_view s, std::size_t i,
+                        const ByteSet& set) noexcept {
+   for (; i < s.size(); ++i)
+      if (set.contains(s[i])) return i;
+   return s.size();
+}
+
+std::size_t count_newlines_scalar(std::string_view s) noexcept {
+   std::size_t n = 0;
+   for (const char c : s) n += (c == '\n');
+   return n;
+}
+
+#ifdef CLANKER_SCAN_X86
+
+// SSE2 has no byte shuffle, so test each member with a compare.
+std::size_t find_sse2(std::string_view s, std::size_t i,
+                      const ByteSet& set) noexcept {
+   if (set.size() > ByteSet::kMaxMembers) return find_scalar(s, i, set);
+
+   const char* p = s.data();
+   const std::size_t n = s.size();
+   while (i + 16 <= n) {
+      const __m128i v =
+         _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      __m128i hit = _mm_setzero_si128();
+      for (std::size_t k = 0; k < set.size(); ++k)
+         hit = _mm_or_si128(hit,
+                            _mm_cmpeq_epi8(v, _mm_set1_epi8(set.members()[k])));
+      const auto mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+      if (mask != 0)
+         return i + static_cast<std::size_t>(std::countr_zero(mask));
+      i += 16;
+   }
+   return find_scalar(s, i, set);
+}
+
+std::size_t count_newlines_sse2(std::string_view s) noexcept {
+   const char* p = s.data();
+   const std::size_t n = s.size();
+   const __m128i nl = _mm_set1_epi8('\n');
+   std::size_t count = 0;
+   std::size_t i = 0;
+   for (; i + 16 <= n; i += 16) {
+      const __m128i v =
+         _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      const auto mask =
+         static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+      count += static_cast<std::size_t>(std::popcount(mask));
+   }
+   return count + count_newlines_scalar(s.substr(i));
+}
+
+// AVX2: classify 32 bytes at once with the nibble tables (vpshufb).
+__attribute__((target("avx2"))) std::size_t
+find_avx2(std::string_view s, std::size_t i, const ByteSet& set) noexcept {
+   if (!set.nibble_ok()) return find_sse2(s, i, set);
+
+   const char* p = s.data();
+   const std::size_t n = s.size();
+
+   const __m128i lo128 =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(set.lo()));
+   const __m128i hi128 =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(set.hi()));
+   const __m256i lo_tbl = _mm256_broadcastsi128_si256(lo128);
+   const __m256i hi_tbl = _mm256_broadcastsi128_si256(hi128);
+   const __m256i low4 = _mm256_set1_epi8(0x0F);
+
+   while (i + 32 <= n) {
+      const __m256i v =
+         _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+      const __m256i lo = _mm256_shuffle_epi8(lo_tbl, _mm256_and_si256(v, low4));
+      const __m256i hi = _mm256_shuffle_epi8(
+         hi_tbl, _mm256_and_si256(_mm256_srli_epi16(v, 4), low4));
+      const __m256i none =
+         _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256());
+      const auto mask = ~static_cast<unsigned>(_mm256_movemask_epi8(none));
+      if (mask != 0)
+         return i + static_cast<std::size_t>(std::countr_zero(mask));
+      i += 32;
+   }
+   return find_sse2(s, i, set);
+}
+
+__attribute__((target("avx2"))) std::size_t
+count_newlines_avx2(std::string_view s) noexcept {
+   const char* p = s.data();
+   const std::size_t n = s.size();
+   const __m256i nl = _mm256_set1_epi8('\n');
+   std::size_t count = 0;
+   std::size_t i = 0;
+   for (; i + 32 <= n; i += 32) {
+      const __m256i v =
+         _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+      const auto mask =
+         static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+      count += static_cast<std::size_t>(std::popcount(mask));
+   }
+   return count + count_newlines_sse2(s.substr(i));
+}
+
+ScanIsa best_supported_isa() noexcept {
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2")) return ScanIsa::Avx2;
+   return ScanIsa::Sse2;
+}
+
+#else
+
+ScanIsa best_supported_isa() noexcept { return ScanIsa::Scalar; }
+
+#endif
+
+std::atomic<ScanIsa>& active_isa() noexcept {
+   static std::atomic<ScanIsa> isa{best_supported_isa()};
+   return isa;
+}
+
+} // namespace
+
+std::size_t find_first_of(std::string_view s, std::size_t from,
+                          const ByteSet& set) noexcept {
+   if (from >= s.size()) return s.size();
+   switch (active_isa().load(std::memory_order_relaxed)) {
+#ifdef CLANKER_SCAN_X86
+   case ScanIsa::Avx2:
+      return find_avx2(s, from, set);
+   case ScanIsa::Sse2:
+      return find_sse2(s, from, set);
+#endif
+   default:
+      return find_scalar(s, from, set);
+   }
+}
+
+std::size_t count_newlines(std::string_view s) noexcept {
+   switch (active_isa().load(std::memory_order_relaxed)) {
+#ifdef CLANKER_SCAN_X86
+   case ScanIsa::Avx2:
+      return count_newlines_avx2(s);
+   case ScanIsa::Sse2:
+      return count_newlines_sse2(s);
+#endif
+   default:
+      return count_newlines_scalar(s);
+   }
+}
+
+ScanIsa scan_isa() noexcept {
+   return active_isa().load(std::memory_order_relaxed);
+}
+
+void set_scan_isa(ScanIsa isa) noexcept {
+   const ScanIsa best = best_supported_isa();
+   if (static_cast<int>(isa) > static_cast<int>(best)) isa = best;
+   active_isa().store(isa, std::memory_order_relaxed);
+}
+
+const char* scan_isa_name(ScanIsa isa) noexcept {
+   switch (isa) {
+   case ScanIsa::Scalar:
+      return "scalar";
+   case ScanIsa::Sse2:
+      return "sse2";
+   case ScanIsa::Avx2:
+      return "avx2";
+   }
+   return "unknown";
+}
+
+} // namespace clanker
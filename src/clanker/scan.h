@@ -0,0 +1,85 @@
+// src/clanker/scan.h
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace clanker {
+
+// A set of byte values, searched in bulk by find_first_of().
+//
+// Besides a plain membership table, the set keeps the two 16-entry nibble
+// tables used by the vector path: byte b is a member iff
+// (lo[b & 0xF] & hi[b >> 4]) != 0. That encoding is exact as long as the
+// members use at most 8 distinct high nibbles; larger sets fall back to
+// comparing members one by one.
+class ByteSet {
+ public:
+   static constexpr std::size_t kMaxMembers = 32;
+
+   constexpr explicit ByteSet(std::string_view members) {
+      std::uint8_t hi_bit_of[16] = {};
+      std::uint8_t next_bit = 1;
+      for (const char ch : members) {
+         const auto b = static_cast<unsigned char>(ch);
+         if (table_[b]) continue;
+         table_[b] = true;
+         if (count_ < kMaxMembers) members_[count_] = ch;
+         ++count_;
+
+         const unsigned h = b >> 4;
+         if (hi_bit_of[h] == 0) {
+            if (next_bit == 0) {
+               nibble_ok_ = false;
+               continue;
+            }
+            hi_bit_of[h] = next_bit;
+            next_bit = static_cast<std::uint8_t>(next_bit << 1);
+         }
+         hi_[h] = hi_bit_of[h];
+         lo_[b & 0xF] = static_cast<std::uint8_t>(lo_[b & 0xF] | hi_bit_of[h]);
+      }
+   }
+
+   [[nodiscard]] constexpr bool contains(char c) const noexcept {
+      return table_[static_cast<unsigned char>(c)];
+   }
+
+   [[nodiscard]] constexpr bool nibble_ok() const noexcept {
+      return nibble_ok_;
+   }
+   [[nodiscard]] constexpr std::size_t size() const noexcept { return count_; }
+   [[nodiscard]] const char* members() const noexcept {
+      return members_.data();
+   }
+   [[nodiscard]] const std::uint8_t* lo() const noexcept { return lo_.data(); }
+   [[nodiscard]] const std::uint8_t* hi() const noexcept { return hi_.data(); }
+
+ private:
+   std::array<bool, 256> table_{};
+   std::array<char, kMaxMembers> members_{};
+   std::array<std::uint8_t, 16> lo_{};
+   std::array<std::uint8_t, 16> hi_{};
+   std::size_t count_{0};
+   bool nibble_ok_{true};
+};
+
+// Index of the first byte at or after `from` that is in `set`, or s.size().
+[[nodiscard]] std::size_t find_first_of(std::string_view s, std::size_t from,
+                                        const ByteSet& set) noexcept;
+
+// Number of '\n' bytes in s.
+[[nodiscard]] std::size_t count_newlines(std::string_view s) noexcept;
+
+// Instruction set used by the bulk scanners. Picked once at startup from
+// what the CPU supports; overridable for tests and benchmarks (requests for
+// an unsupported ISA are clamped to the best supported one).
+enum class ScanIsa { Scalar, Sse2, Avx2 };
+
+[[nodiscard]] ScanIsa scan_isa() noexcept;
+void set_scan_isa(ScanIsa isa) noexcept;
+[[nodiscard]] const char* scan_isa_name(ScanIsa isa) noexcept;
+
+} // namespace clanker
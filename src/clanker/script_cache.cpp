@@ -0,0 +1,637 @@
+// src/clanker/script_cache.cpp
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+#include "clanker/arith.h"
+#include "clanker/expr.h"
+#include "clanker/script_cache.h"
+#include "clanker/util.h"
+#include "clanker/vars.h"
+
+namespace clanker {
+
+namespace {
+
+constexpr char kMagic[8] = {'C', 'L', 'K', 'A', 'S', 'T', '\r', '\n'};
+constexpr std::uint32_t kFormatVersion = 10;
+constexpr std::uint32_t kByteOrderMark = 0x01020304;
+
+constexpr std::uint8_t kTagPipeline = 1;
+constexpr std::uint8_t kTagList = 2;
+
+// Header fields patched by ScriptImageWriter::commit(): content hash, then
+// unit count, then body hash.
+constexpr std::size_t kContentHashOffset = sizeof(kMagic) + 4 + 4 + 8 + 8;
+constexpr std::size_t kUnitsOffset = kContentHashOffset + 8;
+
+// Image bytes buffered before a write.
+constexpr std::size_t kFlushBytes = 64 * 1024;
+
+// Image bytes read before the pages behind them are released.
+constexpr std::size_t kReleaseBytes = 1024 * 1024;
+
+constexpr std::uint64_t kHashMul = 0x9E3779B97F4A7C15ull;
+
+// ---- Encoding ----
+
+template<class T>
+void put(std::string& out, T v) {
+   char buf[sizeof(T)];
+   std::memcpy(buf, &v, sizeof(T));
+   out.append(buf, sizeof(T));
+}
+
+void put_str(std::string& out, std::string_view s) {
+   put<std::uint32_t>(out, static_cast<std::uint32_t>(s.size()));
+   out.append(s);
+}
+
+void put_indices(std::string& out, const std::pmr::vector<std::uint32_t>& v) {
+   put<std::uint32_t>(out, static_cast<std::uint32_t>(v.size()));
+   for (const std::uint32_t w : v) put<std::uint32_t>(out, w);
+}
+
+void put_list(std::string& out, const CommandList& list);
+
+void put_command(std::string& out, const SimpleCommand& sc) {
+   put<std::uint32_t>(out, static_cast<std::uint32_t>(sc.argv.size()));
+   for (const auto& a : sc.argv) put_str(out, a);
+   put<std::uint32_t>(out, static_cast<std::uint32_t>(sc.assigns.size()));
+   for (const auto& a : sc.assigns) put_str(out, a);
+   put_indices(out, sc.brace_words);
+   put_indices(out, sc.glob_words);
+   put_indices(out, sc.subst_words);
+   put<std::uint32_t>(out, static_cast<std::uint32_t>(sc.redirs.size()));
+   for (const Redirection& r : sc.redirs) {
+      put<std::int32_t>(out, r.fd);
+      put<std::uint8_t>(out, static_cast<std::uint8_t>(r.kind));
+      put_str(out, r.target);
+   }
+   put<std::uint8_t>(out, sc.compound.empty() ? 0 : 1);
+   if (sc.compound.empty()) return;
+   const CompoundCommand& cc = sc.compound.front();
+   put<std::uint8_t>(out, static_cast<std::uint8_t>(cc.kind));
+   put<std::uint32_t>(out, static_cast<std::uint32_t>(cc.lists.size()));
+   for (const CommandList& l : cc.lists) put_list(out, l);
+   put_str(out, cc.name);
+   put_command(out, cc.words);
+   put<std::uint8_t>(out, cc.in_words ? 1 : 0);
+   put_indices(out, cc.arms);
+}
+
+void put_pipeline(std::string& out, const Pipeline& pl) {
+   put<std::uint32_t>(out, static_cast<std::uint32_t>(pl.stages.size()));
+   for (const SimpleCommand& sc : pl.stages) put_command(out, sc);
+}
+
+void put_list(std::string& out, const CommandList& list) {
+   put<std::uint32_t>(out, static_cast<std::uint32_t>(list.items.size()));
+   for (const CommandListItem& item : list.items) {
+      put_pipeline(out, item.cmd.first);
+      put<std::uint32_t>(out,
+                         static_cast<std::uint32_t>(item.cmd.rest.size()));
+      for (const AndOrTail& t : item.cmd.rest) {
+         put<std::uint8_t>(out, static_cast<std::uint8_t>(t.op));
+         put_pipeline(out, t.rhs);
+      }
+      put<std::uint8_t>(out, static_cast<std::uint8_t>(item.term));
+   }
+   put<std::uint8_t>(out, list.trailing.has_value() ? 1 : 0);
+   put<std::uint8_t>(out, static_cast<std::uint8_t>(
+                             list.trailing.value_or(Terminator::None)));
+}
+
+// ---- Decoding ----
+
+// Bounds-checked cursor over an image. Any short read clears `ok`; callers
+// check once at the end of a record.
+struct ByteReader {
+   const char* p;
+   const char* end;
+   bool ok{true};
+
+   template<class T>
+   T get() noexcept {
+      T v{};
+      if (static_cast<std::size_t>(end - p) < sizeof(T)) {
+         ok = false;
+         p = end;
+         return v;
+      }
+      std::memcpy(&v, p, sizeof(T));
+      p += sizeof(T);
+      return v;
+   }
+
+   std::string_view get_str() noexcept {
+      const auto n = get<std::uint32_t>();
+      if (static_cast<std::size_t>(end - p) < n) {
+         ok = false;
+         p = end;
+         return {};
+      }
+      const std::string_view s{p, n};
+      p += n;
+      return s;
+   }
+
+   // Element counts are bounded by the bytes left, so a corrupt count
+   // cannot make us reserve gigabytes.
+   std::uint32_t get_count() noexcept {
+      const auto n = get<std::uint32_t>();
+      if (n > static_cast<std::size_t>(end - p)) {
+         ok = false;
+         p = end;
+         return 0;
+      }
+      return n;
+   }
+};
+
+template<class E>
+E get_enum(ByteReader& in, E last) noexcept {
+   const auto v = in.get<std::uint8_t>();
+   if (v > static_cast<std::uint8_t>(last)) in.ok = false;
+   return static_cast<E>(v);
+}
+
+// Strictly increasing argv indices below `argc`.
+void get_indices(ByteReader& in, std::size_t argc,
+                 std::pmr::vector<std::uint32_t>& v) {
+   const std::uint32_t n = in.get_count();
+   v.reserve(n);
+   for (std::uint32_t k = 0; k < n && in.ok; ++k) {
+      const auto w = in.get<std::uint32_t>();
+      if (w >= argc || (!v.empty() && w <= v.back())) in.ok = false;
+      v.push_back(w);
+   }
+}
+
+// Compound commands nest no deeper than the parser allows.
+constexpr int kMaxNesting = 256;
+
+void get_list(ByteReader& in, CommandList& list, int depth);
+
+void get_command(ByteReader& in, SimpleCommand& sc, int depth) {
+   const std::uint32_t argc = in.get_count();
+   sc.argv.reserve(argc);
+   for (std::uint32_t k = 0; k < argc && in.ok; ++k)
+      sc.argv.emplace_back(in.get_str());
+   const std::uint32_t nassigns = in.get_count();
+   sc.assigns.reserve(nassigns);
+   for (std::uint32_t k = 0; k < nassigns && in.ok; ++k) {
+      const std::string_view a = in.get_str();
+      const std::size_t eq = a.find('=');
+      if (eq == 0 || eq == std::string_view::npos) in.ok = false;
+      sc.assigns.emplace_back(a);
+   }
+   get_indices(in, sc.argv.size(), sc.brace_words);
+   get_indices(in, sc.argv.size(), sc.glob_words);
+   get_indices(in, sc.argv.size(), sc.subst_words);
+   // Expressions are not stored; compiling them again is cheap next to
+   // reading the script.
+   for (const std::uint32_t w : sc.subst_words) {
+      std::string err;
+      if (in.ok && (!compile_word_exprs(sc.argv[w], sc.exprs, err) ||
+                    !compile_word_arith(sc.argv[w], sc.ariths, err)))
+         in.ok = false;
+   }
+   for (const auto& a : sc.assigns) {
+      std::string err;
+      if (in.ok && (!compile_word_exprs(a, sc.exprs, err) ||
+                    !compile_word_arith(a, sc.ariths, err)))
+         in.ok = false;
+   }
+   const std::uint32_t nredirs = in.get_count();
+   sc.redirs.reserve(nredirs);
+   for (std::uint32_t k = 0; k < nredirs && in.ok; ++k) {
+      Redirection& r = sc.redirs.emplace_back();
+      r.fd = in.get<std::int32_t>();
+      r.kind = get_enum(in, RedirKind::OutAppend);
+      r.target = in.get_str();
+   }
+   if (in.get<std::uint8_t>() == 0 || !in.ok) return;
+   if (depth >= kMaxNesting || !sc.argv.empty() || !sc.assigns.empty()) {
+      in.ok = false;
+      return;
+   }
+   CompoundCommand& cc = sc.compound.emplace_back();
+   cc.kind = get_enum(in, CompoundKind::Case);
+   const std::uint32_t nlists = in.get_count();
+   cc.lists.reserve(nlists);
+   for (std::uint32_t k = 0; k < nlists && in.ok; ++k)
+      get_list(in, cc.lists.emplace_back(), depth + 1);
+   cc.name = in.get_str();
+   get_command(in, cc.words, depth + 1);
+   cc.in_words = in.get<std::uint8_t>() != 0;
+   const std::uint32_t narms = in.get_count();
+   cc.arms.reserve(narms);
+   for (std::uint32_t k = 0; k < narms && in.ok; ++k) {
+      // Each arm has a pattern: 0, then the same arm or the next.
+      const auto a = in.get<std::uint32_t>();
+      const std::uint32_t last = cc.arms.empty() ? 0 : cc.arms.back();
+      if (a >= cc.lists.size() || (a != last && a != last + 1) ||
+          (cc.arms.empty() && a != 0))
+         in.ok = false;
+      cc.arms.push_back(a);
+   }
+   if (!cc.words.compound.empty() || !cc.words.redirs.empty()) in.ok = false;
+
+   // The shape the parser produces, which the compiler relies on.
+   bool shaped = false;
+   switch (cc.kind) {
+   case CompoundKind::If:
+      shaped = cc.lists.size() >= 2;
+      break;
+   case CompoundKind::While:
+   case CompoundKind::Until:
+      shaped = cc.lists.size() == 2;
+      break;
+   case CompoundKind::For:
+   case CompoundKind::Function:
+      shaped = cc.lists.size() == 1 && VarStore::is_name(cc.name);
+      break;
+   case CompoundKind::Group:
+      shaped = cc.lists.size() == 1;
+      break;
+   case CompoundKind::Arith: {
+      const ArithCompileResult r = compile_arith(cc.name);
+      shaped = cc.lists.empty() && r.program && cc.words.argv.empty();
+      if (shaped) cc.words.ariths.push_back(r.program);
+      break;
+   }
+   case CompoundKind::Case:
+      shaped = !cc.words.argv.empty() &&
+               cc.arms.size() == cc.words.argv.size() - 1 &&
+               (cc.arms.empty() ? cc.lists.empty()
+                                : cc.arms.back() + 1 == cc.lists.size());
+      break;
+   }
+   if (cc.kind != CompoundKind::Case)
+      for (const CommandList& l : cc.lists)
+         shaped = shaped && !l.items.empty();
+   if (!shaped) in.ok = false;
+}
+
+void get_pipeline(ByteReader& in, Pipeline& pl, int depth = 0) {
+   const std::uint32_t nstages = in.get_count();
+   pl.stages.reserve(nstages);
+   for (std::uint32_t i = 0; i < nstages && in.ok; ++i)
+      get_command(in, pl.stages.emplace_back(), depth);
+}
+
+void get_list(ByteReader& in, CommandList& list, int depth = 0) {
+   const std::uint32_t nitems = in.get_count();
+   list.items.reserve(nitems);
+   for (std::uint32_t i = 0; i < nitems && in.ok; ++i) {
+      CommandListItem& item = list.items.emplace_back();
+      get_pipeline(in, item.cmd.first, depth);
+      const std::uint32_t nrest = in.get_count();
+      item.cmd.rest.reserve(nrest);
+      for (std::uint32_t k = 0; k < nrest && in.ok; ++k) {
+         AndOrTail& t = item.cmd.rest.emplace_back();
+         t.op = get_enum(in, AndOrOp::OrIf);
+         get_pipeline(in, t.rhs, depth);
+      }
+      item.term = get_enum(in, Terminator::Ampersand);
+   }
+   const bool has_trailing = in.get<std::uint8_t>() != 0;
+   const Terminator trailing = get_enum(in, Terminator::Ampersand);
+   if (has_trailing) list.trailing = trailing;
+}
+
+std::string hex64(std::uint64_t v) {
+   static constexpr char kDigits[] = "0123456789abcdef";
+   std::string s(16, '0');
+   for (int i = 15; i >= 0; --i, v >>= 4) s[i] = kDigits[v & 0xF];
+   return s;
+}
+
+std::filesystem::path image_path(const ScriptKey& key) {
+   const auto dir = script_cache_dir();
+   if (dir.empty()) return {};
+   return dir / (hex64(hash_bytes(key.path)) + ".ast");
+}
+
+} // namespace
+
+// ---- ContentHasher ----
+
+void ContentHasher::mix(std::uint64_t w) noexcept {
+   h_ = (h_ ^ w) * kHashMul;
+   h_ ^= h_ >> 29;
+}
+
+void ContentHasher::update(std::string_view s) noexcept {
+   size_ += s.size();
+
+   if (npending_ > 0) {
+      const std::size_t n = std::min(s.size(), 8 - npending_);
+      std::memcpy(pending_ + npending_, s.data(), n);
+      npending_ += n;
+      s.remove_prefix(n);
+      if (npending_ < 8) return;
+      std::uint64_t w;
+      std::memcpy(&w, pending_, 8);
+      mix(w);
+      npending_ = 0;
+   }
+
+   std::size_t i = 0;
+   for (; i + 8 <= s.size(); i += 8) {
+      std::uint64_t w;
+      std::memcpy(&w, s.data() + i, 8);
+      mix(w);
+   }
+   npending_ = s.size() - i;
+   if (npending_ > 0) std::memcpy(pending_, s.data() + i, npending_);
+}
+
+std::uint64_t ContentHasher::digest() const noexcept {
+   std::uint64_t tail = 0;
+   std::memcpy(&tail, pending_, npending_);
+   std::uint64_t h = (h_ ^ tail) * kHashMul;
+   h ^= size_ * kHashMul;
+   h ^= h >> 32;
+   return h;
+}
+
+std::uint64_t hash_bytes(std::string_view s) noexcept {
+   ContentHasher h;
+   h.update(s);
+   return h.digest();
+}
+
+std::optional<ScriptKey> make_script_key(const std::filesystem::path& script,
+                                         int fd) {
+   struct stat st{};
+   if (::fstat(fd, &st) != 0) return std::nullopt;
+   // A pipe or device has no stable size or mtime, and cannot be read twice.
+   if (!S_ISREG(st.st_mode)) return std::nullopt;
+
+   std::error_code ec;
+   const auto abs = std::filesystem::absolute(script, ec);
+   if (ec) return std::nullopt;
+
+   return ScriptKey{
+      .path = abs.lexically_normal().string(),
+      .size = static_cast<std::uint64_t>(st.st_size),
+      .mtime_ns = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                  st.st_mtim.tv_nsec,
+      .content_hash = 0};
+}
+
+// ---- ScriptImageWriter ----
+
+ScriptImageWriter::ScriptImageWriter(const ScriptKey& key)
+   : path_(image_path(key)) {
+   if (path_.empty()) return;
+
+   std::error_code ec;
+   std::filesystem::create_directories(path_.parent_path(), ec);
+   if (ec) return;
+   fd_.reset(::open(path_.parent_path().c_str(),
+                    O_TMPFILE | O_WRONLY | O_CLOEXEC, 0600));
+   if (!active()) return;
+
+   out_.append(kMagic, sizeof(kMagic));
+   put<std::uint32_t>(out_, kFormatVersion);
+   put<std::uint32_t>(out_, kByteOrderMark);
+   put<std::uint64_t>(out_, key.size);
+   put<std::int64_t>(out_, key.mtime_ns);
+   put<std::uint64_t>(out_, 0); // content hash, patched by commit()
+   put<std::uint64_t>(out_, 0); // unit count, patched by commit()
+   put<std::uint64_t>(out_, 0); // body hash, patched by commit()
+   put_str(out_, key.path);
+}
+
+void ScriptImageWriter::add(const ParseResult& pr) {
+   if (!active() || failed_) return;
+
+   const std::size_t begin = out_.size();
+   if (pr.result_is_list()) {
+      put<std::uint8_t>(out_, kTagList);
+      put_list(out_, pr.list);
+   } else if (pr.result_is_pipeline() && !pr.pipeline.stages.empty()) {
+      put<std::uint8_t>(out_, kTagPipeline);
+      put_pipeline(out_, pr.pipeline);
+   } else {
+      return;
+   }
+   body_hash_.update(std::string_view(out_).substr(begin));
+   ++units_;
+
+   if (out_.size() >= kFlushBytes) failed_ = !flush();
+}
+
+bool ScriptImageWriter::flush() {
+   const bool ok = fd_write_all(fd_.get(), out_);
+   out_.clear();
+   return ok;
+}
+
+bool ScriptImageWriter::commit(std::uint64_t content_hash) {
+   if (!active() || failed_ || !flush()) return false;
+
+   std::uint64_t fields[3] = {content_hash, units_, body_hash_.digest()};
+   static_assert(kUnitsOffset == kContentHashOffset + 8);
+   if (::pwrite(fd_.get(), fields, sizeof(fields), kContentHashOffset) !=
+       static_cast<ssize_t>(sizeof(fields)))
+      return false;
+
+   // Give the unnamed file a temporary name, then atomically replace any
+   // previous image.
+   const std::string proc = "/proc/self/fd/" + std::to_string(fd_.get());
+   const std::string tmp =
+      path_.string() + ".tmp." + std::to_string(::getpid());
+   if (::linkat(AT_FDCWD, proc.c_str(), AT_FDCWD, tmp.c_str(),
+                AT_SYMLINK_FOLLOW) != 0)
+      return false;
+   if (::rename(tmp.c_str(), path_.c_str()) != 0) {
+      ::unlink(tmp.c_str());
+      return false;
+   }
+   return true;
+}
+
+// ---- ScriptImageReader ----
+
+namespace {
+
+struct ImageHeader {
+   std::uint64_t content_hash{0};
+   std::uint64_t units{0};
+   std::uint64_t body_hash{0};
+};
+
+// Read the header of `image` into `in`/`out`. False unless it is one of
+// ours, built from the script `key` stands for: same path, size and mtime
+// (the content hash is left to the caller).
+bool read_header(std::string_view image, const ScriptKey& key, ByteReader& in,
+                 ImageHeader& out) {
+   char magic[sizeof(kMagic)] = {};
+   if (image.size() >= sizeof(kMagic))
+      std::memcpy(magic, image.data(), sizeof(kMagic));
+   in.p += std::min(image.size(), sizeof(kMagic));
+
+   const auto version = in.get<std::uint32_t>();
+   const auto bom = in.get<std::uint32_t>();
+   const auto size = in.get<std::uint64_t>();
+   const auto mtime_ns = in.get<std::int64_t>();
+   out.content_hash = in.get<std::uint64_t>();
+   out.units = in.get<std::uint64_t>();
+   out.body_hash = in.get<std::uint64_t>();
+   const std::string_view path = in.get_str();
+
+   return in.ok && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0 &&
+          version == kFormatVersion && bom == kByteOrderMark &&
+          size == key.size && mtime_ns == key.mtime_ns && path == key.path;
+}
+
+} // namespace
+
+ScriptImageReader::ScriptImageReader(MappedFile& file, const ScriptKey& key)
+   : file_(&file) {
+   const std::string_view image = file.bytes();
+   ByteReader in{image.data(), image.data() + image.size()};
+   ImageHeader header;
+   ok_ = read_header(image, key, in, header) &&
+         header.content_hash == key.content_hash;
+   if (!ok_) return;
+   const std::uint64_t units = header.units;
+   const std::uint64_t body_hash = header.body_hash;
+
+   ContentHasher hasher;
+   for (const char* p = in.p; p < in.end;) {
+      const auto n =
+         std::min(kReleaseBytes, static_cast<std::size_t>(in.end - p));
+      hasher.update(std::string_view(p, n));
+      p += n;
+      file.release(static_cast<std::size_t>(p - image.data()));
+   }
+   ok_ = hasher.digest() == body_hash;
+   if (!ok_) return;
+
+   p_ = in.p;
+   end_ = in.end;
+   remaining_ = units;
+}
+
+std::optional<ParseResult>
+ScriptImageReader::next(std::pmr::memory_resource* mr) {
+   if (!ok_ || remaining_ == 0) return std::nullopt;
+
+   ByteReader in{p_, end_};
+   const AstAllocator alloc{mr};
+   ParseResult out{.kind = ParseKind::Complete,
+                   .pipeline = Pipeline{alloc},
+                   .list = CommandList{alloc},
+                   .message = {},
+                   .error_offset = 0};
+
+   const auto tag = in.get<std::uint8_t>();
+   if (tag == kTagPipeline)
+      get_pipeline(in, out.pipeline);
+   else if (tag == kTagList)
+      get_list(in, out.list);
+   else
+      in.ok = false;
+
+   ok_ = in.ok;
+   if (!ok_) return std::nullopt;
+   // Release behind us each time a kReleaseBytes boundary is crossed.
+   const char* base = file_->bytes().data();
+   const auto before = static_cast<std::size_t>(p_ - base);
+   const auto after = static_cast<std::size_t>(in.p - base);
+   if (before / kReleaseBytes != after / kReleaseBytes) file_->release(after);
+   p_ = in.p;
+   --remaining_;
+   return out;
+}
+
+// ---- MappedFile ----
+
+MappedFile::~MappedFile() {
+   if (data_ != nullptr) ::munmap(data_, size_);
+}
+
+MappedFile::MappedFile(MappedFile&& o) noexcept
+   : data_(std::exchange(o.data_, nullptr))
+   , size_(std::exchange(o.size_, 0))
+   , released_(std::exchange(o.released_, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& o) noexcept {
+   if (this != &o) {
+      if (data_ != nullptr) ::munmap(data_, size_);
+      data_ = std::exchange(o.data_, nullptr);
+      size_ = std::exchange(o.size_, 0);
+      released_ = std::exchange(o.released_, 0);
+   }
+   return *this;
+}
+
+void MappedFile::release(std::size_t end) noexcept {
+   static const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+   end = std::min(end, size_) / page * page;
+   if (end <= released_) return;
+   ::madvise(static_cast<char*>(data_) + released_, end - released_,
+             MADV_DONTNEED);
+   released_ = end;
+}
+
+std::optional<MappedFile> MappedFile::map(int fd, std::size_t size) {
+   MappedFile m;
+   if (size == 0) return m;
+   void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (p == MAP_FAILED) return std::nullopt;
+   m.data_ = p;
+   m.size_ = size;
+   return m;
+}
+
+// ---- Cache directory ----
+
+std::filesystem::path script_cache_dir() {
+   if (const char* d = std::getenv("CLANKER_CACHE_DIR"); d && *d)
+      return std::filesystem::path(d);
+   if (const char* x = std::getenv("XDG_CACHE_HOME"); x && *x)
+      return std::filesystem::path(x) / "clanker" / "ast";
+   if (const char* h = std::getenv("HOME"); h && *h)
+      return std::filesystem::path(h) / ".cache" / "clanker" / "ast";
+   return {};
+}
+
+std::optional<MappedFile> load_script_image(const ScriptKey& key) {
+   const auto path = image_path(key);
+   if (path.empty()) return std::nullopt;
+
+   const UniqueFd fd{::open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC)};
+   if (fd.get() < 0) return std::nullopt;
+
+   struct stat st{};
+   if (::fstat(fd.get(), &st) != 0) return std::nullopt;
+   if (!S_ISREG(st.st_mode) || st.st_uid != ::geteuid() ||
+       (st.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+      return std::nullopt;
+
+   auto mapped =
+      MappedFile::map(fd.get(), static_cast<std::size_t>(st.st_size));
+   if (!mapped) return std::nullopt;
+
+   // A stale image is known from its header alone; the script need not be
+   // read and hashed for it.
+   const std::string_view image = mapped->bytes();
+   ByteReader in{image.data(), image.data() + image.size()};
+   ImageHeader header;
+   if (!read_header(image, key, in, header)) return std::nullopt;
+   return mapped;
+}
+
+} // namespace clanker
@@ -0,0 +1,162 @@
+// src/clanker/script_cache.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "clanker/parser.h"
+#include "clanker/util.h"
+
+namespace clanker {
+
+// Precompiled scripts for Shell::run_file.
+//
+// A script's parsed units are serialized into a compact binary "image" and
+// stored in the cache directory. The next run of an unchanged script maps
+// the image and decodes units straight into the per-unit arena instead of
+// lexing and parsing the text.
+//
+// Image layout (native byte order, fixed-width fields):
+//
+//   header   magic, format version, byte-order mark, ScriptKey fields,
+//            unit count, hash of the body, script path
+//   body     one record per non-empty unit:
+//              u8 tag (1 = pipeline, 2 = list), then the AST
+//            strings are u32 length + bytes; counts are u32
+//
+// Bump kFormatVersion whenever the AST or the encoding changes.
+
+// What an image was built from. A cached image is used only if every field
+// matches the script as it is now.
+struct ScriptKey {
+   std::string path; // absolute
+   std::uint64_t size{0};
+   std::int64_t mtime_ns{0};
+   std::uint64_t content_hash{0};
+};
+
+// Key for the script open on `fd`, except content_hash, which the caller
+// fills in once it has read the contents. Empty if `fd` cannot be stat'ed
+// or is not a regular file (a FIFO, /dev/stdin): those are never cached.
+[[nodiscard]] std::optional<ScriptKey>
+make_script_key(const std::filesystem::path& script, int fd);
+
+// Stable 64-bit hash of a byte stream (the same across runs and builds),
+// fed in pieces of any size.
+class ContentHasher {
+ public:
+   void update(std::string_view s) noexcept;
+   [[nodiscard]] std::uint64_t digest() const noexcept;
+
+ private:
+   void mix(std::uint64_t w) noexcept;
+
+   std::uint64_t h_{0xCBF29CE484222325ull};
+   std::uint64_t size_{0};
+   char pending_[8] = {};
+   std::size_t npending_{0};
+};
+
+[[nodiscard]] std::uint64_t hash_bytes(std::string_view s) noexcept;
+
+// Streams an image into an unnamed temp file in the cache directory, so
+// memory use does not grow with the script. The file only gets a name on
+// commit(); if the process exits first it simply disappears. When the cache
+// directory is unusable the writer is inactive and every call is a no-op.
+class ScriptImageWriter {
+ public:
+   explicit ScriptImageWriter(const ScriptKey& key);
+
+   [[nodiscard]] bool active() const noexcept { return fd_.get() >= 0; }
+
+   // Append a Complete unit. Empty units (blank lines, comments) are
+   // dropped; running them is a no-op.
+   void add(const ParseResult& pr);
+
+   // Finish the header with the script's content hash (known only once it
+   // has been read to the end) and move the image into place. Best effort.
+   bool commit(std::uint64_t content_hash);
+
+ private:
+   bool flush();
+
+   std::filesystem::path path_;
+   UniqueFd fd_;
+   std::string out_;
+   ContentHasher body_hash_;
+   std::uint64_t units_{0};
+   bool failed_{false};
+};
+
+class MappedFile;
+
+class ScriptImageReader {
+ public:
+   // Checks the header and body hash of `image` against `key`. Pages of the
+   // image are dropped from memory once they have been read, so a large
+   // image does not stay resident while the script runs.
+   ScriptImageReader(MappedFile& image, const ScriptKey& key);
+
+   // False if the image does not match the key, or a record failed to
+   // decode.
+   [[nodiscard]] bool ok() const noexcept { return ok_; }
+
+   // Decode the next unit, allocating its AST from `mr`. Empty at the end
+   // of the image, or on a malformed record (ok() turns false).
+   [[nodiscard]] std::optional<ParseResult>
+   next(std::pmr::memory_resource* mr);
+
+ private:
+   MappedFile* file_{nullptr};
+   const char* p_{nullptr};
+   const char* end_{nullptr};
+   std::uint64_t remaining_{0};
+   bool ok_{false};
+};
+
+// Read-only mapping of a file.
+class MappedFile {
+ public:
+   MappedFile() = default;
+   ~MappedFile();
+
+   MappedFile(MappedFile&& o) noexcept;
+   MappedFile& operator=(MappedFile&& o) noexcept;
+   MappedFile(const MappedFile&) = delete;
+   MappedFile& operator=(const MappedFile&) = delete;
+
+   // Maps `fd` (which stays owned by the caller). Empty on failure.
+   [[nodiscard]] static std::optional<MappedFile> map(int fd,
+                                                      std::size_t size);
+
+   [[nodiscard]] std::string_view bytes() const noexcept {
+      return {static_cast<const char*>(data_), size_};
+   }
+
+   // Drop the whole pages before byte `end` from memory. They are read back
+   // from the file if touched again.
+   void release(std::size_t end) noexcept;
+
+ private:
+   void* data_{nullptr};
+   std::size_t size_{0};
+   std::size_t released_{0};
+};
+
+// Where images live: $CLANKER_CACHE_DIR, else $XDG_CACHE_HOME/clanker/ast,
+// else $HOME/.cache/clanker/ast. Empty if none of those is set.
+[[nodiscard]] std::filesystem::path script_cache_dir();
+
+// Map the cached image for `key`. The file must be a regular file owned by
+// the current user and not writable by anyone else; an image is executable
+// code as far as the shell is concerned. Empty as well if its header shows
+// it was built from another size, mtime or path, so the caller reads the
+// script to hash it only for an image that may still match.
+[[nodiscard]] std::optional<MappedFile> load_script_image(const ScriptKey& key);
+
+} // namespace clanker
@@ -0,0 +1,68 @@
+// src/clanker/script_check.cpp
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+
+#include "clanker/script_check.h"
+#include "clanker/script_reader.h"
+#include "clanker/unit_reader.h"
+#include "clanker/util.h"
+
+namespace clanker {
+
+CheckReport check_script(const std::string& path) {
+   CheckReport report{.path = path, .errors = {}, .io_error = {}};
+
+   const UniqueFd fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+   if (fd.get() < 0) {
+      report.io_error = std::strerror(errno);
+      return report;
+   }
+
+   // Units are split as in batch mode, but an error only drops its unit.
+   ScriptReader reader{fd.get()};
+   (void)for_each_unit(
+      [&] { return reader.next_line(); }, nullptr,
+      [](const ParseResult&) { return true; },
+      [&](const UnitError& e) {
+         // A failed read cuts the last unit short; that is no syntax error.
+         if (!(e.end_of_input && reader.failed()))
+            report.errors.push_back(
+               {.line = e.line, .column = e.column, .message = e.message});
+         return true;
+      });
+
+   if (reader.failed()) report.io_error = "read error";
+   return report;
+}
+
+std::vector<CheckReport> check_scripts(std::span<const std::string> paths,
+                                       unsigned jobs) {
+   std::vector<CheckReport> reports(paths.size());
+   if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+   jobs = static_cast<unsigned>(
+      std::min<std::size_t>(jobs, std::max<std::size_t>(1, paths.size())));
+
+   // Files are claimed one at a time, so a few large files do not leave the
+   // other workers idle.
+   std::atomic<std::size_t> next{0};
+   auto worker = [&] {
+      for (std::size_t i; (i = next.fetch_add(1)) < paths.size();)
+         reports[i] = check_script(paths[i]);
+   };
+
+   {
+      std::vector<std::jthread> pool;
+      pool.reserve(jobs - 1);
+      for (unsigned t = 1; t < jobs; ++t)
+         pool.emplace_back(worker);
+      worker();
+   } // joins
+   return reports;
+}
+
+} // namespace clanker
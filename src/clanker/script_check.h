@@ -0,0 +1,42 @@
+// src/clanker/script_check.h
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace clanker {
+
+// Syntax check for script files (`clanker --check FILE...`).
+//
+// Each file is split into units the same way batch mode does, and every
+// unit is parsed; nothing is executed. Unlike batch mode, a syntax error
+// does not end the file: the unit is dropped and checking resumes on the
+// next line, so one pass reports every error.
+
+struct CheckDiagnostic {
+   std::size_t line{0};   // 1-based
+   std::size_t column{0}; // 1-based byte column
+   std::string message;
+};
+
+struct CheckReport {
+   std::string path;
+   std::vector<CheckDiagnostic> errors;
+   std::string io_error; // non-empty if the file could not be read
+
+   [[nodiscard]] bool ok() const noexcept {
+      return errors.empty() && io_error.empty();
+   }
+};
+
+[[nodiscard]] CheckReport check_script(const std::string& path);
+
+// Check `paths` on up to `jobs` threads (0 = one per hardware thread).
+// Parsing is pure, so files are independent. Reports come back in the order
+// of `paths`.
+[[nodiscard]] std::vector<CheckReport>
+check_scripts(std::span<const std::string> paths, unsigned jobs = 0);
+
+} // namespace clanker
@@ -0,0 +1,62 @@
+// src/clanker/script_reader.cpp
+#include <cerrno>
+#include <unistd.h>
+
+#include "clanker/script_reader.h"
+
+namespace clanker {
+
+ScriptReader::ScriptReader(int fd)
+   : fd_(fd)
+   , chunk_(kChunkBytes) {}
+
+bool ScriptReader::fill() {
+   pos_ = len_ = 0;
+   if (eof_ || failed_) return false;
+   for (;;) {
+      const ssize_t n = ::read(fd_, chunk_.data(), chunk_.size());
+      if (n < 0) {
+         if (errno == EINTR) continue;
+         failed_ = true;
+         return false;
+      }
+      if (n == 0) {
+         eof_ = true;
+         return false;
+      }
+      len_ = static_cast<std::size_t>(n);
+      hasher_.update(std::string_view(chunk_.data(), len_));
+      return true;
+   }
+}
+
+std::optional<std::string_view> ScriptReader::next_line() {
+   carry_.clear();
+   for (;;) {
+      if (pos_ == len_ && !fill()) {
+         // A last line without '\n'.
+         if (carry_.empty() || failed_) return std::nullopt;
+         return std::string_view(carry_);
+      }
+
+      const std::string_view rest(chunk_.data() + pos_, len_ - pos_);
+      const std::size_t nl = rest.find('\n');
+      if (nl == std::string_view::npos) {
+         carry_.append(rest);
+         pos_ = len_;
+         continue;
+      }
+
+      pos_ += nl + 1;
+      if (carry_.empty()) return rest.substr(0, nl);
+      carry_.append(rest.substr(0, nl));
+      return std::string_view(carry_);
+   }
+}
+
+void ScriptReader::drain() {
+   while (fill()) {
+   }
+}
+
+} // namespace clanker
@@ -0,0 +1,55 @@
+// src/clanker/script_reader.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "clanker/script_cache.h"
+
+namespace clanker {
+
+// Reads a script line by line through a fixed-size buffer, so memory use
+// is bounded by the longest line rather than by the size of the file, and
+// the first statement can run before the rest has been read. Hashes the
+// bytes as they go by (ScriptKey::content_hash).
+class ScriptReader {
+ public:
+   static constexpr std::size_t kChunkBytes = 64 * 1024;
+
+   // `fd` stays owned by the caller.
+   explicit ScriptReader(int fd);
+
+   // The next line, without its '\n'; valid until the next call. Empty at
+   // end of file or after a read error (see failed()). Like std::getline, a
+   // final line without '\n' is still a line.
+   [[nodiscard]] std::optional<std::string_view> next_line();
+
+   // Read the rest of the file without splitting it (hashing only).
+   void drain();
+
+   [[nodiscard]] bool failed() const noexcept { return failed_; }
+
+   // Hash of everything read so far; covers the whole file once
+   // next_line() has returned empty or drain() has run.
+   [[nodiscard]] std::uint64_t content_hash() const noexcept {
+      return hasher_.digest();
+   }
+
+ private:
+   bool fill();
+
+   int fd_;
+   std::vector<char> chunk_;
+   std::size_t pos_{0};
+   std::size_t len_{0};
+   std::string carry_; // start of a line that crosses a chunk boundary
+   ContentHasher hasher_;
+   bool eof_{false};
+   bool failed_{false};
+};
+
+} // namespace clanker
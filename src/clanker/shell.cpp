@@ -1,17 +1,26 @@
 // src/clanker/shell.cpp
-#include <fstream>
+#include <cstddef>
+#include <fcntl.h>
 #include <iostream>
-#include <sstream>
+#include <memory_resource>
+#include <optional>
+#include <unistd.h>
 
 #include "clanker/builtins.h"
 #include "clanker/exec_policy_default.h"
 #include "clanker/executor.h"
 #include "clanker/line_editor.h"
 #include "clanker/parser.h"
+#include "clanker/script_cache.h"
+#include "clanker/script_reader.h"
 #include "clanker/shell.h"
 #include "clanker/signals.h"
+#include "clanker/source_map.h"
+#include "clanker/unit_reader.h"
 #include "clanker/util.h"
 
+extern char** environ;
+
 namespace clanker {
 
 namespace {
@@ -30,6 +39,41 @@ int execute_parse_result(Executor& exec, const ParseResult& pr,
    return exec.run_pipeline(pr.pipeline);
 }
 
+// "line:col: message" for a parse error in `unit`.
+std::string describe_parse_error(std::string_view unit, const ParseResult& pr) {
+   const SourceLoc loc = locate(unit, pr.error_offset);
+   return std::to_string(loc.line) + ':' + std::to_string(loc.column) + ": " +
+          pr.message;
+}
+
+// "line:col: message" for an error from for_each_unit().
+std::string describe_unit_error(const UnitError& e) {
+   if (e.end_of_input) return e.message;
+   return std::to_string(e.line) + ':' + std::to_string(e.column) + ": " +
+          e.message;
+}
+
+// Lines of an in-memory script, for for_each_unit().
+class TextLines {
+ public:
+   explicit TextLines(std::string_view text) noexcept
+      : text_(text) {}
+
+   std::optional<std::string_view> operator()() noexcept {
+      if (pos_ >= text_.size()) return std::nullopt;
+      const std::size_t nl = text_.find('\n', pos_);
+      const std::size_t end =
+         (nl == std::string_view::npos) ? text_.size() : nl;
+      const std::string_view line = text_.substr(pos_, end - pos_);
+      pos_ = end + 1;
+      return line;
+   }
+
+ private:
+   std::string_view text_;
+   std::size_t pos_{0};
+};
+
 } // namespace
 
 Shell::Shell() {
@@ -37,6 +81,7 @@ Shell::Shell() {
    root_ = p;
    cwd_ = std::filesystem::weakly_canonical(p);
    oldpwd_ = cwd_;
+   vars_.import_environment(environ);
 }
 
 int Shell::run() {
@@ -48,11 +93,16 @@ int Shell::run() {
    Builtins builtins = make_builtins();
 
    DefaultExecPolicy policy{root_};
-   Executor exec{std::move(builtins), policy, &cwd_, &oldpwd_, sec};
+   Executor exec{std::move(builtins), policy, &cwd_, &oldpwd_, &vars_, sec,
+                 &parse_cache_};
 
    Parser parser;
 
+   // Continuation lines are appended to `buffer`; `cont` lets the parser
+   // lex only the appended bytes instead of the whole buffer each time.
    std::string buffer;
+   UnitArena arena;
+   ParseState cont{arena.resource()};
    int last_status = 0;
 
    for (;;) {
@@ -63,6 +113,12 @@ int Shell::run() {
          buffer.clear();
       }
 
+      // New unit: the previous one (if any) has run; recycle its memory.
+      if (buffer.empty()) {
+         cont.reset();
+         arena.release();
+      }
+
       const bool continuing = !buffer.empty();
       const std::string prompt = continuing ? "... " : "clanker > ";
 
@@ -72,25 +128,39 @@ int Shell::run() {
          return last_status; // EOF (Ctrl-D)
       }
 
-      std::string line = *line_opt;
-      if (buffer.empty())
+      const std::string& line = *line_opt;
+      if (buffer.empty()) {
          buffer = line;
-      else
-         buffer += '\n' + line;
+      } else {
+         buffer.push_back('\n');
+         buffer += line;
+      }
+
+      // Seen this exact unit before (e.g. an up-arrow re-run).
+      if (const ParsedUnitPtr unit = parse_cache_.find(buffer)) {
+         buffer.clear();
+         last_status = execute_parse_result(exec, unit->result(), last_status);
+         if (const auto code = exec.exit_requested()) return *code;
+         continue;
+      }
 
-      const auto pr = parser.parse(buffer);
+      const auto pr = parser.parse(buffer, cont);
       if (pr.kind == ParseKind::Incomplete) {
          continue;
       }
       if (pr.kind == ParseKind::Error) {
-         std::cerr << "syntax error: " << pr.message << '\n';
+         std::cerr << "syntax error: " << describe_parse_error(buffer, pr)
+                   << '\n';
          buffer.clear();
          last_status = 2;
          continue;
       }
 
+      const ParsedUnitPtr unit = parse_cache_.insert(buffer, pr);
       buffer.clear();
-      last_status = execute_parse_result(exec, pr, last_status);
+      last_status =
+         execute_parse_result(exec, unit ? unit->result() : pr, last_status);
+      if (const auto code = exec.exit_requested()) return *code;
    }
 }
 
@@ -99,64 +169,128 @@ int Shell::run_string(std::string_view script_text) {
 
    DefaultExecPolicy policy{root_};
    const auto sec = SecurityPolicy::capture_startup_identity();
-   Executor exec{std::move(builtins), policy, &cwd_, &oldpwd_, sec};
-
-   Parser parser;
+   Executor exec{std::move(builtins), policy, &cwd_, &oldpwd_, &vars_, sec,
+                 &parse_cache_};
 
    int last_status = 0;
+   const bool ok = for_each_unit(
+      TextLines{script_text}, &parse_cache_,
+      [&](const ParseResult& pr) {
+         last_status = execute_parse_result(exec, pr, last_status);
+         reap_children_nonblocking();
+         return !exec.exit_requested();
+      },
+      [](const UnitError& e) {
+         std::cerr << "parse: " << describe_unit_error(e) << '\n';
+         return false;
+      });
+   if (!ok) return 2;
 
-   std::string buffer;
-   const std::string text(script_text);
-   std::istringstream in{text};
+   reap_children_nonblocking();
+   return exec.exit_requested().value_or(last_status);
+}
 
-   std::string line;
-   while (std::getline(in, line)) {
-      // Batch: treat newlines as separators, but allow multi-line completion.
-      if (!buffer.empty()) buffer.push_back('\n');
-      buffer += line;
+int Shell::run_image(ScriptImageReader& image) {
+   Builtins builtins = make_builtins();
 
-      const auto pr = parser.parse(buffer);
-      if (pr.kind == ParseKind::Incomplete) {
-         continue; // keep accumulating
-      }
-      if (pr.kind == ParseKind::Error) {
-         std::cerr << "parse: " << pr.message << '\n';
-         return 2;
-      }
+   DefaultExecPolicy policy{root_};
+   const auto sec = SecurityPolicy::capture_startup_identity();
+   Executor exec{std::move(builtins), policy, &cwd_, &oldpwd_, &vars_, sec,
+                 &parse_cache_};
 
-      buffer.clear();
-      last_status = execute_parse_result(exec, pr, last_status);
+   UnitArena arena;
+   int last_status = 0;
+   while (!exec.exit_requested()) {
+      {
+         const auto pr = image.next(arena.resource());
+         if (!pr) break;
+         last_status = execute_parse_result(exec, *pr, last_status);
+      }
+      arena.release();
       reap_children_nonblocking();
    }
-
-   if (!buffer.empty()) {
-      // In batch mode, EOF with incomplete construct is an error.
-      const auto pr = parser.parse(buffer);
-      if (pr.kind == ParseKind::Incomplete) {
-         std::cerr << "parse: unexpected end of input\n";
-         return 2;
-      }
-      if (pr.kind == ParseKind::Error) {
-         std::cerr << "parse: " << pr.message << '\n';
-         return 2;
-      }
-      last_status = execute_parse_result(exec, pr, last_status);
+   if (!image.ok()) {
+      std::cerr << "clanker: corrupt script cache\n";
+      return 2;
    }
+
    reap_children_nonblocking();
-   return last_status;
+   return exec.exit_requested().value_or(last_status);
 }
 
 int Shell::run_file(const std::filesystem::path& script_path) {
-   std::ifstream f(script_path);
-   if (!f) {
+   const UniqueFd fd{::open(script_path.c_str(), O_RDONLY | O_CLOEXEC)};
+   if (fd.get() < 0) {
       std::cerr << "clanker: cannot open script: " << script_path << '\n';
       return 2;
    }
 
-   std::ostringstream ss;
-   ss << f.rdbuf();
-   return run_string(ss.str());
+   std::optional<ScriptKey> key = make_script_key(script_path, fd.get());
+
+   // A cached image exists: hash the script (one streaming pass) and, if it
+   // is unchanged, execute the image.
+   if (key) {
+      if (auto mapped = load_script_image(*key)) {
+         ScriptReader hash_pass{fd.get()};
+         hash_pass.drain();
+         if (!hash_pass.failed()) {
+            key->content_hash = hash_pass.content_hash();
+            ScriptImageReader image{*mapped, *key};
+            if (image.ok()) return run_image(image);
+         }
+         if (::lseek(fd.get(), 0, SEEK_SET) != 0) {
+            std::cerr << "clanker: cannot read script: " << script_path
+                      << '\n';
+            return 2;
+         }
+      }
+   }
+
+   return run_stream(fd.get(), key);
 }
 
-} // namespace clanker
+int Shell::run_stream(int fd, const std::optional<ScriptKey>& key) {
+   Builtins builtins = make_builtins();
+
+   DefaultExecPolicy policy{root_};
+   const auto sec = SecurityPolicy::capture_startup_identity();
+   Executor exec{std::move(builtins), policy, &cwd_, &oldpwd_, &vars_, sec,
+                 &parse_cache_};
+
+   // Units run as soon as they are parsed, and are streamed into a new
+   // image at the same time. After `exit` the rest of the file is still
+   // parsed (not run) so the image is complete for the next run.
+   std::optional<ScriptImageWriter> writer;
+   if (key) writer.emplace(*key);
+   const bool recording = writer && writer->active();
+
+   ScriptReader reader{fd};
+   int last_status = 0;
+   const bool ok = for_each_unit(
+      [&] { return reader.next_line(); }, nullptr,
+      [&](const ParseResult& pr) {
+         if (recording) writer->add(pr);
+         if (exec.exit_requested()) return recording;
+         last_status = execute_parse_result(exec, pr, last_status);
+         reap_children_nonblocking();
+         return recording || !exec.exit_requested();
+      },
+      [&](const UnitError& e) {
+         if (!exec.exit_requested())
+            std::cerr << "parse: " << describe_unit_error(e) << '\n';
+         return false;
+      });
+
+   if (reader.failed()) {
+      std::cerr << "clanker: error reading script\n";
+      return 2;
+   }
+   if (ok && recording) writer->commit(reader.content_hash());
+   if (const auto code = exec.exit_requested()) return *code;
+   if (!ok) return 2;
 
+   reap_children_nonblocking();
+   return last_status;
+}
+
+} // namespace clanker
@@ -3,11 +3,18 @@
 #pragma once
 
 #include <filesystem>
+#include <optional>
 #include <string>
 #include <string_view>
 
+#include "clanker/parse_cache.h"
+#include "clanker/vars.h"
+
 namespace clanker {
 
+class ScriptImageReader;
+struct ScriptKey;
+
 class Shell {
  public:
    Shell();
@@ -24,9 +31,16 @@ class Shell {
    const std::filesystem::path& oldpwd() const noexcept { return oldpwd_; }
 
  private:
+   int run_image(ScriptImageReader& image);
+   int run_stream(int fd, const std::optional<ScriptKey>& key);
+
    std::filesystem::path root_;
    std::filesystem::path cwd_;
    std::filesystem::path oldpwd_;
+   VarStore vars_;
+
+   // Parsed units by source text, shared by every run in this shell.
+   ParseCache parse_cache_;
 };
 
 } // namespace clanker
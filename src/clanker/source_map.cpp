@@ -0,0 +1,19 @@
+// src/clanker/source_map.cpp
+#include <algorithm>
+
+#include "clanker/scan.h"
+#include "clanker/source_map.h"
+
+namespace clanker {
+
+SourceLoc locate(std::string_view text, std::size_t offset) noexcept {
+   offset = std::min(offset, text.size());
+   const std::string_view before = text.substr(0, offset);
+   const std::size_t nl = before.rfind('\n');
+   const std::size_t line_start = (nl == std::string_view::npos) ? 0 : nl + 1;
+   return SourceLoc{.index = offset,
+                    .line = count_newlines(before) + 1,
+                    .column = offset - line_start + 1};
+}
+
+} // namespace clanker
@@ -0,0 +1,19 @@
+// src/clanker/source_map.h
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+#include "clanker/lexer.h"
+
+namespace clanker {
+
+// Turns a byte offset (Token::offset, ParseResult::error_offset) into
+// line/column for diagnostics. Only an error report needs one, so nothing
+// is precomputed: the newlines before `offset` are counted with one
+// vectorized scan. Columns are 1-based byte columns. Offsets past the end
+// clamp to the end.
+[[nodiscard]] SourceLoc locate(std::string_view text,
+                               std::size_t offset) noexcept;
+
+} // namespace clanker
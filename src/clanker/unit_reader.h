@@ -0,0 +1,113 @@
+// src/clanker/unit_reader.h
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "clanker/parse_cache.h"
+#include "clanker/parser.h"
+#include "clanker/source_map.h"
+
+namespace clanker {
+
+// Memory for one unit: its tokens, AST and argv strings. Everything is
+// bump-allocated and released wholesale once the unit is done with, so a
+// typical statement does not touch malloc at all.
+class UnitArena {
+ public:
+   std::pmr::memory_resource* resource() noexcept { return &mono_; }
+   void release() noexcept { mono_.release(); }
+
+ private:
+   std::array<std::byte, 16 * 1024> buf_;
+   std::pmr::monotonic_buffer_resource mono_{buf_.data(), buf_.size()};
+};
+
+// A syntax error found while splitting input into units.
+struct UnitError {
+   std::size_t line{0};   // 1-based, counted from the start of the input
+   std::size_t column{0}; // 1-based byte column
+   std::string message;
+   bool end_of_input{false}; // the input ended inside a unit
+};
+
+// Split batch input into units the way the REPL sees them: lines from
+// next_line() (an optional<string_view>, empty at the end) accumulate until
+// they parse Complete. Batch mode and `--check` both read scripts this way.
+//
+// Each unit goes to on_unit(const ParseResult&) as soon as it is complete,
+// before later lines are read; on_unit returns false to stop. A syntax
+// error goes to on_error(const UnitError&), which returns true to drop the
+// unit and go on with the next line or false to stop there. With `cache`,
+// units are looked up and stored by their text. Returns false if there was
+// an error.
+template<class NextLine, class OnUnit, class OnError>
+bool for_each_unit(NextLine&& next_line, ParseCache* cache, OnUnit&& on_unit,
+                   OnError&& on_error) {
+   const Parser parser;
+
+   std::string buffer;
+   UnitArena arena;
+   ParseState cont{arena.resource()};
+
+   bool ok = true;
+   std::size_t line_no = 0;   // of the line just read
+   std::size_t unit_line = 1; // first line of the unit in `buffer`
+   while (const std::optional<std::string_view> line = next_line()) {
+      ++line_no;
+
+      // New unit: the previous one (if any) is done; recycle its memory.
+      if (buffer.empty()) {
+         cont.reset();
+         arena.release();
+         unit_line = line_no;
+      }
+
+      // Newlines separate commands, but a unit may span lines.
+      if (!buffer.empty()) buffer.push_back('\n');
+      buffer += *line;
+
+      if (cache) {
+         if (const ParsedUnitPtr unit = cache->find(buffer)) {
+            buffer.clear();
+            if (!on_unit(unit->result())) return ok;
+            continue;
+         }
+      }
+
+      const auto pr = parser.parse(buffer, cont);
+      if (pr.kind == ParseKind::Incomplete) {
+         continue; // keep accumulating
+      }
+      if (pr.kind == ParseKind::Error) {
+         const SourceLoc loc = locate(buffer, pr.error_offset);
+         buffer.clear();
+         ok = false;
+         if (!on_error(UnitError{.line = unit_line + loc.line - 1,
+                                 .column = loc.column,
+                                 .message = pr.message}))
+            return false;
+         continue;
+      }
+
+      const ParsedUnitPtr unit = cache ? cache->insert(buffer, pr) : nullptr;
+      buffer.clear();
+      if (!on_unit(unit ? unit->result() : pr)) return ok;
+   }
+
+   if (!buffer.empty()) {
+      // EOF inside a construct is an error.
+      on_error(UnitError{.line = unit_line,
+                         .column = 1,
+                         .message = "unexpected end of input",
+                         .end_of_input = true});
+      return false;
+   }
+   return ok;
+}
+
+} // namespace clanker
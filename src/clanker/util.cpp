@@ -64,7 +64,7 @@ std::vector<std::string> split_lines(const std::string& s) {
    return out;
 }
 
-std::optional<int> to_int(const std::string& s) {
+std::optional<int> to_int(std::string_view s) {
    int v = 0;
    const auto* b = s.data();
    const auto* e = s.data() + s.size();
@@ -5,6 +5,7 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <unistd.h>
 #include <vector>
 
 namespace clanker {
@@ -16,11 +17,51 @@ bool ends_with(const std::string& s, const std::string& suffix);
 std::vector<std::string> split_ws(const std::string& s);
 std::vector<std::string> split_lines(const std::string& s);
 
-std::optional<int> to_int(const std::string& s);
+std::optional<int> to_int(std::string_view s);
 
 // Low-level write helper for fd-backed builtins.
 // Returns false on error (other than EINTR, which is retried).
 bool fd_write_all(int fd, std::string_view s) noexcept;
 
+// Owning file descriptor; closes on destruction.
+class UniqueFd {
+ public:
+   UniqueFd() = default;
+   explicit UniqueFd(int fd)
+      : fd_(fd) {}
+   ~UniqueFd() { reset(); }
+
+   UniqueFd(const UniqueFd&) = delete;
+   UniqueFd& operator=(const UniqueFd&) = delete;
+
+   UniqueFd(UniqueFd&& o) noexcept
+      : fd_(o.fd_) {
+      o.fd_ = -1;
+   }
+   UniqueFd& operator=(UniqueFd&& o) noexcept {
+      if (this != &o) {
+         reset();
+         fd_ = o.fd_;
+         o.fd_ = -1;
+      }
+      return *this;
+   }
+
+   int get() const noexcept { return fd_; }
+   int release() noexcept {
+      const int out = fd_;
+      fd_ = -1;
+      return out;
+   }
+
+   void reset(int fd = -1) noexcept {
+      if (fd_ != -1) ::close(fd_);
+      fd_ = fd;
+   }
+
+ private:
+   int fd_{-1};
+};
+
 } // namespace clanker
 
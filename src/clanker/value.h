@@ -4,10 +4,13 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
 
+#include "clanker/lexer.h" // SourceLoc
+
 namespace clanker {
 
 // Forward declarations for future growth.
@@ -69,6 +72,7 @@ class Value {
    }
 
    [[nodiscard]] const Storage& storage() const noexcept { return v_; }
+   [[nodiscard]] Storage& storage() noexcept { return v_; }
 
    [[nodiscard]] const bool* as_bool() const noexcept {
       return std::get_if<bool>(&v_);
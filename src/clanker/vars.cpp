@@ -0,0 +1,221 @@
+// src/clanker/vars.cpp
+#include <algorithm>
+#include <atomic>
+#include <unistd.h>
+
+#include "clanker/vars.h"
+
+namespace clanker {
+
+namespace {
+
+constexpr std::size_t kInitialSlots = 64;
+
+// FNV-1a. Names are short, so a byte loop beats anything that needs setup.
+std::uint64_t hash_name(std::string_view s) noexcept {
+   std::uint64_t h = 0xcbf29ce484222325ull;
+   for (const char c : s) {
+      h ^= static_cast<unsigned char>(c);
+      h *= 0x100000001b3ull;
+   }
+   return h;
+}
+
+bool is_name_start(char c) noexcept {
+   return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool is_name_char(char c) noexcept {
+   return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+// Layout numbers are unique across stores, so a slot cached for one store
+// is never taken for valid in another that reuses its address.
+std::uint64_t next_layout() noexcept {
+   static std::atomic<std::uint64_t> next{1};
+   return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+VarStore::VarStore()
+   : slots_(kInitialSlots)
+   , layout_(next_layout())
+   , pid_(::getpid()) {}
+
+bool VarStore::is_name(std::string_view name) noexcept {
+   if (name.empty() || !is_name_start(name.front())) return false;
+   return std::all_of(name.begin() + 1, name.end(), is_name_char);
+}
+
+void VarStore::import_environment(char* const* envp) {
+   for (; envp != nullptr && *envp != nullptr; ++envp) {
+      const std::string_view entry{*envp};
+      const std::size_t eq = entry.find('=');
+      if (eq == std::string_view::npos) continue;
+      const std::string_view name = entry.substr(0, eq);
+      if (!is_name(name)) continue;
+      Var& v = slots_[intern(name)].var;
+      v.value = Value{std::string{entry.substr(eq + 1)}};
+      v.set = true;
+      v.exported = true;
+   }
+   env_stale_ = true;
+}
+
+std::size_t VarStore::probe(std::string_view name,
+                            std::uint64_t hash) const noexcept {
+   const std::size_t mask = slots_.size() - 1;
+   for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+      const Slot& s = slots_[i];
+      if (s.name.empty() || (s.hash == hash && s.name == name)) return i;
+   }
+}
+
+std::uint32_t VarStore::intern(std::string_view name) {
+   const std::uint64_t hash = hash_name(name);
+   std::size_t i = probe(name, hash);
+   if (!slots_[i].name.empty()) return static_cast<std::uint32_t>(i);
+
+   // At most half full, so probe sequences stay short and always end.
+   if ((used_ + 1) * 2 > slots_.size()) {
+      grow();
+      i = probe(name, hash);
+   }
+   Slot& s = slots_[i];
+   s.hash = hash;
+   s.name = names_.emplace_back(name);
+   ++used_;
+   return static_cast<std::uint32_t>(i);
+}
+
+void VarStore::grow() {
+   std::vector<Slot> old = std::exchange(slots_, {});
+   slots_.resize(old.size() * 2);
+   std::vector<std::uint32_t> moved(old.size());
+   for (std::size_t k = 0; k < old.size(); ++k) {
+      if (old[k].name.empty()) continue;
+      const std::size_t i = probe(old[k].name, old[k].hash);
+      moved[k] = static_cast<std::uint32_t>(i);
+      slots_[i] = std::move(old[k]);
+   }
+   // Saved bindings refer to slots by index.
+   for (Saved& s : saved_) s.slot = moved[s.slot];
+   layout_ = next_layout();
+}
+
+const VarStore::Var* VarStore::find(std::string_view name) const noexcept {
+   const Slot& s = slots_[probe(name, hash_name(name))];
+   return (!s.name.empty() && s.var.set) ? &s.var : nullptr;
+}
+
+const Value* VarStore::lookup(std::string_view name) const {
+   const Var* v = find(name);
+   return v ? &v->value : nullptr;
+}
+
+void VarStore::set(std::string_view name, Value value) {
+   Var& v = slots_[intern(name)].var;
+   v.value = std::move(value);
+   v.set = true;
+   if (v.exported) env_stale_ = true;
+}
+
+void VarStore::set_at(std::uint32_t slot, Value value) {
+   Var& v = slots_[slot].var;
+   v.value = std::move(value);
+   v.set = true;
+   if (v.exported) env_stale_ = true;
+}
+
+void VarStore::set_exported(std::string_view name, bool exported) {
+   Var& v = slots_[intern(name)].var;
+   if (v.exported == exported) return;
+   v.exported = exported;
+   if (v.set) env_stale_ = true;
+}
+
+void VarStore::unset(std::string_view name) {
+   Slot& s = slots_[probe(name, hash_name(name))];
+   if (s.name.empty()) return;
+   if (s.var.exported && s.var.set) env_stale_ = true;
+   s.var = Var{};
+}
+
+const Value::ProcPtr* VarStore::function(
+   std::string_view name) const noexcept {
+   const Slot& s = slots_[probe(name, hash_name(name))];
+   return s.fn ? &s.fn : nullptr;
+}
+
+void VarStore::define_function(std::string_view name, Value::ProcPtr proc) {
+   Slot& s = slots_[intern(name)];
+   if (!s.fn) ++functions_;
+   s.fn = std::move(proc);
+}
+
+void VarStore::unset_function(std::string_view name) {
+   Slot& s = slots_[probe(name, hash_name(name))];
+   if (!s.fn) return;
+   s.fn.reset();
+   --functions_;
+}
+
+bool VarStore::make_local(std::string_view name) {
+   if (depth_ == 0) return false;
+   const std::uint32_t slot = intern(name);
+   for (std::size_t k = frame_; k < saved_.size(); ++k)
+      if (saved_[k].slot == slot) return true;
+
+   Var& v = slots_[slot].var;
+   if (v.exported && v.set) env_stale_ = true;
+   saved_.push_back({.slot = slot, .var = std::exchange(v, Var{})});
+   return true;
+}
+
+void VarStore::pop_frame(std::size_t parent, std::size_t saved) {
+   for (std::size_t k = saved_.size(); k-- > saved;) {
+      Var& v = slots_[saved_[k].slot].var;
+      if ((v.exported && v.set) ||
+          (saved_[k].var.exported && saved_[k].var.set))
+         env_stale_ = true;
+      v = std::move(saved_[k].var);
+   }
+   saved_.resize(saved);
+   frame_ = parent;
+   --depth_;
+}
+
+char* const* VarStore::environment() {
+   if (!env_stale_) return env_.data();
+
+   env_strings_.clear();
+   std::string err;
+   for (const Slot& s : slots_) {
+      if (s.name.empty() || !s.var.set || !s.var.exported) continue;
+      std::string entry{s.name};
+      entry.push_back('=');
+      // A value with no argv form (a list) is not passed on.
+      if (!lower_value(s.var.value, entry, err)) continue;
+      env_strings_.push_back(std::move(entry));
+   }
+   std::sort(env_strings_.begin(), env_strings_.end());
+
+   env_.clear();
+   for (std::string& e : env_strings_) env_.push_back(e.data());
+   env_.push_back(nullptr);
+   env_stale_ = false;
+   return env_.data();
+}
+
+std::vector<std::pair<std::string_view, const VarStore::Var*>>
+VarStore::list() const {
+   std::vector<std::pair<std::string_view, const Var*>> out;
+   for (const Slot& s : slots_)
+      if (!s.name.empty() && s.var.set) out.emplace_back(s.name, &s.var);
+   std::sort(out.begin(), out.end(),
+             [](const auto& a, const auto& b) { return a.first < b.first; });
+   return out;
+}
+
+} // namespace clanker
@@ -0,0 +1,161 @@
+// src/clanker/vars.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "clanker/expr.h"
+#include "clanker/value.h"
+
+namespace clanker {
+
+// Shell variables (execution-model.md §3.6).
+//
+// Each distinct name is interned once into a slot of an open-addressing
+// table (linear probing, power-of-two capacity) holding the name's hash, a
+// view of the interned name and its binding. Slots are never removed;
+// `unset` only clears the binding. A lookup is one hash and, at the load
+// factor kept here, almost always one probe, with no allocation.
+//
+// Scopes are dynamic, as in bash: make_local() saves the binding a name has
+// and the innermost Frame, an object on the C++ stack of whoever runs the
+// function body, puts it back when it ends.
+class VarStore final : public ExprEnv {
+ public:
+   struct Var {
+      Value value;
+      bool set{false};
+      bool exported{false};
+   };
+
+   VarStore();
+
+   VarStore(const VarStore&) = delete;
+   VarStore& operator=(const VarStore&) = delete;
+
+   // Bind every NAME=value of `envp`, exported.
+   void import_environment(char* const* envp);
+
+   // The binding of `name`; null if it is not set.
+   [[nodiscard]] const Var* find(std::string_view name) const noexcept;
+
+   // ExprEnv: the value of `name` for @( ).
+   [[nodiscard]] const Value* lookup(std::string_view name) const override;
+
+   void set(std::string_view name, Value value);
+   void set_exported(std::string_view name, bool exported);
+   void unset(std::string_view name);
+
+   // Shell functions share the name table but not the bindings: a name can
+   // be a variable and a function at once, and frames do not scope
+   // functions. Null if `name` is not a function.
+   [[nodiscard]] const Value::ProcPtr* function(
+      std::string_view name) const noexcept;
+   void define_function(std::string_view name, Value::ProcPtr proc);
+   void unset_function(std::string_view name);
+
+   // Functions defined; callers skip function() entirely while it is 0.
+   [[nodiscard]] std::size_t function_count() const noexcept {
+      return functions_;
+   }
+
+   // Slots, for callers that resolve names once and reuse them (arith.h).
+   // slot() interns `name`. A slot number stays valid while layout() is
+   // unchanged; no two layouts of any store share a number.
+   [[nodiscard]] std::uint32_t slot(std::string_view name) {
+      return intern(name);
+   }
+   [[nodiscard]] std::uint64_t layout() const noexcept { return layout_; }
+   [[nodiscard]] const Var& var_at(std::uint32_t slot) const noexcept {
+      return slots_[slot].var;
+   }
+   void set_at(std::uint32_t slot, Value value);
+
+   // Save the binding of `name` in the innermost frame; it is restored when
+   // the frame ends. False outside a frame.
+   bool make_local(std::string_view name);
+
+   // A variable scope. Frames nest and must end in reverse order, which
+   // holding them as locals guarantees.
+   class Frame {
+    public:
+      explicit Frame(VarStore& store) noexcept
+         : store_(store)
+         , parent_(store.frame_)
+         , saved_(store.saved_.size()) {
+         store_.frame_ = saved_;
+         ++store_.depth_;
+      }
+      ~Frame() { store_.pop_frame(parent_, saved_); }
+
+      Frame(const Frame&) = delete;
+      Frame& operator=(const Frame&) = delete;
+
+    private:
+      VarStore& store_;
+      std::size_t parent_;
+      std::size_t saved_;
+   };
+
+   // Frames open.
+   [[nodiscard]] std::size_t depth() const noexcept { return depth_; }
+
+   // NAME=value for every exported variable, null-terminated, in the form
+   // execve() takes. Rebuilt only after an exported binding changed; valid
+   // until the next change.
+   [[nodiscard]] char* const* environment();
+
+   // Every set variable, sorted by name.
+   [[nodiscard]] std::vector<std::pair<std::string_view, const Var*>>
+   list() const;
+
+   // Process id of the shell, for $$; forked copies keep the parent's.
+   [[nodiscard]] pid_t shell_pid() const noexcept { return pid_; }
+
+   // A valid variable name: [A-Za-z_][A-Za-z0-9_]*.
+   [[nodiscard]] static bool is_name(std::string_view name) noexcept;
+
+ private:
+   struct Slot {
+      std::uint64_t hash{0};
+      std::string_view name; // empty: free
+      Var var;
+      Value::ProcPtr fn; // shell function; null: none
+   };
+
+   struct Saved {
+      std::uint32_t slot;
+      Var var;
+   };
+
+   [[nodiscard]] std::size_t probe(std::string_view name,
+                                   std::uint64_t hash) const noexcept;
+   std::uint32_t intern(std::string_view name);
+   void grow();
+   void pop_frame(std::size_t parent, std::size_t saved);
+
+   std::vector<Slot> slots_; // size is a power of two
+   std::size_t used_{0};
+   std::size_t functions_{0};
+   std::uint64_t layout_;
+   std::deque<std::string> names_; // interned; never moved
+
+   std::vector<Saved> saved_;
+   std::size_t frame_{0}; // saved_ index where the innermost frame starts
+   std::size_t depth_{0};
+
+   std::vector<std::string> env_strings_;
+   std::vector<char*> env_;
+   bool env_stale_{true};
+
+   pid_t pid_;
+};
+
+} // namespace clanker
@@ -1,10 +1,13 @@
 // src/main.cpp
 
 #include <iostream>
+#include <string>
 #include <string_view>
+#include <vector>
 
-#include "clanker/shell.h"
+#include "clanker/script_check.h"
 #include "clanker/security_policy.h"
+#include "clanker/shell.h"
 
 namespace {
 
@@ -12,7 +15,24 @@ void usage(std::ostream& os, std::string_view prog) {
    os << "usage:\n"
       << "  " << prog << "            # REPL\n"
       << "  " << prog << " -c CMD     # run CMD, batch mode\n"
-      << "  " << prog << " SCRIPT     # run SCRIPT file, batch mode\n";
+      << "  " << prog << " SCRIPT     # run SCRIPT file, batch mode\n"
+      << "  " << prog << " --check FILE...  # syntax-check, run nothing\n";
+}
+
+// `--check FILE...`: print "file:line:col: message" for every syntax error.
+// Exit status 2 if any file has an error or cannot be read.
+int check_files(int argc, char** argv) {
+   const std::vector<std::string> paths(argv + 2, argv + argc);
+   int status = 0;
+   for (const auto& r : clanker::check_scripts(paths)) {
+      if (!r.io_error.empty())
+         std::cerr << r.path << ": " << r.io_error << '\n';
+      for (const auto& e : r.errors)
+         std::cerr << r.path << ':' << e.line << ':' << e.column << ": "
+                   << e.message << '\n';
+      if (!r.ok()) status = 2;
+   }
+   return status;
 }
 
 } // namespace
@@ -25,14 +45,22 @@ int main(int argc, char** argv) {
          return ec;
       }
 
+      const std::string_view prog = (argc > 0 && argv[0]) ? argv[0] : "clanker";
+
+      if (argc >= 2 && std::string_view{argv[1]} == "--check") {
+         if (argc == 2) {
+            usage(std::cerr, prog);
+            return 2;
+         }
+         return check_files(argc, argv);
+      }
+
       clanker::Shell shell;
 
       if (argc == 1) {
          return shell.run(); // REPL
       }
 
-      const std::string_view prog = (argc > 0 && argv[0]) ? argv[0] : "clanker";
-
       if (argc == 3 && std::string_view{argv[1]} == "-c") {
          return shell.run_string(argv[2]);
       }
@@ -1,13 +1,17 @@
 // src/tests/test_main.cpp
 
+#include <chrono>
 #include <filesystem>
 #include <cstdlib>
 #include <cerrno>
 #include <cstring>
+#include <fcntl.h>
+#include <fstream>
 #include <iostream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -46,7 +50,9 @@ std::string read_all(int fd) {
    return s;
 }
 
-RunResult run_clanker(const char* clanker_path, std::string_view cmd) {
+// Run clanker with the given arguments (after argv[0]).
+RunResult run_clanker_args(const char* clanker_path,
+                           const std::vector<std::string>& args) {
    int out_pipe[2]{}, err_pipe[2]{};
    if (::pipe(out_pipe) != 0) throw std::runtime_error("pipe(stdout) failed");
    if (::pipe(err_pipe) != 0) throw std::runtime_error("pipe(stderr) failed");
@@ -63,15 +69,12 @@ RunResult run_clanker(const char* clanker_path, std::string_view cmd) {
       ::close(err_pipe[0]);
       ::close(err_pipe[1]);
 
-      const std::string cmd_str(cmd);
-      char* const argv[] = {
-         const_cast<char*>(clanker_path),
-         const_cast<char*>("-c"),
-         const_cast<char*>(cmd_str.c_str()),
-         nullptr,
-      };
+      std::vector<char*> argv;
+      argv.push_back(const_cast<char*>(clanker_path));
+      for (const auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+      argv.push_back(nullptr);
 
-      ::execv(clanker_path, argv);
+      ::execv(clanker_path, argv.data());
       _exit(127);
    }
 
@@ -99,6 +102,10 @@ RunResult run_clanker(const char* clanker_path, std::string_view cmd) {
    return rr;
 }
 
+RunResult run_clanker(const char* clanker_path, std::string_view cmd) {
+   return run_clanker_args(clanker_path, {"-c", std::string(cmd)});
+}
+
 [[noreturn]] void usage() {
    std::cerr << "usage: clanker_tests /path/to/clanker [--case NAME]\n"
              << "cases:\n"
@@ -108,7 +115,25 @@ RunResult run_clanker(const char* clanker_path, std::string_view cmd) {
              << "  status\n"
              << "  andor\n"
              << "  background\n"
-             << "  redirs\n";
+             << "  redirs\n"
+             << "  multiline\n"
+             << "  parse_cache\n"
+             << "  script_cache\n"
+             << "  check\n"
+             << "  brace\n"
+             << "  glob\n"
+             << "  subst\n"
+             << "  expr\n"
+             << "  vars\n"
+             << "  control\n"
+             << "  functions\n"
+             << "  arith\n"
+             << "  case\n"
+             << "  read\n"
+             << "  pipeline_builtins\n"
+             << "  builtin_output\n"
+             << "  help\n"
+             << "  util_builtins\n";
 
    std::exit(2);
 }
@@ -280,9 +305,804 @@ void test_redirs(const char* clanker) {
       expect(rr.err.empty(), "redir 2> stderr empty");
    }
 
+   // A built-in's redirections are its own: the shell's fds are left alone.
+   {
+      const auto rr = run_clanker(
+         clanker, "pwd > " + out + "; unset 1a 2> " + err + "; read x < " +
+                     out + "; echo \"[$x]\"; pwd; pwd > " + tmp.string() +
+                     "/no/such; echo st=$?; > " + in + "; wc -c < " + in +
+                     "; wc -l < " + err);
+      const auto nl = rr.out.find('\n');
+      const std::string dir =
+         nl == std::string::npos ? "" : rr.out.substr(nl + 1);
+      expect(rr.out == "[" + dir.substr(0, dir.find('\n')) + "]\n" + dir &&
+                dir.ends_with("\nst=1\n0\n1\n"),
+             "built-in redirections");
+      expect(rr.err.find("no/such") != std::string::npos,
+             "built-in redirection error on the shell's stderr");
+   }
+
    std::filesystem::remove_all(tmp);
 }
 
+void test_multiline(const char* clanker) {
+   // Constructs that span lines are completed incrementally.
+   {
+      const auto rr = run_clanker(clanker, "echo \"\"\"a\nb\"\"\"");
+      expect(rr.exit_code == 0, "triple quote exit code");
+      expect(rr.out == "a\nb\n", "triple quote stdout");
+   }
+   {
+      const auto rr = run_clanker(clanker, "echo 'x\ny' z");
+      expect(rr.exit_code == 0, "single quote exit code");
+      expect(rr.out == "x\ny z\n", "single quote stdout");
+   }
+   {
+      const auto rr = run_clanker(clanker, "echo a\\\nb");
+      expect(rr.exit_code == 0, "backslash-newline exit code");
+      expect(rr.out == "ab\n", "backslash-newline stdout");
+   }
+   {
+      const auto rr = run_clanker(clanker, "echo a | \\\ncat && echo b");
+      expect(rr.exit_code == 0, "pipe continuation exit code");
+      expect(rr.out == "a\nb\n", "pipe continuation stdout");
+   }
+   {
+      const auto rr = run_clanker(clanker, "echo 'open");
+      expect(rr.exit_code == 2, "unterminated quote exit code");
+      expect(rr.out.empty(), "unterminated quote stdout empty");
+   }
+   {
+      // Diagnostics report line:col within the script.
+      const auto rr = run_clanker(clanker, "echo a\necho \"x\\q\"");
+      expect(rr.exit_code == 2, "lex error exit code");
+      expect(rr.err.find("parse: 2:8: ") != std::string::npos,
+             "lex error location");
+   }
+   {
+      const auto rr = run_clanker(clanker, "echo a\n\necho b | | c");
+      expect(rr.exit_code == 2, "parse error exit code");
+      expect(rr.err.find("parse: 3:10: ") != std::string::npos,
+             "parse error location");
+   }
+   {
+      // A compound command read line by line resumes the parse where the
+      // previous line left off, including in `for` and `case` headers and
+      // between `case` arms.
+      const auto rr = run_clanker(clanker, "f() {\n"
+                                           "  for x in a b\n"
+                                           "  do\n"
+                                           "    case $x\n"
+                                           "    in\n"
+                                           "      a)\n"
+                                           "        echo A ;;\n"
+                                           "      b) echo B\n"
+                                           "         ;;\n"
+                                           "    esac\n"
+                                           "  done\n"
+                                           "}\n"
+                                           "g()\n"
+                                           "{\n"
+                                           "  if true\n"
+                                           "  then echo G\n"
+                                           "  fi\n"
+                                           "}\n"
+                                           "f; g\n"
+                                           "for y\n"
+                                           "in 1 2; do echo $y; done");
+      expect(rr.exit_code == 0, "multi-line compound exit code");
+      expect(rr.out == "A\nB\nG\n1\n2\n", "multi-line compound stdout");
+   }
+   {
+      const auto rr = run_clanker(clanker, "if true; then\n  echo a\n"
+                                           "  echo b | | c\nfi");
+      expect(rr.exit_code == 2 && rr.out.empty(),
+             "error inside multi-line compound exit code");
+      expect(rr.err.find("parse: 3:12: ") != std::string::npos,
+             "error inside multi-line compound location");
+   }
+}
+
+void test_parse_cache(const char* clanker) {
+   // Repeated units are served from the parsed-command cache.
+   const auto rr =
+      run_clanker(clanker, "echo a\necho b\necho a\necho a\nparsecache");
+   expect(rr.exit_code == 0, "parsecache exit code");
+   expect(rr.out.starts_with("a\nb\na\na\nhits: 2\nmisses: 3\n"),
+          "parsecache counters");
+}
+
+void test_script_cache(const char* clanker) {
+   const auto tmp = make_temp_dir();
+   const auto cache = tmp / "cache";
+   ::setenv("CLANKER_CACHE_DIR", cache.c_str(), 1);
+
+   const std::string script = (tmp / "script.clk").string();
+   auto write_script = [&](std::string_view text) {
+      std::ofstream(script, std::ios::trunc) << text;
+   };
+
+   write_script("# generated\necho one\necho two | cat && echo three\n");
+   {
+      const auto rr = run_clanker_args(clanker, {script});
+      expect(rr.exit_code == 0, "cold run exit code");
+      expect(rr.out == "one\ntwo\nthree\n", "cold run stdout");
+   }
+
+   std::size_t images = 0;
+   for (const auto& e : std::filesystem::directory_iterator(cache))
+      images += (e.path().extension() == ".ast");
+   expect(images == 1, "script image written");
+
+   {
+      const auto rr = run_clanker_args(clanker, {script});
+      expect(rr.exit_code == 0, "cached run exit code");
+      expect(rr.out == "one\ntwo\nthree\n", "cached run stdout");
+   }
+
+   // Edits invalidate the image.
+   write_script("echo changed\n");
+   {
+      const auto rr = run_clanker_args(clanker, {script});
+      expect(rr.out == "changed\n", "edited script stdout");
+   }
+
+   // A parse error still runs the units before it, and is not cached.
+   write_script("echo a\necho b | | c\n");
+   {
+      const auto rr = run_clanker_args(clanker, {script});
+      expect(rr.exit_code == 2, "parse error exit code");
+      expect(rr.out == "a\n", "parse error stdout");
+   }
+
+   // `exit` stops the script; the rest is still compiled into the image.
+   write_script("echo a\nexit 3\necho b\n");
+   for (const char* run : {"cold", "cached"}) {
+      const auto rr = run_clanker_args(clanker, {script});
+      expect(rr.exit_code == 3, std::string(run) + " exit code after exit");
+      expect(rr.out == "a\n", std::string(run) + " stdout after exit");
+   }
+
+   // A FIFO is read once per run and never cached.
+   const std::string fifo = (tmp / "fifo").string();
+   expect(::mkfifo(fifo.c_str(), 0600) == 0, "mkfifo");
+   for (int run = 1; run <= 3; ++run) {
+      const pid_t writer = ::fork();
+      if (writer == 0) {
+         const int fd = ::open(fifo.c_str(), O_WRONLY);
+         if (fd >= 0) (void)::write(fd, "echo hi\n", 8);
+         _exit(0);
+      }
+      const auto rr = run_clanker_args(clanker, {fifo});
+      ::waitpid(writer, nullptr, 0);
+      expect(rr.exit_code == 0 && rr.out == "hi\n",
+             "fifo run " + std::to_string(run));
+   }
+   images = 0;
+   for (const auto& e : std::filesystem::directory_iterator(cache))
+      images += (e.path().extension() == ".ast");
+   expect(images == 1, "fifo not cached");
+
+   ::unsetenv("CLANKER_CACHE_DIR");
+}
+
+void test_check(const char* clanker) {
+   const auto tmp = make_temp_dir();
+   const std::string good = (tmp / "good.clk").string();
+   const std::string bad = (tmp / "bad.clk").string();
+   std::ofstream(good) << "echo one\necho \"two\nlines\" | cat\n";
+   std::ofstream(bad) << "echo a\necho b | | c\necho ok > out\nls >\n";
+
+   {
+      const auto rr = run_clanker_args(clanker, {"--check", good});
+      expect(rr.exit_code == 0, "--check clean exit code");
+      expect(rr.out.empty() && rr.err.empty(), "--check clean output");
+   }
+
+   // Every error is reported, and nothing runs.
+   {
+      const auto rr = run_clanker_args(clanker, {"--check", good, bad});
+      expect(rr.exit_code == 2, "--check error exit code");
+      expect(rr.out.empty(), "--check runs nothing");
+      expect(rr.err.find(bad + ":2:10: ") != std::string::npos,
+             "--check first diagnostic");
+      expect(rr.err.find(bad + ":4:4: ") != std::string::npos,
+             "--check second diagnostic");
+      expect(!std::filesystem::exists(tmp / "out"), "--check no side effects");
+   }
+
+   {
+      const auto rr = run_clanker_args(
+         clanker, {"--check", (tmp / "missing.clk").string()});
+      expect(rr.exit_code == 2, "--check missing file exit code");
+   }
+
+   // Not a script named "--check".
+   {
+      const auto rr = run_clanker_args(clanker, {"--check"});
+      expect(rr.exit_code == 2 && rr.err.find("usage:") != std::string::npos,
+             "--check without files prints usage");
+   }
+}
+
+void test_brace(const char* clanker) {
+   {
+      const auto rr =
+         run_clanker(clanker, "echo a{b,c}d x{1..3} \"{a,b}\" \\{x,y}");
+      expect(rr.exit_code == 0, "brace list/range exit code");
+      expect(rr.out == "abd acd x1 x2 x3 {a,b} {x,y}\n",
+             "brace list/range stdout");
+      expect(rr.err.empty(), "brace list/range stderr empty");
+   }
+   {
+      const auto rr =
+         run_clanker(clanker, "x=a,b; echo {08..10} {e..a..2} ${x}");
+      expect(rr.exit_code == 0, "brace padding exit code");
+      expect(rr.out == "08 09 10 e c a a,b\n", "brace padding stdout");
+   }
+   {
+      ::setenv("CLANKER_EXPAND_MAX_WORDS", "100", 1);
+      const auto rr = run_clanker(clanker, "echo {1..10}{1..11}; echo after");
+      ::unsetenv("CLANKER_EXPAND_MAX_WORDS");
+      expect(rr.exit_code == 0, "brace limit list continues");
+      expect(rr.out == "after\n", "brace limit runs nothing");
+      expect(rr.err.find("exceeds the limit of 100") != std::string::npos,
+             "brace limit stderr");
+   }
+}
+
+void test_glob(const char* clanker) {
+   namespace fs = std::filesystem;
+   const auto tmp = make_temp_dir();
+   const std::string t = tmp.string();
+   fs::create_directories(tmp / "d" / "sub");
+   fs::create_directories(tmp / "d" / ".hidden");
+   for (const char* f : {"a.c", "b.c", ".h.c", "d/1.txt", "d/sub/2.txt",
+                         "d/.hidden/3.txt"})
+      std::ofstream(tmp / f) << "";
+
+   {
+      const auto rr = run_clanker(clanker, "echo " + t + "/*.c " + t +
+                                              "/[!a].c \"" + t + "/*.c\"");
+      expect(rr.exit_code == 0, "glob exit code");
+      expect(rr.out == t + "/a.c " + t + "/b.c " + t + "/b.c " + t + "/*.c\n",
+             "glob stdout");
+   }
+   {
+      const auto rr =
+         run_clanker(clanker, "echo " + t + "/**/*.txt " + t + "/{a,x}*");
+      expect(rr.out == t + "/d/1.txt " + t + "/d/sub/2.txt " + t + "/a.c " +
+                          t + "/x*\n",
+             "glob globstar/brace stdout");
+   }
+   {
+      // A `for` loop walks the matches as it goes, in the same order.
+      const auto rr = run_clanker(
+         clanker, "for f in x " + t + "/d/**/*.txt " + t + "/{a,n}*; do "
+                  "echo \"<$f>\"; done; for f in " + t + "/*.c; do echo $f; "
+                  "break; done");
+      expect(rr.out == "<x>\n<" + t + "/d/1.txt>\n<" + t + "/d/sub/2.txt>\n<" +
+                          t + "/a.c>\n<" + t + "/n*>\n" + t + "/a.c\n",
+             "glob for loop stdout");
+   }
+   {
+      // An old directory's listing is cached; adding a file must still show.
+      const auto old = fs::file_time_type::clock::now() - std::chrono::hours(1);
+      fs::last_write_time(tmp / "d", old);
+      const auto rr = run_clanker(clanker, "echo " + t + "/d/*.txt; touch " +
+                                              t + "/d/new.txt; echo " + t +
+                                              "/d/*.txt");
+      expect(rr.out == t + "/d/1.txt\n" + t + "/d/1.txt " + t +
+                          "/d/new.txt\n",
+             "glob cache invalidation");
+   }
+   fs::remove_all(tmp);
+}
+
+void test_subst(const char* clanker) {
+   {
+      const auto rr = run_clanker(
+         clanker, "echo a$(echo \"b  c\")d `echo x` $(echo $(echo nested))");
+      expect(rr.exit_code == 0, "subst exit code");
+      expect(rr.out == "ab cd x nested\n", "subst splitting/nesting stdout");
+      expect(rr.err.empty(), "subst stderr empty");
+   }
+   {
+      // In double quotes the output is one field, quotes in the body nest,
+      // and wildcards are literal.
+      const auto rr = run_clanker(
+         clanker, "z=\"$(echo a b)\"; for w in \"$z\" \"$(echo \"c  d\")\" "
+                  "\"`echo e f`\" \"[$(echo '*')]\" \"$((1 + 2))\" \"$(true)\"; "
+                  "do echo \"<$w>\"; done");
+      expect(rr.out == "<a b>\n<c  d>\n<e f>\n<[*]>\n<3>\n<>\n",
+             "subst in double quotes stdout");
+   }
+   {
+      // pwd runs in-process; its output must match a plain `pwd`.
+      const auto rr = run_clanker(clanker, "echo $(pwd); pwd");
+      const auto nl = rr.out.find('\n');
+      expect(nl != std::string::npos &&
+                rr.out.substr(0, nl + 1) == rr.out.substr(nl + 1),
+             "subst pure built-in stdout");
+   }
+   {
+      // `exit` in a substitution ends the subshell, not the shell.
+      const auto rr =
+         run_clanker(clanker, "echo a$(echo x; exit 3)b$(exit 4); echo after");
+      expect(rr.exit_code == 0, "subst exit isolation exit code");
+      expect(rr.out == "axb\nafter\n", "subst exit isolation stdout");
+   }
+   {
+      // $? and an assignment-only command take the last substitution's
+      // status; one that cannot be spawned is reported.
+      const auto rr = run_clanker(
+         clanker, "x=$(false); echo a $?; x=$(exit 3) y=$?; echo b $? $y; "
+                  "false; echo $(true) c $?; x=$(sh -c 'exit 4'); echo d $?; "
+                  "x=$(false); true; echo e $?; x=$(no-such-cmd); echo f $?");
+      expect(rr.out == "a 1\nb 3 3\nc 0\nd 4\ne 0\nf 127\n",
+             "subst status stdout");
+      expect(rr.err.find("no-such-cmd: ") != std::string::npos,
+             "subst spawn failure stderr");
+   }
+   {
+      const auto rr = run_clanker(clanker, "echo $(| x); echo next");
+      expect(rr.out == "next\n", "subst syntax error runs nothing");
+      expect(rr.err.find("command substitution: ") != std::string::npos,
+             "subst syntax error stderr");
+   }
+}
+
+void test_expr(const char* clanker) {
+   {
+      const auto rr = run_clanker(
+         clanker, "echo @(1+2*3) x@(\"a b\")y @(len([1,2,3]) > 2) "
+                  "@(*range(3)) @(*[]) @(null)end");
+      expect(rr.exit_code == 0, "expr exit code");
+      expect(rr.out == "7 xa by true 0 1 2 end\n", "expr lowering stdout");
+      expect(rr.err.empty(), "expr stderr empty");
+   }
+   {
+      const auto rr = run_clanker(clanker, "echo @([1]); echo @(1/0); echo ok");
+      expect(rr.out == "ok\n", "expr runtime errors run nothing");
+      expect(rr.err.find("splice it") != std::string::npos &&
+                rr.err.find("division by zero") != std::string::npos,
+             "expr runtime errors stderr");
+   }
+   {
+      // Compiled at parse time: a bad expression stops the whole input.
+      const auto rr = run_clanker(clanker, "echo first; echo @(1 +)");
+      expect(rr.exit_code == 2, "expr syntax error exit code");
+      expect(rr.out.empty(), "expr syntax error runs nothing");
+   }
+   {
+      // Programs are rebuilt when a script runs from its cached image.
+      const auto tmp = make_temp_dir();
+      ::setenv("CLANKER_CACHE_DIR", (tmp / "cache").c_str(), 1);
+      const std::string script = (tmp / "script.clk").string();
+      std::ofstream(script) << "echo @(join(split('a-b', '-'), '+'))\n";
+      const auto cold = run_clanker_args(clanker, {script});
+      const auto cached = run_clanker_args(clanker, {script});
+      ::unsetenv("CLANKER_CACHE_DIR");
+      expect(cold.out == "a+b\n" && cached.out == "a+b\n",
+             "expr from script image stdout");
+      std::filesystem::remove_all(tmp);
+   }
+}
+
+void test_vars(const char* clanker) {
+   {
+      const auto rr = run_clanker(
+         clanker, "p=src/lib.tar.gz; x=1 y=$x; echo ${#p} ${p##*/} ${p%.*} "
+                  "${p//./_} ${u:-d} ${y:+set} \"$p\\$\" $?");
+      expect(rr.exit_code == 0, "vars exit code");
+      expect(rr.out == "14 lib.tar.gz src/lib.tar src/lib_tar_gz d set "
+                       "src/lib.tar.gz$ 0\n",
+             "vars parameter forms stdout");
+      expect(rr.err.empty(), "vars stderr empty");
+   }
+   {
+      // A quoted '/' is part of the pattern, not its end.
+      const auto rr = run_clanker(
+         clanker, "p=/a/b; echo ${p//\\//:} ${p/#\\/a/R} ${p//'/'/-} "
+                  "${p//\"/\"/+} \"${p%/*}\"");
+      expect(rr.out == ":a:b R/b -a-b +a+b /a\n",
+             "vars quoted slash in pattern stdout");
+   }
+   {
+      // Prefix assignments reach the command's environment only.
+      const auto rr = run_clanker(
+         clanker, "x=1 y=${x}2 sh -c 'echo $x$y'; echo \"[$x]\"; export A=1; "
+                  "export -p | grep \"export A=\"; unset A; echo \"[$A]\"");
+      expect(rr.out == "112\n[]\nexport A='1'\n[]\n",
+             "vars prefix and export stdout");
+   }
+   {
+      const auto rr =
+         run_clanker(clanker, "echo ${u:?gone}; echo st=$?; local v");
+      expect(rr.out == "st=1\n", "vars expansion error fails one command");
+      expect(rr.err.find("u: gone") != std::string::npos &&
+                rr.err.find("local: can only be used in a function") !=
+                   std::string::npos,
+             "vars errors stderr");
+   }
+}
+
+void test_control(const char* clanker) {
+   {
+      const auto rr = run_clanker(
+         clanker, "for x in a {1..2} b; do if test $x = 1; then continue; "
+                  "elif test $x = b; then break; else echo $x; fi; done; "
+                  "until true; do echo no; done; echo st=$?");
+      expect(rr.exit_code == 0, "control exit code");
+      expect(rr.out == "a\n2\nst=0\n", "control if/for/until stdout");
+   }
+   {
+      // break 2 leaves both loops, and the redirection around the inner one.
+      const auto rr = run_clanker(
+         clanker, "for i in 1 2; do for j in x y; do echo $i$j; break 2; "
+                  "done > /dev/null; echo no; done; echo $i; "
+                  "while false; do :; done; echo st=$?; echo if then fi");
+      expect(rr.out == "1\nst=0\nif then fi\n", "control break 2 stdout");
+   }
+   {
+      const auto rr = run_clanker(clanker, "for x in a; do echo $x; fi");
+      expect(rr.exit_code == 2, "control parse error exit code");
+      expect(rr.err.find("unexpected 'fi'") != std::string::npos,
+             "control parse error stderr");
+   }
+
+   // Compound commands span lines, and survive the script image.
+   const auto tmp = make_temp_dir();
+   ::setenv("CLANKER_CACHE_DIR", (tmp / "cache").c_str(), 1);
+   const std::string script = (tmp / "loop.clk").string();
+   std::ofstream(script) << "for x in a b\ndo\n  if test $x = a\n  then\n"
+                            "    echo first\n  else\n    echo $x\n  fi\n"
+                            "done\n";
+   for (const char* run : {"control cold script", "control cached script"}) {
+      const auto rr = run_clanker_args(clanker, {script});
+      expect(rr.exit_code == 0 && rr.out == "first\nb\n", run);
+   }
+   ::unsetenv("CLANKER_CACHE_DIR");
+   std::filesystem::remove_all(tmp);
+}
+
+void test_functions(const char* clanker) {
+   {
+      const auto rr = run_clanker(
+         clanker, "greet() { echo \"$# $1-$2 [$@]\"; }; greet a b; "
+                  "each(){ for w; do echo \"<$w>\"; done; }; each \"x y\" z; "
+                  "{ echo grouped; } > /dev/null; echo { literal }");
+      expect(rr.exit_code == 0, "functions exit code");
+      expect(rr.out == "2 a-b [a b]\n<x y>\n<z>\n{ literal }\n",
+             "functions call and positional parameters stdout");
+      expect(rr.err.empty(), "functions stderr empty");
+   }
+   {
+      // `local` ends with the call; `return` ends the body early.
+      const auto rr = run_clanker(
+         clanker, "v=out; f () { local v=in; echo $v; return 3; echo no; }; "
+                  "f; echo \"st=$? v=$v\"; unset -f f; f; echo st=$?; "
+                  "return 1; echo st=$?");
+      expect(rr.out == "in\nst=3 v=out\nst=127\nst=1\n",
+             "functions local and return stdout");
+      expect(rr.err.find("can only `return' from a function") !=
+                std::string::npos,
+             "functions top-level return stderr");
+   }
+   {
+      ::setenv("CLANKER_MAX_CALL_DEPTH", "50", 1);
+      const auto rr = run_clanker(clanker, "r() { r; }; r; echo st=$?");
+      ::unsetenv("CLANKER_MAX_CALL_DEPTH");
+      expect(rr.out == "st=1\n", "functions depth limit stdout");
+      expect(rr.err.find("r: maximum function nesting level exceeded (50)") !=
+                std::string::npos,
+             "functions depth limit stderr");
+   }
+   {
+      const auto rr = run_clanker(clanker, "f() echo no");
+      expect(rr.exit_code == 2, "functions simple body exit code");
+      expect(rr.err.find("must be a compound command") != std::string::npos,
+             "functions simple body stderr");
+   }
+
+   // Definitions survive the script image.
+   const auto tmp = make_temp_dir();
+   ::setenv("CLANKER_CACHE_DIR", (tmp / "cache").c_str(), 1);
+   const std::string script = (tmp / "fn.clk").string();
+   std::ofstream(script) << "twice() {\n  $1\n  $1\n}\ntwice pwd >/dev/null\n"
+                            "{\n  twice true\n} && echo done\n";
+   for (const char* run :
+        {"functions cold script", "functions cached script"}) {
+      const auto rr = run_clanker_args(clanker, {script});
+      expect(rr.exit_code == 0 && rr.out == "done\n", run);
+   }
+   ::unsetenv("CLANKER_CACHE_DIR");
+   std::filesystem::remove_all(tmp);
+}
+
+void test_arith(const char* clanker) {
+   {
+      const auto rr = run_clanker(
+         clanker, "i=0; while (( i < 5 )); do i=$((i + 1)); done; "
+                  "echo $i $((1 + 2 * 3)) $((-2 ** 2)) $((7 % -3)) "
+                  "$((0x10 | 010)) $(( i > 2 ? i << 2 : 0 )); "
+                  "(( n = 5 < 3 )); echo st=$? n=$n; (( n++ )); "
+                  "echo st=$? n=$n");
+      expect(rr.exit_code == 0, "arith exit code");
+      expect(rr.out == "5 7 4 1 24 20\nst=1 n=0\nst=1 n=1\n",
+             "arith values and (( )) status stdout");
+      expect(rr.err.empty(), "arith stderr empty");
+   }
+   {
+      // Checked: no silent wrap-around, and an error fails the command.
+      const auto rr = run_clanker(
+         clanker, "echo $((2 ** 62 * 2)); echo st=$?; (( 1 / 0 )); "
+                  "echo st=$?; x=abc; echo $((x)); f() { echo $(($1 + $#)); }; "
+                  "f 40");
+      expect(rr.out == "st=1\nst=1\n41\n", "arith errors stdout");
+      expect(rr.err.find("$((2 ** 62 * 2)): integer overflow") !=
+                   std::string::npos &&
+                rr.err.find("(( 1 / 0 )): division by 0") !=
+                   std::string::npos &&
+                rr.err.find("x: not an integer") != std::string::npos,
+             "arith errors stderr");
+   }
+   {
+      const auto rr = run_clanker(clanker, "echo $((1 +))");
+      expect(rr.exit_code == 2 &&
+                rr.err.find("$((1 +)): expression expected") !=
+                   std::string::npos,
+             "arith compile error is a syntax error");
+   }
+
+   // (( )) survives the script image.
+   const auto tmp = make_temp_dir();
+   ::setenv("CLANKER_CACHE_DIR", (tmp / "cache").c_str(), 1);
+   const std::string script = (tmp / "count.clk").string();
+   std::ofstream(script) << "n=0\nwhile (( n < 3 ))\ndo\n  n=$((n + 1))\n"
+                            "done\necho $n\n";
+   for (const char* run : {"arith cold script", "arith cached script"}) {
+      const auto rr = run_clanker_args(clanker, {script});
+      expect(rr.exit_code == 0 && rr.out == "3\n", run);
+   }
+   ::unsetenv("CLANKER_CACHE_DIR");
+   std::filesystem::remove_all(tmp);
+}
+
+void test_case(const char* clanker) {
+   {
+      const auto rr = run_clanker(
+         clanker, "for w in a.c b.h x.py .rc README; do case $w in "
+                  "*.c|*.h) echo $w:c;; *.py) echo $w:py;; .*) echo $w:dot;; "
+                  "*) echo $w:other;; esac; done; "
+                  "case abc in (abc) echo paren;; esac; "
+                  "case z in a) echo a;; esac; echo st=$?; "
+                  "false; case z in z) ;; esac; echo st=$?; "
+                  "case z in z) false;; esac; echo st=$?");
+      expect(rr.exit_code == 0, "case exit code");
+      expect(rr.out == "a.c:c\nb.h:c\nx.py:py\n.rc:dot\nREADME:other\n"
+                       "paren\nst=0\nst=0\nst=1\n",
+             "case arms and status stdout");
+      expect(rr.err.empty(), "case stderr empty");
+   }
+   {
+      // Patterns with substitutions are expanded in order, up to the first
+      // match; what they substitute is literal.
+      const auto rr = run_clanker(
+         clanker, "p='h*'; case 'h*' in $p) echo dyn;; esac; "
+                  "case hello in $p) echo no;; h$(echo e)*) echo subst;; "
+                  "${unset:?never}) ;; esac; "
+                  "for i in 1 2 3; do case $i in 2) continue;; 3) break;; "
+                  "esac; echo i=$i; done");
+      expect(rr.out == "dyn\nsubst\ni=1\n", "case substitutions stdout");
+      expect(rr.err.empty(), "case stops at the first match");
+   }
+   {
+      const auto rr = run_clanker(clanker, "case x in a b) echo;; esac");
+      expect(rr.exit_code == 2 &&
+                rr.err.find("expected ')' in 'case'") != std::string::npos,
+             "case syntax error");
+   }
+
+   // `case` survives the script image.
+   const auto tmp = make_temp_dir();
+   ::setenv("CLANKER_CACHE_DIR", (tmp / "cache").c_str(), 1);
+   const std::string script = (tmp / "case.clk").string();
+   std::ofstream(script) << "f() {\n  case $1 in\n    -h|--help) echo help ;;\n"
+                            "    *) ;;\n  esac\n}\nf --help\nf x\n";
+   for (const char* run : {"case cold script", "case cached script"}) {
+      const auto rr = run_clanker_args(clanker, {script});
+      expect(rr.exit_code == 0 && rr.out == "help\n", run);
+   }
+   ::unsetenv("CLANKER_CACHE_DIR");
+   std::filesystem::remove_all(tmp);
+}
+
+void test_read(const char* clanker) {
+   const auto tmp = make_temp_dir();
+   const std::string in = (tmp / "in.txt").string();
+   std::ofstream(in) << "  a  b c  \n1:2:\nx\\ y\\\nz\n" << "p;q;last";
+
+   {
+      const auto rr = run_clanker(
+         clanker, "while read a b; do echo \"[$a][$b]\"; done < " + in +
+                     "; echo \"st=$? [$a][$b]\"");
+      expect(rr.exit_code == 0, "read exit code");
+      expect(rr.out == "[a][b c]\n[1:2:][]\n[x yz][]\nst=0 [p;q;last][]\n",
+             "read splits fields and joins escaped lines");
+   }
+   {
+      const auto rr = run_clanker(
+         clanker, "IFS=:; { read -r a b; read -r a b; } < " + in +
+                     "; echo \"[$a][$b]\"; IFS=';'; "
+                     "while read -d ';' x; do echo \"[$x]\"; done < " + in +
+                     "; echo \"[$x]\"");
+      expect(rr.out == "[1][2]\n[  a  b c  \n1:2:\nx yz\np]\n[q]\n[last]\n",
+             "read with IFS and -d");
+   }
+   {
+      // Read-ahead is rewound on a regular file, so a command run between
+      // two reads starts where the first stopped.
+      const auto rr = run_clanker(
+         clanker, "{ read; head -n 1; read -r; echo \"[$REPLY]\"; } < " + in);
+      expect(rr.out == "1:2:\n[x\\ y\\]\n", "read leaves the offset exact");
+   }
+   {
+      // Nor does it take more than the line from a pipe.
+      const auto rr = run_clanker(
+         clanker, "printf '1\\n2\\n3\\n' | " + std::string(clanker) +
+                     " -c 'read a; head -n 1'");
+      expect(rr.out == "2\n", "read leaves the rest of a pipe");
+   }
+   {
+      const auto rr = run_clanker(clanker, "read 1a < " + in);
+      expect(rr.exit_code == 1 &&
+                rr.err.find("not a valid identifier") != std::string::npos,
+             "read rejects bad names");
+   }
+   std::filesystem::remove_all(tmp);
+}
+
+void test_pipeline_builtins(const char* clanker) {
+   {
+      const auto rr = run_clanker(
+         clanker, "pwd | pwd | read a; echo \"[$a]\"; "
+                  "printf 'x y\\nz\\n' | read b c; echo \"[$b][$c]\"; "
+                  "models | head -n 1; "
+                  "echo x | prompt summarize | cat");
+      expect(rr.exit_code == 0, "builtin stages exit code");
+      const std::string cwd = std::filesystem::current_path().string();
+      expect(rr.out == "[" + cwd + "]\n[x][y]\nopenai:gpt-stub\n"
+                       "[stub llm] summarize\n",
+             "builtin stages stdout");
+      expect(rr.err.empty(), "builtin stages stderr empty");
+   }
+   {
+      // A built-in that changes shell state in a non-last stage runs in a
+      // forked copy of the shell; in the last stage it runs in the shell.
+      const auto rr = run_clanker(
+         clanker, "export A=1 | cat; echo \"[$A]\"; "
+                  "echo | export B=2; echo \"[$B]\"; "
+                  "unset x | false; echo st=$?");
+      expect(rr.out == "[]\n[2]\nst=1\n", "builtin stage shell state");
+   }
+   {
+      // A stage on a worker thread has no variables, but their locale.
+      const auto rr = run_clanker(
+         clanker, "export LC_ALL=C.UTF-8; printf 'x\\u00e9\\n' | cat; "
+                  "LC_ALL=C printf 'y\\u00e9\\n' | cat");
+      expect(rr.out == "x\u00e9\ny\\u00E9\n", "builtin stage locale");
+   }
+   {
+      const auto tmp = make_temp_dir();
+      const std::string out = (tmp / "out").string();
+      const auto rr = run_clanker(
+         clanker, "models > " + out + " | cat; read m < " + out +
+                     "; echo \"[$m]\"");
+      expect(rr.out == "[openai:gpt-stub]\n", "builtin stage redirection");
+      std::filesystem::remove_all(tmp);
+   }
+}
+
+void test_builtin_output(const char* clanker) {
+   {
+      // Far more than the sink's buffer, in pieces of every size.
+      const auto rr = run_clanker(
+         clanker, "v=$(head -c 20000 /dev/zero | tr '\\0' \"'\"); "
+                  "w=$(head -c 30000 /dev/zero | tr '\\0' x); "
+                  "declare -p v w v | wc -c");
+      expect(rr.out == "190015\n", "large built-in output");
+   }
+   {
+      const auto rr = run_clanker(
+         clanker, "pwd > /dev/full; echo st=$?; h=1; declare -p h > /dev/full; "
+                  "echo st=$?");
+      expect(rr.out == "st=1\nst=1\n", "failed built-in writes");
+   }
+}
+
+void test_help(const char* clanker) {
+   const auto rr = run_clanker(clanker, "help; help | head -n 1");
+   expect(rr.exit_code == 0, "help exit code");
+   expect(rr.out.starts_with(":  : — do nothing, successfully\n"
+                             "[  [ expr ] — evaluate a condition\n"
+                             "ask  ask <backend> <text...>"),
+          "help is sorted");
+   expect(rr.out.find("\nread  read [-r] [-d delim] [name ...]") !=
+             std::string::npos,
+          "help lists the core built-ins");
+   expect(rr.out.ends_with("\n:  : — do nothing, successfully\n"),
+          "help in a pipeline stage");
+}
+
+void test_util_builtins(const char* clanker) {
+   {
+      const auto rr = run_clanker(
+         clanker, "export LC_ALL=C; "
+                  "echo -n a; echo -e 'x\\ty' 'b\\c'; echo; echo -E 'a\\nb'; "
+                  "printf '%s-%d\\n' a 1 b 2 c; "
+                  "printf '%5.2f/%x/%o/%c\\n' 3.14159 255 8 xyz; "
+                  "printf '%q %q\\n' 'a b' \"it's\"; "
+                  "printf '%b\\n' 'a\\x41\\101'; "
+                  "printf %d x; echo \" st=$?\"");
+      expect(rr.out == "ax\ty b\na\\nb\na-1\nb-2\nc-0\n 3.14/ff/10/x\n"
+                       "'a b' \"it's\"\naAA\n0 st=1\n",
+             "echo and printf stdout");
+      expect(rr.err == "printf: 'x': expected a numeric value\n",
+             "printf diagnostics");
+   }
+   {
+      const auto rr = run_clanker(
+         clanker, "export LC_ALL=C; test 2 -lt 10; echo $?; "
+                  "[ abc = abc -a -n x ]; echo $?; "
+                  "test -n; echo $?; [ 1 -eq ]; echo $?; [ x; echo $?");
+      expect(rr.out == "0\n0\n0\n2\n2\n", "test status");
+      expect(rr.err == "[: missing argument after '-eq'\n[: missing ']'\n",
+             "test diagnostics");
+   }
+   {
+      // The stat cache lives for one command: a file created after one
+      // test is seen by the next, and -L and -e of a dangling link differ.
+      const auto tmp = make_temp_dir();
+      const std::string f = (tmp / "f").string();
+      const std::string l = (tmp / "l").string();
+      std::filesystem::create_symlink(tmp / "nowhere", l);
+      const auto rr = run_clanker(
+         clanker, "test -e " + f + "; echo $?; : > " + f + "; test -e " + f +
+                     " -a -f " + f + " -a ! -d " + f + "; echo $?; [ -L " + l +
+                     " -a ! -e " + l + " ]; echo $?");
+      expect(rr.out == "1\n0\n0\n", "test file operators");
+      std::filesystem::remove_all(tmp);
+   }
+   {
+      const auto rr = run_clanker(
+         clanker, "export LC_ALL=C; basename /a/b.c .c; "
+                  "basename -a x/y z/; "
+                  "basename -s .h a.h b.h; dirname /a/b c / a//b//; "
+                  "seq 3; seq -w 8 11; seq -s , 1 2 9; seq 0.5 0.25 1; "
+                  "seq -f %03g 2; seq 1 0 2; echo st=$?");
+      expect(rr.out == "b\ny\nz\na\nb\n/a\n.\n/\na\n1\n2\n3\n08\n09\n10\n"
+                       "11\n1,3,5,7,9\n0.50\n0.75\n1.00\n001\n002\nst=1\n",
+             "basename, dirname and seq stdout");
+      expect(rr.err == "seq: invalid Zero increment value: '0'\n"
+                       "Try 'seq --help' for more information.\n",
+             "seq diagnostics");
+   }
+   {
+      // `command` runs the external program, even over a function.
+      const auto rr = run_clanker(
+         clanker, "PATH=/nonexistent true; echo $?; "
+                  "PATH=/nonexistent command true; echo $?; "
+                  "command :; echo $?; x=$(command basename /a/b); echo $x; "
+                  "command seq 2 | command cat; "
+                  "echo() { printf fn; }; echo hi; command echo hi; "
+                  "command -v printf; command -V echo");
+      expect(rr.out == "0\n127\n127\nb\n1\n2\nfnhi\nprintf\necho is a "
+                       "function\n",
+             "command forces the external");
+   }
+}
+
 } // namespace
 
 int main(int argc, char** argv) {
@@ -298,6 +1118,24 @@ int main(int argc, char** argv) {
       test_status(clanker);
       test_andor(clanker);
       test_background(clanker);
+      test_multiline(clanker);
+      test_parse_cache(clanker);
+      test_script_cache(clanker);
+      test_check(clanker);
+      test_brace(clanker);
+      test_glob(clanker);
+      test_subst(clanker);
+      test_expr(clanker);
+      test_vars(clanker);
+      test_control(clanker);
+      test_functions(clanker);
+      test_arith(clanker);
+      test_case(clanker);
+      test_read(clanker);
+      test_pipeline_builtins(clanker);
+      test_builtin_output(clanker);
+      test_help(clanker);
+      test_util_builtins(clanker);
    } else if (which == "smoke") {
       test_smoke(clanker);
    } else if (which == "pipeline") {
@@ -312,6 +1150,42 @@ int main(int argc, char** argv) {
       test_background(clanker);
    } else if (which == "redirs") {
       test_redirs(clanker);
+   } else if (which == "multiline") {
+      test_multiline(clanker);
+   } else if (which == "parse_cache") {
+      test_parse_cache(clanker);
+   } else if (which == "script_cache") {
+      test_script_cache(clanker);
+   } else if (which == "check") {
+      test_check(clanker);
+   } else if (which == "brace") {
+      test_brace(clanker);
+   } else if (which == "glob") {
+      test_glob(clanker);
+   } else if (which == "subst") {
+      test_subst(clanker);
+   } else if (which == "expr") {
+      test_expr(clanker);
+   } else if (which == "vars") {
+      test_vars(clanker);
+   } else if (which == "control") {
+      test_control(clanker);
+   } else if (which == "functions") {
+      test_functions(clanker);
+   } else if (which == "arith") {
+      test_arith(clanker);
+   } else if (which == "case") {
+      test_case(clanker);
+   } else if (which == "read") {
+      test_read(clanker);
+   } else if (which == "pipeline_builtins") {
+      test_pipeline_builtins(clanker);
+   } else if (which == "builtin_output") {
+      test_builtin_output(clanker);
+   } else if (which == "help") {
+      test_help(clanker);
+   } else if (which == "util_builtins") {
+      test_util_builtins(clanker);
    } else {
       usage();
    }